@@ -0,0 +1,222 @@
+// Per-task overhead of the task wrappers before and after they dropped RTTI and std::function.
+// Both paths run the same work: build a task, chain it to the previous one, add it and wait for
+// the batch. The old wrappers are copied below and run on a bare enki scheduler, the new path is
+// the engine's own MyTaskScheduler with everything a task carries today.
+#include "utility/task_scheduler.h"
+#include <TaskScheduler.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace
+{
+	constexpr uint32_t BATCH_SIZE = 256;
+	constexpr uint32_t BATCH_COUNT = 2000;
+	constexpr uint32_t ROUND_COUNT = 5;
+
+	std::atomic<uint64_t> s_sink{ 0 };
+
+	// about what engine tasks capture: a this pointer, a couple of handles and an index
+	struct Payload
+	{
+		std::array<uint64_t, 4> values{};
+	};
+
+	void _Check(bool inCondition)
+	{
+		if (!inCondition)
+		{
+			std::abort();
+		}
+	}
+}
+
+// The wrappers as they were: impls found through IImplement and dynamic_cast,
+// callables in std::function and dependencies in a std::vector
+namespace old_path
+{
+	class IWaitable
+	{
+	public:
+		virtual ~IWaitable() = default;
+		virtual void DependOn(IWaitable* pPrecondition) = 0;
+	};
+
+	class IMultiThreadTask : public IWaitable
+	{
+	public:
+		virtual void ExecuteSubTask(uint32_t SubStart, uint32_t SubEnd, uint32_t inThreadIndex) = 0;
+	};
+
+	class IImplement
+	{
+	public:
+		virtual ~IImplement() = default;
+		virtual void* GetRealImplement() = 0;
+	};
+
+	template<typename T>
+	T* _UnpackImpl(T* inPtr)
+	{
+		T* piUnpacked{ inPtr };
+		IImplement* piImpl{ dynamic_cast<IImplement*>(piUnpacked) };
+
+		while (piImpl != nullptr)
+		{
+			piUnpacked = static_cast<T*>(piImpl->GetRealImplement());
+			piImpl = dynamic_cast<IImplement*>(piUnpacked);
+		}
+
+		return piUnpacked;
+	}
+
+	class MyMultiThreadTaskImpl final : public IMultiThreadTask, public enki::ITaskSet
+	{
+	private:
+		std::function<void(uint32_t, uint32_t, uint32_t)> m_function;
+		std::vector<enki::Dependency> m_dependencies;
+
+	public:
+		MyMultiThreadTaskImpl(std::function<void(uint32_t, uint32_t, uint32_t)> inFunction, uint32_t inSubTaskCount)
+			: enki::ITaskSet(inSubTaskCount), m_function(inFunction) {};
+
+		virtual void DependOn(IWaitable* pPrecondition) override
+		{
+			enki::ICompletable* pCompletable = dynamic_cast<enki::ICompletable*>(pPrecondition);
+			_Check(pCompletable != nullptr);
+			m_dependencies.push_back({});
+			SetDependency(m_dependencies.back(), pCompletable);
+		}
+
+		virtual void ExecuteSubTask(uint32_t SubStart, uint32_t SubEnd, uint32_t inThreadIndex) override
+		{
+			m_function(SubStart, SubEnd, inThreadIndex);
+		}
+
+		virtual void ExecuteRange(enki::TaskSetPartition inRange, uint32_t inThreadnum) override
+		{
+			ExecuteSubTask(inRange.start, inRange.end, inThreadnum);
+		}
+	};
+
+	class MyMultiThreadTask final : public IMultiThreadTask, public IImplement
+	{
+	private:
+		std::unique_ptr<IMultiThreadTask> m_uptrImpl;
+
+	public:
+		MyMultiThreadTask(std::function<void(uint32_t, uint32_t, uint32_t)> inFunction, uint32_t inSubTaskCount = 1)
+			: m_uptrImpl(std::make_unique<MyMultiThreadTaskImpl>(inFunction, inSubTaskCount)) {};
+		virtual void DependOn(IWaitable* pPrecondition) override { m_uptrImpl->DependOn(_UnpackImpl(pPrecondition)); };
+		virtual void ExecuteSubTask(uint32_t SubStart, uint32_t SubEnd, uint32_t inThreadIndex) override { m_uptrImpl->ExecuteSubTask(SubStart, SubEnd, inThreadIndex); };
+		virtual void* GetRealImplement() override { return m_uptrImpl.get(); };
+	};
+
+	void AddMutiThreadTask(enki::TaskScheduler& inScheduler, IMultiThreadTask* pMultiThreadTask)
+	{
+		enki::ITaskSet* piTaskSet = dynamic_cast<enki::ITaskSet*>(_UnpackImpl(pMultiThreadTask));
+		_Check(piTaskSet != nullptr);
+		inScheduler.AddTaskSetToPipe(piTaskSet);
+	}
+
+	void WaitForTask(enki::TaskScheduler& inScheduler, IWaitable* pToWait)
+	{
+		const enki::ICompletable* piComplete = dynamic_cast<const enki::ICompletable*>(_UnpackImpl(pToWait));
+		_Check(piComplete != nullptr);
+		inScheduler.WaitforTask(piComplete);
+	}
+}
+
+namespace
+{
+	// Nanoseconds per task for BATCH_COUNT batches of BATCH_SIZE chained tasks,
+	// the old path runs on the enki scheduler passed, the new one on MyTaskScheduler
+	template<typename Task>
+	auto _RunRound(enki::TaskScheduler* pOldScheduler)->double
+	{
+		std::vector<std::unique_ptr<Task>> tasks;
+		tasks.reserve(BATCH_SIZE);
+
+		const auto start = std::chrono::steady_clock::now();
+		for (uint32_t batch = 0; batch < BATCH_COUNT; ++batch)
+		{
+			tasks.clear();
+			for (uint32_t i = 0; i < BATCH_SIZE; ++i)
+			{
+				Payload payload{};
+				payload.values[0] = static_cast<uint64_t>(batch) * BATCH_SIZE + i;
+				auto& uptrTask = tasks.emplace_back(std::make_unique<Task>(
+					[payload](uint32_t, uint32_t, uint32_t)
+					{
+						s_sink.fetch_add(payload.values[0], std::memory_order_relaxed);
+					}));
+				if (i > 0)
+				{
+					uptrTask->DependOn(tasks[i - 1].get());
+				}
+			}
+
+			// dependents are kicked off by their precondition, only the head goes in the pipe
+			if constexpr (std::is_same_v<Task, old_path::MyMultiThreadTask>)
+			{
+				old_path::AddMutiThreadTask(*pOldScheduler, tasks.front().get());
+				old_path::WaitForTask(*pOldScheduler, tasks.back().get());
+			}
+			else
+			{
+				MyTaskScheduler::GetInstance().AddMutiThreadTask(tasks.front().get());
+				MyTaskScheduler::GetInstance().WaitForTask(tasks.back().get());
+			}
+		}
+		const auto end = std::chrono::steady_clock::now();
+
+		const double totalNs = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+		return totalNs / (static_cast<double>(BATCH_COUNT) * BATCH_SIZE);
+	}
+
+	template<typename Task>
+	auto _RunBest(enki::TaskScheduler* pOldScheduler)->double
+	{
+		double best = _RunRound<Task>(pOldScheduler); // also warms up the worker threads
+		for (uint32_t round = 0; round < ROUND_COUNT; ++round)
+		{
+			best = std::min(best, _RunRound<Task>(pOldScheduler));
+		}
+		return best;
+	}
+}
+
+int main()
+{
+	// one scheduler at a time, both get a worker per core besides the main thread
+	double oldNs = 0.0;
+	{
+		enki::TaskScheduler scheduler;
+		scheduler.Initialize();
+		oldNs = _RunBest<old_path::MyMultiThreadTask>(&scheduler);
+		scheduler.WaitforAllAndShutdown();
+	}
+
+	// no thread is reserved for graphics or compute, the old path has none either
+	TaskSchedulerConfig config{};
+	config.pinGraphicsThread = false;
+	config.pinComputeThread = false;
+	MyTaskScheduler::GetInstance().Create(config);
+	const double newNs = _RunBest<MyMultiThreadTask>(nullptr);
+	MyTaskScheduler::GetInstance().Destroy();
+
+	std::printf("tasks per round: %u (%u chains of %u)\n", BATCH_COUNT * BATCH_SIZE, BATCH_COUNT, BATCH_SIZE);
+	std::printf("old (dynamic_cast, std::function, vector deps): %8.1f ns/task\n", oldNs);
+	std::printf("new (MyTaskScheduler as built):                 %8.1f ns/task\n", newNs);
+	std::printf("speedup: %.2fx\n", oldNs / newNs);
+
+	return s_sink.load() == 0 ? 1 : 0;
+}
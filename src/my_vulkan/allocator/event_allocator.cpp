@@ -0,0 +1,141 @@
+#include "event_allocator.h"
+#include "device.h"
+
+EventAllocator::~EventAllocator()
+{
+	Destroy();
+}
+
+auto EventAllocator::_HasVkEvent(VkEvent inEvent) const->bool
+{
+	return m_mapEventToIndex.find(inEvent) != m_mapEventToIndex.end();
+}
+
+auto EventAllocator::_CreateVkEventWithResult()->std::pair<VkEvent, VkResult>
+{
+	VkEventCreateInfo eventInfo{ VK_STRUCTURE_TYPE_EVENT_CREATE_INFO };
+	VkEvent event = VK_NULL_HANDLE;
+
+	eventInfo.flags = VK_EVENT_CREATE_DEVICE_ONLY_BIT_KHR;
+	const VkResult result = vkCreateEvent(MyDevice::GetInstance().vkDevice, &eventInfo, nullptr, &event);
+	if (result != VK_SUCCESS)
+	{
+		return { VK_NULL_HANDLE, result };
+	}
+
+	const uint32_t index = static_cast<uint32_t>(m_vecEventEntries.size());
+	EventEntry entry{};
+	entry.vkEvent = event;
+	entry.allocated = true;
+	m_vecEventEntries.push_back(entry);
+	m_mapEventToIndex.insert({ event, index });
+
+	return { event, VK_SUCCESS };
+}
+
+auto EventAllocator::_PopFreeEvent()->VkEvent
+{
+	if (m_currentId == static_cast<uint32_t>(~0))
+	{
+		return VK_NULL_HANDLE;
+	}
+
+	const uint32_t index = m_currentId;
+	EventEntry& entry = m_vecEventEntries[index];
+
+	CHECK_TRUE(entry.vkEvent != VK_NULL_HANDLE, "Free event entry is invalid!");
+	CHECK_TRUE(!entry.allocated, "Free event entry is still allocated!");
+
+	m_currentId = entry.nextId;
+	entry.nextId = static_cast<uint32_t>(~0);
+	entry.allocated = true;
+
+	return entry.vkEvent;
+}
+
+auto EventAllocator::_PushFreeEvent(uint32_t inIndex)->void
+{
+	EventEntry& entry = m_vecEventEntries[inIndex];
+
+	CHECK_TRUE(entry.vkEvent != VK_NULL_HANDLE, "Invalid event entry!");
+	CHECK_TRUE(entry.allocated, "Event is already free!");
+
+	entry.allocated = false;
+	entry.nextId = m_currentId;
+	m_currentId = inIndex;
+}
+
+auto EventAllocator::Create()->void
+{
+}
+
+auto EventAllocator::CreateOrGetVkEventWithResult()->std::pair<VkEvent, VkResult>
+{
+	// freed events are unsignaled already, no reset needed
+	VkEvent event = _PopFreeEvent();
+	if (event != VK_NULL_HANDLE)
+	{
+		return { event, VK_SUCCESS };
+	}
+
+	return _CreateVkEventWithResult();
+}
+
+auto EventAllocator::CreateOrGetVkEvent()->VkEvent
+{
+	auto [event, result] = CreateOrGetVkEventWithResult();
+	VK_CHECK(result, "Failed to create or get event!");
+
+	return event;
+}
+
+auto EventAllocator::FreeVkEvent(const VkEvent* inEvents, size_t inCount)->void
+{
+	if (inCount == 0)
+	{
+		return;
+	}
+
+	CHECK_TRUE(inEvents != nullptr, "No events to free!");
+
+	std::vector<uint32_t> indices;
+	std::set<VkEvent> uniqueEvents;
+	indices.reserve(inCount);
+
+	for (size_t i = 0; i < inCount; ++i)
+	{
+		const VkEvent event = inEvents[i];
+
+		CHECK_TRUE(event != VK_NULL_HANDLE, "Cannot free null event!");
+		CHECK_TRUE(uniqueEvents.insert(event).second, "Cannot free the same event twice!");
+		CHECK_TRUE(_HasVkEvent(event), "Event allocator doesn't have this event!");
+
+		const uint32_t index = m_mapEventToIndex.at(event);
+		EventEntry& entry = m_vecEventEntries[index];
+
+		CHECK_TRUE(entry.vkEvent == event, "Wrong event!");
+		CHECK_TRUE(entry.allocated, "Event is already free!");
+
+		indices.push_back(index);
+	}
+
+	for (uint32_t index : indices)
+	{
+		_PushFreeEvent(index);
+	}
+}
+
+auto EventAllocator::Destroy()->void
+{
+	for (EventEntry& entry : m_vecEventEntries)
+	{
+		if (entry.vkEvent != VK_NULL_HANDLE)
+		{
+			vkDestroyEvent(MyDevice::GetInstance().vkDevice, entry.vkEvent, nullptr);
+		}
+	}
+
+	m_mapEventToIndex.clear();
+	m_vecEventEntries.clear();
+	m_currentId = static_cast<uint32_t>(~0);
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include "common.h"
+
+// Pool of device only VkEvents for split barriers. The host can't reset such events,
+// so an event must be unsignaled when it's freed, e.g. by vkCmdResetEvent2 after the wait
+class EventAllocator final
+{
+private:
+	struct EventEntry
+	{
+		VkEvent vkEvent = VK_NULL_HANDLE;
+		bool allocated = false;
+		uint32_t nextId = static_cast<uint32_t>(~0);
+	};
+
+private:
+	std::unordered_map<VkEvent, uint32_t> m_mapEventToIndex;
+	std::vector<EventEntry> m_vecEventEntries;
+	uint32_t m_currentId = static_cast<uint32_t>(~0);
+
+private:
+	auto _HasVkEvent(VkEvent inEvent) const->bool;
+	auto _CreateVkEventWithResult()->std::pair<VkEvent, VkResult>;
+	auto _PopFreeEvent()->VkEvent;
+	auto _PushFreeEvent(uint32_t inIndex)->void;
+
+public:
+	EventAllocator() = default;
+	EventAllocator(const EventAllocator&) = delete;
+	EventAllocator& operator=(const EventAllocator&) = delete;
+	~EventAllocator();
+
+	auto Create()->void;
+
+	auto CreateOrGetVkEventWithResult()->std::pair<VkEvent, VkResult>;
+
+	auto CreateOrGetVkEvent()->VkEvent;
+
+	// The events must be unsignaled and no longer used by pending command buffers
+	auto FreeVkEvent(const VkEvent* inEvents, size_t inCount)->void;
+
+	auto Destroy()->void;
+};
@@ -135,3 +135,37 @@ void MemoryAllocator::FreeMemory(VkBuffer _vkBuffer)
 	vmaFreeMemory(*_GetPtrVmaAllocator(), m_mapVkBufferToAllocation.at(_vkBuffer));
 	m_mapVkBufferToAllocation.erase(_vkBuffer);
 }
+
+VmaAllocation MemoryAllocator::AllocateAliasingMemory(const VkMemoryRequirements& _requirements, VkMemoryPropertyFlags _flags)
+{
+	VmaAllocationCreateInfo allocCreateInfo{};
+	VmaAllocation allocResult = nullptr;
+	VmaAllocationInfo allocInfo{};
+
+	allocCreateInfo.usage = _ToVmaMemoryUsage(_flags);
+	allocCreateInfo.flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
+
+	VK_CHECK(vmaAllocateMemory(*_GetPtrVmaAllocator(), &_requirements, &allocCreateInfo, &allocResult, &allocInfo), "Failed to allocate aliasing memory!");
+
+	m_setAliasingAllocations.insert(allocResult);
+	return allocResult;
+}
+
+void MemoryAllocator::BindVkImageToAliasingMemory(VkImage _vkImage, VmaAllocation _aliasingMemory, VkDeviceSize _offset)
+{
+	CHECK_TRUE(m_setAliasingAllocations.find(_aliasingMemory) != m_setAliasingAllocations.end(), "The aliasing memory isn't allocate by this allocator!");
+	VK_CHECK(vmaBindImageMemory2(*_GetPtrVmaAllocator(), _aliasingMemory, _offset, _vkImage, nullptr), "Failed to bind image to aliasing memory!");
+}
+
+void MemoryAllocator::BindVkBufferToAliasingMemory(VkBuffer _vkBuffer, VmaAllocation _aliasingMemory, VkDeviceSize _offset)
+{
+	CHECK_TRUE(m_setAliasingAllocations.find(_aliasingMemory) != m_setAliasingAllocations.end(), "The aliasing memory isn't allocate by this allocator!");
+	VK_CHECK(vmaBindBufferMemory2(*_GetPtrVmaAllocator(), _aliasingMemory, _offset, _vkBuffer, nullptr), "Failed to bind buffer to aliasing memory!");
+}
+
+void MemoryAllocator::FreeAliasingMemory(VmaAllocation _aliasingMemory)
+{
+	CHECK_TRUE(m_setAliasingAllocations.find(_aliasingMemory) != m_setAliasingAllocations.end(), "The aliasing memory isn't allocate by this allocator!");
+	vmaFreeMemory(*_GetPtrVmaAllocator(), _aliasingMemory);
+	m_setAliasingAllocations.erase(_aliasingMemory);
+}
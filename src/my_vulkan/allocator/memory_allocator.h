@@ -1,5 +1,6 @@
 #pragma once
 #include "common.h"
+#include <unordered_set>
 #pragma push_macro("max")
 #include "vk_mem_alloc.h"
 #pragma pop_macro("max")
@@ -12,6 +13,7 @@ private:
 	std::unique_ptr<VmaAllocator> m_uptrVmaAllocator;
 	std::unordered_map<VkImage, VmaAllocation> m_mapVkImageToAllocation;
 	std::unordered_map<VkBuffer, VmaAllocation> m_mapVkBufferToAllocation;
+	std::unordered_set<VmaAllocation> m_setAliasingAllocations;
 
 private:
 	static VmaMemoryUsage _ToVmaMemoryUsage(VkMemoryPropertyFlags _propertyFlags);
@@ -44,5 +46,18 @@ public:
 
 	void FreeMemory(VkBuffer _vkBuffer);
 
+	// Allocate a dedicated VkDeviceMemory that images and buffers created without memory can share,
+	// resources bound to overlapping ranges of it must never be in use at the same time
+	VmaAllocation AllocateAliasingMemory(const VkMemoryRequirements& _requirements, VkMemoryPropertyFlags _flags);
+
+	// Bind _vkImage to aliasing memory at _offset, offset must satisfy the image alignment
+	void BindVkImageToAliasingMemory(VkImage _vkImage, VmaAllocation _aliasingMemory, VkDeviceSize _offset);
+
+	// Bind _vkBuffer to aliasing memory at _offset, offset must satisfy the buffer alignment
+	void BindVkBufferToAliasingMemory(VkBuffer _vkBuffer, VmaAllocation _aliasingMemory, VkDeviceSize _offset);
+
+	// Free aliasing memory, all resources bound to it should be destroyed before
+	void FreeAliasingMemory(VmaAllocation _aliasingMemory);
+
 	friend class MyDevice;
 };
\ No newline at end of file
@@ -0,0 +1,321 @@
+#include "barrier_batcher.h"
+#include "frame_arena.h"
+#include <limits>
+#include <type_traits>
+
+namespace
+{
+	// [first, first + count), VK_REMAINING_* and VK_WHOLE_SIZE reach the end
+	template<typename T>
+	auto _IsRangeOverlapped(T inFirstA, T inCountA, T inFirstB, T inCountB, std::type_identity_t<T> inRemaining)->bool
+	{
+		const T endA = inCountA == inRemaining ? std::numeric_limits<T>::max() : inFirstA + inCountA;
+		const T endB = inCountB == inRemaining ? std::numeric_limits<T>::max() : inFirstB + inCountB;
+
+		return inFirstA < endB && inFirstB < endA;
+	}
+
+	auto _IsSubresourceRangeOverlapped(const VkImageSubresourceRange& inLeft, const VkImageSubresourceRange& inRight)->bool
+	{
+		return (inLeft.aspectMask & inRight.aspectMask) != 0 &&
+			_IsRangeOverlapped(inLeft.baseMipLevel, inLeft.levelCount, inRight.baseMipLevel, inRight.levelCount, VK_REMAINING_MIP_LEVELS) &&
+			_IsRangeOverlapped(inLeft.baseArrayLayer, inLeft.layerCount, inRight.baseArrayLayer, inRight.layerCount, VK_REMAINING_ARRAY_LAYERS);
+	}
+
+	auto _IsSameSubresourceRange(const VkImageSubresourceRange& inLeft, const VkImageSubresourceRange& inRight)->bool
+	{
+		return inLeft.aspectMask == inRight.aspectMask &&
+			inLeft.baseMipLevel == inRight.baseMipLevel && inLeft.levelCount == inRight.levelCount &&
+			inLeft.baseArrayLayer == inRight.baseArrayLayer && inLeft.layerCount == inRight.layerCount;
+	}
+
+	// ALL_COMMANDS and ALL_GRAPHICS stand for other stages, comparing bits alone would miss them
+	auto _IsStageOverlapped(VkPipelineStageFlags inLeft, VkPipelineStageFlags inRight)->bool
+	{
+		constexpr VkPipelineStageFlags GRAPHICS_STAGES =
+			VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+			VK_PIPELINE_STAGE_TESSELLATION_CONTROL_SHADER_BIT | VK_PIPELINE_STAGE_TESSELLATION_EVALUATION_SHADER_BIT |
+			VK_PIPELINE_STAGE_GEOMETRY_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+			VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		auto expand = [](VkPipelineStageFlags inStages)
+			{
+				return (inStages & VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT) != 0 ? inStages | GRAPHICS_STAGES : inStages;
+			};
+
+		if (inLeft == 0 || inRight == 0)
+		{
+			return false;
+		}
+		if (((inLeft | inRight) & VK_PIPELINE_STAGE_ALL_COMMANDS_BIT) != 0)
+		{
+			return true;
+		}
+		return (expand(inLeft) & expand(inRight)) != 0;
+	}
+
+	// Return whether an identical barrier is pending, in which case it takes the stages of the new one
+	template<typename T, typename TStages>
+	auto _MergeIdenticalBarrier(const T& inBarrier, const TStages& inStages, const std::pmr::vector<T>& inBarriers, std::pmr::vector<TStages>& inoutStages)->bool
+	{
+		for (size_t i = 0; i < inBarriers.size(); ++i)
+		{
+			if (BarrierBatcher::IsSameBarrier(inBarriers[i], inBarrier))
+			{
+				inoutStages[i].src |= inStages.src;
+				inoutStages[i].dst |= inStages.dst;
+				return true;
+			}
+		}
+		return false;
+	}
+}
+
+BarrierBatcher::BarrierBatcher(VkCommandBuffer inVkCommandBuffer, bool inUseSynchronization2, std::pmr::memory_resource* inMemoryResource)
+	: m_vkCommandBuffer(inVkCommandBuffer),
+	m_useSynchronization2(inUseSynchronization2),
+	m_memoryBarriers(inMemoryResource),
+	m_bufferBarriers(inMemoryResource),
+	m_imageBarriers(inMemoryResource),
+	m_memoryBarrierStages(inMemoryResource),
+	m_bufferBarrierStages(inMemoryResource),
+	m_imageBarrierStages(inMemoryResource)
+{
+	CHECK_TRUE(inVkCommandBuffer != VK_NULL_HANDLE, "Invalid command buffer!");
+	CHECK_TRUE(!inUseSynchronization2 || IsSynchronization2Supported(), "Synchronization2 is not enabled!");
+}
+
+auto BarrierBatcher::_HasBarriers() const->bool
+{
+	return !m_memoryBarriers.empty() || !m_bufferBarriers.empty() || !m_imageBarriers.empty();
+}
+
+auto BarrierBatcher::_Conflicts(const VkBufferMemoryBarrier& inBarrier) const->bool
+{
+	for (const auto& pending : m_bufferBarriers)
+	{
+		if (pending.buffer == inBarrier.buffer &&
+			!IsSameBarrier(pending, inBarrier) &&
+			_IsRangeOverlapped(pending.offset, pending.size, inBarrier.offset, inBarrier.size, VK_WHOLE_SIZE))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+auto BarrierBatcher::_Conflicts(const VkImageMemoryBarrier& inBarrier) const->bool
+{
+	for (const auto& pending : m_imageBarriers)
+	{
+		if (pending.image == inBarrier.image &&
+			!IsSameBarrier(pending, inBarrier) &&
+			_IsSubresourceRangeOverlapped(pending.subresourceRange, inBarrier.subresourceRange))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+auto BarrierBatcher::PipelineBarrier(
+	VkPipelineStageFlags inSrcStageMask,
+	VkPipelineStageFlags inDstStageMask,
+	VkDependencyFlags inFlags,
+	const VkMemoryBarrier* inMemoryBarriers, uint32_t inMemoryBarrierCount,
+	const VkBufferMemoryBarrier* inBufferBarriers, uint32_t inBufferBarrierCount,
+	const VkImageMemoryBarrier* inImageBarriers, uint32_t inImageBarrierCount)->void
+{
+	bool needFlush = _HasBarriers() && m_dependencyFlags != inFlags;
+
+	// a memory barrier covers every resource, so it must wait for the batch when it starts
+	// from stages the batch hands over to, whichever side the memory barrier is on
+	if (!needFlush && (!m_memoryBarriers.empty() || inMemoryBarrierCount != 0))
+	{
+		needFlush = _IsStageOverlapped(inSrcStageMask, m_dstStageMask);
+	}
+	for (uint32_t i = 0; !needFlush && i < inBufferBarrierCount; ++i)
+	{
+		needFlush = _Conflicts(inBufferBarriers[i]);
+	}
+	for (uint32_t i = 0; !needFlush && i < inImageBarrierCount; ++i)
+	{
+		needFlush = _Conflicts(inImageBarriers[i]);
+	}
+	if (needFlush)
+	{
+		Flush();
+	}
+
+	const StageMasks stages{ inSrcStageMask, inDstStageMask };
+	m_srcStageMask |= inSrcStageMask;
+	m_dstStageMask |= inDstStageMask;
+	m_dependencyFlags = inFlags;
+	for (uint32_t i = 0; i < inMemoryBarrierCount; ++i)
+	{
+		if (!_MergeIdenticalBarrier(inMemoryBarriers[i], stages, m_memoryBarriers, m_memoryBarrierStages))
+		{
+			m_memoryBarriers.push_back(inMemoryBarriers[i]);
+			m_memoryBarrierStages.push_back(stages);
+		}
+	}
+	for (uint32_t i = 0; i < inBufferBarrierCount; ++i)
+	{
+		if (!_MergeIdenticalBarrier(inBufferBarriers[i], stages, m_bufferBarriers, m_bufferBarrierStages))
+		{
+			m_bufferBarriers.push_back(inBufferBarriers[i]);
+			m_bufferBarrierStages.push_back(stages);
+		}
+	}
+	for (uint32_t i = 0; i < inImageBarrierCount; ++i)
+	{
+		if (!_MergeIdenticalBarrier(inImageBarriers[i], stages, m_imageBarriers, m_imageBarrierStages))
+		{
+			m_imageBarriers.push_back(inImageBarriers[i]);
+			m_imageBarrierStages.push_back(stages);
+		}
+	}
+}
+
+auto BarrierBatcher::Flush()->void
+{
+	if (!_HasBarriers())
+	{
+		return;
+	}
+
+	if (m_useSynchronization2)
+	{
+		_RecordPipelineBarrier2();
+	}
+	else
+	{
+		_RecordPipelineBarrier();
+	}
+
+	m_srcStageMask = 0;
+	m_dstStageMask = 0;
+	m_dependencyFlags = 0;
+	m_memoryBarriers.clear();
+	m_bufferBarriers.clear();
+	m_imageBarriers.clear();
+	m_memoryBarrierStages.clear();
+	m_bufferBarrierStages.clear();
+	m_imageBarrierStages.clear();
+}
+
+auto BarrierBatcher::_RecordPipelineBarrier() const->void
+{
+	vkCmdPipelineBarrier(
+		m_vkCommandBuffer,
+		m_srcStageMask,
+		m_dstStageMask,
+		m_dependencyFlags,
+		static_cast<uint32_t>(m_memoryBarriers.size()), m_memoryBarriers.data(),
+		static_cast<uint32_t>(m_bufferBarriers.size()), m_bufferBarriers.data(),
+		static_cast<uint32_t>(m_imageBarriers.size()), m_imageBarriers.data());
+}
+
+auto BarrierBatcher::_RecordPipelineBarrier2() const->void
+{
+	std::pmr::memory_resource* pMemoryResource = m_memoryBarriers.get_allocator().resource();
+	FrameVector<VkMemoryBarrier2KHR> memoryBarriers(pMemoryResource);
+	FrameVector<VkBufferMemoryBarrier2KHR> bufferBarriers(pMemoryResource);
+	FrameVector<VkImageMemoryBarrier2KHR> imageBarriers(pMemoryResource);
+	VkDependencyInfoKHR dependencyInfo{ VK_STRUCTURE_TYPE_DEPENDENCY_INFO_KHR };
+
+	memoryBarriers.reserve(m_memoryBarriers.size());
+	for (size_t i = 0; i < m_memoryBarriers.size(); ++i)
+	{
+		const VkMemoryBarrier& barrier = m_memoryBarriers[i];
+		VkMemoryBarrier2KHR& barrier2 = memoryBarriers.emplace_back(VkMemoryBarrier2KHR{ VK_STRUCTURE_TYPE_MEMORY_BARRIER_2_KHR });
+
+		barrier2.pNext = barrier.pNext;
+		barrier2.srcStageMask = m_memoryBarrierStages[i].src;
+		barrier2.srcAccessMask = barrier.srcAccessMask;
+		barrier2.dstStageMask = m_memoryBarrierStages[i].dst;
+		barrier2.dstAccessMask = barrier.dstAccessMask;
+	}
+
+	bufferBarriers.reserve(m_bufferBarriers.size());
+	for (size_t i = 0; i < m_bufferBarriers.size(); ++i)
+	{
+		const VkBufferMemoryBarrier& barrier = m_bufferBarriers[i];
+		VkBufferMemoryBarrier2KHR& barrier2 = bufferBarriers.emplace_back(VkBufferMemoryBarrier2KHR{ VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2_KHR });
+
+		barrier2.pNext = barrier.pNext;
+		barrier2.srcStageMask = m_bufferBarrierStages[i].src;
+		barrier2.srcAccessMask = barrier.srcAccessMask;
+		barrier2.dstStageMask = m_bufferBarrierStages[i].dst;
+		barrier2.dstAccessMask = barrier.dstAccessMask;
+		barrier2.srcQueueFamilyIndex = barrier.srcQueueFamilyIndex;
+		barrier2.dstQueueFamilyIndex = barrier.dstQueueFamilyIndex;
+		barrier2.buffer = barrier.buffer;
+		barrier2.offset = barrier.offset;
+		barrier2.size = barrier.size;
+	}
+
+	imageBarriers.reserve(m_imageBarriers.size());
+	for (size_t i = 0; i < m_imageBarriers.size(); ++i)
+	{
+		const VkImageMemoryBarrier& barrier = m_imageBarriers[i];
+		VkImageMemoryBarrier2KHR& barrier2 = imageBarriers.emplace_back(VkImageMemoryBarrier2KHR{ VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2_KHR });
+
+		barrier2.pNext = barrier.pNext;
+		barrier2.srcStageMask = m_imageBarrierStages[i].src;
+		barrier2.srcAccessMask = barrier.srcAccessMask;
+		barrier2.dstStageMask = m_imageBarrierStages[i].dst;
+		barrier2.dstAccessMask = barrier.dstAccessMask;
+		barrier2.oldLayout = barrier.oldLayout;
+		barrier2.newLayout = barrier.newLayout;
+		barrier2.srcQueueFamilyIndex = barrier.srcQueueFamilyIndex;
+		barrier2.dstQueueFamilyIndex = barrier.dstQueueFamilyIndex;
+		barrier2.image = barrier.image;
+		barrier2.subresourceRange = barrier.subresourceRange;
+	}
+
+	dependencyInfo.dependencyFlags = m_dependencyFlags;
+	dependencyInfo.memoryBarrierCount = static_cast<uint32_t>(memoryBarriers.size());
+	dependencyInfo.pMemoryBarriers = memoryBarriers.data();
+	dependencyInfo.bufferMemoryBarrierCount = static_cast<uint32_t>(bufferBarriers.size());
+	dependencyInfo.pBufferMemoryBarriers = bufferBarriers.data();
+	dependencyInfo.imageMemoryBarrierCount = static_cast<uint32_t>(imageBarriers.size());
+	dependencyInfo.pImageMemoryBarriers = imageBarriers.data();
+	vkCmdPipelineBarrier2KHR(m_vkCommandBuffer, &dependencyInfo);
+}
+
+auto BarrierBatcher::IsSynchronization2Supported()->bool
+{
+	return vkCmdPipelineBarrier2KHR != nullptr;
+}
+
+auto BarrierBatcher::IsSameBarrier(const VkMemoryBarrier& inLeft, const VkMemoryBarrier& inRight)->bool
+{
+	return inLeft.pNext == inRight.pNext &&
+		inLeft.srcAccessMask == inRight.srcAccessMask &&
+		inLeft.dstAccessMask == inRight.dstAccessMask;
+}
+
+auto BarrierBatcher::IsSameBarrier(const VkBufferMemoryBarrier& inLeft, const VkBufferMemoryBarrier& inRight)->bool
+{
+	return inLeft.pNext == inRight.pNext &&
+		inLeft.srcAccessMask == inRight.srcAccessMask &&
+		inLeft.dstAccessMask == inRight.dstAccessMask &&
+		inLeft.srcQueueFamilyIndex == inRight.srcQueueFamilyIndex &&
+		inLeft.dstQueueFamilyIndex == inRight.dstQueueFamilyIndex &&
+		inLeft.buffer == inRight.buffer &&
+		inLeft.offset == inRight.offset &&
+		inLeft.size == inRight.size;
+}
+
+auto BarrierBatcher::IsSameBarrier(const VkImageMemoryBarrier& inLeft, const VkImageMemoryBarrier& inRight)->bool
+{
+	return inLeft.pNext == inRight.pNext &&
+		inLeft.srcAccessMask == inRight.srcAccessMask &&
+		inLeft.dstAccessMask == inRight.dstAccessMask &&
+		inLeft.oldLayout == inRight.oldLayout &&
+		inLeft.newLayout == inRight.newLayout &&
+		inLeft.srcQueueFamilyIndex == inRight.srcQueueFamilyIndex &&
+		inLeft.dstQueueFamilyIndex == inRight.dstQueueFamilyIndex &&
+		inLeft.image == inRight.image &&
+		_IsSameSubresourceRange(inLeft.subresourceRange, inRight.subresourceRange);
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include "common.h"
+#include <memory_resource>
+
+// Gathers pipeline barriers recorded back to back into one call. With synchronization1 the stage masks
+// of the call are the union of the merged barriers, with synchronization2 every barrier keeps its own.
+// Identical transitions are recorded once, a barrier touching a subresource already in the batch
+// with another transition starts a new batch, so transitions of a subresource stay in order.
+// Memory barriers touch everything, they start a new batch when chained after the pending stages
+class BarrierBatcher final
+{
+private:
+	struct StageMasks
+	{
+		VkPipelineStageFlags src = 0;
+		VkPipelineStageFlags dst = 0;
+	};
+
+	VkCommandBuffer m_vkCommandBuffer = VK_NULL_HANDLE;
+	bool m_useSynchronization2 = false;
+	VkPipelineStageFlags m_srcStageMask = 0;
+	VkPipelineStageFlags m_dstStageMask = 0;
+	VkDependencyFlags m_dependencyFlags = 0;
+	std::pmr::vector<VkMemoryBarrier> m_memoryBarriers;
+	std::pmr::vector<VkBufferMemoryBarrier> m_bufferBarriers;
+	std::pmr::vector<VkImageMemoryBarrier> m_imageBarriers;
+	std::pmr::vector<StageMasks> m_memoryBarrierStages;
+	std::pmr::vector<StageMasks> m_bufferBarrierStages;
+	std::pmr::vector<StageMasks> m_imageBarrierStages;
+
+private:
+	auto _HasBarriers() const->bool;
+
+	// Whether the barrier must wait for the pending ones, otherwise it may be merged
+	auto _Conflicts(const VkBufferMemoryBarrier& inBarrier) const->bool;
+	auto _Conflicts(const VkImageMemoryBarrier& inBarrier) const->bool;
+
+	auto _RecordPipelineBarrier() const->void;
+	auto _RecordPipelineBarrier2() const->void;
+
+public:
+	// Scratch memory comes from inMemoryResource, e.g. the frame arena of the recording thread
+	BarrierBatcher(VkCommandBuffer inVkCommandBuffer, bool inUseSynchronization2, std::pmr::memory_resource* inMemoryResource);
+	BarrierBatcher(const BarrierBatcher&) = delete;
+	BarrierBatcher& operator=(const BarrierBatcher&) = delete;
+
+	// Same as vkCmdPipelineBarrier, the barriers are copied. Nothing is recorded until Flush,
+	// or until a barrier that can't be merged comes in
+	auto PipelineBarrier(
+		VkPipelineStageFlags inSrcStageMask,
+		VkPipelineStageFlags inDstStageMask,
+		VkDependencyFlags inFlags,
+		const VkMemoryBarrier* inMemoryBarriers, uint32_t inMemoryBarrierCount,
+		const VkBufferMemoryBarrier* inBufferBarriers, uint32_t inBufferBarrierCount,
+		const VkImageMemoryBarrier* inImageBarriers, uint32_t inImageBarrierCount)->void;
+
+	// Record the pending barriers, must be called before any other command goes into the command buffer
+	auto Flush()->void;
+
+	// Whether vkCmdPipelineBarrier2KHR is loaded, i.e. the device enabled synchronization2
+	static auto IsSynchronization2Supported()->bool;
+
+	static auto IsSameBarrier(const VkMemoryBarrier& inLeft, const VkMemoryBarrier& inRight)->bool;
+	static auto IsSameBarrier(const VkBufferMemoryBarrier& inLeft, const VkBufferMemoryBarrier& inRight)->bool;
+	static auto IsSameBarrier(const VkImageMemoryBarrier& inLeft, const VkImageMemoryBarrier& inRight)->bool;
+};
@@ -3,7 +3,9 @@
 auto CommandBuffer::AppendCommands(const PrimaryScope* inPrimaryScope)->CommandBuffer&
 {
 	CHECK_TRUE(inPrimaryScope != nullptr, "No primary scope!");
-	m_scopes.emplace_back(*inPrimaryScope);
+	std::pmr::memory_resource* pMemoryResource = m_scopes.get_allocator().resource();
+
+	m_scopes.emplace_back(PrimaryScope{ CommandStream(inPrimaryScope->commands, pMemoryResource) });
 	return *this;
 }
 
@@ -13,7 +15,24 @@ auto CommandBuffer::AppendRenderPass(const RenderPassScope* inRenderPassScope)->
 	CHECK_TRUE(inRenderPassScope->renderPass != VK_NULL_HANDLE, "Invalid render pass!");
 	CHECK_TRUE(inRenderPassScope->framebuffer != VK_NULL_HANDLE, "Invalid framebuffer!");
 
-	m_scopes.emplace_back(*inRenderPassScope);
+	std::pmr::memory_resource* pMemoryResource = m_scopes.get_allocator().resource();
+	// a plain copy would keep the vectors in the source's memory resource
+	RenderPassScope renderPassScope{
+		.renderPass = inRenderPassScope->renderPass,
+		.framebuffer = inRenderPassScope->framebuffer,
+		.renderArea = inRenderPassScope->renderArea,
+		.clearValues = std::pmr::vector<VkClearValue>(inRenderPassScope->clearValues, pMemoryResource),
+		.contents = inRenderPassScope->contents,
+		.next = inRenderPassScope->next,
+		.subpassScopes = std::pmr::vector<SubpassScope>(pMemoryResource),
+	};
+
+	renderPassScope.subpassScopes.reserve(inRenderPassScope->subpassScopes.size());
+	for (const SubpassScope& subpassScope : inRenderPassScope->subpassScopes)
+	{
+		renderPassScope.subpassScopes.push_back(SubpassScope{ CommandStream(subpassScope.commands, pMemoryResource) });
+	}
+	m_scopes.emplace_back(std::move(renderPassScope));
 
 	return *this;
 }
@@ -1,19 +1,20 @@
 #pragma once
-#include "command.h"
+#include "command_stream.h"
 #include "common.h"
 #include <variant>
+#include <memory_resource>
 
 class CommandBuffer final
 {
 public:
 	struct PrimaryScope final
 	{
-		std::vector<const Command*> commands;
+		CommandStream commands;
 	};
 
 	struct SubpassScope final
 	{
-		std::vector<const Command*> commands;
+		CommandStream commands;
 	};
 
 	struct RenderPassScope final
@@ -21,19 +22,23 @@ public:
 		VkRenderPass renderPass = VK_NULL_HANDLE;
 		VkFramebuffer framebuffer = VK_NULL_HANDLE;
 		VkRect2D renderArea{};
-		std::vector<VkClearValue> clearValues;
+		std::pmr::vector<VkClearValue> clearValues;
+		// SECONDARY_COMMAND_BUFFERS records every subpass in secondary command buffers on worker
+		// threads, INLINE still does so for subpasses too large for one command buffer
 		VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE;
 		const void* next = nullptr;
-		std::vector<SubpassScope> subpassScopes;
+		std::pmr::vector<SubpassScope> subpassScopes;
 	};
 
 	using Scope = std::variant<PrimaryScope, RenderPassScope>;
 
 private:
-	std::vector<Scope> m_scopes;
+	std::pmr::vector<Scope> m_scopes; // appended scopes are copied into the same memory resource
 
 public:
 	CommandBuffer() = default;
+	// Pass a frame arena for command buffers that are built and enqueued within one frame
+	explicit CommandBuffer(std::pmr::memory_resource* inMemoryResource) : m_scopes(inMemoryResource) {};
 	CommandBuffer(const CommandBuffer&) = delete;
 	CommandBuffer& operator=(const CommandBuffer&) = delete;
 	CommandBuffer(CommandBuffer&&) noexcept = default;
@@ -0,0 +1,98 @@
+#include "command_cost_model.h"
+
+namespace
+{
+	auto _GetDefaultCost(CommandStream::CommandType inType)->float
+	{
+		switch (inType)
+		{
+		case CommandStream::CommandType::PIPELINE_BARRIER:
+			return 300.0f;
+		case CommandStream::CommandType::CLEAR_COLOR_IMAGE:
+			return 300.0f;
+		case CommandStream::CommandType::FILL_BUFFER:
+			return 150.0f;
+		case CommandStream::CommandType::BLIT_IMAGE:
+			return 400.0f;
+		case CommandStream::CommandType::COPY_BUFFER_TO_IMAGE:
+			return 300.0f;
+		case CommandStream::CommandType::COPY_BUFFER:
+			return 200.0f;
+		case CommandStream::CommandType::BUILD_ACCELERATION_STRUCTURES:
+			return 2000.0f;
+		case CommandStream::CommandType::WRITE_ACCELERATION_STRUCTURES_PROPERTIES:
+			return 200.0f;
+		case CommandStream::CommandType::COPY_ACCELERATION_STRUCTURE:
+			return 300.0f;
+		case CommandStream::CommandType::EXECUTE_COMMANDS:
+			return 200.0f;
+		case CommandStream::CommandType::BIND_PIPELINE:
+			return 100.0f;
+		case CommandStream::CommandType::BIND_DESCRIPTOR_SETS:
+			return 150.0f;
+		case CommandStream::CommandType::BIND_VERTEX_BUFFERS:
+			return 80.0f;
+		case CommandStream::CommandType::BIND_INDEX_BUFFER:
+			return 50.0f;
+		case CommandStream::CommandType::SET_VIEWPORT:
+			return 50.0f;
+		case CommandStream::CommandType::SET_SCISSOR:
+			return 50.0f;
+		case CommandStream::CommandType::PUSH_CONSTANTS:
+			return 80.0f;
+		case CommandStream::CommandType::DRAW:
+			return 100.0f;
+		case CommandStream::CommandType::DRAW_INDEXED:
+			return 100.0f;
+		case CommandStream::CommandType::DISPATCH:
+			return 100.0f;
+		case CommandStream::CommandType::EXTERNAL:
+			return 500.0f;
+		default:
+			CHECK_TRUE(false, "Unsupported command type!");
+			return 0.0f;
+		}
+	}
+}
+
+std::unique_ptr<CommandCostModel> CommandCostModel::s_uptrInstance;
+
+CommandCostModel::CommandCostModel()
+{
+	Reset();
+}
+
+auto CommandCostModel::GetInstance()->CommandCostModel&
+{
+	if (s_uptrInstance == nullptr)
+	{
+		s_uptrInstance.reset(new CommandCostModel());
+	}
+
+	return *s_uptrInstance;
+}
+
+auto CommandCostModel::GetCost(CommandStream::CommandType inType) const->float
+{
+	const size_t typeIndex = static_cast<size_t>(inType);
+
+	CHECK_TRUE(typeIndex < COMMAND_TYPE_COUNT, "Unsupported command type!");
+	return m_costs[typeIndex].load(std::memory_order_relaxed);
+}
+
+auto CommandCostModel::AddSample(CommandStream::CommandType inType, float inNanoseconds)->void
+{
+	const size_t typeIndex = static_cast<size_t>(inType);
+
+	CHECK_TRUE(typeIndex < COMMAND_TYPE_COUNT, "Unsupported command type!");
+	const float cost = m_costs[typeIndex].load(std::memory_order_relaxed);
+	m_costs[typeIndex].store(cost + (inNanoseconds - cost) * CALIBRATION_WEIGHT, std::memory_order_relaxed);
+}
+
+auto CommandCostModel::Reset()->void
+{
+	for (size_t typeIndex = 0; typeIndex < COMMAND_TYPE_COUNT; ++typeIndex)
+	{
+		m_costs[typeIndex].store(_GetDefaultCost(static_cast<CommandStream::CommandType>(typeIndex)), std::memory_order_relaxed);
+	}
+}
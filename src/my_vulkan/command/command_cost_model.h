@@ -0,0 +1,37 @@
+#pragma once
+#include "command_stream.h"
+#include <atomic>
+
+// Estimated CPU time in nanoseconds to record each command type, used to size command buffer
+// batches. Estimates start from fixed defaults and, with calibration enabled, follow the
+// recording times CommandStream measures
+class CommandCostModel final
+{
+private:
+	static constexpr size_t COMMAND_TYPE_COUNT = static_cast<size_t>(CommandStream::CommandType::EXTERNAL) + 1;
+	static constexpr float CALIBRATION_WEIGHT = 0.05f; // weight of a new sample in the moving average
+
+	static std::unique_ptr<CommandCostModel> s_uptrInstance;
+	std::array<std::atomic<float>, COMMAND_TYPE_COUNT> m_costs;
+	std::atomic<bool> m_calibrationEnabled{ false };
+
+private:
+	CommandCostModel();
+
+public:
+	static auto GetInstance()->CommandCostModel&;
+
+	auto GetCost(CommandStream::CommandType inType) const->float;
+
+	// Measuring each recorded command costs a clock read on both sides of it
+	auto SetCalibrationEnabled(bool inEnabled)->void { m_calibrationEnabled.store(inEnabled, std::memory_order_relaxed); };
+
+	auto IsCalibrationEnabled() const->bool { return m_calibrationEnabled.load(std::memory_order_relaxed); };
+
+	// Blend a measured recording time into the estimate, concurrent samples may overwrite
+	// each other which only slows the convergence down
+	auto AddSample(CommandStream::CommandType inType, float inNanoseconds)->void;
+
+	// Back to the default estimates
+	auto Reset()->void;
+};
@@ -1,93 +1,171 @@
 #include "command_queue.h"
 #include "allocator/fence_allocator.h"
 #include "device.h"
+#include "upload_manager.h"
+#include "task_scheduler.h"
+#include "frame_arena.h"
+#include "command_cost_model.h"
+#include "command_state_tracker.h"
+#include <exception>
+#include <algorithm>
+#include <thread>
 
 namespace
 {
-	constexpr size_t COMMAND_COUNT_PER_VK_COMMAND_BUFFER = 256;
+	// Estimated recording costs are in nanoseconds, see CommandCostModel. Below the minimum, the
+	// begin, end and submission of a command buffer outweigh recording it on another thread
+	constexpr float MIN_COMMAND_BUFFER_BATCH_COST = 50'000.0f;
+	// more batches than threads so threads that finish early take over the rest
+	constexpr uint32_t COMMAND_BUFFER_BATCHES_PER_THREAD = 2;
+
+	// Chunk of a subpass recorded into its own secondary command buffer
+	struct _SecondaryRecordItem final
+	{
+		const CommandStream* pCommands = nullptr;
+		CommandStream::Range range;
+		const FrameVector<size_t>* pStateCommands = nullptr; // see CommandStream::Split
+		VkRenderPass renderPass = VK_NULL_HANDLE;
+		VkFramebuffer framebuffer = VK_NULL_HANDLE;
+		uint32_t subpass = 0;
+		VkCommandBuffer vkCommandBuffer = VK_NULL_HANDLE;
+	};
 
 	struct _ScopeRecordItem final
 	{
 		CommandBuffer::Scope scope;
-		size_t commandCount = 0;
+		float estimatedCost = 0.0f; // recorded into the primary command buffer
+		// secondary command buffers executed by a render pass scope, in subpass order
+		size_t firstSecondaryItem = 0;
+		size_t secondaryItemCount = 0;
 	};
 
 	struct _CommandBufferRecordBatch final
 	{
-		std::vector<_ScopeRecordItem> scopes;
-		size_t commandCount = 0;
+		FrameVector<_ScopeRecordItem> scopes;
+		float estimatedCost = 0.0f;
 		VkCommandBuffer vkCommandBuffer = VK_NULL_HANDLE;
 	};
 
-	struct _CommandPoolRecordBatch final
+	// Subpasses costing more than a batch are split across secondary command buffers
+	auto _IsSecondarySubpass(const CommandBuffer::RenderPassScope& inScope, const CommandBuffer::SubpassScope& inSubpassScope, float inBatchCost)->bool
 	{
-		std::vector<size_t> commandBufferBatchIndices;
-	};
+		if (inSubpassScope.commands.IsEmpty())
+		{
+			return false;
+		}
+
+		return inScope.contents == VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS ||
+			inSubpassScope.commands.GetEstimatedCost() > inBatchCost;
+	}
 
-	auto _CountRenderPassScopeCommands(const CommandBuffer::RenderPassScope& inScope)->size_t
+	// Cost of all commands of the scope, wherever they are recorded
+	auto _EstimateRenderPassScopeWork(const CommandBuffer::RenderPassScope& inScope)->float
 	{
-		size_t result = 0;
+		float result = 0.0f;
 		for (const CommandBuffer::SubpassScope& subpassScope : inScope.subpassScopes)
 		{
-			result += subpassScope.commands.size();
+			result += subpassScope.commands.GetEstimatedCost();
 		}
 
 		return result;
 	}
 
-	auto _RecordPrimaryScope(VkCommandBuffer inVkCommandBuffer, const CommandBuffer::PrimaryScope& inScope)->void
+	// Cost the primary command buffer records, a secondary subpass only costs its execute command
+	auto _EstimatePrimaryRenderPassScopeCost(const CommandBuffer::RenderPassScope& inScope, float inBatchCost)->float
 	{
-		for (const Command* command : inScope.commands)
+		const float executeCost = CommandCostModel::GetInstance().GetCost(CommandStream::CommandType::EXECUTE_COMMANDS);
+		float result = 0.0f;
+		for (const CommandBuffer::SubpassScope& subpassScope : inScope.subpassScopes)
 		{
-			CHECK_TRUE(command != nullptr, "Invalid command!");
-			command->Record(inVkCommandBuffer);
+			result += _IsSecondarySubpass(inScope, subpassScope, inBatchCost) ? executeCost : subpassScope.commands.GetEstimatedCost();
 		}
+
+		return result;
+	}
+
+	auto _RecordPrimaryScope(VkCommandBuffer inVkCommandBuffer, const CommandBuffer::PrimaryScope& inScope, CommandStateTracker& inoutTracker)->void
+	{
+		inScope.commands.Record(inVkCommandBuffer, &inoutTracker);
 	}
 
-	auto _RecordRenderPassScope(VkCommandBuffer inVkCommandBuffer, const CommandBuffer::RenderPassScope& inScope)->void
+	auto _RecordRenderPassScope(
+		VkCommandBuffer inVkCommandBuffer,
+		const _ScopeRecordItem& inScopeItem,
+		const FrameVector<_SecondaryRecordItem>& inSecondaryItems,
+		CommandStateTracker& inoutTracker)->void
 	{
-		CHECK_TRUE(inScope.renderPass != VK_NULL_HANDLE, "Invalid render pass!");
-		CHECK_TRUE(inScope.framebuffer != VK_NULL_HANDLE, "Invalid framebuffer!");
-		CHECK_TRUE(inScope.contents == VK_SUBPASS_CONTENTS_INLINE, "Only inline render pass scopes are supported!");
+		const auto& scope = std::get<CommandBuffer::RenderPassScope>(inScopeItem.scope);
+
+		CHECK_TRUE(scope.renderPass != VK_NULL_HANDLE, "Invalid render pass!");
+		CHECK_TRUE(scope.framebuffer != VK_NULL_HANDLE, "Invalid framebuffer!");
+		CHECK_TRUE(!scope.subpassScopes.empty(), "Render pass scope has no subpass!");
 
-		BeginRenderPassCommand::Parameters beginParameters;
-		beginParameters.renderPass = inScope.renderPass;
-		beginParameters.framebuffer = inScope.framebuffer;
-		beginParameters.renderArea = inScope.renderArea;
-		beginParameters.clearValues = inScope.clearValues;
-		beginParameters.contents = inScope.contents;
-		beginParameters.next = inScope.next;
+		VkRenderPassBeginInfo beginInfo{ VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO };
+		beginInfo.pNext = scope.next;
+		beginInfo.renderPass = scope.renderPass;
+		beginInfo.framebuffer = scope.framebuffer;
+		beginInfo.renderArea = scope.renderArea;
+		beginInfo.clearValueCount = static_cast<uint32_t>(scope.clearValues.size());
+		beginInfo.pClearValues = scope.clearValues.data();
 
-		BeginRenderPassCommand beginRenderPassCommand;
-		beginRenderPassCommand.SetParameters(beginParameters).Record(inVkCommandBuffer);
+		FrameVector<VkCommandBuffer> secondaryCommandBuffers(FrameArenaPool::GetInstance().GetThreadResource());
+		size_t secondaryItemIndex = inScopeItem.firstSecondaryItem;
+		const size_t secondaryItemEnd = inScopeItem.firstSecondaryItem + inScopeItem.secondaryItemCount;
 
-		for (size_t subpassIndex = 0; subpassIndex < inScope.subpassScopes.size(); ++subpassIndex)
+		for (size_t subpassIndex = 0; subpassIndex < scope.subpassScopes.size(); ++subpassIndex)
 		{
-			const CommandBuffer::SubpassScope& subpassScope = inScope.subpassScopes[subpassIndex];
-			for (const Command* command : subpassScope.commands)
+			const CommandBuffer::SubpassScope& subpassScope = scope.subpassScopes[subpassIndex];
+			// the chunks were made for subpasses that go to secondary command buffers
+			const bool isSecondary = secondaryItemIndex < secondaryItemEnd && inSecondaryItems[secondaryItemIndex].subpass == subpassIndex;
+			const VkSubpassContents contents = isSecondary ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE;
+
+			if (subpassIndex == 0)
 			{
-				CHECK_TRUE(command != nullptr, "Invalid command!");
-				command->Record(inVkCommandBuffer);
+				vkCmdBeginRenderPass(inVkCommandBuffer, &beginInfo, contents);
 			}
+			else
+			{
+				vkCmdNextSubpass(inVkCommandBuffer, contents);
+			}
+
+			if (!isSecondary)
+			{
+				subpassScope.commands.Record(inVkCommandBuffer, &inoutTracker);
+				continue;
+			}
+
+			secondaryCommandBuffers.clear();
+			while (secondaryItemIndex < secondaryItemEnd && inSecondaryItems[secondaryItemIndex].subpass == subpassIndex)
+			{
+				const _SecondaryRecordItem& secondaryItem = inSecondaryItems[secondaryItemIndex];
 
-			if (subpassIndex + 1 < inScope.subpassScopes.size())
+				CHECK_TRUE(secondaryItem.vkCommandBuffer != VK_NULL_HANDLE, "Secondary command buffer is not recorded!");
+				secondaryCommandBuffers.push_back(secondaryItem.vkCommandBuffer);
+				++secondaryItemIndex;
+			}
+			if (!secondaryCommandBuffers.empty())
 			{
-				vkCmdNextSubpass(inVkCommandBuffer, inScope.contents);
+				vkCmdExecuteCommands(inVkCommandBuffer, static_cast<uint32_t>(secondaryCommandBuffers.size()), secondaryCommandBuffers.data());
+				inoutTracker.Invalidate();
 			}
 		}
 
-		EndRenderPassCommand{}.Record(inVkCommandBuffer);
+		vkCmdEndRenderPass(inVkCommandBuffer);
 	}
 
-	auto _RecordScope(VkCommandBuffer inVkCommandBuffer, const _ScopeRecordItem& inScope)->void
+	auto _RecordScope(
+		VkCommandBuffer inVkCommandBuffer,
+		const _ScopeRecordItem& inScope,
+		const FrameVector<_SecondaryRecordItem>& inSecondaryItems,
+		CommandStateTracker& inoutTracker)->void
 	{
 		if (std::holds_alternative<CommandBuffer::PrimaryScope>(inScope.scope))
 		{
-			_RecordPrimaryScope(inVkCommandBuffer, std::get<CommandBuffer::PrimaryScope>(inScope.scope));
+			_RecordPrimaryScope(inVkCommandBuffer, std::get<CommandBuffer::PrimaryScope>(inScope.scope), inoutTracker);
 		}
 		else if (std::holds_alternative<CommandBuffer::RenderPassScope>(inScope.scope))
 		{
-			_RecordRenderPassScope(inVkCommandBuffer, std::get<CommandBuffer::RenderPassScope>(inScope.scope));
+			_RecordRenderPassScope(inVkCommandBuffer, inScope, inSecondaryItems, inoutTracker);
 		}
 		else
 		{
@@ -95,20 +173,82 @@ namespace
 		}
 	}
 
-	auto _RecordCommandBufferBatch(const _CommandBufferRecordBatch& inBatch)->void
+	auto _RecordCommandBufferBatch(const _CommandBufferRecordBatch& inBatch, const FrameVector<_SecondaryRecordItem>& inSecondaryItems)->void
 	{
 		CHECK_TRUE(inBatch.vkCommandBuffer != VK_NULL_HANDLE, "Invalid command buffer!");
 
 		VkCommandBufferBeginInfo beginInfo{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
 		VK_CHECK(vkBeginCommandBuffer(inBatch.vkCommandBuffer, &beginInfo), "Failed to begin command buffer!");
 
+		// bound state lives as long as the command buffer, so binds are filtered across scopes
+		CommandStateTracker stateTracker(inBatch.vkCommandBuffer);
 		for (const _ScopeRecordItem& scope : inBatch.scopes)
 		{
-			_RecordScope(inBatch.vkCommandBuffer, scope);
+			_RecordScope(inBatch.vkCommandBuffer, scope, inSecondaryItems, stateTracker);
 		}
 
 		VK_CHECK(vkEndCommandBuffer(inBatch.vkCommandBuffer), "Failed to end command buffer!");
 	}
+
+	auto _RecordSecondaryItem(_SecondaryRecordItem& inoutItem, CommandPool* inCommandPool)->void
+	{
+		inoutItem.vkCommandBuffer = inCommandPool->AllocateOrGetCommandBuffer(VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+
+		VkCommandBufferInheritanceInfo inheritanceInfo{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO };
+		inheritanceInfo.renderPass = inoutItem.renderPass;
+		inheritanceInfo.subpass = inoutItem.subpass;
+		inheritanceInfo.framebuffer = inoutItem.framebuffer;
+
+		VkCommandBufferBeginInfo beginInfo{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+		beginInfo.pInheritanceInfo = &inheritanceInfo;
+		VK_CHECK(vkBeginCommandBuffer(inoutItem.vkCommandBuffer, &beginInfo), "Failed to begin secondary command buffer!");
+
+		// a secondary command buffer inherits no bound state, the binds in effect where the chunk was cut go first
+		CommandStateTracker stateTracker(inoutItem.vkCommandBuffer);
+		inoutItem.pCommands->RecordState(inoutItem.vkCommandBuffer, inoutItem.range, *inoutItem.pStateCommands, &stateTracker);
+		inoutItem.pCommands->Record(inoutItem.vkCommandBuffer, inoutItem.range, &stateTracker);
+
+		VK_CHECK(vkEndCommandBuffer(inoutItem.vkCommandBuffer), "Failed to end secondary command buffer!");
+	}
+
+	// Run inRecord(index, threadIndex) for every index on worker threads and wait. Exceptions must
+	// not escape a worker thread, the first one is rethrown after the join
+	template<typename RecordFunction>
+	auto _RecordOnWorkers(uint32_t inCount, const char* inName, const RecordFunction& inRecord)->void
+	{
+		FrameVector<std::exception_ptr> recordErrors(inCount, FrameArenaPool::GetInstance().GetThreadResource());
+
+		MyMultiThreadTask recordTask(
+			[&inRecord, &recordErrors](uint32_t inSubStart, uint32_t inSubEnd, uint32_t inThreadIndex)
+			{
+				for (uint32_t index = inSubStart; index < inSubEnd; ++index)
+				{
+					try
+					{
+						inRecord(index, inThreadIndex);
+					}
+					catch (...)
+					{
+						recordErrors[index] = std::current_exception();
+					}
+				}
+			},
+			inCount);
+		recordTask.SetName(inName);
+
+		auto& taskScheduler = MyTaskScheduler::GetInstance();
+		taskScheduler.AddMutiThreadTask(&recordTask);
+		taskScheduler.WaitForTask(&recordTask);
+
+		for (const std::exception_ptr& recordError : recordErrors)
+		{
+			if (recordError != nullptr)
+			{
+				std::rethrow_exception(recordError);
+			}
+		}
+	}
 }
 
 auto CommandQueue::SyncInfo::AddWaitSemaphore(VkSemaphore inSemaphore, VkPipelineStageFlags inStage)->SyncInfo&
@@ -118,6 +258,7 @@ auto CommandQueue::SyncInfo::AddWaitSemaphore(VkSemaphore inSemaphore, VkPipelin
 
 	m_waitSemaphores.push_back(inSemaphore);
 	m_waitStages.push_back(inStage);
+	m_waitValues.push_back(0);
 	return *this;
 }
 
@@ -125,9 +266,45 @@ auto CommandQueue::SyncInfo::AddSemaphoreToSignal(VkSemaphore inSemaphore)->Sync
 {
 	CHECK_TRUE(inSemaphore != VK_NULL_HANDLE, "Invalid signal semaphore!");
 	m_signalSemaphores.push_back(inSemaphore);
+	m_signalValues.push_back(0);
+	return *this;
+}
+
+auto CommandQueue::SyncInfo::AddWaitTimelineSemaphore(VkSemaphore inSemaphore, uint64_t inValue, VkPipelineStageFlags inStage)->SyncInfo&
+{
+	CHECK_TRUE(inSemaphore != VK_NULL_HANDLE, "Invalid wait semaphore!");
+	CHECK_TRUE(inStage != 0, "Invalid wait stage!");
+
+	m_waitSemaphores.push_back(inSemaphore);
+	m_waitStages.push_back(inStage);
+	m_waitValues.push_back(inValue);
+	return *this;
+}
+
+auto CommandQueue::SyncInfo::AddTimelineSemaphoreToSignal(VkSemaphore inSemaphore, uint64_t inValue)->SyncInfo&
+{
+	CHECK_TRUE(inSemaphore != VK_NULL_HANDLE, "Invalid signal semaphore!");
+	CHECK_TRUE(inValue != 0, "Invalid signal value!");
+
+	m_signalSemaphores.push_back(inSemaphore);
+	m_signalValues.push_back(inValue);
 	return *this;
 }
 
+auto CommandQueue::SyncInfo::AddWaitQueue(const CommandQueue* inQueue, uint64_t inValue, VkPipelineStageFlags inStage)->SyncInfo&
+{
+	CHECK_TRUE(inQueue != nullptr, "Invalid queue to wait!");
+	CHECK_TRUE(inQueue->m_syncMode == SyncMode::TIMELINE, "Only queues in timeline mode can be waited by value!");
+	CHECK_TRUE(inValue <= inQueue->GetSubmittedValue(), "Can't wait for a value that is not submitted yet!");
+
+	if (inValue == 0)
+	{
+		return *this;
+	}
+
+	return AddWaitTimelineSemaphore(inQueue->m_vkTimelineSemaphore, inValue, inStage);
+}
+
 CommandQueue::CommandQueue()
 {
 	m_uptrFenceAllocator = std::make_unique<FenceAllocator>();
@@ -139,7 +316,7 @@ CommandQueue::~CommandQueue()
 	_Deinit();
 }
 
-auto CommandQueue::_Init(QueueFamilyType inQueueFamilyType)->void
+auto CommandQueue::_Init(QueueFamilyType inQueueFamilyType, SyncMode inSyncMode)->void
 {
 	CHECK_TRUE(inQueueFamilyType != QueueFamilyType::UNSET, "Invalid command queue family type!");
 	CHECK_TRUE(m_vkQueue == VK_NULL_HANDLE, "Command queue is already initialized!");
@@ -158,14 +335,32 @@ auto CommandQueue::_Init(QueueFamilyType inQueueFamilyType)->void
 	}
 	m_uptrFenceAllocator->Create();
 
+	m_syncMode = inSyncMode;
+	if (m_syncMode == SyncMode::TIMELINE)
+	{
+		VkSemaphoreTypeCreateInfo semaphoreTypeInfo{ VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO };
+		VkSemaphoreCreateInfo semaphoreInfo{ VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
+
+		semaphoreTypeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+		semaphoreTypeInfo.initialValue = 0;
+		semaphoreInfo.pNext = &semaphoreTypeInfo;
+		m_vkTimelineSemaphore = device.CreateVkSemaphore(&semaphoreInfo);
+	}
+	m_submittedValue.store(0, std::memory_order_relaxed);
+	m_completedValue = 0;
+	m_frameTimelineValues.fill(0);
+
 	CommandPoolCreateInfo commandPoolCreateInfo;
 	commandPoolCreateInfo.CustomizeQueueFamilyType(inQueueFamilyType);
 
+	// any task scheduler thread may record, so each of them gets its own pool
+	const uint32_t threadCount = MyTaskScheduler::GetInstance().GetThreadCount();
 	for (auto& frameCommandPools : m_commandPools)
 	{
+		CHECK_TRUE(frameCommandPools.empty(), "Command pool is already initialized!");
+		frameCommandPools.resize(threadCount);
 		for (auto& commandPool : frameCommandPools)
 		{
-			CHECK_TRUE(commandPool == nullptr, "Command pool is already initialized!");
 			commandPool = std::make_unique<CommandPool>();
 			commandPool->Create(&commandPoolCreateInfo);
 		}
@@ -176,9 +371,12 @@ auto CommandQueue::_Init(QueueFamilyType inQueueFamilyType)->void
 
 auto CommandQueue::_Deinit()->void
 {
+	Flush();
+	DisableSubmitThread();
+
 	for (uint8_t frameIndex = 0; frameIndex < FRAME_IN_FLIGHT_COUNT; ++frameIndex)
 	{
-		_WaitFrameFences(frameIndex);
+		_WaitFrameSubmissions(frameIndex);
 	}
 
 	m_recordedCommandBuffers.clear();
@@ -193,6 +391,7 @@ auto CommandQueue::_Deinit()->void
 				commandPool.reset();
 			}
 		}
+		frameCommandPools.clear();
 	}
 
 	if (m_uptrFenceAllocator != nullptr)
@@ -200,6 +399,13 @@ auto CommandQueue::_Deinit()->void
 		m_uptrFenceAllocator->Destroy();
 	}
 
+	if (m_vkTimelineSemaphore != VK_NULL_HANDLE)
+	{
+		MyDevice::GetInstance().DestroyVkSemaphore(m_vkTimelineSemaphore);
+	}
+	m_submittedValue.store(0, std::memory_order_relaxed);
+	m_completedValue = 0;
+
 	m_vkQueue = VK_NULL_HANDLE;
 	m_queueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 	m_queueFamilyType = QueueFamilyType::UNSET;
@@ -208,29 +414,44 @@ auto CommandQueue::_Deinit()->void
 
 GraphicsQueue::GraphicsQueue() = default;
 
-auto GraphicsQueue::Init()->void
+GraphicsQueue::~GraphicsQueue()
+{
+	FrameArenaPool::GetInstance().Destroy();
+}
+
+auto GraphicsQueue::Init(SyncMode inSyncMode)->void
 {
-	_Init(QueueFamilyType::GRAPHICS);
+	_Init(QueueFamilyType::GRAPHICS, inSyncMode);
+	FrameArenaPool::GetInstance().Create(FRAME_IN_FLIGHT_COUNT);
+	FrameArenaPool::GetInstance().StartFrame(m_currentFrameIndex);
+}
+
+auto GraphicsQueue::StartFrame()->void
+{
+	CommandQueue::StartFrame();
+
+	// the frame fence has retired, nothing recorded in that frame is still in use
+	FrameArenaPool::GetInstance().StartFrame(m_currentFrameIndex);
 }
 
 ComputeQueue::ComputeQueue() = default;
 
-auto ComputeQueue::Init()->void
+auto ComputeQueue::Init(SyncMode inSyncMode)->void
 {
-	_Init(QueueFamilyType::COMPUTE);
+	_Init(QueueFamilyType::COMPUTE, inSyncMode);
 }
 
 TransferQueue::TransferQueue() = default;
 
-auto TransferQueue::Init()->void
+auto TransferQueue::Init(SyncMode inSyncMode)->void
 {
-	_Init(QueueFamilyType::TRANSFER);
+	_Init(QueueFamilyType::TRANSFER, inSyncMode);
 }
 
-auto CommandQueue::_GetCommandPool(uint8_t inFrameIndex, uint8_t inThreadIndex) const->CommandPool*
+auto CommandQueue::_GetCommandPool(uint8_t inFrameIndex, uint32_t inThreadIndex) const->CommandPool*
 {
 	CHECK_TRUE(inFrameIndex < FRAME_IN_FLIGHT_COUNT, "Command queue frame index out of range!");
-	CHECK_TRUE(inThreadIndex < THREAD_COUNT, "Command queue thread index out of range!");
+	CHECK_TRUE(inThreadIndex < m_commandPools[inFrameIndex].size(), "Command queue thread index out of range!");
 
 	const auto& commandPool = m_commandPools[inFrameIndex][inThreadIndex];
 	CHECK_TRUE(commandPool != nullptr, "Command pool is not created!");
@@ -238,10 +459,18 @@ auto CommandQueue::_GetCommandPool(uint8_t inFrameIndex, uint8_t inThreadIndex)
 	return commandPool.get();
 }
 
-auto CommandQueue::_WaitFrameFences(uint8_t inFrameIndex)->void
+auto CommandQueue::_WaitFrameSubmissions(uint8_t inFrameIndex)->void
 {
 	CHECK_TRUE(inFrameIndex < FRAME_IN_FLIGHT_COUNT, "Command queue frame index out of range!");
 
+	if (m_syncMode == SyncMode::TIMELINE)
+	{
+		// submissions signal increasing values, waiting the last one retires the whole frame
+		WaitForValue(m_frameTimelineValues[inFrameIndex]);
+		m_frameTimelineValues[inFrameIndex] = 0;
+		return;
+	}
+
 	std::vector<VkFence>& frameFences = m_frameFences[inFrameIndex];
 	if (frameFences.empty())
 	{
@@ -262,17 +491,20 @@ auto CommandQueue::_ResetFrameCommandPools(uint8_t inFrameIndex)->void
 {
 	CHECK_TRUE(inFrameIndex < FRAME_IN_FLIGHT_COUNT, "Command queue frame index out of range!");
 
-	for (uint8_t threadIndex = 0; threadIndex < THREAD_COUNT; ++threadIndex)
+	for (auto& commandPool : m_commandPools[inFrameIndex])
 	{
-		_GetCommandPool(inFrameIndex, threadIndex)->Reset();
+		commandPool->Reset();
 	}
 }
 
 auto CommandQueue::StartFrame()->void
 {
+	// pending submissions use command buffers of the current frame
+	Flush();
+
 	m_currentFrameIndex = static_cast<uint8_t>((m_currentFrameIndex + 1) % FRAME_IN_FLIGHT_COUNT);
 
-	_WaitFrameFences(m_currentFrameIndex);
+	_WaitFrameSubmissions(m_currentFrameIndex);
 	_ResetFrameCommandPools(m_currentFrameIndex);
 }
 
@@ -282,35 +514,325 @@ auto CommandQueue::Enqueue(CommandBuffer* inCommandBuffers, size_t inCount)->Com
 	return *this;
 }
 
-auto CommandQueue::Submit(SyncInfo inSyncInfo)->void
+auto CommandQueue::Submit(SyncInfo inSyncInfo)->uint64_t
 {
 	CHECK_TRUE(m_vkQueue != VK_NULL_HANDLE, "Command queue is not created!");
 	CHECK_TRUE(!m_recordedCommandBuffers.empty(), "No command buffers to submit!");
 	CHECK_TRUE(
 		inSyncInfo.m_waitSemaphores.size() == inSyncInfo.m_waitStages.size(),
 		"Wait semaphore count must match wait stage count!");
-	CHECK_TRUE(m_uptrFenceAllocator != nullptr, "Command queue fence allocator is not created!");
 
-	VkFence frameFence = m_uptrFenceAllocator->CreateOrGetVkFence();
+	// staged uploads must land before the work that consumes them
+	UploadManager* uploadManager = MyDevice::GetInstance().GetUploadManager();
+	if (m_queueFamilyType == QueueFamilyType::GRAPHICS)
+	{
+		// pending submissions were issued before these uploads, they must not see them. The flush
+		// is queued behind them on the submit thread, so the caller doesn't wait for it to drain
+		if (uploadManager->HasPendingUploads())
+		{
+			RunOnSubmitThread([uploadManager]() { uploadManager->Flush(); });
+		}
+		else
+		{
+			uploadManager->Flush();
+		}
+	}
+	else
+	{
+		// synchronous uploads are copied on the graphics queue, wait for them on the device
+		const uint64_t uploadValue = uploadManager->FlushForOtherQueue();
+		if (uploadValue != 0)
+		{
+			inSyncInfo.AddWaitTimelineSemaphore(uploadManager->GetSyncUploadTimeline(), uploadValue, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+		}
+	}
 
-	VkSubmitInfo submitInfo{ VK_STRUCTURE_TYPE_SUBMIT_INFO };
-	submitInfo.waitSemaphoreCount = static_cast<uint32_t>(inSyncInfo.m_waitSemaphores.size());
-	submitInfo.pWaitSemaphores = inSyncInfo.m_waitSemaphores.empty() ? nullptr : inSyncInfo.m_waitSemaphores.data();
-	submitInfo.pWaitDstStageMask = inSyncInfo.m_waitStages.empty() ? nullptr : inSyncInfo.m_waitStages.data();
-	submitInfo.commandBufferCount = static_cast<uint32_t>(m_recordedCommandBuffers.size());
-	submitInfo.pCommandBuffers = m_recordedCommandBuffers.data();
-	submitInfo.signalSemaphoreCount = static_cast<uint32_t>(inSyncInfo.m_signalSemaphores.size());
-	submitInfo.pSignalSemaphores = inSyncInfo.m_signalSemaphores.empty() ? nullptr : inSyncInfo.m_signalSemaphores.data();
+	uint64_t signalValue = 0;
+	if (m_syncMode == SyncMode::TIMELINE)
+	{
+		signalValue = m_submittedValue.fetch_add(1, std::memory_order_acq_rel) + 1;
+		inSyncInfo.AddTimelineSemaphoreToSignal(m_vkTimelineSemaphore, signalValue);
+		m_frameTimelineValues[m_currentFrameIndex] = signalValue;
+	}
 
-	VK_CHECK(vkQueueSubmit(m_vkQueue, 1, &submitInfo, frameFence), "Failed to submit command queue!");
+	// binary semaphores must be signaled before anyone waits on them, so don't hold them back
+	bool signalBinarySemaphore = std::find(inSyncInfo.m_signalValues.begin(), inSyncInfo.m_signalValues.end(), 0) != inSyncInfo.m_signalValues.end();
 
-	m_frameFences[m_currentFrameIndex].push_back(frameFence);
+	PendingSubmit pendingSubmit;
+	pendingSubmit.syncInfo = std::move(inSyncInfo);
+	pendingSubmit.commandBuffers = std::move(m_recordedCommandBuffers);
+	m_pendingSubmits.push_back(std::move(pendingSubmit));
 	m_recordedCommandBuffers.clear();
+
+	if (!m_deferSubmit || signalBinarySemaphore)
+	{
+		Flush();
+	}
+
+	return signalValue;
+}
+
+auto CommandQueue::Flush()->void
+{
+	if (m_pendingSubmits.empty())
+	{
+		return;
+	}
+
+	CHECK_TRUE(m_uptrFenceAllocator != nullptr, "Command queue fence allocator is not created!");
+
+	// in timeline mode the last signaled value already covers the batch
+	SubmitWork submitWork;
+	if (m_syncMode == SyncMode::FENCE)
+	{
+		submitWork.vkFence = m_uptrFenceAllocator->CreateOrGetVkFence();
+		m_frameFences[m_currentFrameIndex].push_back(submitWork.vkFence);
+	}
+	submitWork.submits = std::move(m_pendingSubmits);
+	m_pendingSubmits.clear();
+
+	if (HasSubmitThread())
+	{
+		_PushSubmitWork(submitWork);
+	}
+	else
+	{
+		_ExecuteSubmitWork(submitWork);
+	}
+}
+
+auto CommandQueue::_ExecuteSubmitWork(SubmitWork& inoutWork)->void
+{
+	if (!inoutWork.submits.empty())
+	{
+		std::vector<VkTimelineSemaphoreSubmitInfo> timelineInfos(inoutWork.submits.size(), { VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO });
+		std::vector<VkSubmitInfo> submitInfos(inoutWork.submits.size(), { VK_STRUCTURE_TYPE_SUBMIT_INFO });
+
+		for (size_t i = 0; i < inoutWork.submits.size(); ++i)
+		{
+			const SyncInfo& syncInfo = inoutWork.submits[i].syncInfo;
+			const std::vector<VkCommandBuffer>& commandBuffers = inoutWork.submits[i].commandBuffers;
+			VkTimelineSemaphoreSubmitInfo& timelineInfo = timelineInfos[i];
+			VkSubmitInfo& submitInfo = submitInfos[i];
+
+			// values of binary semaphores are ignored
+			timelineInfo.waitSemaphoreValueCount = static_cast<uint32_t>(syncInfo.m_waitValues.size());
+			timelineInfo.pWaitSemaphoreValues = syncInfo.m_waitValues.empty() ? nullptr : syncInfo.m_waitValues.data();
+			timelineInfo.signalSemaphoreValueCount = static_cast<uint32_t>(syncInfo.m_signalValues.size());
+			timelineInfo.pSignalSemaphoreValues = syncInfo.m_signalValues.empty() ? nullptr : syncInfo.m_signalValues.data();
+
+			submitInfo.pNext = &timelineInfo;
+			submitInfo.waitSemaphoreCount = static_cast<uint32_t>(syncInfo.m_waitSemaphores.size());
+			submitInfo.pWaitSemaphores = syncInfo.m_waitSemaphores.empty() ? nullptr : syncInfo.m_waitSemaphores.data();
+			submitInfo.pWaitDstStageMask = syncInfo.m_waitStages.empty() ? nullptr : syncInfo.m_waitStages.data();
+			submitInfo.commandBufferCount = static_cast<uint32_t>(commandBuffers.size());
+			submitInfo.pCommandBuffers = commandBuffers.data();
+			submitInfo.signalSemaphoreCount = static_cast<uint32_t>(syncInfo.m_signalSemaphores.size());
+			submitInfo.pSignalSemaphores = syncInfo.m_signalSemaphores.empty() ? nullptr : syncInfo.m_signalSemaphores.data();
+		}
+
+		VK_CHECK(
+			MyDevice::GetInstance().QueueSubmit(m_vkQueue, static_cast<uint32_t>(submitInfos.size()), submitInfos.data(), inoutWork.vkFence),
+			"Failed to submit command queue!");
+	}
+
+	if (inoutWork.function)
+	{
+		inoutWork.function();
+	}
+}
+
+auto CommandQueue::_PushSubmitWork(SubmitWork& inoutWork)->void
+{
+	_RethrowSubmitError();
+
+	std::lock_guard<std::mutex> lock(m_submitPushMutex);
+
+	// the submit thread is behind by a whole ring, let it catch up
+	while (!m_uptrSubmitWorks->TryPush(inoutWork))
+	{
+		std::this_thread::yield();
+	}
+
+	if (m_submitWorkCount.fetch_add(1, std::memory_order_acq_rel) == 0)
+	{
+		// the last run drained everything but may not be marked complete yet. It is past its last
+		// pop, so spin on the flag instead of a wait that could run unrelated tasks inside Submit
+		while (!m_uptrSubmitTask->GetCompletable()->GetIsComplete())
+		{
+			std::this_thread::yield();
+		}
+		MyTaskScheduler::GetInstance().AddSingleThreadTask(m_uptrSubmitTask.get());
+	}
+}
+
+auto CommandQueue::_DrainSubmitWorks()->void
+{
+	do
+	{
+		// the work is pushed before the count grows, so it is there or about to be
+		SubmitWork submitWork;
+		while (!m_uptrSubmitWorks->TryPop(submitWork))
+		{
+			std::this_thread::yield();
+		}
+
+		try
+		{
+			_ExecuteSubmitWork(submitWork);
+		}
+		catch (...)
+		{
+			// exceptions must not escape a worker thread, the next Submit or wait rethrows it
+			std::lock_guard<std::mutex> lock(m_submitErrorMutex);
+			if (m_submitError == nullptr)
+			{
+				m_submitError = std::current_exception();
+			}
+		}
+	} while (m_submitWorkCount.fetch_sub(1, std::memory_order_acq_rel) > 1);
+}
+
+auto CommandQueue::_RethrowSubmitError()->void
+{
+	std::exception_ptr submitError;
+	{
+		std::lock_guard<std::mutex> lock(m_submitErrorMutex);
+		std::swap(submitError, m_submitError);
+	}
+
+	if (submitError != nullptr)
+	{
+		std::rethrow_exception(submitError);
+	}
+}
+
+auto CommandQueue::EnableSubmitThread(uint32_t inThreadIndex)->void
+{
+	CHECK_TRUE(!HasSubmitThread(), "Submit thread is already enabled!");
+	CHECK_TRUE(inThreadIndex != 0, "Submit thread can't be pinned to the main thread!");
+
+	Flush();
+	m_uptrSubmitWorks = std::make_unique<SpscQueue<SubmitWork, SUBMIT_WORK_CAPACITY>>();
+	m_uptrSubmitTask = std::make_unique<MySinglThreadTask>([this]() { _DrainSubmitWorks(); }, inThreadIndex);
+	m_uptrSubmitTask->SetName("SubmitQueue");
+	m_uptrSubmitTask->SetPriority(TaskPriority::FRAME_CRITICAL);
+	m_submitWorkCount.store(0, std::memory_order_relaxed);
+}
+
+auto CommandQueue::DisableSubmitThread()->void
+{
+	if (!HasSubmitThread())
+	{
+		return;
+	}
+
+	Flush();
+	WaitSubmitThreadIdle();
+	m_uptrSubmitTask.reset();
+	m_uptrSubmitWorks.reset();
+}
+
+auto CommandQueue::RunOnSubmitThread(std::function<void()> inFunction)->void
+{
+	CHECK_TRUE(inFunction != nullptr, "No function to run!");
+
+	// keep the order with submissions that are not handed out yet
+	Flush();
+
+	SubmitWork submitWork;
+	submitWork.function = std::move(inFunction);
+	if (HasSubmitThread())
+	{
+		_PushSubmitWork(submitWork);
+	}
+	else
+	{
+		_ExecuteSubmitWork(submitWork);
+	}
+}
+
+auto CommandQueue::WaitSubmitThreadIdle()->void
+{
+	if (!HasSubmitThread())
+	{
+		return;
+	}
+
+	// another producer may have pushed but not added the task yet, so a complete task alone
+	// doesn't mean nothing is left
+	auto& taskScheduler = MyTaskScheduler::GetInstance();
+	taskScheduler.WaitForTask(m_uptrSubmitTask.get());
+	while (m_submitWorkCount.load(std::memory_order_acquire) != 0 || !m_uptrSubmitTask->GetCompletable()->GetIsComplete())
+	{
+		std::this_thread::yield();
+		taskScheduler.WaitForTask(m_uptrSubmitTask.get());
+	}
+	_RethrowSubmitError();
+}
+
+auto CommandQueue::SetDeferredSubmit(bool inDeferred)->void
+{
+	if (!inDeferred)
+	{
+		Flush();
+	}
+	m_deferSubmit = inDeferred;
 }
 
 auto CommandQueue::WaitTillDone()->void
 {
-	_WaitFrameFences(m_currentFrameIndex);
+	Flush();
+	WaitSubmitThreadIdle();
+
+	if (m_syncMode == SyncMode::TIMELINE)
+	{
+		WaitForValue(GetSubmittedValue());
+		return;
+	}
+
+	_WaitFrameSubmissions(m_currentFrameIndex);
+}
+
+auto CommandQueue::IsValueDone(uint64_t inValue) const->bool
+{
+	CHECK_TRUE(m_syncMode == SyncMode::TIMELINE, "Command queue is not in timeline mode!");
+
+	if (inValue <= m_completedValue)
+	{
+		return true;
+	}
+
+	VK_CHECK(
+		vkGetSemaphoreCounterValue(MyDevice::GetInstance().vkDevice, m_vkTimelineSemaphore, &m_completedValue),
+		"Failed to query command queue timeline!");
+
+	return inValue <= m_completedValue;
+}
+
+auto CommandQueue::WaitForValue(uint64_t inValue)->void
+{
+	CHECK_TRUE(m_syncMode == SyncMode::TIMELINE, "Command queue is not in timeline mode!");
+	CHECK_TRUE(inValue <= GetSubmittedValue(), "Can't wait for a value that is not submitted yet!");
+
+	if (inValue <= m_completedValue)
+	{
+		return;
+	}
+
+	// the value may still sit in the pending submissions
+	Flush();
+
+	VkSemaphoreWaitInfo waitInfo{ VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO };
+	waitInfo.semaphoreCount = 1;
+	waitInfo.pSemaphores = &m_vkTimelineSemaphore;
+	waitInfo.pValues = &inValue;
+
+	VK_CHECK(
+		vkWaitSemaphores(MyDevice::GetInstance().vkDevice, &waitInfo, UINT64_MAX),
+		"Failed to wait for command queue timeline!");
+
+	m_completedValue = inValue;
 }
 
 auto CommandQueue::_RecordCommandBuffer(CommandBuffer* inCommandBuffers, size_t inCount)->void
@@ -322,7 +844,10 @@ auto CommandQueue::_RecordCommandBuffer(CommandBuffer* inCommandBuffers, size_t
 
 	CHECK_TRUE(inCommandBuffers != nullptr, "No command buffers!");
 
-	std::vector<_ScopeRecordItem> scopeItems;
+	// everything below only lives for this call, keep it in the frame arena
+	std::pmr::memory_resource* pFrameResource = FrameArenaPool::GetInstance().GetThreadResource();
+	FrameVector<_ScopeRecordItem> scopeItems(pFrameResource);
+	float totalCost = 0.0f;
 
 	// Move all input scopes into a local linear stream. This consumes the input
 	// CommandBuffers and keeps Vulkan scope boundaries intact for batching.
@@ -335,29 +860,26 @@ auto CommandQueue::_RecordCommandBuffer(CommandBuffer* inCommandBuffers, size_t
 			if (std::holds_alternative<CommandBuffer::PrimaryScope>(scopeVariant))
 			{
 				const auto& primaryScope = std::get<CommandBuffer::PrimaryScope>(scopeVariant);
-				if (primaryScope.commands.empty())
+				if (primaryScope.commands.IsEmpty())
 				{
 					continue;
 				}
 
-				_ScopeRecordItem item;
-				item.commandCount = primaryScope.commands.size();
-				item.scope = std::move(scopeVariant);
-				scopeItems.push_back(std::move(item));
+				totalCost += primaryScope.commands.GetEstimatedCost();
+				scopeItems.push_back(_ScopeRecordItem{ std::move(scopeVariant), primaryScope.commands.GetEstimatedCost() });
 			}
 			else if (std::holds_alternative<CommandBuffer::RenderPassScope>(scopeVariant))
 			{
 				const auto& renderPassScope = std::get<CommandBuffer::RenderPassScope>(scopeVariant);
-				const size_t commandCount = _CountRenderPassScopeCommands(renderPassScope);
-				if (commandCount == 0)
+				const float work = _EstimateRenderPassScopeWork(renderPassScope);
+				if (work <= 0.0f)
 				{
 					continue;
 				}
 
-				_ScopeRecordItem item;
-				item.commandCount = commandCount;
-				item.scope = std::move(scopeVariant);
-				scopeItems.push_back(std::move(item));
+				// the primary command buffer's share is known once the batch cost is
+				totalCost += work;
+				scopeItems.push_back(_ScopeRecordItem{ std::move(scopeVariant), work });
 			}
 			else
 			{
@@ -368,21 +890,36 @@ auto CommandQueue::_RecordCommandBuffer(CommandBuffer* inCommandBuffers, size_t
 		commandBuffer.m_scopes.clear();
 	}
 
-	std::vector<_CommandBufferRecordBatch> commandBufferBatches;
-	_CommandBufferRecordBatch currentBatch;
+	// Spread the estimated cost evenly over the threads, every batch of commands or subpass chunk
+	// costs about the same, so no thread is left recording one expensive scope alone
+	const uint32_t threadCount = MyTaskScheduler::GetInstance().GetThreadCount();
+	const float batchCost = std::max(MIN_COMMAND_BUFFER_BATCH_COST, totalCost / static_cast<float>(threadCount * COMMAND_BUFFER_BATCHES_PER_THREAD));
 
-	// Pack multiple scopes into one VkCommandBuffer until the command-count budget is
-	// reached. A single oversized scope is never split, so render pass validity is preserved.
+	for (_ScopeRecordItem& scopeItem : scopeItems)
+	{
+		if (std::holds_alternative<CommandBuffer::RenderPassScope>(scopeItem.scope))
+		{
+			scopeItem.estimatedCost = _EstimatePrimaryRenderPassScopeCost(std::get<CommandBuffer::RenderPassScope>(scopeItem.scope), batchCost);
+		}
+	}
+
+	FrameVector<_CommandBufferRecordBatch> commandBufferBatches(pFrameResource);
+	_CommandBufferRecordBatch currentBatch{ FrameVector<_ScopeRecordItem>(pFrameResource) };
+
+	// Pack multiple scopes into one VkCommandBuffer until the batch cost is reached. A scope is
+	// never split across primary command buffers, so render pass validity is preserved, large
+	// subpasses go to secondary command buffers instead.
 	for (_ScopeRecordItem& scopeItem : scopeItems)
 	{
 		if (!currentBatch.scopes.empty() &&
-			currentBatch.commandCount + scopeItem.commandCount > COMMAND_COUNT_PER_VK_COMMAND_BUFFER)
+			currentBatch.estimatedCost + scopeItem.estimatedCost > batchCost)
 		{
 			commandBufferBatches.push_back(std::move(currentBatch));
-			currentBatch = _CommandBufferRecordBatch{};
+			currentBatch.scopes = FrameVector<_ScopeRecordItem>(pFrameResource);
+			currentBatch.estimatedCost = 0.0f;
 		}
 
-		currentBatch.commandCount += scopeItem.commandCount;
+		currentBatch.estimatedCost += scopeItem.estimatedCost;
 		currentBatch.scopes.push_back(std::move(scopeItem));
 	}
 
@@ -396,48 +933,79 @@ auto CommandQueue::_RecordCommandBuffer(CommandBuffer* inCommandBuffers, size_t
 		return;
 	}
 
-	std::array<_CommandPoolRecordBatch, THREAD_COUNT> commandPoolBatches;
-	const size_t batchCount = commandBufferBatches.size();
-	const size_t baseBatchCountPerThread = batchCount / THREAD_COUNT;
-	const size_t extraBatchCount = batchCount % THREAD_COUNT;
-	size_t nextBatchIndex = 0;
-
-	// Assign contiguous command-buffer batches to per-thread command pools. The batches
-	// are independent after this point and can be recorded on worker threads later.
-	for (uint8_t threadIndex = 0; threadIndex < THREAD_COUNT; ++threadIndex)
+	// Large subpasses are cut into chunks now that the batches no longer move, the primary
+	// command buffers execute them so they are recorded first
+	FrameVector<_SecondaryRecordItem> secondaryItems(pFrameResource);
+	FrameVector<CommandStream::Range> subpassRanges(pFrameResource);
+	FrameVector<size_t> stateCommands(pFrameResource);
+	for (_CommandBufferRecordBatch& commandBufferBatch : commandBufferBatches)
 	{
-		const size_t threadBatchCount = baseBatchCountPerThread + (threadIndex < extraBatchCount ? 1 : 0);
-		if (threadBatchCount == 0)
+		for (_ScopeRecordItem& scopeItem : commandBufferBatch.scopes)
 		{
-			continue;
+			if (!std::holds_alternative<CommandBuffer::RenderPassScope>(scopeItem.scope))
+			{
+				continue;
+			}
+
+			const auto& renderPassScope = std::get<CommandBuffer::RenderPassScope>(scopeItem.scope);
+			scopeItem.firstSecondaryItem = secondaryItems.size();
+			for (size_t subpassIndex = 0; subpassIndex < renderPassScope.subpassScopes.size(); ++subpassIndex)
+			{
+				const CommandBuffer::SubpassScope& subpassScope = renderPassScope.subpassScopes[subpassIndex];
+				if (!_IsSecondarySubpass(renderPassScope, subpassScope, batchCost))
+				{
+					continue;
+				}
+
+				subpassRanges.clear();
+				subpassScope.commands.Split(batchCost, subpassRanges, stateCommands);
+				for (const CommandStream::Range& range : subpassRanges)
+				{
+					secondaryItems.push_back(_SecondaryRecordItem{
+						.pCommands = &subpassScope.commands,
+						.range = range,
+						.pStateCommands = &stateCommands,
+						.renderPass = renderPassScope.renderPass,
+						.framebuffer = renderPassScope.framebuffer,
+						.subpass = static_cast<uint32_t>(subpassIndex),
+					});
+				}
+			}
+			scopeItem.secondaryItemCount = secondaryItems.size() - scopeItem.firstSecondaryItem;
 		}
+	}
 
-		CommandPool* commandPool = _GetCommandPool(m_currentFrameIndex, threadIndex);
-		_CommandPoolRecordBatch& commandPoolBatch = commandPoolBatches[threadIndex];
-		commandPoolBatch.commandBufferBatchIndices.reserve(threadBatchCount);
+	// The enki thread index picks the command pool, so one pool is only ever touched by the
+	// thread that owns it, and items that land on the same thread are recorded back to back
+	const uint8_t frameIndex = m_currentFrameIndex;
+
+	if (!secondaryItems.empty())
+	{
+		_RecordOnWorkers(
+			static_cast<uint32_t>(secondaryItems.size()),
+			"RecordSecondaryCommandBuffers",
+			[this, frameIndex, &secondaryItems](uint32_t inItemIndex, uint32_t inThreadIndex)
+			{
+				_RecordSecondaryItem(secondaryItems[inItemIndex], _GetCommandPool(frameIndex, inThreadIndex));
+			});
+	}
 
-		for (size_t localBatchIndex = 0; localBatchIndex < threadBatchCount; ++localBatchIndex)
+	_RecordOnWorkers(
+		static_cast<uint32_t>(commandBufferBatches.size()),
+		"RecordCommandBuffers",
+		[this, frameIndex, &commandBufferBatches, &secondaryItems](uint32_t inBatchIndex, uint32_t inThreadIndex)
 		{
-			_CommandBufferRecordBatch& commandBufferBatch = commandBufferBatches[nextBatchIndex];
+			CommandPool* commandPool = _GetCommandPool(frameIndex, inThreadIndex);
+			_CommandBufferRecordBatch& commandBufferBatch = commandBufferBatches[inBatchIndex];
+
 			commandBufferBatch.vkCommandBuffer = commandPool->AllocateOrGetCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY);
-			commandPoolBatch.commandBufferBatchIndices.push_back(nextBatchIndex);
-			++nextBatchIndex;
-		}
-	}
+			_RecordCommandBufferBatch(commandBufferBatch, secondaryItems);
+		});
 
+	// Submission order follows batch order, not the order threads finished recording
 	for (const _CommandBufferRecordBatch& commandBufferBatch : commandBufferBatches)
 	{
 		CHECK_TRUE(commandBufferBatch.vkCommandBuffer != VK_NULL_HANDLE, "Invalid command buffer!");
 		m_recordedCommandBuffers.push_back(commandBufferBatch.vkCommandBuffer);
 	}
-
-	// Record per-pool batches as isolated units. This is single-threaded for now, but the
-	// outer loop is the intended future parallelization boundary.
-	for (const _CommandPoolRecordBatch& commandPoolBatch : commandPoolBatches)
-	{
-		for (size_t commandBufferBatchIndex : commandPoolBatch.commandBufferBatchIndices)
-		{
-			_RecordCommandBufferBatch(commandBufferBatches[commandBufferBatchIndex]);
-		}
-	}
 }
@@ -2,48 +2,105 @@
 #include "command_buffer.h"
 #include "command_pool.h"
 #include "common_enums.h"
+#include "spsc_queue.h"
+#include <atomic>
+#include <mutex>
+#include <exception>
 class FenceAllocator;
 class MyDevice;
+class MySinglThreadTask;
 
 class CommandQueue
 {
 public:
+	enum class SyncMode
+	{
+		FENCE,    // each submission takes a fence, a frame retires by waiting all of them
+		TIMELINE, // each submission signals the next value of the queue's timeline semaphore
+	};
+
 	class SyncInfo
 	{
 	private:
 		std::vector<VkSemaphore> m_waitSemaphores;
 		std::vector<VkPipelineStageFlags> m_waitStages;
+		std::vector<uint64_t> m_waitValues;   // 0 for binary semaphores
 		std::vector<VkSemaphore> m_signalSemaphores;
+		std::vector<uint64_t> m_signalValues; // 0 for binary semaphores
 
 	public:
 		auto AddWaitSemaphore(VkSemaphore inSemaphore, VkPipelineStageFlags inStage)->SyncInfo&;
 		auto AddSemaphoreToSignal(VkSemaphore inSemaphore)->SyncInfo&;
 
+		// Wait till the timeline semaphore reaches the value
+		auto AddWaitTimelineSemaphore(VkSemaphore inSemaphore, uint64_t inValue, VkPipelineStageFlags inStage)->SyncInfo&;
+		auto AddTimelineSemaphoreToSignal(VkSemaphore inSemaphore, uint64_t inValue)->SyncInfo&;
+
+		// Wait till the submission of another queue that returned the value is done,
+		// the queue must be in timeline mode
+		auto AddWaitQueue(const CommandQueue* inQueue, uint64_t inValue, VkPipelineStageFlags inStage)->SyncInfo&;
+
 	private:
 		friend class CommandQueue;
 	};
 
 protected:
-	static constexpr uint8_t THREAD_COUNT = 4;
+	struct PendingSubmit
+	{
+		SyncInfo syncInfo;
+		std::vector<VkCommandBuffer> commandBuffers;
+	};
+
+	struct SubmitWork
+	{
+		std::vector<PendingSubmit> submits; // issued with one vkQueueSubmit
+		VkFence vkFence = VK_NULL_HANDLE;
+		std::function<void()> function;     // runs after the submission, e.g. present
+	};
+
+protected:
 	static constexpr uint8_t FRAME_IN_FLIGHT_COUNT = 3;
+	static constexpr size_t SUBMIT_WORK_CAPACITY = 64;
 
 protected:
 	VkQueue m_vkQueue = VK_NULL_HANDLE;
 	uint32_t m_queueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 	QueueFamilyType m_queueFamilyType = QueueFamilyType::UNSET;
+	SyncMode m_syncMode = SyncMode::FENCE;
+	bool m_deferSubmit = false;
 	uint8_t m_currentFrameIndex = FRAME_IN_FLIGHT_COUNT - 1;
-	std::array<std::array<std::unique_ptr<CommandPool>, THREAD_COUNT>, FRAME_IN_FLIGHT_COUNT> m_commandPools;
-	std::array<std::vector<VkFence>, FRAME_IN_FLIGHT_COUNT> m_frameFences;
+	std::array<std::vector<std::unique_ptr<CommandPool>>, FRAME_IN_FLIGHT_COUNT> m_commandPools; // one pool per task scheduler thread
+	std::array<std::vector<VkFence>, FRAME_IN_FLIGHT_COUNT> m_frameFences;      // fence mode only
+	std::array<uint64_t, FRAME_IN_FLIGHT_COUNT> m_frameTimelineValues{};         // timeline mode only, last value submitted in the frame
 	std::vector<VkCommandBuffer> m_recordedCommandBuffers;
+	std::vector<PendingSubmit> m_pendingSubmits;                                  // submitted but not handed to the driver yet
 	std::unique_ptr<FenceAllocator> m_uptrFenceAllocator;
+	VkSemaphore m_vkTimelineSemaphore = VK_NULL_HANDLE;
+	std::atomic<uint64_t> m_submittedValue{ 0 }; // read by awaiters on worker threads
+	mutable uint64_t m_completedValue = 0; // cached, only grows
+
+	// submit thread, only the pinned task pops. The frame thread, present and graphics pinned
+	// tasks all push, so producers take m_submitPushMutex to stay a single producer to the ring
+	std::unique_ptr<SpscQueue<SubmitWork, SUBMIT_WORK_CAPACITY>> m_uptrSubmitWorks;
+	std::mutex m_submitPushMutex;
+	std::unique_ptr<MySinglThreadTask> m_uptrSubmitTask;
+	std::atomic<uint32_t> m_submitWorkCount{ 0 };
+	std::mutex m_submitErrorMutex;
+	std::exception_ptr m_submitError;
 
 protected:
-	auto _GetCommandPool(uint8_t inFrameIndex, uint8_t inThreadIndex) const->CommandPool*;
-	auto _Init(QueueFamilyType inQueueFamilyType)->void;
+	auto _GetCommandPool(uint8_t inFrameIndex, uint32_t inThreadIndex) const->CommandPool*;
+	auto _Init(QueueFamilyType inQueueFamilyType, SyncMode inSyncMode)->void;
 	auto _Deinit()->void;
-	auto _WaitFrameFences(uint8_t inFrameIndex)->void;
+	auto _WaitFrameSubmissions(uint8_t inFrameIndex)->void;
 	auto _ResetFrameCommandPools(uint8_t inFrameIndex)->void;
 	auto _RecordCommandBuffer(CommandBuffer* inCommandBuffers, size_t inCount)->void;
+	auto _ExecuteSubmitWork(SubmitWork& inoutWork)->void;
+	auto _PushSubmitWork(SubmitWork& inoutWork)->void;
+
+	// Body of the pinned submit task, runs till no work is left
+	auto _DrainSubmitWorks()->void;
+	auto _RethrowSubmitError()->void;
 
 protected:
 	CommandQueue();
@@ -55,31 +112,61 @@ public:
 
 	virtual auto StartFrame()->void;
 	virtual auto Enqueue(CommandBuffer* inCommandBuffers, size_t inCount)->CommandQueue&;
-	virtual auto Submit(SyncInfo inSyncInfo)->void;
+	// Return the timeline value signaled by this submission, 0 in fence mode.
+	// In deferred mode the submission is queued till Flush, unless it signals a binary semaphore
+	virtual auto Submit(SyncInfo inSyncInfo)->uint64_t;
 	virtual auto WaitTillDone()->void;
 
+	// Hand all pending submissions to the driver with one vkQueueSubmit
+	auto Flush()->void;
+
+	// Queue submissions and issue them together on Flush, frame start or a wait
+	auto SetDeferredSubmit(bool inDeferred)->void;
+
+	// Hand submissions and presents to a pinned task on the enki thread, so the
+	// caller returns right after recording. Thread 0 is the main thread and can't be used
+	auto EnableSubmitThread(uint32_t inThreadIndex)->void;
+	auto DisableSubmitThread()->void;
+	auto HasSubmitThread() const->bool { return m_uptrSubmitTask != nullptr; };
+
+	// Run the function in order with the submissions of this queue, on the submit thread if it's enabled
+	auto RunOnSubmitThread(std::function<void()> inFunction)->void;
+
+	// Block till all work handed to the submit thread is done, rethrow its error if any
+	auto WaitSubmitThreadIdle()->void;
+
+	// Timeline mode only
+	auto IsValueDone(uint64_t inValue) const->bool;
+	auto WaitForValue(uint64_t inValue)->void;
+
 	auto GetVkQueue() const->VkQueue { return m_vkQueue; };
 	auto GetQueueFamilyIndex() const->uint32_t { return m_queueFamilyIndex; };
 	auto GetQueueFamilyType() const->QueueFamilyType { return m_queueFamilyType; };
+	auto GetSyncMode() const->SyncMode { return m_syncMode; };
+	auto GetTimelineSemaphore() const->VkSemaphore { return m_vkTimelineSemaphore; };
+	auto GetSubmittedValue() const->uint64_t { return m_submittedValue.load(std::memory_order_acquire); };
 };
 
 class GraphicsQueue final : public CommandQueue
 {
 public:
 	explicit GraphicsQueue();
-	auto Init()->void;
+	~GraphicsQueue();
+	// Also owns the frame arenas, they follow the frames of this queue
+	auto Init(SyncMode inSyncMode = SyncMode::TIMELINE)->void;
+	virtual auto StartFrame()->void override;
 };
 
 class ComputeQueue final : public CommandQueue
 {
 public:
 	explicit ComputeQueue();
-	auto Init()->void;
+	auto Init(SyncMode inSyncMode = SyncMode::TIMELINE)->void;
 };
 
 class TransferQueue final : public CommandQueue
 {
 public:
 	explicit TransferQueue();
-	auto Init()->void;
+	auto Init(SyncMode inSyncMode = SyncMode::TIMELINE)->void;
 };
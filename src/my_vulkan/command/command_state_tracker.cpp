@@ -0,0 +1,316 @@
+#include "command_state_tracker.h"
+#include <cstring>
+#include <mutex>
+
+namespace
+{
+	std::mutex s_totalCountersMutex;
+	CommandStateTracker::Counters s_totalCounters;
+
+	auto _IsSameViewport(const VkViewport& inLeft, const VkViewport& inRight)->bool
+	{
+		return inLeft.x == inRight.x && inLeft.y == inRight.y &&
+			inLeft.width == inRight.width && inLeft.height == inRight.height &&
+			inLeft.minDepth == inRight.minDepth && inLeft.maxDepth == inRight.maxDepth;
+	}
+
+	auto _IsSameScissor(const VkRect2D& inLeft, const VkRect2D& inRight)->bool
+	{
+		return inLeft.offset.x == inRight.offset.x && inLeft.offset.y == inRight.offset.y &&
+			inLeft.extent.width == inRight.extent.width && inLeft.extent.height == inRight.extent.height;
+	}
+}
+
+auto CommandStateTracker::Counters::Add(const Counters& inOther)->void
+{
+	for (size_t i = 0; i < BIND_TYPE_COUNT; ++i)
+	{
+		recorded[i] += inOther.recorded[i];
+		skipped[i] += inOther.skipped[i];
+	}
+}
+
+CommandStateTracker::CommandStateTracker(VkCommandBuffer inVkCommandBuffer)
+	: m_vkCommandBuffer(inVkCommandBuffer)
+{
+	CHECK_TRUE(inVkCommandBuffer != VK_NULL_HANDLE, "Invalid command buffer!");
+}
+
+CommandStateTracker::~CommandStateTracker()
+{
+	std::lock_guard<std::mutex> lock(s_totalCountersMutex);
+	s_totalCounters.Add(m_counters);
+}
+
+auto CommandStateTracker::_GetBindPointState(VkPipelineBindPoint inBindPoint)->BindPointState&
+{
+	switch (inBindPoint)
+	{
+	case VK_PIPELINE_BIND_POINT_GRAPHICS:
+		return m_bindPoints[0];
+	case VK_PIPELINE_BIND_POINT_COMPUTE:
+		return m_bindPoints[1];
+	case VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR:
+		return m_bindPoints[2];
+	default:
+		CHECK_TRUE(false, "Unsupported pipeline bind point!");
+		return m_bindPoints[0];
+	}
+}
+
+auto CommandStateTracker::_Count(BindType inType, bool inSkipped)->void
+{
+	const size_t typeIndex = static_cast<size_t>(inType);
+	if (inSkipped)
+	{
+		++m_counters.skipped[typeIndex];
+	}
+	else
+	{
+		++m_counters.recorded[typeIndex];
+	}
+}
+
+auto CommandStateTracker::BindPipeline(VkPipelineBindPoint inBindPoint, VkPipeline inPipeline)->void
+{
+	BindPointState& bindPointState = _GetBindPointState(inBindPoint);
+	const bool skip = bindPointState.pipeline == inPipeline;
+
+	_Count(BindType::PIPELINE, skip);
+	if (skip)
+	{
+		return;
+	}
+
+	vkCmdBindPipeline(m_vkCommandBuffer, inBindPoint, inPipeline);
+	bindPointState.pipeline = inPipeline;
+}
+
+auto CommandStateTracker::BindDescriptorSets(
+	VkPipelineBindPoint inBindPoint,
+	VkPipelineLayout inLayout,
+	uint32_t inFirstSet,
+	const VkDescriptorSet* inDescriptorSets, uint32_t inDescriptorSetCount,
+	const uint32_t* inDynamicOffsets, uint32_t inDynamicOffsetCount)->void
+{
+	BindPointState& bindPointState = _GetBindPointState(inBindPoint);
+
+	// sets bound with another layout may be disturbed, don't trust them
+	if (bindPointState.descriptorSetLayout != inLayout)
+	{
+		bindPointState.descriptorSets = {};
+		bindPointState.descriptorSetLayout = inLayout;
+	}
+
+	// which dynamic offsets belong to which set depends on the set layouts, record such calls as they are
+	if (inDynamicOffsetCount > 0 && inDescriptorSetCount > 1)
+	{
+		vkCmdBindDescriptorSets(m_vkCommandBuffer, inBindPoint, inLayout, inFirstSet, inDescriptorSetCount, inDescriptorSets, inDynamicOffsetCount, inDynamicOffsets);
+		for (uint32_t i = 0; i < inDescriptorSetCount; ++i)
+		{
+			if (inFirstSet + i < MAX_DESCRIPTOR_SET_COUNT)
+			{
+				bindPointState.descriptorSets[inFirstSet + i] = DescriptorSetState{};
+			}
+			_Count(BindType::DESCRIPTOR_SET, false);
+		}
+		return;
+	}
+
+	// consecutive sets that changed are bound in one call, the dynamic offsets can only belong to a single set
+	uint32_t runStart = 0;
+	bool runOpen = false;
+	auto recordRun = [&](uint32_t inRunEnd)
+		{
+			if (runOpen)
+			{
+				vkCmdBindDescriptorSets(
+					m_vkCommandBuffer, inBindPoint, inLayout,
+					inFirstSet + runStart, inRunEnd - runStart, inDescriptorSets + runStart,
+					inDynamicOffsetCount, inDynamicOffsets);
+				runOpen = false;
+			}
+		};
+
+	for (uint32_t i = 0; i < inDescriptorSetCount; ++i)
+	{
+		const uint32_t setIndex = inFirstSet + i;
+		bool skip = false;
+
+		if (setIndex < MAX_DESCRIPTOR_SET_COUNT)
+		{
+			DescriptorSetState& setState = bindPointState.descriptorSets[setIndex];
+
+			skip = setState.descriptorSet == inDescriptorSets[i] &&
+				setState.dynamicOffsets.size() == inDynamicOffsetCount &&
+				(inDynamicOffsetCount == 0 || std::memcmp(setState.dynamicOffsets.data(), inDynamicOffsets, sizeof(uint32_t) * inDynamicOffsetCount) == 0);
+			if (!skip)
+			{
+				setState.descriptorSet = inDescriptorSets[i];
+				setState.dynamicOffsets.assign(inDynamicOffsets, inDynamicOffsets + inDynamicOffsetCount);
+			}
+		}
+
+		_Count(BindType::DESCRIPTOR_SET, skip);
+		if (skip)
+		{
+			recordRun(i);
+		}
+		else if (!runOpen)
+		{
+			runOpen = true;
+			runStart = i;
+		}
+	}
+	recordRun(inDescriptorSetCount);
+}
+
+auto CommandStateTracker::BindVertexBuffers(uint32_t inFirstBinding, const VkBuffer* inBuffers, const VkDeviceSize* inOffsets, uint32_t inBindingCount)->void
+{
+	const bool canTrack = static_cast<size_t>(inFirstBinding) + inBindingCount <= MAX_VERTEX_BINDING_COUNT;
+	bool skip = canTrack;
+
+	for (uint32_t i = 0; skip && i < inBindingCount; ++i)
+	{
+		const size_t binding = static_cast<size_t>(inFirstBinding) + i;
+		skip = m_vertexBufferValid[binding] && m_vertexBuffers[binding] == inBuffers[i] && m_vertexBufferOffsets[binding] == inOffsets[i];
+	}
+
+	_Count(BindType::VERTEX_BUFFERS, skip);
+	if (skip)
+	{
+		return;
+	}
+
+	vkCmdBindVertexBuffers(m_vkCommandBuffer, inFirstBinding, inBindingCount, inBuffers, inOffsets);
+	for (uint32_t i = 0; i < inBindingCount; ++i)
+	{
+		const size_t binding = static_cast<size_t>(inFirstBinding) + i;
+		if (binding < MAX_VERTEX_BINDING_COUNT)
+		{
+			m_vertexBuffers[binding] = inBuffers[i];
+			m_vertexBufferOffsets[binding] = inOffsets[i];
+			m_vertexBufferValid[binding] = true;
+		}
+	}
+}
+
+auto CommandStateTracker::BindIndexBuffer(VkBuffer inBuffer, VkDeviceSize inOffset, VkIndexType inIndexType)->void
+{
+	const bool skip = m_indexBuffer.buffer == inBuffer && m_indexBuffer.offset == inOffset && m_indexBuffer.indexType == inIndexType;
+
+	_Count(BindType::INDEX_BUFFER, skip);
+	if (skip)
+	{
+		return;
+	}
+
+	vkCmdBindIndexBuffer(m_vkCommandBuffer, inBuffer, inOffset, inIndexType);
+	m_indexBuffer = IndexBufferState{ inBuffer, inOffset, inIndexType };
+}
+
+auto CommandStateTracker::SetViewports(uint32_t inFirstViewport, const VkViewport* inViewports, uint32_t inViewportCount)->void
+{
+	const bool canTrack = static_cast<size_t>(inFirstViewport) + inViewportCount <= MAX_VIEWPORT_COUNT;
+	bool skip = canTrack;
+
+	for (uint32_t i = 0; skip && i < inViewportCount; ++i)
+	{
+		const std::optional<VkViewport>& viewport = m_viewports[inFirstViewport + i];
+		skip = viewport.has_value() && _IsSameViewport(viewport.value(), inViewports[i]);
+	}
+
+	_Count(BindType::VIEWPORT, skip);
+	if (skip)
+	{
+		return;
+	}
+
+	vkCmdSetViewport(m_vkCommandBuffer, inFirstViewport, inViewportCount, inViewports);
+	for (uint32_t i = 0; i < inViewportCount && inFirstViewport + i < MAX_VIEWPORT_COUNT; ++i)
+	{
+		m_viewports[inFirstViewport + i] = inViewports[i];
+	}
+}
+
+auto CommandStateTracker::SetScissors(uint32_t inFirstScissor, const VkRect2D* inScissors, uint32_t inScissorCount)->void
+{
+	const bool canTrack = static_cast<size_t>(inFirstScissor) + inScissorCount <= MAX_VIEWPORT_COUNT;
+	bool skip = canTrack;
+
+	for (uint32_t i = 0; skip && i < inScissorCount; ++i)
+	{
+		const std::optional<VkRect2D>& scissor = m_scissors[inFirstScissor + i];
+		skip = scissor.has_value() && _IsSameScissor(scissor.value(), inScissors[i]);
+	}
+
+	_Count(BindType::SCISSOR, skip);
+	if (skip)
+	{
+		return;
+	}
+
+	vkCmdSetScissor(m_vkCommandBuffer, inFirstScissor, inScissorCount, inScissors);
+	for (uint32_t i = 0; i < inScissorCount && inFirstScissor + i < MAX_VIEWPORT_COUNT; ++i)
+	{
+		m_scissors[inFirstScissor + i] = inScissors[i];
+	}
+}
+
+auto CommandStateTracker::PushConstants(VkPipelineLayout inLayout, VkShaderStageFlags inStages, uint32_t inOffset, uint32_t inSize, const void* inData)->void
+{
+	const bool canTrack = static_cast<size_t>(inOffset) + inSize <= MAX_PUSH_CONSTANT_SIZE;
+	const uint8_t* pBytes = static_cast<const uint8_t*>(inData);
+
+	// push constants are kept across compatible layouts only, be strict and keep them per layout
+	if (m_pushConstantLayout != inLayout)
+	{
+		m_pushConstantValid.reset();
+		m_pushConstantLayout = inLayout;
+	}
+
+	bool skip = canTrack;
+	for (uint32_t i = 0; skip && i < inSize; ++i)
+	{
+		const size_t byteIndex = static_cast<size_t>(inOffset) + i;
+		skip = m_pushConstantValid[byteIndex] && m_pushConstantStages[byteIndex] == inStages && m_pushConstantData[byteIndex] == pBytes[i];
+	}
+
+	_Count(BindType::PUSH_CONSTANTS, skip);
+	if (skip)
+	{
+		return;
+	}
+
+	vkCmdPushConstants(m_vkCommandBuffer, inLayout, inStages, inOffset, inSize, inData);
+	for (uint32_t i = 0; i < inSize && inOffset + i < MAX_PUSH_CONSTANT_SIZE; ++i)
+	{
+		const size_t byteIndex = static_cast<size_t>(inOffset) + i;
+		m_pushConstantData[byteIndex] = pBytes[i];
+		m_pushConstantStages[byteIndex] = inStages;
+		m_pushConstantValid[byteIndex] = true;
+	}
+}
+
+auto CommandStateTracker::Invalidate()->void
+{
+	m_bindPoints = {};
+	m_vertexBufferValid.reset();
+	m_indexBuffer = IndexBufferState{};
+	m_viewports = {};
+	m_scissors = {};
+	m_pushConstantLayout = VK_NULL_HANDLE;
+	m_pushConstantValid.reset();
+}
+
+auto CommandStateTracker::GetTotalCounters()->Counters
+{
+	std::lock_guard<std::mutex> lock(s_totalCountersMutex);
+	return s_totalCounters;
+}
+
+auto CommandStateTracker::ResetTotalCounters()->void
+{
+	std::lock_guard<std::mutex> lock(s_totalCountersMutex);
+	s_totalCounters = Counters{};
+}
@@ -0,0 +1,113 @@
+#pragma once
+#include "common.h"
+#include <bitset>
+
+// Remembers what is bound in one VkCommandBuffer and drops binds that would change nothing.
+// Anything recorded around the tracker must be followed by Invalidate
+class CommandStateTracker final
+{
+public:
+	enum class BindType
+	{
+		PIPELINE,
+		DESCRIPTOR_SET,
+		VERTEX_BUFFERS,
+		INDEX_BUFFER,
+		VIEWPORT,
+		SCISSOR,
+		PUSH_CONSTANTS,
+	};
+
+	static constexpr size_t BIND_TYPE_COUNT = static_cast<size_t>(BindType::PUSH_CONSTANTS) + 1;
+
+	struct Counters
+	{
+		std::array<uint64_t, BIND_TYPE_COUNT> recorded{};
+		std::array<uint64_t, BIND_TYPE_COUNT> skipped{};
+
+		auto Add(const Counters& inOther)->void;
+	};
+
+private:
+	// graphics, compute and ray tracing
+	static constexpr size_t BIND_POINT_COUNT = 3;
+	static constexpr size_t MAX_DESCRIPTOR_SET_COUNT = 8;
+	static constexpr size_t MAX_VERTEX_BINDING_COUNT = 16;
+	static constexpr size_t MAX_VIEWPORT_COUNT = 16;
+	// past it push constants are always recorded
+	static constexpr size_t MAX_PUSH_CONSTANT_SIZE = 256;
+
+	struct DescriptorSetState
+	{
+		VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+		std::vector<uint32_t> dynamicOffsets;
+	};
+
+	struct BindPointState
+	{
+		VkPipeline pipeline = VK_NULL_HANDLE;
+		VkPipelineLayout descriptorSetLayout = VK_NULL_HANDLE; // layout the sets below were bound with
+		std::array<DescriptorSetState, MAX_DESCRIPTOR_SET_COUNT> descriptorSets;
+	};
+
+	struct IndexBufferState
+	{
+		VkBuffer buffer = VK_NULL_HANDLE;
+		VkDeviceSize offset = 0;
+		VkIndexType indexType = VK_INDEX_TYPE_MAX_ENUM;
+	};
+
+	VkCommandBuffer m_vkCommandBuffer = VK_NULL_HANDLE;
+	std::array<BindPointState, BIND_POINT_COUNT> m_bindPoints;
+	std::array<VkBuffer, MAX_VERTEX_BINDING_COUNT> m_vertexBuffers{};
+	std::array<VkDeviceSize, MAX_VERTEX_BINDING_COUNT> m_vertexBufferOffsets{};
+	std::bitset<MAX_VERTEX_BINDING_COUNT> m_vertexBufferValid;
+	IndexBufferState m_indexBuffer;
+	std::array<std::optional<VkViewport>, MAX_VIEWPORT_COUNT> m_viewports;
+	std::array<std::optional<VkRect2D>, MAX_VIEWPORT_COUNT> m_scissors;
+	VkPipelineLayout m_pushConstantLayout = VK_NULL_HANDLE;
+	std::array<uint8_t, MAX_PUSH_CONSTANT_SIZE> m_pushConstantData{};
+	std::array<VkShaderStageFlags, MAX_PUSH_CONSTANT_SIZE> m_pushConstantStages{};
+	std::bitset<MAX_PUSH_CONSTANT_SIZE> m_pushConstantValid;
+	Counters m_counters;
+
+private:
+	auto _GetBindPointState(VkPipelineBindPoint inBindPoint)->BindPointState&;
+	auto _Count(BindType inType, bool inSkipped)->void;
+
+public:
+	explicit CommandStateTracker(VkCommandBuffer inVkCommandBuffer);
+	CommandStateTracker(const CommandStateTracker&) = delete;
+	CommandStateTracker& operator=(const CommandStateTracker&) = delete;
+	// Add the counters to the totals
+	~CommandStateTracker();
+
+	auto BindPipeline(VkPipelineBindPoint inBindPoint, VkPipeline inPipeline)->void;
+
+	auto BindDescriptorSets(
+		VkPipelineBindPoint inBindPoint,
+		VkPipelineLayout inLayout,
+		uint32_t inFirstSet,
+		const VkDescriptorSet* inDescriptorSets, uint32_t inDescriptorSetCount,
+		const uint32_t* inDynamicOffsets, uint32_t inDynamicOffsetCount)->void;
+
+	auto BindVertexBuffers(uint32_t inFirstBinding, const VkBuffer* inBuffers, const VkDeviceSize* inOffsets, uint32_t inBindingCount)->void;
+
+	auto BindIndexBuffer(VkBuffer inBuffer, VkDeviceSize inOffset, VkIndexType inIndexType)->void;
+
+	auto SetViewports(uint32_t inFirstViewport, const VkViewport* inViewports, uint32_t inViewportCount)->void;
+
+	auto SetScissors(uint32_t inFirstScissor, const VkRect2D* inScissors, uint32_t inScissorCount)->void;
+
+	auto PushConstants(VkPipelineLayout inLayout, VkShaderStageFlags inStages, uint32_t inOffset, uint32_t inSize, const void* inData)->void;
+
+	// Forget everything, e.g. after external commands or vkCmdExecuteCommands
+	auto Invalidate()->void;
+
+	auto GetCounters() const->const Counters& { return m_counters; };
+
+	// Counters of all trackers destroyed so far
+	static auto GetTotalCounters()->Counters;
+
+	static auto ResetTotalCounters()->void;
+};
@@ -0,0 +1,1145 @@
+#include "command_stream.h"
+#include "barrier_batcher.h"
+#include "command_cost_model.h"
+#include "command_state_tracker.h"
+#include "frame_arena.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include <unordered_map>
+
+namespace
+{
+	constexpr size_t WORD_SIZE = sizeof(uint64_t);
+
+	struct _PipelineBarrierPayload
+	{
+		VkPipelineStageFlags srcStageMask;
+		VkPipelineStageFlags dstStageMask;
+		VkDependencyFlags flags;
+		uint32_t memoryBarrierCount;
+		uint32_t bufferBarrierCount;
+		uint32_t imageBarrierCount;
+	};
+
+	struct _ClearColorImagePayload
+	{
+		VkImage image;
+		VkImageLayout imageLayout;
+		VkClearColorValue clearColor;
+		uint32_t rangeCount;
+	};
+
+	struct _FillBufferPayload
+	{
+		VkBuffer buffer;
+		VkDeviceSize offset;
+		VkDeviceSize size;
+		uint32_t value;
+	};
+
+	struct _BlitImagePayload
+	{
+		VkImage srcImage;
+		VkImage dstImage;
+		VkImageLayout srcLayout;
+		VkImageLayout dstLayout;
+		VkFilter filter;
+		uint32_t regionCount;
+	};
+
+	struct _CopyBufferToImagePayload
+	{
+		VkBuffer srcBuffer;
+		VkImage dstImage;
+		VkImageLayout dstLayout;
+		uint32_t regionCount;
+	};
+
+	struct _CopyBufferPayload
+	{
+		VkBuffer srcBuffer;
+		VkBuffer dstBuffer;
+		uint32_t regionCount;
+	};
+
+	// followed by each build info with its geometries and ranges
+	struct _BuildAccelerationStructuresPayload
+	{
+		uint32_t infoCount;
+	};
+
+	struct _WriteAccelerationStructuresPropertiesPayload
+	{
+		VkQueryPool queryPool;
+		VkQueryType queryType;
+		uint32_t firstQuery;
+		uint32_t accelerationStructureCount;
+	};
+
+	struct _CopyAccelerationStructurePayload
+	{
+		VkAccelerationStructureKHR src;
+		VkAccelerationStructureKHR dst;
+		VkCopyAccelerationStructureModeKHR mode;
+	};
+
+	struct _ExecuteCommandsPayload
+	{
+		uint32_t commandBufferCount;
+	};
+
+	struct _BindPipelinePayload
+	{
+		VkPipeline pipeline;
+		VkPipelineBindPoint bindPoint;
+	};
+
+	// followed by the sets and the dynamic offsets
+	struct _BindDescriptorSetsPayload
+	{
+		VkPipelineLayout layout;
+		VkPipelineBindPoint bindPoint;
+		uint32_t firstSet;
+		uint32_t descriptorSetCount;
+		uint32_t dynamicOffsetCount;
+	};
+
+	// followed by the buffers and the offsets
+	struct _BindVertexBuffersPayload
+	{
+		uint32_t firstBinding;
+		uint32_t bindingCount;
+	};
+
+	struct _BindIndexBufferPayload
+	{
+		VkBuffer buffer;
+		VkDeviceSize offset;
+		VkIndexType indexType;
+	};
+
+	// viewports and scissors
+	struct _SetViewportStatePayload
+	{
+		uint32_t first;
+		uint32_t count;
+	};
+
+	// followed by the bytes
+	struct _PushConstantsPayload
+	{
+		VkPipelineLayout layout;
+		VkShaderStageFlags stages;
+		uint32_t offset;
+		uint32_t size;
+	};
+
+	struct _DrawPayload
+	{
+		uint32_t vertexCount;
+		uint32_t instanceCount;
+		uint32_t firstVertex;
+		uint32_t firstInstance;
+	};
+
+	struct _DrawIndexedPayload
+	{
+		uint32_t indexCount;
+		uint32_t instanceCount;
+		uint32_t firstIndex;
+		int32_t vertexOffset;
+		uint32_t firstInstance;
+	};
+
+	struct _DispatchPayload
+	{
+		uint32_t groupCountX;
+		uint32_t groupCountY;
+		uint32_t groupCountZ;
+	};
+
+	struct _ExternalPayload
+	{
+		uint32_t recordIndex;
+		float estimatedCost; // 0 to use the cost model
+	};
+
+	constexpr auto _PaddedSize(size_t inSize)->size_t
+	{
+		return (inSize + WORD_SIZE - 1) / WORD_SIZE * WORD_SIZE;
+	}
+
+	template<typename T>
+	constexpr auto _PaddedArraySize(size_t inCount)->size_t
+	{
+		return _PaddedSize(sizeof(T) * inCount);
+	}
+
+	// Copy values into the stream, every value or array starts on a word
+	class _PayloadWriter final
+	{
+	private:
+		std::byte* m_pCursor = nullptr;
+
+	public:
+		explicit _PayloadWriter(std::byte* inPayload) : m_pCursor(inPayload) {};
+
+		template<typename T>
+		auto Write(const T& inValue)->void
+		{
+			Write(&inValue, 1);
+		}
+
+		template<typename T>
+		auto Write(const T* inValues, size_t inCount)->void
+		{
+			static_assert(std::is_trivially_copyable_v<T>);
+			static_assert(alignof(T) <= WORD_SIZE);
+
+			if (inCount > 0)
+			{
+				std::memcpy(m_pCursor, inValues, sizeof(T) * inCount);
+			}
+			m_pCursor += _PaddedArraySize<T>(inCount);
+		}
+
+		// Leave the values zero, the stream is zero filled when a command is appended
+		template<typename T>
+		auto Skip(size_t inCount)->void
+		{
+			m_pCursor += _PaddedArraySize<T>(inCount);
+		}
+	};
+
+	// Walk the values in the order they were written
+	class _PayloadReader final
+	{
+	private:
+		const std::byte* m_pCursor = nullptr;
+
+	public:
+		explicit _PayloadReader(const std::byte* inPayload) : m_pCursor(inPayload) {};
+
+		template<typename T>
+		auto Read()->const T&
+		{
+			return *Read<T>(1);
+		}
+
+		template<typename T>
+		auto Read(size_t inCount)->const T*
+		{
+			const T* pResult = std::launder(reinterpret_cast<const T*>(m_pCursor));
+			m_pCursor += _PaddedArraySize<T>(inCount);
+			return inCount > 0 ? pResult : nullptr;
+		}
+	};
+
+	// Key of one piece of bound state: a pipeline, a descriptor set, a vertex binding, a viewport, 4 bytes of push constants...
+	auto _MakeStateSlot(CommandStream::CommandType inType, VkPipelineBindPoint inBindPoint, uint32_t inIndex)->uint64_t
+	{
+		uint64_t bindPointIndex = 0;
+		switch (inBindPoint)
+		{
+		case VK_PIPELINE_BIND_POINT_GRAPHICS:
+			bindPointIndex = 0;
+			break;
+		case VK_PIPELINE_BIND_POINT_COMPUTE:
+			bindPointIndex = 1;
+			break;
+		case VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR:
+			bindPointIndex = 2;
+			break;
+		default:
+			bindPointIndex = 3;
+			break;
+		}
+
+		return (static_cast<uint64_t>(inType) << 40) | (bindPointIndex << 32) | inIndex;
+	}
+}
+
+CommandStream::CommandStream(std::pmr::memory_resource* inMemoryResource)
+	: m_words(inMemoryResource), m_externalRecords(inMemoryResource)
+{
+}
+
+CommandStream::CommandStream(const CommandStream& inOther, std::pmr::memory_resource* inMemoryResource)
+	: m_words(inOther.m_words, inMemoryResource),
+	m_externalRecords(inOther.m_externalRecords, inMemoryResource),
+	m_commandCount(inOther.m_commandCount),
+	m_estimatedCost(inOther.m_estimatedCost)
+{
+}
+
+auto CommandStream::_AppendCommand(CommandType inType, size_t inPayloadSize, std::optional<float> inEstimatedCost)->std::byte*
+{
+	const size_t payloadWordCount = _PaddedSize(inPayloadSize) / WORD_SIZE;
+	const size_t headerIndex = m_words.size();
+	const Header header{ inType, static_cast<uint32_t>(payloadWordCount + 1) };
+
+	CHECK_TRUE(payloadWordCount < UINT32_MAX, "Command is too large!");
+
+	m_words.resize(headerIndex + header.wordCount);
+	std::memcpy(&m_words[headerIndex], &header, sizeof(Header));
+	++m_commandCount;
+	m_estimatedCost += inEstimatedCost.has_value() ? inEstimatedCost.value() : CommandCostModel::GetInstance().GetCost(inType);
+
+	return reinterpret_cast<std::byte*>(&m_words[headerIndex + 1]);
+}
+
+auto CommandStream::_GetCommandCost(const Header& inHeader, size_t inWordIndex) const->float
+{
+	if (inHeader.type == CommandType::EXTERNAL)
+	{
+		_ExternalPayload payload{};
+
+		std::memcpy(&payload, &m_words[inWordIndex + 1], sizeof(_ExternalPayload));
+		if (payload.estimatedCost > 0.0f)
+		{
+			return payload.estimatedCost;
+		}
+	}
+
+	return CommandCostModel::GetInstance().GetCost(inHeader.type);
+}
+
+auto CommandStream::_GetBoundStateSlots(const Header& inHeader, size_t inWordIndex, std::pmr::vector<uint64_t>& outSlots) const->void
+{
+	_PayloadReader reader(reinterpret_cast<const std::byte*>(&m_words[inWordIndex + 1]));
+	switch (inHeader.type)
+	{
+	case CommandType::BIND_PIPELINE:
+	{
+		const auto& payload = reader.Read<_BindPipelinePayload>();
+
+		outSlots.push_back(_MakeStateSlot(inHeader.type, payload.bindPoint, 0));
+		break;
+	}
+	case CommandType::BIND_DESCRIPTOR_SETS:
+	{
+		const auto& payload = reader.Read<_BindDescriptorSetsPayload>();
+
+		for (uint32_t i = 0; i < payload.descriptorSetCount; ++i)
+		{
+			outSlots.push_back(_MakeStateSlot(inHeader.type, payload.bindPoint, payload.firstSet + i));
+		}
+		break;
+	}
+	case CommandType::BIND_VERTEX_BUFFERS:
+	{
+		const auto& payload = reader.Read<_BindVertexBuffersPayload>();
+
+		for (uint32_t i = 0; i < payload.bindingCount; ++i)
+		{
+			outSlots.push_back(_MakeStateSlot(inHeader.type, VK_PIPELINE_BIND_POINT_GRAPHICS, payload.firstBinding + i));
+		}
+		break;
+	}
+	case CommandType::BIND_INDEX_BUFFER:
+	{
+		outSlots.push_back(_MakeStateSlot(inHeader.type, VK_PIPELINE_BIND_POINT_GRAPHICS, 0));
+		break;
+	}
+	case CommandType::SET_VIEWPORT:
+	case CommandType::SET_SCISSOR:
+	{
+		const auto& payload = reader.Read<_SetViewportStatePayload>();
+
+		for (uint32_t i = 0; i < payload.count; ++i)
+		{
+			outSlots.push_back(_MakeStateSlot(inHeader.type, VK_PIPELINE_BIND_POINT_GRAPHICS, payload.first + i));
+		}
+		break;
+	}
+	case CommandType::PUSH_CONSTANTS:
+	{
+		const auto& payload = reader.Read<_PushConstantsPayload>();
+
+		// offsets and sizes are multiples of 4
+		for (uint32_t offset = payload.offset; offset < payload.offset + payload.size; offset += 4)
+		{
+			outSlots.push_back(_MakeStateSlot(inHeader.type, VK_PIPELINE_BIND_POINT_GRAPHICS, offset / 4));
+		}
+		break;
+	}
+	default:
+		break;
+	}
+}
+
+auto CommandStream::_RecordCommand(
+	VkCommandBuffer inVkCommandBuffer,
+	const Header& inHeader,
+	size_t inWordIndex,
+	CommandStateTracker& inoutTracker,
+	BarrierBatcher& inoutBarrierBatcher) const->bool
+{
+	bool isSample = true;
+
+	_PayloadReader reader(reinterpret_cast<const std::byte*>(&m_words[inWordIndex + 1]));
+	switch (inHeader.type)
+	{
+	case CommandType::PIPELINE_BARRIER:
+	{
+		const auto& payload = reader.Read<_PipelineBarrierPayload>();
+		const VkMemoryBarrier* pMemoryBarriers = reader.Read<VkMemoryBarrier>(payload.memoryBarrierCount);
+		const VkBufferMemoryBarrier* pBufferBarriers = reader.Read<VkBufferMemoryBarrier>(payload.bufferBarrierCount);
+		const VkImageMemoryBarrier* pImageBarriers = reader.Read<VkImageMemoryBarrier>(payload.imageBarrierCount);
+
+		inoutBarrierBatcher.PipelineBarrier(
+			payload.srcStageMask,
+			payload.dstStageMask,
+			payload.flags,
+			pMemoryBarriers, payload.memoryBarrierCount,
+			pBufferBarriers, payload.bufferBarrierCount,
+			pImageBarriers, payload.imageBarrierCount);
+		// the call is made when the batch is flushed, timing it here would teach the cost model nothing
+		isSample = false;
+		break;
+	}
+	case CommandType::CLEAR_COLOR_IMAGE:
+	{
+		const auto& payload = reader.Read<_ClearColorImagePayload>();
+		const VkImageSubresourceRange* pRanges = reader.Read<VkImageSubresourceRange>(payload.rangeCount);
+
+		vkCmdClearColorImage(inVkCommandBuffer, payload.image, payload.imageLayout, &payload.clearColor, payload.rangeCount, pRanges);
+		break;
+	}
+	case CommandType::FILL_BUFFER:
+	{
+		const auto& payload = reader.Read<_FillBufferPayload>();
+
+		vkCmdFillBuffer(inVkCommandBuffer, payload.buffer, payload.offset, payload.size, payload.value);
+		break;
+	}
+	case CommandType::BLIT_IMAGE:
+	{
+		const auto& payload = reader.Read<_BlitImagePayload>();
+		const VkImageBlit* pRegions = reader.Read<VkImageBlit>(payload.regionCount);
+
+		vkCmdBlitImage(inVkCommandBuffer, payload.srcImage, payload.srcLayout, payload.dstImage, payload.dstLayout, payload.regionCount, pRegions, payload.filter);
+		break;
+	}
+	case CommandType::COPY_BUFFER_TO_IMAGE:
+	{
+		const auto& payload = reader.Read<_CopyBufferToImagePayload>();
+		const VkBufferImageCopy* pRegions = reader.Read<VkBufferImageCopy>(payload.regionCount);
+
+		vkCmdCopyBufferToImage(inVkCommandBuffer, payload.srcBuffer, payload.dstImage, payload.dstLayout, payload.regionCount, pRegions);
+		break;
+	}
+	case CommandType::COPY_BUFFER:
+	{
+		const auto& payload = reader.Read<_CopyBufferPayload>();
+		const VkBufferCopy* pRegions = reader.Read<VkBufferCopy>(payload.regionCount);
+
+		vkCmdCopyBuffer(inVkCommandBuffer, payload.srcBuffer, payload.dstBuffer, payload.regionCount, pRegions);
+		break;
+	}
+	case CommandType::BUILD_ACCELERATION_STRUCTURES:
+	{
+		const auto& payload = reader.Read<_BuildAccelerationStructuresPayload>();
+		std::pmr::memory_resource* pFrameResource = FrameArenaPool::GetInstance().GetThreadResource();
+		FrameVector<VkAccelerationStructureBuildGeometryInfoKHR> buildInfos(pFrameResource);
+		FrameVector<const VkAccelerationStructureBuildRangeInfoKHR*> buildRanges(pFrameResource);
+
+		buildInfos.reserve(payload.infoCount);
+		buildRanges.reserve(payload.infoCount);
+		for (uint32_t i = 0; i < payload.infoCount; ++i)
+		{
+			VkAccelerationStructureBuildGeometryInfoKHR& buildInfo = buildInfos.emplace_back(reader.Read<VkAccelerationStructureBuildGeometryInfoKHR>());
+
+			buildInfo.pGeometries = reader.Read<VkAccelerationStructureGeometryKHR>(buildInfo.geometryCount);
+			buildRanges.push_back(reader.Read<VkAccelerationStructureBuildRangeInfoKHR>(buildInfo.geometryCount));
+		}
+
+		vkCmdBuildAccelerationStructuresKHR(inVkCommandBuffer, payload.infoCount, buildInfos.data(), buildRanges.data());
+		break;
+	}
+	case CommandType::WRITE_ACCELERATION_STRUCTURES_PROPERTIES:
+	{
+		const auto& payload = reader.Read<_WriteAccelerationStructuresPropertiesPayload>();
+		const VkAccelerationStructureKHR* pAccelerationStructures = reader.Read<VkAccelerationStructureKHR>(payload.accelerationStructureCount);
+
+		vkCmdWriteAccelerationStructuresPropertiesKHR(
+			inVkCommandBuffer,
+			payload.accelerationStructureCount, pAccelerationStructures,
+			payload.queryType,
+			payload.queryPool,
+			payload.firstQuery);
+		break;
+	}
+	case CommandType::COPY_ACCELERATION_STRUCTURE:
+	{
+		const auto& payload = reader.Read<_CopyAccelerationStructurePayload>();
+		VkCopyAccelerationStructureInfoKHR copyInfo{ VK_STRUCTURE_TYPE_COPY_ACCELERATION_STRUCTURE_INFO_KHR };
+
+		copyInfo.src = payload.src;
+		copyInfo.dst = payload.dst;
+		copyInfo.mode = payload.mode;
+		vkCmdCopyAccelerationStructureKHR(inVkCommandBuffer, &copyInfo);
+		break;
+	}
+	case CommandType::EXECUTE_COMMANDS:
+	{
+		const auto& payload = reader.Read<_ExecuteCommandsPayload>();
+		const VkCommandBuffer* pCommandBuffers = reader.Read<VkCommandBuffer>(payload.commandBufferCount);
+
+		vkCmdExecuteCommands(inVkCommandBuffer, payload.commandBufferCount, pCommandBuffers);
+		// the state is undefined after secondary command buffers
+		inoutTracker.Invalidate();
+		break;
+	}
+	case CommandType::BIND_PIPELINE:
+	{
+		const auto& payload = reader.Read<_BindPipelinePayload>();
+
+		inoutTracker.BindPipeline(payload.bindPoint, payload.pipeline);
+		break;
+	}
+	case CommandType::BIND_DESCRIPTOR_SETS:
+	{
+		const auto& payload = reader.Read<_BindDescriptorSetsPayload>();
+		const VkDescriptorSet* pDescriptorSets = reader.Read<VkDescriptorSet>(payload.descriptorSetCount);
+		const uint32_t* pDynamicOffsets = reader.Read<uint32_t>(payload.dynamicOffsetCount);
+
+		inoutTracker.BindDescriptorSets(
+			payload.bindPoint,
+			payload.layout,
+			payload.firstSet,
+			pDescriptorSets, payload.descriptorSetCount,
+			pDynamicOffsets, payload.dynamicOffsetCount);
+		break;
+	}
+	case CommandType::BIND_VERTEX_BUFFERS:
+	{
+		const auto& payload = reader.Read<_BindVertexBuffersPayload>();
+		const VkBuffer* pBuffers = reader.Read<VkBuffer>(payload.bindingCount);
+		const VkDeviceSize* pOffsets = reader.Read<VkDeviceSize>(payload.bindingCount);
+
+		inoutTracker.BindVertexBuffers(payload.firstBinding, pBuffers, pOffsets, payload.bindingCount);
+		break;
+	}
+	case CommandType::BIND_INDEX_BUFFER:
+	{
+		const auto& payload = reader.Read<_BindIndexBufferPayload>();
+
+		inoutTracker.BindIndexBuffer(payload.buffer, payload.offset, payload.indexType);
+		break;
+	}
+	case CommandType::SET_VIEWPORT:
+	{
+		const auto& payload = reader.Read<_SetViewportStatePayload>();
+		const VkViewport* pViewports = reader.Read<VkViewport>(payload.count);
+
+		inoutTracker.SetViewports(payload.first, pViewports, payload.count);
+		break;
+	}
+	case CommandType::SET_SCISSOR:
+	{
+		const auto& payload = reader.Read<_SetViewportStatePayload>();
+		const VkRect2D* pScissors = reader.Read<VkRect2D>(payload.count);
+
+		inoutTracker.SetScissors(payload.first, pScissors, payload.count);
+		break;
+	}
+	case CommandType::PUSH_CONSTANTS:
+	{
+		const auto& payload = reader.Read<_PushConstantsPayload>();
+		const uint8_t* pData = reader.Read<uint8_t>(payload.size);
+
+		inoutTracker.PushConstants(payload.layout, payload.stages, payload.offset, payload.size, pData);
+		break;
+	}
+	case CommandType::DRAW:
+	{
+		const auto& payload = reader.Read<_DrawPayload>();
+
+		vkCmdDraw(inVkCommandBuffer, payload.vertexCount, payload.instanceCount, payload.firstVertex, payload.firstInstance);
+		break;
+	}
+	case CommandType::DRAW_INDEXED:
+	{
+		const auto& payload = reader.Read<_DrawIndexedPayload>();
+
+		vkCmdDrawIndexed(inVkCommandBuffer, payload.indexCount, payload.instanceCount, payload.firstIndex, payload.vertexOffset, payload.firstInstance);
+		break;
+	}
+	case CommandType::DISPATCH:
+	{
+		const auto& payload = reader.Read<_DispatchPayload>();
+
+		vkCmdDispatch(inVkCommandBuffer, payload.groupCountX, payload.groupCountY, payload.groupCountZ);
+		break;
+	}
+	case CommandType::EXTERNAL:
+	{
+		const auto& payload = reader.Read<_ExternalPayload>();
+
+		CHECK_TRUE(payload.recordIndex < m_externalRecords.size(), "Corrupted command stream!");
+		m_externalRecords[payload.recordIndex](inVkCommandBuffer);
+		inoutTracker.Invalidate();
+		// a caller given cost says nothing about other external commands
+		isSample = payload.estimatedCost <= 0.0f;
+		break;
+	}
+	default:
+		CHECK_TRUE(false, "Unsupported command type!");
+		break;
+	}
+
+	return isSample;
+}
+
+auto CommandStream::PipelineBarrier(
+	VkPipelineStageFlags inSrcStageMask,
+	VkPipelineStageFlags inDstStageMask,
+	VkDependencyFlags inFlags,
+	const VkMemoryBarrier* inMemoryBarriers, uint32_t inMemoryBarrierCount,
+	const VkBufferMemoryBarrier* inBufferBarriers, uint32_t inBufferBarrierCount,
+	const VkImageMemoryBarrier* inImageBarriers, uint32_t inImageBarrierCount)->CommandStream&
+{
+	if (inMemoryBarrierCount == 0 && inBufferBarrierCount == 0 && inImageBarrierCount == 0)
+	{
+		return *this;
+	}
+
+	CHECK_TRUE(inSrcStageMask != 0, "Invalid source pipeline stage mask!");
+	CHECK_TRUE(inDstStageMask != 0, "Invalid destination pipeline stage mask!");
+
+	const size_t payloadSize =
+		_PaddedSize(sizeof(_PipelineBarrierPayload)) +
+		_PaddedArraySize<VkMemoryBarrier>(inMemoryBarrierCount) +
+		_PaddedArraySize<VkBufferMemoryBarrier>(inBufferBarrierCount) +
+		_PaddedArraySize<VkImageMemoryBarrier>(inImageBarrierCount);
+	_PayloadWriter writer(_AppendCommand(CommandType::PIPELINE_BARRIER, payloadSize));
+
+	writer.Write(_PipelineBarrierPayload{ inSrcStageMask, inDstStageMask, inFlags, inMemoryBarrierCount, inBufferBarrierCount, inImageBarrierCount });
+	writer.Write(inMemoryBarriers, inMemoryBarrierCount);
+	writer.Write(inBufferBarriers, inBufferBarrierCount);
+	writer.Write(inImageBarriers, inImageBarrierCount);
+
+	return *this;
+}
+
+auto CommandStream::ClearColorImage(
+	VkImage inImage,
+	VkImageLayout inImageLayout,
+	const VkClearColorValue& inClearColor,
+	const VkImageSubresourceRange* inRanges, uint32_t inRangeCount)->CommandStream&
+{
+	CHECK_TRUE(inImage != VK_NULL_HANDLE, "Invalid image!");
+	CHECK_TRUE(inRangeCount > 0, "No image subresource ranges!");
+
+	const size_t payloadSize =
+		_PaddedSize(sizeof(_ClearColorImagePayload)) +
+		_PaddedArraySize<VkImageSubresourceRange>(inRangeCount);
+	_PayloadWriter writer(_AppendCommand(CommandType::CLEAR_COLOR_IMAGE, payloadSize));
+
+	writer.Write(_ClearColorImagePayload{ inImage, inImageLayout, inClearColor, inRangeCount });
+	writer.Write(inRanges, inRangeCount);
+
+	return *this;
+}
+
+auto CommandStream::FillBuffer(VkBuffer inBuffer, VkDeviceSize inOffset, VkDeviceSize inSize, uint32_t inValue)->CommandStream&
+{
+	CHECK_TRUE(inBuffer != VK_NULL_HANDLE, "Invalid buffer!");
+
+	_PayloadWriter writer(_AppendCommand(CommandType::FILL_BUFFER, sizeof(_FillBufferPayload)));
+
+	writer.Write(_FillBufferPayload{ inBuffer, inOffset, inSize, inValue });
+
+	return *this;
+}
+
+auto CommandStream::BlitImage(
+	VkImage inSrcImage, VkImageLayout inSrcLayout,
+	VkImage inDstImage, VkImageLayout inDstLayout,
+	const VkImageBlit* inRegions, uint32_t inRegionCount,
+	VkFilter inFilter)->CommandStream&
+{
+	CHECK_TRUE(inSrcImage != VK_NULL_HANDLE, "Invalid source image!");
+	CHECK_TRUE(inDstImage != VK_NULL_HANDLE, "Invalid destination image!");
+	CHECK_TRUE(inRegionCount > 0, "No blit regions!");
+
+	const size_t payloadSize =
+		_PaddedSize(sizeof(_BlitImagePayload)) +
+		_PaddedArraySize<VkImageBlit>(inRegionCount);
+	_PayloadWriter writer(_AppendCommand(CommandType::BLIT_IMAGE, payloadSize));
+
+	writer.Write(_BlitImagePayload{ inSrcImage, inDstImage, inSrcLayout, inDstLayout, inFilter, inRegionCount });
+	writer.Write(inRegions, inRegionCount);
+
+	return *this;
+}
+
+auto CommandStream::CopyBufferToImage(
+	VkBuffer inSrcBuffer,
+	VkImage inDstImage, VkImageLayout inDstLayout,
+	const VkBufferImageCopy* inRegions, uint32_t inRegionCount)->CommandStream&
+{
+	CHECK_TRUE(inSrcBuffer != VK_NULL_HANDLE, "Invalid source buffer!");
+	CHECK_TRUE(inDstImage != VK_NULL_HANDLE, "Invalid destination image!");
+	CHECK_TRUE(inRegionCount > 0, "No copy regions!");
+
+	const size_t payloadSize =
+		_PaddedSize(sizeof(_CopyBufferToImagePayload)) +
+		_PaddedArraySize<VkBufferImageCopy>(inRegionCount);
+	_PayloadWriter writer(_AppendCommand(CommandType::COPY_BUFFER_TO_IMAGE, payloadSize));
+
+	writer.Write(_CopyBufferToImagePayload{ inSrcBuffer, inDstImage, inDstLayout, inRegionCount });
+	writer.Write(inRegions, inRegionCount);
+
+	return *this;
+}
+
+auto CommandStream::CopyBuffer(VkBuffer inSrcBuffer, VkBuffer inDstBuffer, const VkBufferCopy* inRegions, uint32_t inRegionCount)->CommandStream&
+{
+	CHECK_TRUE(inSrcBuffer != VK_NULL_HANDLE, "Invalid source buffer!");
+	CHECK_TRUE(inDstBuffer != VK_NULL_HANDLE, "Invalid destination buffer!");
+	CHECK_TRUE(inRegionCount > 0, "No copy regions!");
+
+	const size_t payloadSize =
+		_PaddedSize(sizeof(_CopyBufferPayload)) +
+		_PaddedArraySize<VkBufferCopy>(inRegionCount);
+	_PayloadWriter writer(_AppendCommand(CommandType::COPY_BUFFER, payloadSize));
+
+	writer.Write(_CopyBufferPayload{ inSrcBuffer, inDstBuffer, inRegionCount });
+	writer.Write(inRegions, inRegionCount);
+
+	return *this;
+}
+
+auto CommandStream::BuildAccelerationStructures(
+	const VkAccelerationStructureBuildGeometryInfoKHR* inBuildInfos,
+	const VkAccelerationStructureBuildRangeInfoKHR* const* inBuildRanges,
+	uint32_t inInfoCount)->CommandStream&
+{
+	CHECK_TRUE(inInfoCount > 0, "No acceleration structure build infos!");
+	CHECK_TRUE(inBuildInfos != nullptr && inBuildRanges != nullptr, "Invalid acceleration structure build input!");
+
+	size_t payloadSize = _PaddedSize(sizeof(_BuildAccelerationStructuresPayload));
+	for (uint32_t i = 0; i < inInfoCount; ++i)
+	{
+		const VkAccelerationStructureBuildGeometryInfoKHR& buildInfo = inBuildInfos[i];
+
+		CHECK_TRUE(buildInfo.ppGeometries == nullptr, "ppGeometries is not supported, use pGeometries!");
+		payloadSize +=
+			_PaddedSize(sizeof(VkAccelerationStructureBuildGeometryInfoKHR)) +
+			_PaddedArraySize<VkAccelerationStructureGeometryKHR>(buildInfo.geometryCount) +
+			_PaddedArraySize<VkAccelerationStructureBuildRangeInfoKHR>(buildInfo.geometryCount);
+	}
+	_PayloadWriter writer(_AppendCommand(CommandType::BUILD_ACCELERATION_STRUCTURES, payloadSize));
+
+	writer.Write(_BuildAccelerationStructuresPayload{ inInfoCount });
+	for (uint32_t i = 0; i < inInfoCount; ++i)
+	{
+		const VkAccelerationStructureBuildGeometryInfoKHR& buildInfo = inBuildInfos[i];
+
+		// pGeometries is patched to the copy in the stream when recorded
+		writer.Write(buildInfo);
+		writer.Write(buildInfo.pGeometries, buildInfo.geometryCount);
+		writer.Write(inBuildRanges[i], buildInfo.geometryCount);
+	}
+
+	return *this;
+}
+
+auto CommandStream::WriteAccelerationStructuresProperties(
+	const VkAccelerationStructureKHR* inAccelerationStructures, uint32_t inCount,
+	VkQueryType inQueryType,
+	VkQueryPool inQueryPool,
+	uint32_t inFirstQuery)->CommandStream&
+{
+	CHECK_TRUE(inCount > 0, "No acceleration structures!");
+	CHECK_TRUE(inQueryPool != VK_NULL_HANDLE, "Invalid query pool!");
+
+	const size_t payloadSize =
+		_PaddedSize(sizeof(_WriteAccelerationStructuresPropertiesPayload)) +
+		_PaddedArraySize<VkAccelerationStructureKHR>(inCount);
+	_PayloadWriter writer(_AppendCommand(CommandType::WRITE_ACCELERATION_STRUCTURES_PROPERTIES, payloadSize));
+
+	writer.Write(_WriteAccelerationStructuresPropertiesPayload{ inQueryPool, inQueryType, inFirstQuery, inCount });
+	writer.Write(inAccelerationStructures, inCount);
+
+	return *this;
+}
+
+auto CommandStream::CopyAccelerationStructure(
+	VkAccelerationStructureKHR inSrc,
+	VkAccelerationStructureKHR inDst,
+	VkCopyAccelerationStructureModeKHR inMode)->CommandStream&
+{
+	CHECK_TRUE(inSrc != VK_NULL_HANDLE, "Invalid source acceleration structure!");
+	CHECK_TRUE(inDst != VK_NULL_HANDLE, "Invalid destination acceleration structure!");
+
+	_PayloadWriter writer(_AppendCommand(CommandType::COPY_ACCELERATION_STRUCTURE, sizeof(_CopyAccelerationStructurePayload)));
+
+	writer.Write(_CopyAccelerationStructurePayload{ inSrc, inDst, inMode });
+
+	return *this;
+}
+
+auto CommandStream::ExecuteCommands(const VkCommandBuffer* inCommandBuffers, uint32_t inCount)->CommandStream&
+{
+	CHECK_TRUE(inCount > 0, "No command buffers to execute!");
+
+	const size_t payloadSize =
+		_PaddedSize(sizeof(_ExecuteCommandsPayload)) +
+		_PaddedArraySize<VkCommandBuffer>(inCount);
+	_PayloadWriter writer(_AppendCommand(CommandType::EXECUTE_COMMANDS, payloadSize));
+
+	writer.Write(_ExecuteCommandsPayload{ inCount });
+	writer.Write(inCommandBuffers, inCount);
+
+	return *this;
+}
+
+auto CommandStream::BindPipeline(VkPipelineBindPoint inBindPoint, VkPipeline inPipeline)->CommandStream&
+{
+	CHECK_TRUE(inPipeline != VK_NULL_HANDLE, "Invalid pipeline!");
+
+	_PayloadWriter writer(_AppendCommand(CommandType::BIND_PIPELINE, sizeof(_BindPipelinePayload)));
+
+	writer.Write(_BindPipelinePayload{ inPipeline, inBindPoint });
+
+	return *this;
+}
+
+auto CommandStream::BindDescriptorSets(
+	VkPipelineBindPoint inBindPoint,
+	VkPipelineLayout inLayout,
+	uint32_t inFirstSet,
+	const VkDescriptorSet* inDescriptorSets, uint32_t inDescriptorSetCount,
+	const uint32_t* inDynamicOffsets, uint32_t inDynamicOffsetCount)->CommandStream&
+{
+	CHECK_TRUE(inLayout != VK_NULL_HANDLE, "Invalid pipeline layout!");
+	CHECK_TRUE(inDescriptorSets != nullptr && inDescriptorSetCount > 0, "No descriptor sets!");
+	CHECK_TRUE(inDynamicOffsets != nullptr || inDynamicOffsetCount == 0, "No dynamic offsets!");
+
+	const size_t payloadSize =
+		_PaddedSize(sizeof(_BindDescriptorSetsPayload)) +
+		_PaddedArraySize<VkDescriptorSet>(inDescriptorSetCount) +
+		_PaddedArraySize<uint32_t>(inDynamicOffsetCount);
+	_PayloadWriter writer(_AppendCommand(CommandType::BIND_DESCRIPTOR_SETS, payloadSize));
+
+	writer.Write(_BindDescriptorSetsPayload{ inLayout, inBindPoint, inFirstSet, inDescriptorSetCount, inDynamicOffsetCount });
+	writer.Write(inDescriptorSets, inDescriptorSetCount);
+	writer.Write(inDynamicOffsets, inDynamicOffsetCount);
+
+	return *this;
+}
+
+auto CommandStream::BindVertexBuffers(uint32_t inFirstBinding, const VkBuffer* inBuffers, const VkDeviceSize* inOffsets, uint32_t inBindingCount)->CommandStream&
+{
+	CHECK_TRUE(inBuffers != nullptr && inBindingCount > 0, "No vertex buffers!");
+
+	const size_t payloadSize =
+		_PaddedSize(sizeof(_BindVertexBuffersPayload)) +
+		_PaddedArraySize<VkBuffer>(inBindingCount) +
+		_PaddedArraySize<VkDeviceSize>(inBindingCount);
+	_PayloadWriter writer(_AppendCommand(CommandType::BIND_VERTEX_BUFFERS, payloadSize));
+
+	writer.Write(_BindVertexBuffersPayload{ inFirstBinding, inBindingCount });
+	writer.Write(inBuffers, inBindingCount);
+	if (inOffsets != nullptr)
+	{
+		writer.Write(inOffsets, inBindingCount);
+	}
+	else
+	{
+		writer.Skip<VkDeviceSize>(inBindingCount);
+	}
+
+	return *this;
+}
+
+auto CommandStream::BindIndexBuffer(VkBuffer inBuffer, VkDeviceSize inOffset, VkIndexType inIndexType)->CommandStream&
+{
+	CHECK_TRUE(inBuffer != VK_NULL_HANDLE, "Invalid index buffer!");
+
+	_PayloadWriter writer(_AppendCommand(CommandType::BIND_INDEX_BUFFER, sizeof(_BindIndexBufferPayload)));
+
+	writer.Write(_BindIndexBufferPayload{ inBuffer, inOffset, inIndexType });
+
+	return *this;
+}
+
+auto CommandStream::SetViewports(uint32_t inFirstViewport, const VkViewport* inViewports, uint32_t inViewportCount)->CommandStream&
+{
+	CHECK_TRUE(inViewports != nullptr && inViewportCount > 0, "No viewports!");
+
+	const size_t payloadSize =
+		_PaddedSize(sizeof(_SetViewportStatePayload)) +
+		_PaddedArraySize<VkViewport>(inViewportCount);
+	_PayloadWriter writer(_AppendCommand(CommandType::SET_VIEWPORT, payloadSize));
+
+	writer.Write(_SetViewportStatePayload{ inFirstViewport, inViewportCount });
+	writer.Write(inViewports, inViewportCount);
+
+	return *this;
+}
+
+auto CommandStream::SetScissors(uint32_t inFirstScissor, const VkRect2D* inScissors, uint32_t inScissorCount)->CommandStream&
+{
+	CHECK_TRUE(inScissors != nullptr && inScissorCount > 0, "No scissors!");
+
+	const size_t payloadSize =
+		_PaddedSize(sizeof(_SetViewportStatePayload)) +
+		_PaddedArraySize<VkRect2D>(inScissorCount);
+	_PayloadWriter writer(_AppendCommand(CommandType::SET_SCISSOR, payloadSize));
+
+	writer.Write(_SetViewportStatePayload{ inFirstScissor, inScissorCount });
+	writer.Write(inScissors, inScissorCount);
+
+	return *this;
+}
+
+auto CommandStream::PushConstants(VkPipelineLayout inLayout, VkShaderStageFlags inStages, uint32_t inOffset, uint32_t inSize, const void* inData)->CommandStream&
+{
+	CHECK_TRUE(inLayout != VK_NULL_HANDLE, "Invalid pipeline layout!");
+	CHECK_TRUE(inData != nullptr && inSize > 0, "No push constant data!");
+
+	const size_t payloadSize =
+		_PaddedSize(sizeof(_PushConstantsPayload)) +
+		_PaddedArraySize<uint8_t>(inSize);
+	_PayloadWriter writer(_AppendCommand(CommandType::PUSH_CONSTANTS, payloadSize));
+
+	writer.Write(_PushConstantsPayload{ inLayout, inStages, inOffset, inSize });
+	writer.Write(static_cast<const uint8_t*>(inData), inSize);
+
+	return *this;
+}
+
+auto CommandStream::Draw(uint32_t inVertexCount, uint32_t inInstanceCount, uint32_t inFirstVertex, uint32_t inFirstInstance)->CommandStream&
+{
+	_PayloadWriter writer(_AppendCommand(CommandType::DRAW, sizeof(_DrawPayload)));
+
+	writer.Write(_DrawPayload{ inVertexCount, inInstanceCount, inFirstVertex, inFirstInstance });
+
+	return *this;
+}
+
+auto CommandStream::DrawIndexed(uint32_t inIndexCount, uint32_t inInstanceCount, uint32_t inFirstIndex, int32_t inVertexOffset, uint32_t inFirstInstance)->CommandStream&
+{
+	_PayloadWriter writer(_AppendCommand(CommandType::DRAW_INDEXED, sizeof(_DrawIndexedPayload)));
+
+	writer.Write(_DrawIndexedPayload{ inIndexCount, inInstanceCount, inFirstIndex, inVertexOffset, inFirstInstance });
+
+	return *this;
+}
+
+auto CommandStream::Dispatch(uint32_t inGroupCountX, uint32_t inGroupCountY, uint32_t inGroupCountZ)->CommandStream&
+{
+	_PayloadWriter writer(_AppendCommand(CommandType::DISPATCH, sizeof(_DispatchPayload)));
+
+	writer.Write(_DispatchPayload{ inGroupCountX, inGroupCountY, inGroupCountZ });
+
+	return *this;
+}
+
+auto CommandStream::External(std::function<void(VkCommandBuffer)> inRecord, std::optional<float> inEstimatedCost)->CommandStream&
+{
+	CHECK_TRUE(inRecord != nullptr, "No record function!");
+	CHECK_TRUE(!inEstimatedCost.has_value() || inEstimatedCost.value() > 0.0f, "Invalid estimated cost!");
+
+	_PayloadWriter writer(_AppendCommand(CommandType::EXTERNAL, sizeof(_ExternalPayload), inEstimatedCost));
+
+	writer.Write(_ExternalPayload{ static_cast<uint32_t>(m_externalRecords.size()), inEstimatedCost.value_or(0.0f) });
+	m_externalRecords.push_back(std::move(inRecord));
+
+	return *this;
+}
+
+auto CommandStream::Append(const CommandStream& inOther)->CommandStream&
+{
+	CHECK_TRUE(&inOther != this, "Can't append a command stream to itself!");
+
+	const size_t firstWord = m_words.size();
+	const uint32_t externalRecordOffset = static_cast<uint32_t>(m_externalRecords.size());
+
+	m_words.insert(m_words.end(), inOther.m_words.begin(), inOther.m_words.end());
+	m_externalRecords.insert(m_externalRecords.end(), inOther.m_externalRecords.begin(), inOther.m_externalRecords.end());
+	m_commandCount += inOther.m_commandCount;
+	m_estimatedCost += inOther.m_estimatedCost;
+
+	// external records of the other stream moved behind ours
+	if (externalRecordOffset == 0 || inOther.m_externalRecords.empty())
+	{
+		return *this;
+	}
+	for (size_t wordIndex = firstWord; wordIndex < m_words.size();)
+	{
+		Header header{};
+
+		std::memcpy(&header, &m_words[wordIndex], sizeof(Header));
+		if (header.type == CommandType::EXTERNAL)
+		{
+			_ExternalPayload payload{};
+
+			std::memcpy(&payload, &m_words[wordIndex + 1], sizeof(_ExternalPayload));
+			payload.recordIndex += externalRecordOffset;
+			std::memcpy(&m_words[wordIndex + 1], &payload, sizeof(_ExternalPayload));
+		}
+		wordIndex += header.wordCount;
+	}
+
+	return *this;
+}
+
+auto CommandStream::Clear()->void
+{
+	m_words.clear();
+	m_externalRecords.clear();
+	m_commandCount = 0;
+	m_estimatedCost = 0.0f;
+}
+
+auto CommandStream::Split(float inMaxCost, std::pmr::vector<Range>& outRanges, std::pmr::vector<size_t>& outStateCommands) const->void
+{
+	CHECK_TRUE(inMaxCost > 0.0f, "Invalid cost per range!");
+
+	// last command that set each piece of bound state, see _GetBoundStateSlots
+	std::pmr::unordered_map<uint64_t, size_t> stateCommands(outRanges.get_allocator().resource());
+	std::pmr::vector<uint64_t> slots(outRanges.get_allocator().resource());
+	bool isStateKnown = true;
+
+	Range currentRange{};
+	for (size_t wordIndex = 0; wordIndex < m_words.size();)
+	{
+		Header header{};
+
+		std::memcpy(&header, &m_words[wordIndex], sizeof(Header));
+		const float commandCost = _GetCommandCost(header, wordIndex);
+		if (isStateKnown && currentRange.commandCount > 0 && currentRange.estimatedCost + commandCost > inMaxCost)
+		{
+			outRanges.push_back(currentRange);
+			currentRange = Range{ wordIndex, 0, 0, 0.0f, outStateCommands.size(), 0 };
+
+			// replayed in stream order, so a command whose state is partly overwritten comes before the one overwriting it
+			for (const auto& [slot, commandWord] : stateCommands)
+			{
+				outStateCommands.push_back(commandWord);
+			}
+			const auto itFirst = outStateCommands.begin() + currentRange.firstStateCommand;
+			std::sort(itFirst, outStateCommands.end());
+			outStateCommands.erase(std::unique(itFirst, outStateCommands.end()), outStateCommands.end());
+			currentRange.stateCommandCount = outStateCommands.size() - currentRange.firstStateCommand;
+		}
+		currentRange.wordCount += header.wordCount;
+		++currentRange.commandCount;
+		currentRange.estimatedCost += commandCost;
+
+		if (header.type == CommandType::EXTERNAL || header.type == CommandType::EXECUTE_COMMANDS)
+		{
+			// what they leave bound can't be replayed
+			isStateKnown = false;
+		}
+		else if (isStateKnown)
+		{
+			slots.clear();
+			_GetBoundStateSlots(header, wordIndex, slots);
+			for (uint64_t slot : slots)
+			{
+				stateCommands[slot] = wordIndex;
+			}
+		}
+		wordIndex += header.wordCount;
+	}
+
+	if (currentRange.commandCount > 0)
+	{
+		outRanges.push_back(currentRange);
+	}
+}
+
+auto CommandStream::RecordState(
+	VkCommandBuffer inVkCommandBuffer,
+	const Range& inRange,
+	const std::pmr::vector<size_t>& inStateCommands,
+	CommandStateTracker* inoutTracker) const->void
+{
+	CHECK_TRUE(inVkCommandBuffer != VK_NULL_HANDLE, "Invalid command buffer!");
+	CHECK_TRUE(inRange.firstStateCommand + inRange.stateCommandCount <= inStateCommands.size(), "State commands out of range!");
+
+	std::optional<CommandStateTracker> localTracker;
+	CommandStateTracker* pTracker = inoutTracker;
+	if (pTracker == nullptr)
+	{
+		pTracker = &localTracker.emplace(inVkCommandBuffer);
+	}
+
+	// only binds are replayed, nothing reaches it
+	BarrierBatcher barrierBatcher(
+		inVkCommandBuffer,
+		BarrierBatcher::IsSynchronization2Supported(),
+		FrameArenaPool::GetInstance().GetThreadResource());
+
+	for (size_t i = 0; i < inRange.stateCommandCount; ++i)
+	{
+		const size_t wordIndex = inStateCommands[inRange.firstStateCommand + i];
+		Header header{};
+
+		CHECK_TRUE(wordIndex < inRange.firstWord, "State command is not before the range!");
+		std::memcpy(&header, &m_words[wordIndex], sizeof(Header));
+		_RecordCommand(inVkCommandBuffer, header, wordIndex, *pTracker, barrierBatcher);
+	}
+}
+
+auto CommandStream::Record(VkCommandBuffer inVkCommandBuffer, CommandStateTracker* inoutTracker) const->void
+{
+	Record(inVkCommandBuffer, Range{ 0, m_words.size(), m_commandCount, m_estimatedCost }, inoutTracker);
+}
+
+auto CommandStream::Record(VkCommandBuffer inVkCommandBuffer, const Range& inRange, CommandStateTracker* inoutTracker) const->void
+{
+	CHECK_TRUE(inVkCommandBuffer != VK_NULL_HANDLE, "Invalid command buffer!");
+	CHECK_TRUE(inRange.firstWord + inRange.wordCount <= m_words.size(), "Command range out of stream!");
+
+	std::optional<CommandStateTracker> localTracker;
+	CommandStateTracker* pTracker = inoutTracker;
+	if (pTracker == nullptr)
+	{
+		pTracker = &localTracker.emplace(inVkCommandBuffer);
+	}
+
+	// consecutive barriers become one call
+	BarrierBatcher barrierBatcher(
+		inVkCommandBuffer,
+		BarrierBatcher::IsSynchronization2Supported(),
+		FrameArenaPool::GetInstance().GetThreadResource());
+
+	CommandCostModel& costModel = CommandCostModel::GetInstance();
+	const bool calibrate = costModel.IsCalibrationEnabled();
+	const size_t endWord = inRange.firstWord + inRange.wordCount;
+	for (size_t wordIndex = inRange.firstWord; wordIndex < endWord;)
+	{
+		Header header{};
+		std::chrono::steady_clock::time_point startTime;
+
+		std::memcpy(&header, &m_words[wordIndex], sizeof(Header));
+		CHECK_TRUE(header.wordCount > 0 && wordIndex + header.wordCount <= endWord, "Corrupted command stream!");
+		if (header.type != CommandType::PIPELINE_BARRIER)
+		{
+			barrierBatcher.Flush();
+		}
+		if (calibrate)
+		{
+			startTime = std::chrono::steady_clock::now();
+		}
+
+		const bool isSample = _RecordCommand(inVkCommandBuffer, header, wordIndex, *pTracker, barrierBatcher);
+		if (calibrate && isSample)
+		{
+			const std::chrono::duration<float, std::nano> recordTime = std::chrono::steady_clock::now() - startTime;
+			costModel.AddSample(header.type, recordTime.count());
+		}
+		wordIndex += header.wordCount;
+	}
+	barrierBatcher.Flush();
+}
@@ -0,0 +1,201 @@
+#pragma once
+#include "common.h"
+#include <cstddef>
+#include <memory_resource>
+
+class BarrierBatcher;
+class CommandStateTracker;
+
+// Commands encoded as POD headers with inline payloads in one contiguous buffer and decoded
+// by a switch when recorded. Arrays are copied in, so callers don't keep anything alive,
+// but pNext chains inside the Vulkan structs are kept as pointers
+class CommandStream final
+{
+public:
+	enum class CommandType : uint32_t
+	{
+		PIPELINE_BARRIER,
+		CLEAR_COLOR_IMAGE,
+		FILL_BUFFER,
+		BLIT_IMAGE,
+		COPY_BUFFER_TO_IMAGE,
+		COPY_BUFFER,
+		BUILD_ACCELERATION_STRUCTURES,
+		WRITE_ACCELERATION_STRUCTURES_PROPERTIES,
+		COPY_ACCELERATION_STRUCTURE,
+		EXECUTE_COMMANDS,
+		BIND_PIPELINE,
+		BIND_DESCRIPTOR_SETS,
+		BIND_VERTEX_BUFFERS,
+		BIND_INDEX_BUFFER,
+		SET_VIEWPORT,
+		SET_SCISSOR,
+		PUSH_CONSTANTS,
+		DRAW,
+		DRAW_INDEXED,
+		DISPATCH,
+		EXTERNAL, // keep it last
+	};
+
+	// Consecutive commands of a stream, only valid while the stream is not changed
+	struct Range
+	{
+		size_t firstWord = 0;
+		size_t wordCount = 0;
+		uint32_t commandCount = 0;
+		float estimatedCost = 0.0f;
+		// binds before the range still in effect at its start, indices into the state commands of Split
+		size_t firstStateCommand = 0;
+		size_t stateCommandCount = 0;
+	};
+
+private:
+	struct Header
+	{
+		CommandType type;
+		uint32_t wordCount; // header included
+	};
+
+	// every command and array starts on a word, enough for any Vulkan struct
+	using Word = uint64_t;
+	static_assert(sizeof(Header) == sizeof(Word));
+
+	std::pmr::vector<Word> m_words;
+	std::pmr::vector<std::function<void(VkCommandBuffer)>> m_externalRecords; // EXTERNAL payloads index into it
+	uint32_t m_commandCount = 0;
+	float m_estimatedCost = 0.0f; // nanoseconds to record, see CommandCostModel
+
+private:
+	// Return where the payload of inPayloadSize bytes goes, the cost defaults to the cost model's
+	auto _AppendCommand(CommandType inType, size_t inPayloadSize, std::optional<float> inEstimatedCost = std::nullopt)->std::byte*;
+
+	auto _GetCommandCost(const Header& inHeader, size_t inWordIndex) const->float;
+
+	// Keys of the state the command binds, nothing for other commands
+	auto _GetBoundStateSlots(const Header& inHeader, size_t inWordIndex, std::pmr::vector<uint64_t>& outSlots) const->void;
+
+	// Return false when the time spent says nothing about the command type, see CommandCostModel
+	auto _RecordCommand(
+		VkCommandBuffer inVkCommandBuffer,
+		const Header& inHeader,
+		size_t inWordIndex,
+		CommandStateTracker& inoutTracker,
+		BarrierBatcher& inoutBarrierBatcher) const->bool;
+
+public:
+	CommandStream() = default;
+	explicit CommandStream(std::pmr::memory_resource* inMemoryResource);
+	// Copy the commands into another memory resource
+	CommandStream(const CommandStream& inOther, std::pmr::memory_resource* inMemoryResource);
+
+	auto PipelineBarrier(
+		VkPipelineStageFlags inSrcStageMask,
+		VkPipelineStageFlags inDstStageMask,
+		VkDependencyFlags inFlags,
+		const VkMemoryBarrier* inMemoryBarriers, uint32_t inMemoryBarrierCount,
+		const VkBufferMemoryBarrier* inBufferBarriers, uint32_t inBufferBarrierCount,
+		const VkImageMemoryBarrier* inImageBarriers, uint32_t inImageBarrierCount)->CommandStream&;
+
+	auto ClearColorImage(
+		VkImage inImage,
+		VkImageLayout inImageLayout,
+		const VkClearColorValue& inClearColor,
+		const VkImageSubresourceRange* inRanges, uint32_t inRangeCount)->CommandStream&;
+
+	auto FillBuffer(VkBuffer inBuffer, VkDeviceSize inOffset, VkDeviceSize inSize, uint32_t inValue)->CommandStream&;
+
+	auto BlitImage(
+		VkImage inSrcImage, VkImageLayout inSrcLayout,
+		VkImage inDstImage, VkImageLayout inDstLayout,
+		const VkImageBlit* inRegions, uint32_t inRegionCount,
+		VkFilter inFilter)->CommandStream&;
+
+	auto CopyBufferToImage(
+		VkBuffer inSrcBuffer,
+		VkImage inDstImage, VkImageLayout inDstLayout,
+		const VkBufferImageCopy* inRegions, uint32_t inRegionCount)->CommandStream&;
+
+	auto CopyBuffer(VkBuffer inSrcBuffer, VkBuffer inDstBuffer, const VkBufferCopy* inRegions, uint32_t inRegionCount)->CommandStream&;
+
+	// Same as vkCmdBuildAccelerationStructuresKHR, pGeometries are copied in, ppGeometries is not supported
+	auto BuildAccelerationStructures(
+		const VkAccelerationStructureBuildGeometryInfoKHR* inBuildInfos,
+		const VkAccelerationStructureBuildRangeInfoKHR* const* inBuildRanges,
+		uint32_t inInfoCount)->CommandStream&;
+
+	auto WriteAccelerationStructuresProperties(
+		const VkAccelerationStructureKHR* inAccelerationStructures, uint32_t inCount,
+		VkQueryType inQueryType,
+		VkQueryPool inQueryPool,
+		uint32_t inFirstQuery)->CommandStream&;
+
+	auto CopyAccelerationStructure(
+		VkAccelerationStructureKHR inSrc,
+		VkAccelerationStructureKHR inDst,
+		VkCopyAccelerationStructureModeKHR inMode)->CommandStream&;
+
+	auto ExecuteCommands(const VkCommandBuffer* inCommandBuffers, uint32_t inCount)->CommandStream&;
+
+	// Binds and dynamic state that change nothing are dropped when recorded, see CommandStateTracker
+	auto BindPipeline(VkPipelineBindPoint inBindPoint, VkPipeline inPipeline)->CommandStream&;
+
+	auto BindDescriptorSets(
+		VkPipelineBindPoint inBindPoint,
+		VkPipelineLayout inLayout,
+		uint32_t inFirstSet,
+		const VkDescriptorSet* inDescriptorSets, uint32_t inDescriptorSetCount,
+		const uint32_t* inDynamicOffsets = nullptr, uint32_t inDynamicOffsetCount = 0)->CommandStream&;
+
+	// Offsets may be null for all zero
+	auto BindVertexBuffers(uint32_t inFirstBinding, const VkBuffer* inBuffers, const VkDeviceSize* inOffsets, uint32_t inBindingCount)->CommandStream&;
+
+	auto BindIndexBuffer(VkBuffer inBuffer, VkDeviceSize inOffset, VkIndexType inIndexType)->CommandStream&;
+
+	auto SetViewports(uint32_t inFirstViewport, const VkViewport* inViewports, uint32_t inViewportCount)->CommandStream&;
+
+	auto SetScissors(uint32_t inFirstScissor, const VkRect2D* inScissors, uint32_t inScissorCount)->CommandStream&;
+
+	auto PushConstants(VkPipelineLayout inLayout, VkShaderStageFlags inStages, uint32_t inOffset, uint32_t inSize, const void* inData)->CommandStream&;
+
+	auto Draw(uint32_t inVertexCount, uint32_t inInstanceCount, uint32_t inFirstVertex, uint32_t inFirstInstance)->CommandStream&;
+
+	auto DrawIndexed(uint32_t inIndexCount, uint32_t inInstanceCount, uint32_t inFirstIndex, int32_t inVertexOffset, uint32_t inFirstInstance)->CommandStream&;
+
+	auto Dispatch(uint32_t inGroupCountX, uint32_t inGroupCountY, uint32_t inGroupCountZ)->CommandStream&;
+
+	// For anything without an encoding, the function is kept by the stream. State it binds is not
+	// tracked, so binds after it are always recorded. Give an estimated
+	// recording cost in nanoseconds for expensive work, e.g. a long run of draws
+	auto External(std::function<void(VkCommandBuffer)> inRecord, std::optional<float> inEstimatedCost = std::nullopt)->CommandStream&;
+
+	auto Append(const CommandStream& inOther)->CommandStream&;
+
+	auto Clear()->void;
+
+	auto IsEmpty() const->bool { return m_commandCount == 0; };
+
+	auto GetCommandCount() const->uint32_t { return m_commandCount; };
+
+	auto GetEstimatedCost() const->float { return m_estimatedCost; };
+
+	// Cut the stream into ranges of at most inMaxCost estimated cost, e.g. to record them on
+	// different threads. A command costing more gets a range of its own. The binds each range
+	// inherits are appended to outStateCommands, see RecordState. Nothing is cut after an
+	// external command or ExecuteCommands since the state they leave is unknown
+	auto Split(float inMaxCost, std::pmr::vector<Range>& outRanges, std::pmr::vector<size_t>& outStateCommands) const->void;
+
+	// Record the binds a range of Split inherits, e.g. before the range in a secondary command
+	// buffer, which starts with nothing bound
+	auto RecordState(
+		VkCommandBuffer inVkCommandBuffer,
+		const Range& inRange,
+		const std::pmr::vector<size_t>& inStateCommands,
+		CommandStateTracker* inoutTracker = nullptr) const->void;
+
+	// Decode every command into the command buffer, the stream can be recorded any number of times.
+	// Pass the tracker of the command buffer to filter binds across streams, otherwise the filter
+	// only spans this call. Consecutive barriers are merged by a BarrierBatcher. Recording times
+	// are fed back to CommandCostModel when its calibration is enabled
+	auto Record(VkCommandBuffer inVkCommandBuffer, CommandStateTracker* inoutTracker = nullptr) const->void;
+	auto Record(VkCommandBuffer inVkCommandBuffer, const Range& inRange, CommandStateTracker* inoutTracker = nullptr) const->void;
+};
@@ -13,6 +13,8 @@
 #include "pipeline_allocator.h"
 #include "allocator/sampler_allocator.h"
 #include "command/command_queue.h"
+#include "resource/upload_manager.h"
+#include "task_scheduler.h"
 #include <iomanip>
 #define VOLK_IMPLEMENTATION
 #include <volk.h>
@@ -308,7 +310,7 @@ void MyDevice::RecreateSwapchain()
 		glfwGetFramebufferSize(pWindow, &width, &height);
 		glfwWaitEvents();
 	}
-	vkDeviceWaitIdle(vkDevice);
+	WaitIdle();
 	_DestroySwapchain();
 	_CreateSwapchain();
 }
@@ -344,24 +346,28 @@ std::optional<uint32_t> MyDevice::AquireAvailableSwapchainImageIndex(VkSemaphore
 
 void MyDevice::PresentSwapchainImage(const std::vector<VkSemaphore>& waitSemaphores, uint32_t imageIdx)
 {
-	VkSwapchainKHR swapChains[] = { vkSwapchain };
-	VkPresentInfoKHR presentInfo{ VK_STRUCTURE_TYPE_PRESENT_INFO_KHR };
-	presentInfo.waitSemaphoreCount = static_cast<uint32_t>(waitSemaphores.size());
-	presentInfo.pWaitSemaphores = waitSemaphores.data();
-	presentInfo.swapchainCount = 1;
-	presentInfo.pSwapchains = swapChains;
-	presentInfo.pImageIndices = &imageIdx;
-	presentInfo.pResults = nullptr;
-
-	VkResult result = vkQueuePresentKHR(m_vkPresentQueue, &presentInfo);
-	if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) 
-	{
-		m_needRecreate = true;
-	}
-	else if (result != VK_SUCCESS) 
-	{
-		throw std::runtime_error("Failed to present swapchain!");
-	}
+	// the wait semaphores are signaled by graphics submissions, which may still sit in the submit thread
+	m_uptrGraphicsCommandQueue->RunOnSubmitThread(
+		[this, waitSemaphores, imageIdx, vkSwapchainToPresent = vkSwapchain]()
+		{
+			VkPresentInfoKHR presentInfo{ VK_STRUCTURE_TYPE_PRESENT_INFO_KHR };
+			presentInfo.waitSemaphoreCount = static_cast<uint32_t>(waitSemaphores.size());
+			presentInfo.pWaitSemaphores = waitSemaphores.data();
+			presentInfo.swapchainCount = 1;
+			presentInfo.pSwapchains = &vkSwapchainToPresent;
+			presentInfo.pImageIndices = &imageIdx;
+			presentInfo.pResults = nullptr;
+
+			VkResult result = QueuePresent(m_vkPresentQueue, presentInfo);
+			if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR)
+			{
+				m_needRecreate = true;
+			}
+			else if (result != VK_SUCCESS)
+			{
+				throw std::runtime_error("Failed to present swapchain!");
+			}
+		});
 }
 
 bool MyDevice::NeedRecreateSwapchain() const
@@ -377,6 +383,7 @@ bool MyDevice::NeedCloseWindow() const
 void MyDevice::StartFrame() const
 {
 	glfwPollEvents();
+	MyTaskScheduler::GetInstance().BeginFrame();
 }
 
 void MyDevice::_DestroySwapchain()
@@ -427,6 +434,7 @@ void MyDevice::_AddBaseExtensionsAndFeatures(vkb::PhysicalDeviceSelector& _selec
 	VkPhysicalDeviceFeatures requiredFeatures{};
 	VkPhysicalDeviceDescriptorIndexingFeaturesEXT physicalDeviceDescriptorIndexingFeatures{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT };
 	VkPhysicalDeviceSynchronization2FeaturesKHR sync2Feature{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES_KHR };
+	VkPhysicalDeviceVulkan12Features vulkan12Featrues{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES };
 	
 	requiredFeatures.geometryShader = VK_TRUE;
 	requiredFeatures.samplerAnisotropy = VK_TRUE;
@@ -438,6 +446,7 @@ void MyDevice::_AddBaseExtensionsAndFeatures(vkb::PhysicalDeviceSelector& _selec
 	physicalDeviceDescriptorIndexingFeatures.runtimeDescriptorArray = VK_TRUE;
 	physicalDeviceDescriptorIndexingFeatures.descriptorBindingVariableDescriptorCount = VK_TRUE;
 	sync2Feature.synchronization2 = VK_TRUE;
+	vulkan12Featrues.timelineSemaphore = VK_TRUE; // asynchronous uploads signal a timeline semaphore
 	
 	_selector.add_required_extensions(
 		{ 
@@ -449,6 +458,7 @@ void MyDevice::_AddBaseExtensionsAndFeatures(vkb::PhysicalDeviceSelector& _selec
 		});
 	_selector.set_required_features(requiredFeatures);
 	_selector.add_required_extension_features(sync2Feature);
+	_selector.add_required_extension_features(vulkan12Featrues);
 	//_selector.add_required_extension_features(physicalDeviceDescriptorIndexingFeatures);
 }
 
@@ -727,8 +737,26 @@ void MyDevice::_DestroyCommandQueues()
 	m_uptrGraphicsCommandQueue.reset();
 }
 
+void MyDevice::_CreateUploadManager()
+{
+	m_uptrUploadManager = std::make_unique<UploadManager>();
+	m_uptrUploadManager->Create();
+}
+
+void MyDevice::_DestroyUploadManager()
+{
+	if (m_uptrUploadManager != nullptr)
+	{
+		m_uptrUploadManager->Destroy();
+		m_uptrUploadManager.reset();
+	}
+}
+
 void MyDevice::Create()
 {
+	// the command queues make a command pool per task scheduler thread
+	CHECK_TRUE(MyTaskScheduler::GetInstance().IsCreated(), "Create the task scheduler before the device!");
+
 	_InitVolk();
 	_InitGLFW();
 	_CreateInstance();
@@ -737,6 +765,7 @@ void MyDevice::Create()
 	_CreateLogicalDevice();
 	_CreateCommandQueues();
 	_CreateMemoryAllocator();
+	_CreateUploadManager();
 	_CreateSamplerAllocator();
 	_CreateRenderPassAllocator();
 	_CreatePipelineLayoutAllocator();
@@ -749,6 +778,7 @@ void MyDevice::Create()
 
 void MyDevice::Destroy()
 {
+	_DestroyUploadManager();
 	_DestroyCommandQueues();
 	_DestroyDescriptorSetAllocator();
 	_DestroySwapchain();
@@ -782,6 +812,16 @@ UserInput MyDevice::GetUserInput() const
 
 void MyDevice::WaitIdle() const
 {
+	// presents and submissions handed to submit threads must reach the queues first
+	for (CommandQueue* commandQueue : std::initializer_list<CommandQueue*>{ m_uptrGraphicsCommandQueue.get(), m_uptrComputeCommandQueue.get(), m_uptrTransferCommandQueue.get() })
+	{
+		if (commandQueue != nullptr)
+		{
+			commandQueue->WaitSubmitThreadIdle();
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(m_queueMutex);
 	vkDeviceWaitIdle(vkDevice);
 }
 
@@ -820,6 +860,11 @@ auto MyDevice::GetTransferCommandQueue()->TransferQueue*
 	return m_uptrTransferCommandQueue.get();
 }
 
+auto MyDevice::GetUploadManager()->UploadManager*
+{
+	return m_uptrUploadManager.get();
+}
+
 VkFence MyDevice::CreateVkFence(
 	VkFenceCreateFlags inFlags, 
 	const void* inNextPtr, 
@@ -1078,6 +1123,11 @@ void MyDevice::UpdateDescriptorSets(const std::vector<VkCopyDescriptorSet>& inCo
 	UpdateDescriptorSets({}, inCopyUpdates);
 }
 
+void MyDevice::UpdateDescriptorSets(const VkWriteDescriptorSet* inWriteUpdates, size_t inWriteCount)
+{
+	vkUpdateDescriptorSets(vkDevice, static_cast<uint32_t>(inWriteCount), inWriteUpdates, 0, nullptr);
+}
+
 VkPipelineCache MyDevice::CreatePipelineCache(const VkPipelineCacheCreateInfo& inCreateInfo, const VkAllocationCallbacks* pCallbacks)
 {
 	VkResult processResult;
@@ -1273,6 +1323,24 @@ VkResult MyDevice::WaitForFences(const std::vector<VkFence>& inFencesToWait, boo
 		inTimeout);
 }
 
+VkResult MyDevice::QueueSubmit(VkQueue inQueue, uint32_t inSubmitCount, const VkSubmitInfo* inSubmitInfos, VkFence inFence)
+{
+	std::lock_guard<std::mutex> lock(m_queueMutex);
+	return vkQueueSubmit(inQueue, inSubmitCount, inSubmitInfos, inFence);
+}
+
+VkResult MyDevice::QueuePresent(VkQueue inQueue, const VkPresentInfoKHR& inPresentInfo)
+{
+	std::lock_guard<std::mutex> lock(m_queueMutex);
+	return vkQueuePresentKHR(inQueue, &inPresentInfo);
+}
+
+VkResult MyDevice::QueueWaitIdle(VkQueue inQueue)
+{
+	std::lock_guard<std::mutex> lock(m_queueMutex);
+	return vkQueueWaitIdle(inQueue);
+}
+
 VkCommandPool MyDevice::CreateCommandPool(const VkCommandPoolCreateInfo& inCreateInfo, const VkAllocationCallbacks* pAllocator)
 {
 	VkCommandPool result = VK_NULL_HANDLE;
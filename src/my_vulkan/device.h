@@ -2,6 +2,8 @@
 #include "common.h"
 #include "common_enums.h"
 #include <VkBootstrap.h>
+#include <mutex>
+#include <atomic>
 #include "image.h"
 #include "sampler.h"
 
@@ -17,6 +19,7 @@ class SamplerAllocator;
 class GraphicsQueue;
 class ComputeQueue;
 class TransferQueue;
+class UploadManager;
 
 struct UserInput
 {
@@ -70,7 +73,7 @@ private:
 	VkQueue				m_vkGraphicsQueue = VK_NULL_HANDLE;
 	VkQueue				m_vkComputeQueue = VK_NULL_HANDLE;
 	VkQueue				m_vkTransferQueue = VK_NULL_HANDLE;
-	bool				m_needRecreate = false;
+	std::atomic<bool>	m_needRecreate = false; // can be set by the graphics submit thread
 	bool				m_initialized = false;
 	UserInput			m_userInput{};
 	std::vector<std::unique_ptr<Image>> m_uptrSwapchainImages;
@@ -86,7 +89,9 @@ private:
 	std::unique_ptr<GraphicsQueue> m_uptrGraphicsCommandQueue;
 	std::unique_ptr<ComputeQueue> m_uptrComputeCommandQueue;
 	std::unique_ptr<TransferQueue> m_uptrTransferCommandQueue;
+	std::unique_ptr<UploadManager> m_uptrUploadManager;
 	std::unordered_map<VkCommandPool, uint32_t> m_mapPoolToQueueFamily;
+	mutable std::mutex m_queueMutex;
 
 private:
 	MyDevice();
@@ -124,6 +129,8 @@ private:
 	void _DestroySamplerAllocator();
 	void _CreateCommandQueues();
 	void _DestroyCommandQueues();
+	void _CreateUploadManager();
+	void _DestroyUploadManager();
 
 	// Add required extensions to the device, before select physical device
 	void _AddBaseExtensionsAndFeatures(vkb::PhysicalDeviceSelector& _selector) const;
@@ -159,6 +166,7 @@ public:
 	
 	std::optional<uint32_t> AquireAvailableSwapchainImageIndex(VkSemaphore finishSignal);
 	
+	// Present on the graphics submit thread if it's enabled, so present is ordered after the submissions
 	void PresentSwapchainImage(const std::vector<VkSemaphore>& waitSemaphores, uint32_t imageIdx);
 	
 	bool NeedRecreateSwapchain() const;
@@ -192,6 +200,8 @@ public:
 	auto GetComputeCommandQueue()->ComputeQueue*;
 	auto GetTransferCommandQueue()->TransferQueue*;
 
+	auto GetUploadManager()->UploadManager*;
+
 	// Get queue family index by the function,
 	// https://github.com/KhronosGroup/Vulkan-Guide/blob/main/chapters/queues.adoc
 	uint32_t GetQueueFamilyIndexOfType(QueueFamilyType inType) const;
@@ -283,6 +293,10 @@ public:
 	void UpdateDescriptorSets(
 		const std::vector<VkCopyDescriptorSet>& inCopyUpdates);
 
+	void UpdateDescriptorSets(
+		const VkWriteDescriptorSet* inWriteUpdates,
+		size_t inWriteCount);
+
 	// https://docs.vulkan.org/refpages/latest/refpages/source/vkCreatePipelineCache.html
 	VkPipelineCache CreatePipelineCache(
 		const VkPipelineCacheCreateInfo& inCreateInfo,
@@ -344,6 +358,18 @@ public:
 		bool inWaitAll = true, 
 		uint64_t inTimeout = UINT64_MAX);
 
+	// Queues must be externally synchronized, all submissions, presents and
+	// queue waits go through these so submit threads can share queues safely
+	VkResult QueueSubmit(
+		VkQueue inQueue,
+		uint32_t inSubmitCount,
+		const VkSubmitInfo* inSubmitInfos,
+		VkFence inFence = VK_NULL_HANDLE);
+
+	VkResult QueuePresent(VkQueue inQueue, const VkPresentInfoKHR& inPresentInfo);
+
+	VkResult QueueWaitIdle(VkQueue inQueue);
+
 	VkCommandPool CreateCommandPool(
 		const VkCommandPoolCreateInfo& inCreateInfo,
 		const VkAllocationCallbacks* pAllocator = nullptr);
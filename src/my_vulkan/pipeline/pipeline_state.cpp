@@ -1,4 +1,5 @@
 #include "pipeline_state.h"
+#include "command_stream.h"
 
 void PipelineState::SetDescriptorSet(
 	uint32_t inSet,
@@ -220,6 +221,57 @@ uint32_t GraphicsPipelineDrawState::GetIndexCount() const
 	return m_indexedDrawState.has_value() ? m_indexedDrawState->indexCount : 0;
 }
 
+void GraphicsPipelineDrawState::AppendDrawTo(CommandStream& inoutCommands, VkPipeline inPipeline, VkPipelineLayout inLayout) const
+{
+	CHECK_TRUE(m_drawState.has_value() || m_indexedDrawState.has_value(), "No draw state!");
+
+	inoutCommands.BindPipeline(VK_PIPELINE_BIND_POINT_GRAPHICS, inPipeline);
+	for (const VulkanDescriptorSetBinding& binding : GetDescriptorSetBindings())
+	{
+		if (binding.descriptorSet == VK_NULL_HANDLE)
+		{
+			continue;
+		}
+		inoutCommands.BindDescriptorSets(
+			VK_PIPELINE_BIND_POINT_GRAPHICS,
+			inLayout,
+			binding.setIndex,
+			&binding.descriptorSet, 1,
+			binding.dynamicOffsets.data(), static_cast<uint32_t>(binding.dynamicOffsets.size()));
+	}
+	for (const VulkanPushConstantBinding& binding : GetPushConstantBindings())
+	{
+		if (binding.size > 0)
+		{
+			inoutCommands.PushConstants(inLayout, binding.stages, 0, binding.size, binding.GetData());
+		}
+	}
+	if (!GetViewports().empty())
+	{
+		inoutCommands.SetViewports(0, GetViewports().data(), static_cast<uint32_t>(GetViewports().size()));
+	}
+	if (!GetScissors().empty())
+	{
+		inoutCommands.SetScissors(0, GetScissors().data(), static_cast<uint32_t>(GetScissors().size()));
+	}
+	if (!m_vertexBuffers.empty())
+	{
+		inoutCommands.BindVertexBuffers(0, m_vertexBuffers.data(), m_vertexBufferOffsets.data(), static_cast<uint32_t>(m_vertexBuffers.size()));
+	}
+
+	if (m_indexedDrawState.has_value())
+	{
+		const IndexedDrawState& drawState = m_indexedDrawState.value();
+
+		inoutCommands.BindIndexBuffer(m_indexBuffer, m_indexBufferOffset, m_indexType);
+		inoutCommands.DrawIndexed(drawState.indexCount, drawState.instanceCount, drawState.firstIndex, drawState.vertexOffset, drawState.firstInstance);
+		return;
+	}
+
+	const DrawState& drawState = m_drawState.value();
+	inoutCommands.Draw(drawState.vertexCount, drawState.instanceCount, drawState.firstVertex, drawState.firstInstance);
+}
+
 void GraphicsPipelineIndirectDrawState::SetIndirectDrawState(
 	VkBuffer inIndirectBuffer,
 	VkDeviceSize inOffset,
@@ -6,6 +6,7 @@
 class Buffer;
 class ImageView;
 class AccelStruct;
+class CommandStream;
 
 struct VulkanDescriptorSetBinding
 {
@@ -141,6 +142,10 @@ public:
 	bool HasIndexedDrawState() const;
 	uint32_t GetVertexCount() const;
 	uint32_t GetIndexCount() const;
+
+	// Encode the full state and the draw, binds equal to the previous draw's are dropped when the
+	// stream is recorded. Push constants are pushed at offset 0 of the layout
+	void AppendDrawTo(CommandStream& inoutCommands, VkPipeline inPipeline, VkPipelineLayout inLayout) const;
 };
 
 class GraphicsPipelineIndirectDrawState final : public GraphicsPipelineState
@@ -1,5 +1,7 @@
 #include "render_pass.h"
 #include "device.h"
+#include "image.h"
+#include <algorithm>
 
 namespace
 {
@@ -120,6 +122,15 @@ void RenderPassCreateInfo::SubpassDescription::AddColorAttachment(
 	}
 }
 
+void RenderPassCreateInfo::SubpassDescription::AddInputAttachment(
+	uint32_t inInputSlot,
+	RenderPassCreateInfo::AttachmentHandle inAttachmentHandle,
+	VkImageLayout inLayout)
+{
+	ResizeAttachmentReferenceVector(m_inputAttachments, inInputSlot);
+	m_inputAttachments[inInputSlot] = VkAttachmentReference{ inAttachmentHandle, inLayout };
+}
+
 void RenderPassCreateInfo::SubpassDescription::CustomizeAvailableState(
 	VkPipelineStageFlags inStage,
 	VkAccessFlags inAccess)
@@ -175,6 +186,7 @@ void RenderPass::Create(const RenderPassCreateInfo* inCreateInfo)
 
 	std::vector<VkAttachmentDescription> vkAttachments;
 	std::vector<VkSubpassDescription> vkSubpasses;
+	std::vector<std::vector<VkAttachmentReference>> inputAttachments;
 	std::vector<std::vector<VkAttachmentReference>> colorAttachments;
 	std::vector<std::vector<VkAttachmentReference>> resolveAttachments;
 	std::vector<VkAttachmentReference> depthStencilAttachments;
@@ -198,6 +210,7 @@ void RenderPass::Create(const RenderPassCreateInfo* inCreateInfo)
 				"Attachment reference is out of range!");
 		};
 
+	inputAttachments.reserve(inCreateInfo->m_subpasses.size());
 	colorAttachments.reserve(inCreateInfo->m_subpasses.size());
 	resolveAttachments.reserve(inCreateInfo->m_subpasses.size());
 	depthStencilAttachments.reserve(inCreateInfo->m_subpasses.size());
@@ -205,6 +218,10 @@ void RenderPass::Create(const RenderPassCreateInfo* inCreateInfo)
 
 	for (const auto& subpass : inCreateInfo->m_subpasses)
 	{
+		for (const auto& attachment : subpass.m_inputAttachments)
+		{
+			validateAttachmentHandle(attachment);
+		}
 		for (const auto& attachment : subpass.m_colorAttachments)
 		{
 			validateAttachmentHandle(attachment);
@@ -224,12 +241,15 @@ void RenderPass::Create(const RenderPassCreateInfo* inCreateInfo)
 				"Resolve attachments must match color attachment count!");
 		}
 
+		inputAttachments.push_back(subpass.m_inputAttachments);
 		colorAttachments.push_back(subpass.m_colorAttachments);
 		resolveAttachments.push_back(subpass.m_resolveAttachments);
 		depthStencilAttachments.push_back(subpass.m_depthStencilAttachment.value_or(kUnusedAttachment));
 
 		VkSubpassDescription vkSubpass{};
 		vkSubpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		vkSubpass.inputAttachmentCount = static_cast<uint32_t>(inputAttachments.back().size());
+		vkSubpass.pInputAttachments = inputAttachments.back().data();
 		vkSubpass.colorAttachmentCount = static_cast<uint32_t>(colorAttachments.back().size());
 		vkSubpass.pColorAttachments = colorAttachments.back().data();
 		if (!resolveAttachments.back().empty())
@@ -289,3 +309,68 @@ void RenderPass::Destroy()
 	}
 	m_clearValues.clear();
 }
+
+void FramebufferCreateInfo::SetImageView(RenderPassCreateInfo::AttachmentHandle inTargetAttachment, const ImageView* inViewAttached)
+{
+	if (m_views.size() <= inTargetAttachment)
+	{
+		m_views.resize(inTargetAttachment + 1, nullptr);
+	}
+	m_views[inTargetAttachment] = inViewAttached;
+}
+
+void FramebufferCreateInfo::SetRenderPass(const RenderPass* inRenderPass)
+{
+	m_pRenderPass = inRenderPass;
+}
+
+Framebuffer::~Framebuffer()
+{
+	assert(m_vkFramebuffer == VK_NULL_HANDLE);
+}
+
+void Framebuffer::Create(const FramebufferCreateInfo* inCreateInfo)
+{
+	CHECK_TRUE(inCreateInfo != nullptr, "No framebuffer create info!");
+	CHECK_TRUE(m_vkFramebuffer == VK_NULL_HANDLE, "Framebuffer already created!");
+	CHECK_TRUE(inCreateInfo->m_pRenderPass != nullptr, "Framebuffer needs a render pass!");
+	CHECK_TRUE(!inCreateInfo->m_views.empty(), "Framebuffer needs at least one attachment!");
+
+	std::vector<VkImageView> vkImageViews;
+	VkFramebufferCreateInfo framebufferInfo{ VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO };
+
+	// views may be larger than the framebuffer, so take the smallest of them
+	framebufferInfo.width = UINT32_MAX;
+	framebufferInfo.height = UINT32_MAX;
+	framebufferInfo.layers = UINT32_MAX;
+	vkImageViews.reserve(inCreateInfo->m_views.size());
+	for (const ImageView* pView : inCreateInfo->m_views)
+	{
+		CHECK_TRUE(pView != nullptr, "Framebuffer attachment has no image view!");
+
+		const auto& viewInformation = pView->GetImageViewInformation();
+		framebufferInfo.width = std::min(framebufferInfo.width, std::max(viewInformation.width >> viewInformation.baseMipLevel, 1u));
+		framebufferInfo.height = std::min(framebufferInfo.height, std::max(viewInformation.height >> viewInformation.baseMipLevel, 1u));
+		framebufferInfo.layers = std::min(framebufferInfo.layers, viewInformation.layerCount);
+		vkImageViews.push_back(pView->GetVkImageView());
+	}
+	framebufferInfo.renderPass = inCreateInfo->m_pRenderPass->GetVkRenderPass();
+	framebufferInfo.attachmentCount = static_cast<uint32_t>(vkImageViews.size());
+	framebufferInfo.pAttachments = vkImageViews.data();
+
+	m_vkFramebuffer = MyDevice::GetInstance().CreateFramebuffer(framebufferInfo);
+}
+
+void Framebuffer::Destroy()
+{
+	if (m_vkFramebuffer != VK_NULL_HANDLE)
+	{
+		MyDevice::GetInstance().DestroyFramebuffer(m_vkFramebuffer);
+		m_vkFramebuffer = VK_NULL_HANDLE;
+	}
+}
+
+VkFramebuffer Framebuffer::GetVkFramebuffer() const
+{
+	return m_vkFramebuffer;
+}
@@ -34,6 +34,7 @@ public:
 			VkAccessFlags dstAccess = 0;
 		};
 
+		std::vector<VkAttachmentReference> m_inputAttachments;
 		std::vector<VkAttachmentReference> m_colorAttachments;
 		std::vector<VkAttachmentReference> m_resolveAttachments;
 		std::optional<VkAttachmentReference> m_depthStencilAttachment;
@@ -56,6 +57,11 @@ public:
 			uint32_t inOutputSlot,
 			RenderPassCreateInfo::AttachmentHandle inColorAttachmentHandle,
 			VkImageLayout inColorLayout);
+		// Read an attachment written by an earlier subpass at the same pixel, i.e. subpassInput in shader
+		void AddInputAttachment(
+			uint32_t inInputSlot,
+			RenderPassCreateInfo::AttachmentHandle inAttachmentHandle,
+			VkImageLayout inLayout);
 		void CustomizeAvailableState(
 			VkPipelineStageFlags inStage,
 			VkAccessFlags inAccess);
@@ -129,7 +135,14 @@ public:
 
 class FramebufferCreateInfo final
 {
+private:
+	friend class Framebuffer;
+
+	const RenderPass* m_pRenderPass = nullptr;
+	std::vector<const ImageView*> m_views; // [attachment]
+
 public:
+	// Set the view of every attachment of the render pass, the framebuffer takes the size the views share
 	void SetImageView(RenderPassCreateInfo::AttachmentHandle inTargetAttachment, const ImageView* inViewAttached);
 	void SetRenderPass(const RenderPass* inRenderPass);
 };
@@ -2,7 +2,9 @@
 #include "device.h"
 #include "command_buffer.h"
 #include "memory_allocator.h"
+#include "upload_manager.h"
 #include "utils.h"
+#include "utility/hash_util.h"
 
 namespace 
 {
@@ -12,12 +14,15 @@ namespace
 		std::vector<VkCommandBuffer> cmdsToSubmit = { inCommandBuffer };
 		auto& device = MyDevice::GetInstance();
 		VkQueue queueToSubmit = device.GetQueueOfType(QueueFamilyType::GRAPHICS);
+
+		// pending uploads may target the buffers we use, submit them first
+		device.GetUploadManager()->Flush();
 		
 		submitInfo.commandBufferCount = cmdsToSubmit.size();
 		submitInfo.pCommandBuffers = cmdsToSubmit.data();
 		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-		vkQueueSubmit(queueToSubmit, 1, &submitInfo, VK_NULL_HANDLE);
-		vkQueueWaitIdle(queueToSubmit);
+		device.QueueSubmit(queueToSubmit, 1, &submitInfo, VK_NULL_HANDLE);
+		device.QueueWaitIdle(queueToSubmit);
 	}
 }
 
@@ -43,8 +48,13 @@ void Buffer::Create(const BufferCreateInfo* inCreateInfo)
 	bufferToFill.size = inCreateInfo->m_bufferSize;
 	bufferToFill.usage = inCreateInfo->m_usage;
 	bufferToFill.optAlignment = inCreateInfo->m_optAlignment;
+	bufferToFill.isMemoryAliased = inCreateInfo->m_aliasMemory;
+	CHECK_TRUE(!bufferToFill.isMemoryAliased || !CONTAIN_BITS(bufferToFill.memoryProperty, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT), "Aliased buffer can't be mapped to host!");
 	m_vkBuffer = device.CreateBuffer(bufferInfo);
-	_AllocateMemory();
+	if (!bufferToFill.isMemoryAliased)
+	{
+		_AllocateMemory();
+	}
 }
 
 void Buffer::Destroy()
@@ -53,7 +63,10 @@ void Buffer::Destroy()
 
 	if (m_vkBuffer != VK_NULL_HANDLE)
 	{
-		_FreeMemory();
+		if (!m_bufferInformation.isMemoryAliased)
+		{
+			_FreeMemory();
+		}
 		MyDevice::GetInstance().DestroyBuffer(m_vkBuffer);
 		m_vkBuffer = VK_NULL_HANDLE;
 	}
@@ -115,18 +128,7 @@ void Buffer::_CopyFromHostWithMappedMemory(const void* src, size_t bufferOffest,
 
 void Buffer::_CopyFromHostWithStaggingBuffer(const void* src, size_t bufferOffest, size_t size)
 {
-	Buffer stagingBuffer{};
-	BufferCreateInfo createInfo{};
-
-	createInfo.SetBufferSize(size).SetBufferUsage(VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
-	createInfo.CustomizeMemoryProperty(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-	
-	stagingBuffer.Create(&createInfo);
-	stagingBuffer.CopyFromHost(src, 0, size);
-	
-	CopyFromBuffer(&stagingBuffer, 0, bufferOffest, size);
-
-	stagingBuffer.Destroy();
+	MyDevice::GetInstance().GetUploadManager()->UploadToBuffer(src, this, bufferOffest, size);
 }
 
 Buffer::Buffer()
@@ -239,6 +241,18 @@ VkDescriptorBufferInfo Buffer::GetDescriptorBufferInfo() const
 	return result;
 }
 
+VkMemoryRequirements Buffer::GetMemoryRequirements() const
+{
+	CHECK_TRUE(m_vkBuffer != VK_NULL_HANDLE, "Buffer is not created!");
+	VkMemoryRequirements requirements{};
+	vkGetBufferMemoryRequirements(MyDevice::GetInstance().vkDevice, m_vkBuffer, &requirements);
+	if (m_bufferInformation.optAlignment.has_value())
+	{
+		requirements.alignment = std::max(requirements.alignment, m_bufferInformation.optAlignment.value());
+	}
+	return requirements;
+}
+
 VkBuffer Buffer::GetVkBuffer() const
 {
 	return m_vkBuffer;
@@ -280,6 +294,25 @@ BufferCreateInfo& BufferCreateInfo::CustomizeAlignment(VkDeviceSize inAlignment)
 	return *this;
 }
 
+BufferCreateInfo& BufferCreateInfo::CustomizeMemoryAliasing()
+{
+	m_aliasMemory = true;
+	return *this;
+}
+
+size_t BufferCreateInfo::GetHash() const
+{
+	size_t result = 0;
+
+	hash_combine(result, m_optAlignment);
+	hash_combine(result, m_memoryProperty);
+	hash_combine(result, m_sharingMode);
+	hash_combine(result, m_bufferSize);
+	hash_combine(result, m_usage);
+	hash_combine(result, m_aliasMemory);
+	return result;
+}
+
 auto BufferViewInfo::Reset()->BufferViewInfo&
 {
 	*this = BufferViewInfo{};
@@ -59,6 +59,7 @@ private:
 	VkSharingMode m_sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 	VkDeviceSize m_bufferSize;
 	VkBufferUsageFlags m_usage;
+	bool m_aliasMemory = false;
 
 	friend class Buffer;
 
@@ -80,6 +81,15 @@ public:
 
 	// Optional, for buffers that have alignment requirement
 	BufferCreateInfo& CustomizeAlignment(VkDeviceSize inAlignment);
+
+	// Optional, default: false. If enabled, Create() only creates the VkBuffer without any memory,
+	// owner must bind it to aliasing memory through MemoryAllocator before use
+	BufferCreateInfo& CustomizeMemoryAliasing();
+
+	size_t GetHash() const;
+
+	// Same settings, compares what GetHash hashes
+	bool operator==(const BufferCreateInfo& inOther) const = default;
 };
 
 class Buffer final
@@ -92,6 +102,7 @@ public:
 		VkSharingMode sharingMode;
 		VkMemoryPropertyFlags	memoryProperty;
 		std::optional<VkDeviceSize> optAlignment; // buffer may have alignment requirements, i.e. Scratch Buffer
+		bool isMemoryAliased = false;             // memory is bound and freed by others
 	};
 
 private:
@@ -114,7 +125,7 @@ private:
 	// Map the memory and copy, if this buffer is host coherent
 	void _CopyFromHostWithMappedMemory(const void* src, size_t bufferOffset, size_t size);
 	
-	// Create a staging buffer to copy from host and then copy from staging buffer
+	// Stage the data with the upload manager, the copy is executed when uploads are flushed
 	void _CopyFromHostWithStaggingBuffer(const void* src, size_t bufferOffest, size_t size);
 
 	BufferView* _FindView(const BufferViewInfo& inCreateInfo) const;
@@ -134,7 +145,8 @@ public:
 	
 	void Destroy();
 
-	// Copy from host wait till finish, will use stagging buffer if necessary
+	// Copy from host, for host coherent buffer it finishes immediately, otherwise data is staged
+	// and copied before the next submission to graphics queue, host data can be released after return
 	void CopyFromHost(const void* src, size_t bufferOffset, size_t size);
 
 	// Copy from buffer on graphics queue, wait till copy finish
@@ -152,6 +164,9 @@ public:
 	// Get buffer information
 	const Buffer::Information& GetBufferInformation() const;
 	
+	// Get memory requirements of the buffer, alignment requirement is included
+	VkMemoryRequirements GetMemoryRequirements() const;
+
 	// Get device address of the buffer, require VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT
 	VkDeviceAddress GetDeviceAddress() const;
 
@@ -3,6 +3,7 @@
 #include "device.h"
 #include "buffer.h"
 #include "utility/hash_util.h"
+#include "utility/frame_arena.h"
 #include <algorithm>
 #include <stdexcept>
 #include <type_traits>
@@ -99,13 +100,25 @@ namespace
 			uint32_t descriptorCount = 0;
 		};
 
-		std::unordered_map<uint32_t, BindingLayoutMetadata> layoutMetadata;
-		std::vector<VkWriteDescriptorSet> writes;
-		std::vector<std::vector<VkDescriptorBufferInfo>> bufferInfoStorage;
-		std::vector<std::vector<VkDescriptorImageInfo>> imageInfoStorage;
-		std::vector<std::vector<VkBufferView>> bufferViewStorage;
-		std::vector<std::vector<VkAccelerationStructureKHR>> accelerationStructureStorage;
-		std::vector<VkWriteDescriptorSetAccelerationStructureKHR> accelerationStructureWriteStorage;
+		// scratch for one update, callers recording a frame pass the frame arena
+		explicit DescriptorWriteBundle(std::pmr::memory_resource* inMemoryResource)
+			: layoutMetadata(inMemoryResource),
+			writes(inMemoryResource),
+			bufferInfoStorage(inMemoryResource),
+			imageInfoStorage(inMemoryResource),
+			bufferViewStorage(inMemoryResource),
+			accelerationStructureStorage(inMemoryResource),
+			accelerationStructureWriteStorage(inMemoryResource)
+		{
+		}
+
+		FrameUnorderedMap<uint32_t, BindingLayoutMetadata> layoutMetadata;
+		FrameVector<VkWriteDescriptorSet> writes;
+		FrameVector<FrameVector<VkDescriptorBufferInfo>> bufferInfoStorage;
+		FrameVector<FrameVector<VkDescriptorImageInfo>> imageInfoStorage;
+		FrameVector<FrameVector<VkBufferView>> bufferViewStorage;
+		FrameVector<FrameVector<VkAccelerationStructureKHR>> accelerationStructureStorage;
+		FrameVector<VkWriteDescriptorSetAccelerationStructureKHR> accelerationStructureWriteStorage;
 	};
 
 	static void _FillDescriptorWrite(
@@ -512,12 +525,12 @@ void DescriptorSetState::SetBinding(DescriptorState inBindingInfo, uint32_t inBi
 	m_mapBindingToDescriptor[inBinding] = std::move(inBindingInfo);
 }
 
-void DescriptorSet::WriteBindings(const DescriptorSetState& inBinding)
+void DescriptorSet::WriteBindings(const DescriptorSetState& inBinding, std::pmr::memory_resource* inScratchResource)
 {
 	CHECK_TRUE(m_vkDescriptorSet != VK_NULL_HANDLE, "DescriptorSet must be created before writing bindings!");
 
 	DescriptorSetState changedBindingState;
-	DescriptorWriteBundle writeBundle;
+	DescriptorWriteBundle writeBundle(inScratchResource != nullptr ? inScratchResource : std::pmr::get_default_resource());
 
 	writeBundle.layoutMetadata.reserve(inBinding.m_mapBindingToDescriptor.size());
 
@@ -567,7 +580,7 @@ void DescriptorSet::WriteBindings(const DescriptorSetState& inBinding)
 	_FillDescriptorWrite(m_vkDescriptorSet, changedBindingState, writeBundle);
 	if (!writeBundle.writes.empty())
 	{
-		MyDevice::GetInstance().UpdateDescriptorSets(writeBundle.writes);
+		MyDevice::GetInstance().UpdateDescriptorSets(writeBundle.writes.data(), writeBundle.writes.size());
 	}
 }
 
@@ -638,7 +651,7 @@ void DynamicDescriptorSetAllocator::_WriteDescriptorSet(VkDescriptorSet inDescri
 	}
 	CHECK_TRUE(inAllocateInfo.m_descriptorSetLayout != nullptr, "Dynamic descriptor allocation requires a DescriptorSetLayout for writes!");
 
-	DescriptorWriteBundle writeBundle;
+	DescriptorWriteBundle writeBundle(inAllocateInfo.m_pScratchResource != nullptr ? inAllocateInfo.m_pScratchResource : std::pmr::get_default_resource());
 	for (const auto& [bindingId, layoutBinding] : inAllocateInfo.m_descriptorSetLayout->m_descriptorBindings)
 	{
 		writeBundle.layoutMetadata[bindingId] = { layoutBinding.descriptorType, layoutBinding.descriptorCount };
@@ -647,7 +660,7 @@ void DynamicDescriptorSetAllocator::_WriteDescriptorSet(VkDescriptorSet inDescri
 	_FillDescriptorWrite(inDescriptorSet, inAllocateInfo.m_state, writeBundle);
 	if (!writeBundle.writes.empty())
 	{
-		MyDevice::GetInstance().UpdateDescriptorSets(writeBundle.writes);
+		MyDevice::GetInstance().UpdateDescriptorSets(writeBundle.writes.data(), writeBundle.writes.size());
 	}
 }
 
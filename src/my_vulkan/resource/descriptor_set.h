@@ -2,6 +2,7 @@
 #include "common.h"
 #include <cstdint>
 #include <map>
+#include <memory_resource>
 #include <variant>
 class DescriptorSet;
 class DescriptorSetLayout;
@@ -176,7 +177,9 @@ public:
 
 	void Create(const DescriptorSetCreateInfo& inCreateInfo);
 
-	void WriteBindings(const DescriptorSetState& inBinding);
+	// Scratch storage for the writes comes from inScratchResource, pass the frame arena when
+	// writing during frame recording. Null uses the default resource
+	void WriteBindings(const DescriptorSetState& inBinding, std::pmr::memory_resource* inScratchResource = nullptr);
 
 	void Destroy();
 
@@ -202,11 +205,14 @@ public:
 		VkDescriptorSetLayout m_vkDescriptorSetLayout = VK_NULL_HANDLE;
 		const DescriptorSetLayout* m_descriptorSetLayout = nullptr;
 		DescriptorSetState m_state{};
+		std::pmr::memory_resource* m_pScratchResource = nullptr;
 
 	public:
 		void SetLayout(VkDescriptorSetLayout inLayout){ m_vkDescriptorSetLayout = inLayout; m_descriptorSetLayout = nullptr; }
 		void SetLayout(const DescriptorSetLayout* inLayout);
 		void SetDescriptorSetState(const DescriptorSetState& inState) { m_state = inState; }
+		// Opt into e.g. the frame arena for the write storage, the default resource otherwise
+		void SetScratchResource(std::pmr::memory_resource* inResource) { m_pScratchResource = inResource; }
 	};
 
 private:
@@ -3,6 +3,7 @@
 #include "buffer.h"
 #include "command_buffer.h"
 #include "memory_allocator.h"
+#include "utility/hash_util.h"
 //#ifndef STB_IMAGE_IMPLEMENTATION
 //#define STB_IMAGE_IMPLEMENTATION
 //#endif defined in tinyglTF
@@ -47,9 +48,13 @@ void Image::Create(const ImageCreateInfo* inCreateInfo)
 	infoToFill.usage = imageInfo.usage;
 	infoToFill.samples = imageInfo.samples;
 	infoToFill.isSwapchainImage = false;
+	infoToFill.isMemoryAliased = inCreateInfo->m_aliasMemory;
 	infoToFill.memoryProperty = inCreateInfo->m_optMemoryProperty.value_or(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 	m_vkImage = device.CreateImage(imageInfo);
-	_AllocateMemory();
+	if (!infoToFill.isMemoryAliased)
+	{
+		_AllocateMemory();
+	}
 }
 
 void Image::Create(const SwapchainImageCreateInfo* inCreateInfo)
@@ -91,7 +96,10 @@ void Image::Destroy()
 	{
 		if (m_vkImage != VK_NULL_HANDLE)
 		{
-			_FreeMemory();
+			if (!m_imageInformation.isMemoryAliased)
+			{
+				_FreeMemory();
+			}
 			vkDestroyImage(MyDevice::GetInstance().vkDevice, m_vkImage, nullptr);
 			m_vkImage = VK_NULL_HANDLE;
 		}
@@ -129,6 +137,15 @@ VkExtent3D Image::GetImageSize() const
 	return extent;
 }
 
+VkMemoryRequirements Image::GetMemoryRequirements() const
+{
+	CHECK_TRUE(m_vkImage != VK_NULL_HANDLE, "Image is not created!");
+	CHECK_TRUE(!m_imageInformation.isSwapchainImage, "Swapchain image doesn't have memory requirements!");
+	VkMemoryRequirements requirements{};
+	vkGetImageMemoryRequirements(MyDevice::GetInstance().vkDevice, m_vkImage, &requirements);
+	return requirements;
+}
+
 VkImage Image::GetVkImage() const
 {
 	return m_vkImage;
@@ -407,6 +424,53 @@ ImageCreateInfo& ImageCreateInfo::CustomizeSampleCount(VkSampleCountFlagBits sam
 	return *this;
 }
 
+ImageCreateInfo& ImageCreateInfo::CustomizeMemoryAliasing()
+{
+	m_aliasMemory = true;
+	return *this;
+}
+
+size_t ImageCreateInfo::GetHash() const
+{
+	size_t result = 0;
+
+	hash_combine(result, m_usage);
+	hash_combine(result, m_type);
+	hash_combine(result, m_optWidth);
+	hash_combine(result, m_optHeight);
+	hash_combine(result, m_optDepth);
+	hash_combine(result, m_optMipLevels);
+	hash_combine(result, m_optArrayLayers);
+	hash_combine(result, m_optFormat);
+	hash_combine(result, m_optTiling);
+	hash_combine(result, m_optMemoryProperty);
+	hash_combine(result, m_optSampleCount);
+	hash_combine(result, m_aliasMemory);
+	return result;
+}
+
+VkFormat ImageCreateInfo::GetFormat() const
+{
+	return m_optFormat.value_or(VK_FORMAT_R32G32B32A32_SFLOAT);
+}
+
+VkSampleCountFlagBits ImageCreateInfo::GetSampleCount() const
+{
+	return m_optSampleCount.value_or(VK_SAMPLE_COUNT_1_BIT);
+}
+
+bool ImageCreateInfo::HasSameExtent(const ImageCreateInfo& inOther) const
+{
+	return m_optWidth == inOther.m_optWidth
+		&& m_optHeight == inOther.m_optHeight
+		&& m_optDepth == inOther.m_optDepth;
+}
+
+bool ImageCreateInfo::IsSwapchainSized() const
+{
+	return !m_optWidth.has_value();
+}
+
 SwapchainImageCreateInfo& SwapchainImageCreateInfo::SetUp(VkImage inSwapchain, VkImageUsageFlags inUsage, VkFormat inFormat)
 {
 	m_vkHandle = inSwapchain;
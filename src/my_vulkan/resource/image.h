@@ -26,6 +26,7 @@ private:
 	std::optional<VkImageTiling> m_optTiling;					// optional, default value: VK_IMAGE_TILING_OPTIMAL;
 	std::optional<VkMemoryPropertyFlags> m_optMemoryProperty;	// optional, default value: VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
 	std::optional<VkSampleCountFlagBits> m_optSampleCount;		// optional, default value: VK_SAMPLE_COUNT_1_BIT;
+	bool m_aliasMemory = false;									// optional, default value: false
 
 	friend class Image;
 
@@ -61,6 +62,26 @@ public:
 
 	// Optional, default: VK_SAMPLE_COUNT_1_BIT
 	ImageCreateInfo& CustomizeSampleCount(VkSampleCountFlagBits sampleCount);
+
+	// Optional, default: false. If enabled, Create() only creates the VkImage without any memory,
+	// owner must bind it to aliasing memory through MemoryAllocator before use
+	ImageCreateInfo& CustomizeMemoryAliasing();
+
+	// Hash of everything set, an image sized by the swapchain doesn't hash the swapchain size
+	size_t GetHash() const;
+
+	VkFormat GetFormat() const;
+
+	VkSampleCountFlagBits GetSampleCount() const;
+
+	// Whether both have the same size, images sized by the swapchain count as the same
+	bool HasSameExtent(const ImageCreateInfo& inOther) const;
+
+	// Whether the size isn't set, so the image takes the swapchain size when it's created
+	bool IsSwapchainSized() const;
+
+	// Same settings, compares what GetHash hashes
+	bool operator==(const ImageCreateInfo& inOther) const = default;
 };
 
 class SwapchainImageCreateInfo final
@@ -164,6 +185,7 @@ public:
 		VkSampleCountFlagBits samples;
 		VkMemoryPropertyFlags memoryProperty;			  // image memory
 		bool isSwapchainImage = false;
+		bool isMemoryAliased = false;						  // memory is bound and freed by others
 	};
 
 private:
@@ -199,5 +221,7 @@ public:
 
 	VkExtent3D GetImageSize() const;
 
+	VkMemoryRequirements GetMemoryRequirements() const;
+
 	VkImage GetVkImage() const;
 };
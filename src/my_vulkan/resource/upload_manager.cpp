@@ -0,0 +1,460 @@
+#include "upload_manager.h"
+#include "buffer.h"
+#include "device.h"
+#include "command_pool.h"
+#include "utils.h"
+
+namespace
+{
+	auto _RecordBarrierBatch(VkCommandBuffer inVkCommandBuffer, const QueueContext::BarrierBatch& inBatch)->void
+	{
+		if (!inBatch.HasBarriers())
+		{
+			return;
+		}
+
+		vkCmdPipelineBarrier(
+			inVkCommandBuffer,
+			inBatch.srcStages,
+			inBatch.dstStages,
+			inBatch.flags,
+			0, nullptr,
+			static_cast<uint32_t>(inBatch.bufferBarriers.size()), inBatch.bufferBarriers.data(),
+			static_cast<uint32_t>(inBatch.imageBarriers.size()), inBatch.imageBarriers.data());
+	}
+}
+
+UploadManager::~UploadManager()
+{
+	Destroy();
+}
+
+auto UploadManager::_CreateRingSet(RingSet& outRingSet, QueueFamilyType inQueueFamilyType, VkDeviceSize inRingSize)->void
+{
+	auto& device = MyDevice::GetInstance();
+	BufferCreateInfo bufferCreateInfo{};
+	CommandPoolCreateInfo commandPoolCreateInfo{};
+
+	bufferCreateInfo.SetBufferSize(inRingSize).SetBufferUsage(VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+	bufferCreateInfo.CustomizeMemoryProperty(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	commandPoolCreateInfo.CustomizeQueueFamilyType(inQueueFamilyType);
+	commandPoolCreateInfo.CustomizeCommandPoolCreateFlags(VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+
+	for (auto& ring : outRingSet.rings)
+	{
+		ring.uptrStagingBuffer = std::make_unique<Buffer>();
+		ring.uptrStagingBuffer->Create(&bufferCreateInfo);
+		ring.uptrCommandPool = std::make_unique<CommandPool>();
+		ring.uptrCommandPool->Create(&commandPoolCreateInfo);
+		if (inQueueFamilyType != QueueFamilyType::TRANSFER)
+		{
+			ring.vkFence = device.CreateVkFence(VK_FENCE_CREATE_SIGNALED_BIT);
+		}
+		ring.timelineValue = 0;
+		ring.head = 0;
+	}
+
+	outRingSet.currentIndex = 0;
+	outRingSet.queueFamilyType = inQueueFamilyType;
+}
+
+auto UploadManager::_DestroyRingSet(RingSet& inoutRingSet)->void
+{
+	auto& device = MyDevice::GetInstance();
+
+	for (auto& ring : inoutRingSet.rings)
+	{
+		_RetireRing(ring);
+		ring.uptrCommandPool->Destroy();
+		ring.uptrCommandPool.reset();
+		ring.uptrStagingBuffer->Destroy();
+		ring.uptrStagingBuffer.reset();
+		if (ring.vkFence != VK_NULL_HANDLE)
+		{
+			device.DestroyVkFence(ring.vkFence);
+		}
+	}
+
+	inoutRingSet.queueFamilyType = QueueFamilyType::UNSET;
+}
+
+auto UploadManager::_GetCurrentRing(RingSet& inRingSet)->StagingRing&
+{
+	return inRingSet.rings[inRingSet.currentIndex];
+}
+
+auto UploadManager::_GetRecordingCommandBuffer(RingSet& inRingSet)->VkCommandBuffer
+{
+	StagingRing& ring = _GetCurrentRing(inRingSet);
+
+	if (ring.vkCommandBuffer == VK_NULL_HANDLE)
+	{
+		VkCommandBufferBeginInfo beginInfo{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+		ring.vkCommandBuffer = ring.uptrCommandPool->AllocateOrGetCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+		VK_CHECK(vkBeginCommandBuffer(ring.vkCommandBuffer, &beginInfo), "Failed to begin upload command buffer!");
+	}
+
+	return ring.vkCommandBuffer;
+}
+
+auto UploadManager::_StageHostData(RingSet& inRingSet, const void* inSrc, VkDeviceSize inSize, VkBuffer& outStagingBuffer, VkDeviceSize& outOffset)->void
+{
+	if (inSize > m_ringSize)
+	{
+		// too large for a ring, use a dedicated staging buffer that lives until the ring retires
+		auto uptrStagingBuffer = std::make_unique<Buffer>();
+		BufferCreateInfo bufferCreateInfo{};
+
+		bufferCreateInfo.SetBufferSize(inSize).SetBufferUsage(VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+		bufferCreateInfo.CustomizeMemoryProperty(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+		uptrStagingBuffer->Create(&bufferCreateInfo);
+		uptrStagingBuffer->CopyFromHost(inSrc, 0, inSize);
+
+		outStagingBuffer = uptrStagingBuffer->GetVkBuffer();
+		outOffset = 0;
+		_GetCurrentRing(inRingSet).oversizedStagingBuffers.push_back(std::move(uptrStagingBuffer));
+		return;
+	}
+
+	VkDeviceSize offset = common_utils::AlignUp(_GetCurrentRing(inRingSet).head, STAGING_OFFSET_ALIGNMENT);
+	if (offset + inSize > m_ringSize)
+	{
+		_FlushLocked(inRingSet);
+		offset = 0;
+	}
+
+	StagingRing& ring = _GetCurrentRing(inRingSet);
+	ring.uptrStagingBuffer->CopyFromHost(inSrc, offset, inSize);
+	ring.head = offset + inSize;
+
+	outStagingBuffer = ring.uptrStagingBuffer->GetVkBuffer();
+	outOffset = offset;
+}
+
+auto UploadManager::_FlushLocked(RingSet& inoutRingSet)->void
+{
+	StagingRing& ring = _GetCurrentRing(inoutRingSet);
+	if (ring.vkCommandBuffer == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	const bool isTransfer = (inoutRingSet.queueFamilyType == QueueFamilyType::TRANSFER);
+
+	if (isTransfer)
+	{
+		// release ownership to graphics queue, the matching acquire is recorded by AcquireOnGraphics
+		if (!ring.ownershipTransfers.empty())
+		{
+			auto batches = m_uptrGraphicsContext->GrabResourcesFromOther(
+				m_uptrTransferContext.get(),
+				ring.ownershipTransfers.data(),
+				ring.ownershipTransfers.size());
+
+			_RecordBarrierBatch(ring.vkCommandBuffer, batches.release);
+			m_pendingAcquires.push_back({ m_transferSubmittedValue + 1, std::move(batches.acquire) });
+			ring.ownershipTransfers.clear();
+		}
+	}
+	else
+	{
+		// make the uploaded data visible to whatever is submitted to the queue after us
+		VkMemoryBarrier barrier{ VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+		vkCmdPipelineBarrier(
+			ring.vkCommandBuffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+			0,
+			1, &barrier,
+			0, nullptr,
+			0, nullptr);
+	}
+	VK_CHECK(vkEndCommandBuffer(ring.vkCommandBuffer), "Failed to end upload command buffer!");
+
+	auto& device = MyDevice::GetInstance();
+	VkSubmitInfo submitInfo{ VK_STRUCTURE_TYPE_SUBMIT_INFO };
+	VkTimelineSemaphoreSubmitInfo timelineInfo{ VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO };
+	const VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+	uint64_t timelineValue = 0;
+	uint64_t syncUploadValue = 0;
+	VkFence fence = VK_NULL_HANDLE;
+
+	submitInfo.pNext = &timelineInfo;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &ring.vkCommandBuffer;
+
+	if (isTransfer)
+	{
+		timelineValue = ++m_transferSubmittedValue;
+		submitInfo.signalSemaphoreCount = 1;
+		submitInfo.pSignalSemaphores = &m_vkTransferTimeline;
+		timelineInfo.signalSemaphoreValueCount = 1;
+		timelineInfo.pSignalSemaphoreValues = &timelineValue;
+		ring.timelineValue = timelineValue;
+	}
+	else
+	{
+		if (m_graphicsWaitValue != 0)
+		{
+			timelineValue = m_graphicsWaitValue;
+			submitInfo.waitSemaphoreCount = 1;
+			submitInfo.pWaitSemaphores = &m_vkTransferTimeline;
+			submitInfo.pWaitDstStageMask = &waitStage;
+			timelineInfo.waitSemaphoreValueCount = 1;
+			timelineInfo.pWaitSemaphoreValues = &timelineValue;
+			m_graphicsWaitValue = 0;
+		}
+		syncUploadValue = ++m_syncUploadSubmittedValue;
+		submitInfo.signalSemaphoreCount = 1;
+		submitInfo.pSignalSemaphores = &m_vkSyncUploadTimeline;
+		timelineInfo.signalSemaphoreValueCount = 1;
+		timelineInfo.pSignalSemaphoreValues = &syncUploadValue;
+		fence = ring.vkFence;
+		VK_CHECK(vkResetFences(device.vkDevice, 1, &fence), "Failed to reset upload fence!");
+	}
+
+	VK_CHECK(device.QueueSubmit(device.GetQueueOfType(inoutRingSet.queueFamilyType), 1, &submitInfo, fence), "Failed to submit uploads!");
+	ring.vkCommandBuffer = VK_NULL_HANDLE;
+
+	inoutRingSet.currentIndex = static_cast<uint8_t>((inoutRingSet.currentIndex + 1) % RING_COUNT);
+	_RetireRing(_GetCurrentRing(inoutRingSet));
+}
+
+auto UploadManager::_RetireRing(StagingRing& inoutRing)->void
+{
+	CHECK_TRUE(inoutRing.vkCommandBuffer == VK_NULL_HANDLE, "Can't retire a recording upload ring!");
+
+	if (inoutRing.vkFence != VK_NULL_HANDLE)
+	{
+		VK_CHECK(MyDevice::GetInstance().WaitForFences({ inoutRing.vkFence }), "Failed to wait for upload fence!");
+	}
+	else
+	{
+		_WaitTransferTimeline(inoutRing.timelineValue);
+	}
+
+	inoutRing.uptrCommandPool->Reset();
+	for (auto& uptrBuffer : inoutRing.oversizedStagingBuffers)
+	{
+		uptrBuffer->Destroy();
+	}
+	inoutRing.oversizedStagingBuffers.clear();
+	inoutRing.head = 0;
+}
+
+auto UploadManager::_WaitTransferTimeline(uint64_t inValue)->void
+{
+	if (inValue == 0)
+	{
+		return;
+	}
+
+	VkSemaphoreWaitInfo waitInfo{ VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO };
+	waitInfo.semaphoreCount = 1;
+	waitInfo.pSemaphores = &m_vkTransferTimeline;
+	waitInfo.pValues = &inValue;
+
+	VK_CHECK(vkWaitSemaphores(MyDevice::GetInstance().vkDevice, &waitInfo, UINT64_MAX), "Failed to wait for transfer timeline!");
+}
+
+auto UploadManager::Create(VkDeviceSize inRingSize)->void
+{
+	CHECK_TRUE(m_ringSize == 0, "Upload manager is already created!");
+	CHECK_TRUE(inRingSize > 0, "Invalid upload ring size!");
+
+	auto& device = MyDevice::GetInstance();
+	VkSemaphoreTypeCreateInfo semaphoreTypeInfo{ VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO };
+	VkSemaphoreCreateInfo semaphoreInfo{ VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
+
+	semaphoreTypeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+	semaphoreTypeInfo.initialValue = 0;
+	semaphoreInfo.pNext = &semaphoreTypeInfo;
+	m_vkTransferTimeline = device.CreateVkSemaphore(&semaphoreInfo);
+	m_vkSyncUploadTimeline = device.CreateVkSemaphore(&semaphoreInfo);
+	m_transferSubmittedValue = 0;
+	m_syncUploadSubmittedValue = 0;
+	m_graphicsWaitValue = 0;
+
+	m_uptrGraphicsContext = std::make_unique<QueueContext>(device.GetQueueFamilyIndexOfType(QueueFamilyType::GRAPHICS));
+	m_uptrTransferContext = std::make_unique<QueueContext>(device.GetQueueFamilyIndexOfType(QueueFamilyType::TRANSFER));
+
+	m_ringSize = inRingSize;
+	_CreateRingSet(m_graphicsRings, QueueFamilyType::GRAPHICS, inRingSize);
+	_CreateRingSet(m_transferRings, QueueFamilyType::TRANSFER, inRingSize);
+}
+
+auto UploadManager::Destroy()->void
+{
+	if (m_ringSize == 0)
+	{
+		return;
+	}
+
+	WaitTillDone();
+
+	_DestroyRingSet(m_transferRings);
+	_DestroyRingSet(m_graphicsRings);
+	m_pendingAcquires.clear();
+	m_uptrTransferContext.reset();
+	m_uptrGraphicsContext.reset();
+	MyDevice::GetInstance().DestroyVkSemaphore(m_vkTransferTimeline);
+	MyDevice::GetInstance().DestroyVkSemaphore(m_vkSyncUploadTimeline);
+
+	m_ringSize = 0;
+}
+
+auto UploadManager::UploadToBuffer(const void* inSrc, const Buffer* inDstBuffer, VkDeviceSize inDstOffset, VkDeviceSize inSize)->void
+{
+	CHECK_TRUE(m_ringSize != 0, "Upload manager is not created!");
+	CHECK_TRUE(inSrc != nullptr, "No data to upload!");
+	CHECK_TRUE(inDstBuffer != nullptr, "No buffer to upload to!");
+	CHECK_TRUE(inDstOffset + inSize <= inDstBuffer->GetBufferInformation().size, "Upload out of buffer range!");
+
+	if (inSize == 0)
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	VkBufferCopy copyRegion{};
+	VkBuffer vkStagingBuffer = VK_NULL_HANDLE;
+
+	_StageHostData(m_graphicsRings, inSrc, inSize, vkStagingBuffer, copyRegion.srcOffset);
+	copyRegion.dstOffset = inDstOffset;
+	copyRegion.size = inSize;
+	vkCmdCopyBuffer(_GetRecordingCommandBuffer(m_graphicsRings), vkStagingBuffer, inDstBuffer->GetVkBuffer(), 1, &copyRegion);
+}
+
+auto UploadManager::UploadToBufferAsync(
+	const void* inSrc,
+	const Buffer* inDstBuffer,
+	VkDeviceSize inDstOffset,
+	VkDeviceSize inSize,
+	VkAccessFlags inDstAccess,
+	VkPipelineStageFlags inDstStage)->UploadToken
+{
+	CHECK_TRUE(m_ringSize != 0, "Upload manager is not created!");
+	CHECK_TRUE(inSrc != nullptr, "No data to upload!");
+	CHECK_TRUE(inDstBuffer != nullptr, "No buffer to upload to!");
+	CHECK_TRUE(inDstOffset + inSize <= inDstBuffer->GetBufferInformation().size, "Upload out of buffer range!");
+
+	UploadToken token{};
+	if (inSize == 0)
+	{
+		return token;
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	VkBufferCopy copyRegion{};
+	VkBuffer vkStagingBuffer = VK_NULL_HANDLE;
+	QueueContext::ResourceReleased released{};
+	QueueContext::ResourceAcquired acquired{};
+
+	_StageHostData(m_transferRings, inSrc, inSize, vkStagingBuffer, copyRegion.srcOffset);
+	copyRegion.dstOffset = inDstOffset;
+	copyRegion.size = inSize;
+	vkCmdCopyBuffer(_GetRecordingCommandBuffer(m_transferRings), vkStagingBuffer, inDstBuffer->GetVkBuffer(), 1, &copyRegion);
+
+	released.SetBufferMemory(inDstBuffer, inSize, inDstOffset);
+	released.SetReleaseTime(VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+	m_uptrTransferContext->PushResources(&released, 1);
+
+	acquired.SetBufferMemory(inDstBuffer, inSize, inDstOffset);
+	acquired.SetAcquiredTime(inDstAccess, inDstStage);
+	_GetCurrentRing(m_transferRings).ownershipTransfers.push_back(acquired);
+
+	// the copy is in current ring, which signals the next value when it's flushed
+	token.value = m_transferSubmittedValue + 1;
+	return token;
+}
+
+auto UploadManager::AcquireOnGraphics(UploadToken inToken)->void
+{
+	if (inToken.value == 0)
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if (inToken.value > m_transferSubmittedValue)
+	{
+		_FlushLocked(m_transferRings);
+	}
+	CHECK_TRUE(inToken.value <= m_transferSubmittedValue, "Invalid upload token!");
+
+	while (!m_pendingAcquires.empty() && m_pendingAcquires.front().timelineValue <= inToken.value)
+	{
+		const PendingAcquire& pending = m_pendingAcquires.front();
+
+		_RecordBarrierBatch(_GetRecordingCommandBuffer(m_graphicsRings), pending.barriers);
+		m_graphicsWaitValue = std::max(m_graphicsWaitValue, pending.timelineValue);
+		m_pendingAcquires.pop_front();
+	}
+}
+
+auto UploadManager::IsUploadDone(UploadToken inToken)->bool
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	uint64_t completedValue = 0;
+
+	if (inToken.value > m_transferSubmittedValue)
+	{
+		return false;
+	}
+
+	VK_CHECK(vkGetSemaphoreCounterValue(MyDevice::GetInstance().vkDevice, m_vkTransferTimeline, &completedValue), "Failed to query transfer timeline!");
+	return completedValue >= inToken.value;
+}
+
+auto UploadManager::WaitForUpload(UploadToken inToken)->void
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if (inToken.value > m_transferSubmittedValue)
+	{
+		_FlushLocked(m_transferRings);
+	}
+	_WaitTransferTimeline(inToken.value);
+}
+
+auto UploadManager::HasPendingUploads()->bool
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return _GetCurrentRing(m_graphicsRings).vkCommandBuffer != VK_NULL_HANDLE;
+}
+
+auto UploadManager::Flush()->void
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	_FlushLocked(m_transferRings);
+	_FlushLocked(m_graphicsRings);
+}
+
+auto UploadManager::FlushForOtherQueue()->uint64_t
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	_FlushLocked(m_graphicsRings);
+	return m_syncUploadSubmittedValue;
+}
+
+auto UploadManager::WaitTillDone()->void
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	std::vector<VkFence> fences;
+
+	_FlushLocked(m_transferRings);
+	_FlushLocked(m_graphicsRings);
+	for (const auto& ring : m_graphicsRings.rings)
+	{
+		fences.push_back(ring.vkFence);
+	}
+
+	VK_CHECK(MyDevice::GetInstance().WaitForFences(fences), "Failed to wait for upload fences!");
+	_WaitTransferTimeline(m_transferSubmittedValue);
+}
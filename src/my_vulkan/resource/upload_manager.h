@@ -0,0 +1,146 @@
+#pragma once
+#include "common.h"
+#include "common_enums.h"
+#include "context.h"
+#include <mutex>
+#include <deque>
+
+class Buffer;
+class CommandPool;
+
+// Stages host data for device local resources. Each ring owns a persistently mapped
+// staging buffer and one command buffer, uploads are sub-allocated linearly from the
+// current ring and recorded into its command buffer, a flush submits them together and
+// moves to the next ring. A ring is reused only after its last submission is done,
+// so uploading never waits for the whole queue to go idle.
+//
+// Synchronous uploads go through the graphics queue and signal a timeline semaphore that
+// other queues wait on before they consume them. Asynchronous uploads go through
+// the transfer queue and signal a timeline semaphore, the graphics queue only waits for
+// them and acquires ownership of the uploaded resources when AcquireOnGraphics is called.
+class UploadManager final
+{
+public:
+	// Transfer timeline value that is signaled once the upload is done, 0 means nothing to wait
+	struct UploadToken
+	{
+		uint64_t value = 0;
+	};
+
+private:
+	static constexpr uint8_t RING_COUNT = 3; // one ring per frame in flight
+	static constexpr VkDeviceSize DEFAULT_RING_SIZE = 32ull * 1024ull * 1024ull;
+	static constexpr VkDeviceSize STAGING_OFFSET_ALIGNMENT = 16;
+
+	struct StagingRing
+	{
+		std::unique_ptr<Buffer> uptrStagingBuffer;
+		std::unique_ptr<CommandPool> uptrCommandPool;
+		std::vector<std::unique_ptr<Buffer>> oversizedStagingBuffers; // uploads that don't fit in a ring
+		std::vector<QueueContext::ResourceAcquired> ownershipTransfers; // async uploads to hand over to graphics
+		VkCommandBuffer vkCommandBuffer = VK_NULL_HANDLE;                // VK_NULL_HANDLE if nothing is recorded
+		VkFence vkFence = VK_NULL_HANDLE;                                // graphics rings retire by fence
+		uint64_t timelineValue = 0;                                      // transfer rings retire by timeline value
+		VkDeviceSize head = 0;
+	};
+
+	struct RingSet
+	{
+		std::array<StagingRing, RING_COUNT> rings;
+		uint8_t currentIndex = 0;
+		QueueFamilyType queueFamilyType = QueueFamilyType::UNSET;
+	};
+
+	struct PendingAcquire
+	{
+		uint64_t timelineValue;
+		QueueContext::BarrierBatch barriers;
+	};
+
+private:
+	RingSet m_graphicsRings;
+	RingSet m_transferRings;
+	VkDeviceSize m_ringSize = 0;
+	VkSemaphore m_vkTransferTimeline = VK_NULL_HANDLE;
+	uint64_t m_transferSubmittedValue = 0;          // value signaled by the latest transfer submission
+	uint64_t m_graphicsWaitValue = 0;               // transfer value the next graphics submission waits on
+	VkSemaphore m_vkSyncUploadTimeline = VK_NULL_HANDLE;
+	uint64_t m_syncUploadSubmittedValue = 0;        // value signaled by the latest synchronous upload flush
+	std::deque<PendingAcquire> m_pendingAcquires;   // released by transfer queue, not yet acquired by graphics
+	std::unique_ptr<QueueContext> m_uptrGraphicsContext;
+	std::unique_ptr<QueueContext> m_uptrTransferContext;
+	std::mutex m_mutex;
+
+private:
+	auto _CreateRingSet(RingSet& outRingSet, QueueFamilyType inQueueFamilyType, VkDeviceSize inRingSize)->void;
+
+	auto _DestroyRingSet(RingSet& inoutRingSet)->void;
+
+	auto _GetCurrentRing(RingSet& inRingSet)->StagingRing&;
+
+	// Begin the command buffer of current ring if it's not recording yet
+	auto _GetRecordingCommandBuffer(RingSet& inRingSet)->VkCommandBuffer;
+
+	// Copy host data to staging memory of current ring, flush and move to next ring if it's full.
+	// Data that can never fit in a ring goes to a dedicated staging buffer
+	auto _StageHostData(RingSet& inRingSet, const void* inSrc, VkDeviceSize inSize, VkBuffer& outStagingBuffer, VkDeviceSize& outOffset)->void;
+
+	// Submit the recorded uploads of current ring and move to the next ring, need to be locked
+	auto _FlushLocked(RingSet& inoutRingSet)->void;
+
+	// Wait the ring's last submission and recycle its resources
+	auto _RetireRing(StagingRing& inoutRing)->void;
+
+	auto _WaitTransferTimeline(uint64_t inValue)->void;
+
+public:
+	UploadManager() = default;
+	UploadManager(const UploadManager&) = delete;
+	UploadManager& operator=(const UploadManager&) = delete;
+	~UploadManager();
+
+	auto Create(VkDeviceSize inRingSize = DEFAULT_RING_SIZE)->void;
+
+	auto Destroy()->void;
+
+	// Copy host data to the buffer, the data is copied to staging memory immediately,
+	// the device copy is executed on graphics queue when uploads are flushed
+	auto UploadToBuffer(const void* inSrc, const Buffer* inDstBuffer, VkDeviceSize inDstOffset, VkDeviceSize inSize)->void;
+
+	// Copy host data to the buffer on transfer queue, return the token to wait on.
+	// The buffer range is owned by transfer queue until AcquireOnGraphics is called with the token,
+	// inDstAccess and inDstStage describe how graphics queue will consume it
+	auto UploadToBufferAsync(
+		const void* inSrc,
+		const Buffer* inDstBuffer,
+		VkDeviceSize inDstOffset,
+		VkDeviceSize inSize,
+		VkAccessFlags inDstAccess,
+		VkPipelineStageFlags inDstStage)->UploadToken;
+
+	// Make the next graphics submission wait for the token and acquire ownership of
+	// every asynchronous upload up to it, graphics work that doesn't consume them never waits
+	auto AcquireOnGraphics(UploadToken inToken)->void;
+
+	// Return true if the asynchronous upload is done on device
+	auto IsUploadDone(UploadToken inToken)->bool;
+
+	// Block the host till the asynchronous upload is done on device
+	auto WaitForUpload(UploadToken inToken)->void;
+
+	// Return true if synchronous uploads are recorded but not submitted yet
+	auto HasPendingUploads()->bool;
+
+	// Submit all pending uploads, commands submitted to the graphics
+	// queue afterwards will see the synchronous uploads
+	auto Flush()->void;
+
+	// Submit pending synchronous uploads for work on a queue other than graphics, return the
+	// value of GetSyncUploadTimeline that work must wait on, 0 if nothing was ever uploaded
+	auto FlushForOtherQueue()->uint64_t;
+
+	auto GetSyncUploadTimeline() const->VkSemaphore { return m_vkSyncUploadTimeline; };
+
+	// Flush and wait till all uploads done
+	auto WaitTillDone()->void;
+};
@@ -0,0 +1,609 @@
+#include "coroutine_task.h"
+#include "task_scheduler.h"
+#include "command_queue.h"
+#include "device.h"
+#include "utils.h"
+#include <TaskScheduler.h>
+#include <stdexcept>
+#include <algorithm>
+
+namespace
+{
+	char s_doneMarker = 0;
+
+	// stored as the continuation of a finished coroutine
+	void* const DONE = &s_doneMarker;
+
+	// Owners blocked on a coroutine sleep here rather than on the coroutine, which they destroy
+	// as soon as it's done. DONE is stored under the mutex, so the notify never touches the frame
+	std::mutex s_doneMutex;
+	std::condition_variable s_doneCondition;
+
+	// Return the awaiting coroutine, don't touch the promise after this
+	auto _MarkDone(std::atomic<void*>& inoutContinuation)->void*
+	{
+		std::lock_guard<std::mutex> lock(s_doneMutex);
+		return inoutContinuation.exchange(DONE, std::memory_order_acq_rel);
+	}
+
+	auto _IsTaskComplete(const IWaitable* inWaitable)->bool
+	{
+		return inWaitable->GetCompletable()->GetIsComplete();
+	}
+
+	auto _IsTimelineValueReached(VkSemaphore inSemaphore, uint64_t inValue)->bool
+	{
+		uint64_t completedValue = 0;
+		VK_CHECK(vkGetSemaphoreCounterValue(MyDevice::GetInstance().vkDevice, inSemaphore, &completedValue), "Failed to query timeline semaphore!");
+		return completedValue >= inValue;
+	}
+
+	auto _IsFenceSignaled(VkFence inFence)->bool
+	{
+		return vkGetFenceStatus(MyDevice::GetInstance().vkDevice, inFence) == VK_SUCCESS;
+	}
+}
+
+auto TaskAwaiter::await_ready() const->bool
+{
+	CHECK_TRUE(m_pWaitable != nullptr, "No task to await!");
+	return _IsTaskComplete(m_pWaitable);
+}
+
+auto TaskAwaiter::await_suspend(std::coroutine_handle<> inHandle)->void
+{
+	CoroutineScheduler::GetInstance().AddTaskWait(m_pWaitable, inHandle);
+}
+
+auto QueueValueAwaiter::await_ready() const->bool
+{
+	CHECK_TRUE(m_pQueue != nullptr, "No command queue to await!");
+	CHECK_TRUE(m_pQueue->GetSyncMode() == CommandQueue::SyncMode::TIMELINE, "Command queue is not in timeline mode!");
+	CHECK_TRUE(m_value <= m_pQueue->GetSubmittedValue(), "Can't await a value that is not submitted yet!");
+
+	// query the semaphore directly, the queue caches its completed value for the owner thread only
+	return _IsTimelineValueReached(m_pQueue->GetTimelineSemaphore(), m_value);
+}
+
+auto QueueValueAwaiter::await_suspend(std::coroutine_handle<> inHandle)->void
+{
+	CoroutineScheduler::GetInstance().AddTimelineWait(m_pQueue->GetTimelineSemaphore(), m_value, inHandle);
+}
+
+auto FenceAwaiter::await_ready() const->bool
+{
+	CHECK_TRUE(m_vkFence != VK_NULL_HANDLE, "No fence to await!");
+	return _IsFenceSignaled(m_vkFence);
+}
+
+auto FenceAwaiter::await_suspend(std::coroutine_handle<> inHandle)->void
+{
+	CoroutineScheduler::GetInstance().AddFenceWait(m_vkFence, inHandle);
+}
+
+FileReadAwaiter::FileReadAwaiter(const std::string& inFilePath)
+	: m_filePath(inFilePath)
+{
+}
+
+FileReadAwaiter::~FileReadAwaiter() = default;
+
+auto FileReadAwaiter::await_suspend(std::coroutine_handle<> inHandle)->void
+{
+	m_uptrReadTask = std::make_unique<MyMultiThreadTask>(
+		[this](uint32_t, uint32_t, uint32_t)
+		{
+			try
+			{
+				common_utils::ReadFile(m_filePath, m_data);
+			}
+			catch (...)
+			{
+				m_exception = std::current_exception();
+			}
+		});
+	m_uptrReadTask->SetName("ReadFile");
+	m_uptrReadTask->SetPriority(TaskPriority::BACKGROUND);
+	MyTaskScheduler::GetInstance().AddMutiThreadTask(m_uptrReadTask.get());
+
+	// resumed once enki is done with the task, so it can go with the coroutine frame
+	CoroutineScheduler::GetInstance().AddTaskWait(m_uptrReadTask.get(), inHandle);
+}
+
+auto FileReadAwaiter::await_resume()->std::vector<uint8_t>
+{
+	if (m_exception != nullptr)
+	{
+		std::rethrow_exception(m_exception);
+	}
+	return std::move(m_data);
+}
+
+auto task_await::QueueValue(const CommandQueue* inQueue, uint64_t inValue)->QueueValueAwaiter
+{
+	return QueueValueAwaiter(inQueue, inValue);
+}
+
+auto task_await::Fence(VkFence inFence)->FenceAwaiter
+{
+	return FenceAwaiter(inFence);
+}
+
+auto task_await::ReadFile(const std::string& inFilePath)->FileReadAwaiter
+{
+	return FileReadAwaiter(inFilePath);
+}
+
+auto CoroutineTask::ChildAwaiter::await_ready() const->bool
+{
+	return m_pChild->m_started && m_pChild->IsDone();
+}
+
+auto CoroutineTask::ChildAwaiter::await_suspend(Handle inHandle)->bool
+{
+	CHECK_TRUE(m_pChild->m_handle, "No coroutine to await!");
+	promise_type& childPromise = m_pChild->m_handle.promise();
+	const bool needStart = !m_pChild->m_started;
+	void* expected = nullptr;
+
+	m_pChild->m_started = true;
+
+	// once the continuation is set the child may finish and resume us on another thread,
+	// so nothing of this frame is touched after that
+	if (!childPromise.m_continuation.compare_exchange_strong(expected, inHandle.address(), std::memory_order_acq_rel))
+	{
+		// anything but DONE is another awaiter, taking its place would leave it suspended forever
+		CHECK_TRUE(expected == DONE, "A coroutine can only be awaited once!");
+		return false; // already done, go on without suspending
+	}
+	if (needStart)
+	{
+		childPromise.ScheduleResume();
+	}
+	return true;
+}
+
+auto CoroutineTask::ChildAwaiter::await_resume() const->void
+{
+	m_pChild->m_handle.promise().RethrowIfFailed();
+}
+
+auto CoroutineTask::FinalAwaiter::await_suspend(Handle inHandle) noexcept->void
+{
+	// the owner may destroy the coroutine right after this
+	void* continuation = _MarkDone(inHandle.promise().m_continuation);
+
+	s_doneCondition.notify_all();
+
+	// the awaiting coroutine goes on as a new task rather than on this stack, so it may destroy us right away
+	if (continuation != nullptr)
+	{
+		Handle::from_address(continuation).promise().ScheduleResume();
+	}
+}
+
+CoroutineTask::promise_type::promise_type() = default;
+
+auto CoroutineTask::promise_type::get_return_object()->CoroutineTask
+{
+	return CoroutineTask(Handle::from_promise(*this));
+}
+
+auto CoroutineTask::promise_type::ScheduleResume()->void
+{
+	CoroutineScheduler::GetInstance().ScheduleResume(Handle::from_promise(*this));
+}
+
+auto CoroutineTask::promise_type::Cancel()->void
+{
+	const std::exception_ptr exception = std::make_exception_ptr(std::runtime_error("Coroutine is cancelled, its scheduler is destroyed!"));
+	void* handleAddress = Handle::from_promise(*this).address();
+
+	// the awaiting coroutine is suspended on this one, it would never go on either
+	while (handleAddress != nullptr && handleAddress != DONE)
+	{
+		promise_type& promise = Handle::from_address(handleAddress).promise();
+
+		promise.m_exception = exception;
+		handleAddress = _MarkDone(promise.m_continuation);
+	}
+	s_doneCondition.notify_all();
+}
+
+auto CoroutineTask::promise_type::IsDone() const->bool
+{
+	return m_continuation.load(std::memory_order_acquire) == DONE;
+}
+
+auto CoroutineTask::promise_type::RethrowIfFailed() const->void
+{
+	if (m_exception != nullptr)
+	{
+		std::rethrow_exception(m_exception);
+	}
+}
+
+CoroutineTask::CoroutineTask(CoroutineTask&& inoutOther) noexcept
+	: m_handle(std::exchange(inoutOther.m_handle, nullptr)), m_started(std::exchange(inoutOther.m_started, false))
+{
+}
+
+CoroutineTask& CoroutineTask::operator=(CoroutineTask&& inoutOther) noexcept
+{
+	if (this != &inoutOther)
+	{
+		// the old coroutine goes with the temporary
+		CoroutineTask other(std::move(inoutOther));
+		std::swap(m_handle, other.m_handle);
+		std::swap(m_started, other.m_started);
+	}
+	return *this;
+}
+
+CoroutineTask::~CoroutineTask()
+{
+	if (!m_handle)
+	{
+		return;
+	}
+
+	if (m_started)
+	{
+		_WaitDone();
+	}
+	m_handle.destroy();
+	m_handle = nullptr;
+}
+
+auto CoroutineTask::_WaitDone()->void
+{
+	// sleep till it's done, helping with other tasks here could block on unrelated work
+	std::unique_lock<std::mutex> lock(s_doneMutex);
+	s_doneCondition.wait(lock, [this]() { return m_handle.promise().IsDone(); });
+}
+
+auto CoroutineTask::Start()->void
+{
+	CHECK_TRUE(m_handle, "No coroutine to start!");
+	CHECK_TRUE(!m_started, "Coroutine is already started!");
+
+	m_started = true;
+	m_handle.promise().ScheduleResume();
+}
+
+auto CoroutineTask::IsDone() const->bool
+{
+	return m_handle && m_handle.promise().IsDone();
+}
+
+auto CoroutineTask::Wait()->void
+{
+	CHECK_TRUE(m_started, "Coroutine is not started!");
+
+	_WaitDone();
+	m_handle.promise().RethrowIfFailed();
+}
+
+std::unique_ptr<CoroutineScheduler> CoroutineScheduler::s_uptrInstance;
+std::atomic<bool> CoroutineScheduler::s_hasTaskWaits{ false };
+
+CoroutineScheduler::~CoroutineScheduler()
+{
+	Destroy();
+}
+
+auto CoroutineScheduler::GetInstance()->CoroutineScheduler&
+{
+	if (s_uptrInstance == nullptr)
+	{
+		s_uptrInstance.reset(new CoroutineScheduler());
+	}
+
+	return *s_uptrInstance;
+}
+
+auto CoroutineScheduler::_StartLocked()->void
+{
+	if (!m_thread.joinable())
+	{
+		m_stop = false;
+		m_thread = std::thread(&CoroutineScheduler::_Run, this);
+	}
+}
+
+auto CoroutineScheduler::_Run()->void
+{
+	auto& taskScheduler = MyTaskScheduler::GetInstance();
+	std::vector<std::coroutine_handle<>> readyHandles;
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	taskScheduler.RegisterExternalThread();
+	while (!m_stop)
+	{
+		m_wakeRequested = false;
+		_PollWaitsLocked(readyHandles);
+		if (!readyHandles.empty())
+		{
+			lock.unlock();
+			for (auto handle : readyHandles)
+			{
+				ScheduleResume(handle);
+			}
+			readyHandles.clear();
+			lock.lock();
+			continue;
+		}
+
+		_WaitForProgress(lock);
+	}
+	lock.unlock();
+	taskScheduler.DeregisterExternalThread();
+}
+
+auto CoroutineScheduler::_HasWaitsLocked() const->bool
+{
+	return !m_taskWaits.empty() || !m_timelineWaits.empty() || !m_fenceWaits.empty();
+}
+
+auto CoroutineScheduler::_PollWaitsLocked(std::vector<std::coroutine_handle<>>& outReadyHandles)->void
+{
+	auto pollList = [&outReadyHandles](auto& inoutWaits, auto&& inIsReady)
+		{
+			for (size_t i = 0; i < inoutWaits.size();)
+			{
+				if (!inIsReady(inoutWaits[i]))
+				{
+					++i;
+					continue;
+				}
+				outReadyHandles.push_back(inoutWaits[i].handle);
+				inoutWaits[i] = inoutWaits.back();
+				inoutWaits.pop_back();
+			}
+		};
+
+	pollList(m_taskWaits, [](const TaskWait& inWait) { return _IsTaskComplete(inWait.pWaitable); });
+	pollList(m_timelineWaits, [](const TimelineWait& inWait) { return _IsTimelineValueReached(inWait.vkSemaphore, inWait.value); });
+	pollList(m_fenceWaits, [](const FenceWait& inWait) { return _IsFenceSignaled(inWait.vkFence); });
+	s_hasTaskWaits.store(!m_taskWaits.empty(), std::memory_order_release);
+}
+
+auto CoroutineScheduler::_WaitForProgress(std::unique_lock<std::mutex>& inoutLock)->void
+{
+	auto funcWakeRequested = [this]() { return m_stop || m_wakeRequested; };
+
+	if (!_HasWaitsLocked())
+	{
+		m_condition.wait(inoutLock, funcWakeRequested);
+		return;
+	}
+
+	if (m_taskWaits.empty() && (m_timelineWaits.empty() || m_fenceWaits.empty()))
+	{
+		_WaitGpu(inoutLock);
+		return;
+	}
+
+	// tasks wake us as they finish, GPU waits next to them are checked now and then
+	auto timeout = std::chrono::duration_cast<std::chrono::microseconds>(TASK_FALLBACK_INTERVAL);
+	if (!m_timelineWaits.empty() || !m_fenceWaits.empty())
+	{
+		timeout = GPU_POLL_INTERVAL;
+	}
+	if (std::any_of(m_taskWaits.begin(), m_taskWaits.end(), [](const TaskWait& inWait) { return inWait.finishing; }))
+	{
+		timeout = TASK_FINISH_INTERVAL;
+	}
+	m_condition.wait_for(inoutLock, timeout, funcWakeRequested);
+}
+
+auto CoroutineScheduler::_WaitGpu(std::unique_lock<std::mutex>& inoutLock)->void
+{
+	// only one kind of GPU wait is left, let the driver wake us when any of them is done
+	const VkDevice vkDevice = MyDevice::GetInstance().vkDevice;
+	VkResult result = VK_SUCCESS;
+
+	if (!m_fenceWaits.empty())
+	{
+		std::vector<VkFence> fences;
+
+		for (const FenceWait& wait : m_fenceWaits)
+		{
+			fences.push_back(wait.vkFence);
+		}
+
+		inoutLock.unlock();
+		result = vkWaitForFences(vkDevice, static_cast<uint32_t>(fences.size()), fences.data(), VK_FALSE, GPU_WAIT_TIMEOUT_NS);
+		inoutLock.lock();
+		CHECK_TRUE(result == VK_SUCCESS || result == VK_TIMEOUT, "Failed to wait for fences!");
+		return;
+	}
+
+	std::vector<VkSemaphore> semaphores;
+	std::vector<uint64_t> values;
+	VkSemaphoreWaitInfo waitInfo{ VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO };
+
+	for (const TimelineWait& wait : m_timelineWaits)
+	{
+		semaphores.push_back(wait.vkSemaphore);
+		values.push_back(wait.value);
+	}
+	waitInfo.flags = VK_SEMAPHORE_WAIT_ANY_BIT;
+	waitInfo.semaphoreCount = static_cast<uint32_t>(semaphores.size());
+	waitInfo.pSemaphores = semaphores.data();
+	waitInfo.pValues = values.data();
+
+	inoutLock.unlock();
+	result = vkWaitSemaphores(vkDevice, &waitInfo, GPU_WAIT_TIMEOUT_NS);
+	inoutLock.lock();
+	CHECK_TRUE(result == VK_SUCCESS || result == VK_TIMEOUT, "Failed to wait for timeline semaphores!");
+}
+
+auto CoroutineScheduler::AddTaskWait(const IWaitable* inWaitable, std::coroutine_handle<> inHandle)->void
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	_StartLocked();
+	m_taskWaits.push_back({ inWaitable, inHandle });
+	s_hasTaskWaits.store(true, std::memory_order_release);
+	m_wakeRequested = true;
+	m_condition.notify_one();
+}
+
+auto CoroutineScheduler::AddTimelineWait(VkSemaphore inSemaphore, uint64_t inValue, std::coroutine_handle<> inHandle)->void
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	_StartLocked();
+	m_timelineWaits.push_back({ inSemaphore, inValue, inHandle });
+	m_wakeRequested = true;
+	m_condition.notify_one();
+}
+
+auto CoroutineScheduler::AddFenceWait(VkFence inFence, std::coroutine_handle<> inHandle)->void
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	_StartLocked();
+	m_fenceWaits.push_back({ inFence, inHandle });
+	m_wakeRequested = true;
+	m_condition.notify_one();
+}
+
+auto CoroutineScheduler::ScheduleResume(std::coroutine_handle<> inHandle)->void
+{
+	ResumeSlot* pSlot = nullptr;
+
+	{
+		std::lock_guard<std::mutex> lock(m_resumeMutex);
+
+		// a slot whose task is still returning from the last resume is skipped, not waited for
+		for (size_t i = 0; i < m_resumeSlots.size() && pSlot == nullptr; ++i)
+		{
+			ResumeSlot* pCandidate = m_resumeSlots[(m_nextResumeSlot + i) % m_resumeSlots.size()].get();
+
+			if (!pCandidate->reserved.load(std::memory_order_acquire) && _IsTaskComplete(pCandidate->uptrTask.get()))
+			{
+				pSlot = pCandidate;
+			}
+		}
+		if (pSlot == nullptr)
+		{
+			auto uptrSlot = std::make_unique<ResumeSlot>();
+
+			pSlot = uptrSlot.get();
+			pSlot->uptrTask = std::make_unique<MyMultiThreadTask>(
+				[pSlot](uint32_t, uint32_t, uint32_t)
+				{
+					pSlot->handle.resume();
+				});
+			pSlot->uptrTask->SetName("Coroutine");
+			m_resumeSlots.push_back(std::move(uptrSlot));
+		}
+		m_nextResumeSlot = (m_nextResumeSlot + 1) % m_resumeSlots.size();
+		pSlot->reserved.store(true, std::memory_order_relaxed);
+	}
+
+	// enki may run the task inline when its pipe is full, so it's added out of the lock
+	pSlot->handle = inHandle;
+	MyTaskScheduler::GetInstance().AddMutiThreadTask(pSlot->uptrTask.get());
+	pSlot->reserved.store(false, std::memory_order_release);
+}
+
+auto CoroutineScheduler::NotifyTaskComplete(const enki::ICompletable* inTask)->void
+{
+	if (!s_hasTaskWaits.load(std::memory_order_acquire))
+	{
+		return;
+	}
+
+	// the flag is only set by a wait, so the instance exists
+	CoroutineScheduler& self = *s_uptrInstance;
+	std::lock_guard<std::mutex> lock(self.m_mutex);
+	bool waited = false;
+
+	for (TaskWait& wait : self.m_taskWaits)
+	{
+		if (wait.pWaitable->GetCompletable() == inTask)
+		{
+			wait.finishing = true;
+			waited = true;
+		}
+	}
+	if (waited)
+	{
+		self.m_wakeRequested = true;
+		self.m_condition.notify_one();
+	}
+}
+
+auto CoroutineScheduler::Destroy()->void
+{
+	auto& taskScheduler = MyTaskScheduler::GetInstance();
+	std::vector<const IWaitable*> tasksToWait;
+
+	// resumes in flight may still park coroutines, let them finish before the thread stops.
+	// A wait may run tasks that take our locks, so none is held while waiting
+	{
+		std::lock_guard<std::mutex> lock(m_resumeMutex);
+		for (const auto& uptrSlot : m_resumeSlots)
+		{
+			tasksToWait.push_back(uptrSlot->uptrTask.get());
+		}
+	}
+	for (const IWaitable* pTask : tasksToWait)
+	{
+		taskScheduler.WaitForTask(pTask);
+	}
+	tasksToWait.clear();
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+		m_condition.notify_one();
+	}
+
+	if (m_thread.joinable())
+	{
+		m_thread.join();
+	}
+
+	std::vector<std::coroutine_handle<>> parkedHandles;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		for (const TaskWait& wait : m_taskWaits)
+		{
+			tasksToWait.push_back(wait.pWaitable);
+			parkedHandles.push_back(wait.handle);
+		}
+		for (const TimelineWait& wait : m_timelineWaits)
+		{
+			parkedHandles.push_back(wait.handle);
+		}
+		for (const FenceWait& wait : m_fenceWaits)
+		{
+			parkedHandles.push_back(wait.handle);
+		}
+		m_taskWaits.clear();
+		m_timelineWaits.clear();
+		m_fenceWaits.clear();
+		s_hasTaskWaits.store(false, std::memory_order_release);
+	}
+
+	// e.g. a file read writes into the coroutine frame till it's done
+	for (const IWaitable* pTask : tasksToWait)
+	{
+		taskScheduler.WaitForTask(pTask);
+	}
+
+	// the owners destroy them, a handle destroyed here would be destroyed again by its CoroutineTask
+	for (auto handle : parkedHandles)
+	{
+		CoroutineTask::Handle::from_address(handle.address()).promise().Cancel();
+	}
+
+	std::lock_guard<std::mutex> lock(m_resumeMutex);
+	m_resumeSlots.clear();
+	m_nextResumeSlot = 0;
+}
@@ -0,0 +1,263 @@
+#pragma once
+#include "common.h"
+#include <coroutine>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+
+namespace enki { class ICompletable; }
+class IWaitable;
+class CommandQueue;
+class MyMultiThreadTask;
+class CoroutineTask;
+
+// Awaiters handed to co_await inside a CoroutineTask. None of them blocks a worker thread,
+// the coroutine is parked in CoroutineScheduler and resumed as a new task once it's ready
+class TaskAwaiter final
+{
+private:
+	const IWaitable* m_pWaitable = nullptr;
+
+public:
+	TaskAwaiter(const IWaitable* inWaitable) : m_pWaitable(inWaitable) {};
+	auto await_ready() const->bool;
+	auto await_suspend(std::coroutine_handle<> inHandle)->void;
+	auto await_resume() const->void {};
+};
+
+class QueueValueAwaiter final
+{
+private:
+	const CommandQueue* m_pQueue = nullptr;
+	uint64_t m_value = 0;
+
+public:
+	QueueValueAwaiter(const CommandQueue* inQueue, uint64_t inValue) : m_pQueue(inQueue), m_value(inValue) {};
+	auto await_ready() const->bool;
+	auto await_suspend(std::coroutine_handle<> inHandle)->void;
+	auto await_resume() const->void {};
+};
+
+class FenceAwaiter final
+{
+private:
+	VkFence m_vkFence = VK_NULL_HANDLE;
+
+public:
+	FenceAwaiter(VkFence inFence) : m_vkFence(inFence) {};
+	auto await_ready() const->bool;
+	auto await_suspend(std::coroutine_handle<> inHandle)->void;
+	auto await_resume() const->void {};
+};
+
+class FileReadAwaiter final
+{
+private:
+	std::string m_filePath;
+	std::vector<uint8_t> m_data;
+	std::exception_ptr m_exception;
+	std::unique_ptr<MyMultiThreadTask> m_uptrReadTask; // runs on a worker, the coroutine is parked on it
+
+public:
+	FileReadAwaiter(const std::string& inFilePath);
+	FileReadAwaiter(FileReadAwaiter&&) = delete;
+	~FileReadAwaiter();
+	auto await_ready() const->bool { return false; };
+	auto await_suspend(std::coroutine_handle<> inHandle)->void;
+	auto await_resume()->std::vector<uint8_t>;
+};
+
+namespace task_await
+{
+	// The value must be handed to the driver already, call Flush first if the queue defers submissions
+	auto QueueValue(const CommandQueue* inQueue, uint64_t inValue)->QueueValueAwaiter;
+
+	auto Fence(VkFence inFence)->FenceAwaiter;
+
+	// Read the whole file in a background task, co_await returns its bytes
+	auto ReadFile(const std::string& inFilePath)->FileReadAwaiter;
+}
+
+// Coroutine running on task scheduler worker threads, e.g.
+//   CoroutineTask BuildBlas(...) { co_await task_await::QueueValue(pQueue, uploadValue); ...; co_await task_await::QueueValue(pQueue, buildValue); ... }
+// It starts suspended, call Start or co_await it from another CoroutineTask, only one coroutine may await it.
+// Besides awaiters above it can co_await another CoroutineTask or an IWaitable task
+class CoroutineTask final
+{
+public:
+	class promise_type;
+	using Handle = std::coroutine_handle<promise_type>;
+
+private:
+	class ChildAwaiter final
+	{
+	private:
+		CoroutineTask* m_pChild = nullptr;
+
+	public:
+		ChildAwaiter(CoroutineTask* inChild) : m_pChild(inChild) {};
+		auto await_ready() const->bool;
+		auto await_suspend(Handle inHandle)->bool;
+		auto await_resume() const->void;
+	};
+
+	class FinalAwaiter final
+	{
+	public:
+		auto await_ready() const noexcept->bool { return false; };
+		auto await_suspend(Handle inHandle) noexcept->void;
+		auto await_resume() const noexcept->void {};
+	};
+
+public:
+	class promise_type final
+	{
+	private:
+		std::atomic<void*> m_continuation{ nullptr }; // awaiting coroutine, DONE once finished
+		std::exception_ptr m_exception;
+
+	public:
+		promise_type();
+
+		auto get_return_object()->CoroutineTask;
+		auto initial_suspend() const noexcept->std::suspend_always { return {}; };
+		auto final_suspend() const noexcept->FinalAwaiter { return {}; };
+		auto return_void()->void {};
+		auto unhandled_exception()->void { m_exception = std::current_exception(); };
+
+		// only awaiters that never block a thread are allowed
+		auto await_transform(CoroutineTask& inChild)->ChildAwaiter { return ChildAwaiter(&inChild); };
+		auto await_transform(CoroutineTask&& inChild)->ChildAwaiter { return ChildAwaiter(&inChild); };
+		auto await_transform(const IWaitable& inWaitable)->TaskAwaiter { return TaskAwaiter(&inWaitable); };
+		auto await_transform(TaskAwaiter inAwaiter)->TaskAwaiter { return inAwaiter; };
+		auto await_transform(QueueValueAwaiter inAwaiter)->QueueValueAwaiter { return inAwaiter; };
+		auto await_transform(FenceAwaiter inAwaiter)->FenceAwaiter { return inAwaiter; };
+		auto await_transform(FileReadAwaiter&& inAwaiter)->FileReadAwaiter&& { return std::move(inAwaiter); };
+
+		// Resume the coroutine on a worker thread
+		auto ScheduleResume()->void;
+
+		// Finish a coroutine that will never be resumed, and the ones awaiting it, with an exception
+		auto Cancel()->void;
+
+		auto IsDone() const->bool;
+
+		auto RethrowIfFailed() const->void;
+
+		friend class CoroutineTask;
+	};
+
+private:
+	Handle m_handle;
+	bool m_started = false;
+
+private:
+	explicit CoroutineTask(Handle inHandle) : m_handle(inHandle) {};
+
+	auto _WaitDone()->void;
+
+public:
+	CoroutineTask(CoroutineTask&& inoutOther) noexcept;
+	CoroutineTask& operator=(CoroutineTask&& inoutOther) noexcept;
+	CoroutineTask(const CoroutineTask&) = delete;
+	CoroutineTask& operator=(const CoroutineTask&) = delete;
+	~CoroutineTask();
+
+	auto Start()->void;
+
+	auto IsDone() const->bool;
+
+	// Block till the coroutine finishes and rethrow its exception, not for use inside a task
+	auto Wait()->void;
+};
+
+// Owns the thread that parks suspended coroutines: it sleeps till tasks, fences or timeline values
+// are done, then hands the coroutines back to the task scheduler
+class CoroutineScheduler final
+{
+private:
+	struct TaskWait
+	{
+		const IWaitable* pWaitable = nullptr;
+		std::coroutine_handle<> handle;
+		bool finishing = false; // enki is about to mark it complete, see NotifyTaskComplete
+	};
+
+	struct TimelineWait
+	{
+		VkSemaphore vkSemaphore = VK_NULL_HANDLE;
+		uint64_t value = 0;
+		std::coroutine_handle<> handle;
+	};
+
+	struct FenceWait
+	{
+		VkFence vkFence = VK_NULL_HANDLE;
+		std::coroutine_handle<> handle;
+	};
+
+	// Runs coroutines on worker threads, taken again once enki is done with its task
+	struct ResumeSlot
+	{
+		std::unique_ptr<MyMultiThreadTask> uptrTask;
+		std::coroutine_handle<> handle;
+		std::atomic<bool> reserved{ false }; // picked but not added yet
+	};
+
+	static constexpr uint64_t GPU_WAIT_TIMEOUT_NS = 1'000'000;
+	// GPU waits next to other kinds of waits can't be slept on, they are checked this often
+	static constexpr auto GPU_POLL_INTERVAL = std::chrono::microseconds(500);
+	// a task is reported right before enki marks it complete, check again after this
+	static constexpr auto TASK_FINISH_INTERVAL = std::chrono::microseconds(10);
+	// a task done while its wait was being added isn't reported, it's found after this
+	static constexpr auto TASK_FALLBACK_INTERVAL = std::chrono::milliseconds(1);
+
+	static std::unique_ptr<CoroutineScheduler> s_uptrInstance;
+	static std::atomic<bool> s_hasTaskWaits; // lets task completions skip the lock when no one waits
+	std::thread m_thread;
+	std::mutex m_mutex;
+	std::condition_variable m_condition;
+	bool m_stop = false;
+	bool m_wakeRequested = false;
+	std::vector<TaskWait> m_taskWaits;
+	std::vector<TimelineWait> m_timelineWaits;
+	std::vector<FenceWait> m_fenceWaits;
+	std::mutex m_resumeMutex;
+	std::vector<std::unique_ptr<ResumeSlot>> m_resumeSlots;
+	size_t m_nextResumeSlot = 0;
+
+private:
+	CoroutineScheduler() = default;
+
+	auto _StartLocked()->void;
+	auto _Run()->void;
+	auto _HasWaitsLocked() const->bool;
+	// Move coroutines that can go on out of the wait lists
+	auto _PollWaitsLocked(std::vector<std::coroutine_handle<>>& outReadyHandles)->void;
+	// Sleep till some wait may be done or something new is added
+	auto _WaitForProgress(std::unique_lock<std::mutex>& inoutLock)->void;
+	// Sleep in the driver, only fences or only timeline values may be left
+	auto _WaitGpu(std::unique_lock<std::mutex>& inoutLock)->void;
+
+public:
+	~CoroutineScheduler();
+
+	static auto GetInstance()->CoroutineScheduler&;
+
+	auto AddTaskWait(const IWaitable* inWaitable, std::coroutine_handle<> inHandle)->void;
+	auto AddTimelineWait(VkSemaphore inSemaphore, uint64_t inValue, std::coroutine_handle<> inHandle)->void;
+	auto AddFenceWait(VkFence inFence, std::coroutine_handle<> inHandle)->void;
+
+	// Resume the coroutine as a new task
+	auto ScheduleResume(std::coroutine_handle<> inHandle)->void;
+
+	// Called by every task as it finishes, wakes the thread if a coroutine is parked on it
+	static auto NotifyTaskComplete(const enki::ICompletable* inTask)->void;
+
+	// Stop the thread. Coroutines still parked are never resumed, they finish with an exception
+	// so their owners can destroy them
+	auto Destroy()->void;
+};
@@ -0,0 +1,125 @@
+#include "frame_arena.h"
+#include "task_scheduler.h"
+#include "utils.h"
+#include <algorithm>
+
+FrameArena::FrameArena(size_t inBlockSize)
+	: m_blockSize(inBlockSize)
+{
+	CHECK_TRUE(inBlockSize > 0, "Invalid frame arena block size!");
+}
+
+auto FrameArena::_AddBlock(size_t inMinSize)->void
+{
+	Block& block = m_blocks.emplace_back();
+	block.size = std::max(m_blockSize, inMinSize);
+	block.uptrData = std::make_unique_for_overwrite<std::byte[]>(block.size);
+}
+
+auto FrameArena::do_allocate(size_t inBytes, size_t inAlignment)->void*
+{
+	while (true)
+	{
+		if (m_blockIndex >= m_blocks.size())
+		{
+			// room for the worst alignment padding as well
+			_AddBlock(inBytes + inAlignment);
+		}
+
+		Block& block = m_blocks[m_blockIndex];
+		const uintptr_t base = reinterpret_cast<uintptr_t>(block.uptrData.get());
+		const uintptr_t alignedAddress = common_utils::AlignUp(base + m_offset, inAlignment);
+		const size_t newOffset = static_cast<size_t>(alignedAddress - base) + inBytes;
+
+		if (newOffset <= block.size)
+		{
+			m_usedSize += newOffset - m_offset;
+			m_offset = newOffset;
+			return reinterpret_cast<void*>(alignedAddress);
+		}
+
+		++m_blockIndex;
+		m_offset = 0;
+	}
+}
+
+auto FrameArena::Reset()->void
+{
+	if (m_blocks.size() > 1 || (!m_blocks.empty() && m_blocks[0].size > std::max(m_blockSize, MAX_RETAINED_SIZE)))
+	{
+		size_t totalSize = 0;
+		for (const Block& block : m_blocks)
+		{
+			totalSize += block.size;
+		}
+		m_blocks.clear();
+		_AddBlock(std::min(totalSize, std::max(m_blockSize, MAX_RETAINED_SIZE)));
+	}
+
+	m_blockIndex = 0;
+	m_offset = 0;
+	m_usedSize = 0;
+}
+
+std::unique_ptr<FrameArenaPool> FrameArenaPool::s_uptrInstance;
+
+auto FrameArenaPool::GetInstance()->FrameArenaPool&
+{
+	if (s_uptrInstance == nullptr)
+	{
+		s_uptrInstance.reset(new FrameArenaPool());
+	}
+
+	return *s_uptrInstance;
+}
+
+auto FrameArenaPool::Create(uint32_t inFrameCount)->void
+{
+	CHECK_TRUE(m_arenas.empty(), "Frame arena pool is already created!");
+	CHECK_TRUE(inFrameCount > 0, "Invalid frame count!");
+
+	const uint32_t threadCount = MyTaskScheduler::GetInstance().GetThreadCount();
+	m_arenas.resize(inFrameCount);
+	for (auto& frameArenas : m_arenas)
+	{
+		frameArenas.resize(threadCount);
+		for (auto& uptrArena : frameArenas)
+		{
+			uptrArena = std::make_unique<FrameArena>();
+		}
+	}
+	m_currentFrameIndex.store(0, std::memory_order_release);
+}
+
+auto FrameArenaPool::Destroy()->void
+{
+	m_arenas.clear();
+}
+
+auto FrameArenaPool::StartFrame(uint32_t inFrameIndex)->void
+{
+	CHECK_TRUE(inFrameIndex < m_arenas.size(), "Invalid frame index!");
+
+	for (auto& uptrArena : m_arenas[inFrameIndex])
+	{
+		uptrArena->Reset();
+	}
+	m_currentFrameIndex.store(inFrameIndex, std::memory_order_release);
+}
+
+auto FrameArenaPool::GetThreadResource()->std::pmr::memory_resource*
+{
+	if (m_arenas.empty())
+	{
+		return std::pmr::get_default_resource();
+	}
+
+	const uint32_t threadIndex = MyTaskScheduler::GetInstance().GetCurrentThreadIndex();
+	auto& frameArenas = m_arenas[m_currentFrameIndex.load(std::memory_order_acquire)];
+	if (threadIndex >= frameArenas.size())
+	{
+		return std::pmr::get_default_resource();
+	}
+
+	return frameArenas[threadIndex].get();
+}
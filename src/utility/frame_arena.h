@@ -0,0 +1,80 @@
+#pragma once
+#include "common.h"
+#include <atomic>
+#include <cstddef>
+#include <memory_resource>
+
+// Bump allocator for CPU data that only lives while a frame is recorded. Deallocation is a
+// no-op, everything is dropped at once by Reset. Not thread safe, each thread owns its arena
+class FrameArena final : public std::pmr::memory_resource
+{
+private:
+	struct Block
+	{
+		std::unique_ptr<std::byte[]> uptrData;
+		size_t size = 0;
+	};
+
+	static constexpr size_t DEFAULT_BLOCK_SIZE = 64 * 1024;
+	static constexpr size_t MAX_RETAINED_SIZE = 4 * 1024 * 1024; // a spike above this is given back at reset
+
+	std::vector<Block> m_blocks;
+	size_t m_blockIndex = 0; // block being bumped
+	size_t m_offset = 0;     // in the block being bumped
+	size_t m_usedSize = 0;   // handed out since last reset
+	size_t m_blockSize = DEFAULT_BLOCK_SIZE;
+
+private:
+	auto _AddBlock(size_t inMinSize)->void;
+
+protected:
+	virtual auto do_allocate(size_t inBytes, size_t inAlignment)->void* override;
+	virtual auto do_deallocate(void*, size_t, size_t)->void override {};
+	virtual auto do_is_equal(const std::pmr::memory_resource& inOther) const noexcept->bool override { return this == &inOther; };
+
+public:
+	explicit FrameArena(size_t inBlockSize = DEFAULT_BLOCK_SIZE);
+	FrameArena(const FrameArena&) = delete;
+	FrameArena& operator=(const FrameArena&) = delete;
+
+	// Drop all allocations, blocks are merged into one so a steady frame never allocates.
+	// The merged block is capped at MAX_RETAINED_SIZE
+	auto Reset()->void;
+
+	auto GetUsedSize() const->size_t { return m_usedSize; };
+};
+
+// Containers that opt into a frame arena, e.g. FrameVector<VkImageMemoryBarrier> barriers(FrameArenaPool::GetInstance().GetThreadResource());
+// They must only grow on the thread that created them and must not outlive the frame
+template<typename T>
+using FrameVector = std::pmr::vector<T>;
+
+template<typename Key, typename T>
+using FrameUnorderedMap = std::pmr::unordered_map<Key, T>;
+
+// One arena per frame in flight per task scheduler thread. The graphics queue rewinds the
+// arenas of a frame once its fence retires and the frame slot is reused
+class FrameArenaPool final
+{
+private:
+	static std::unique_ptr<FrameArenaPool> s_uptrInstance;
+	std::vector<std::vector<std::unique_ptr<FrameArena>>> m_arenas; // [frame][thread]
+	std::atomic<uint32_t> m_currentFrameIndex{ 0 };
+
+private:
+	FrameArenaPool() = default;
+
+public:
+	static auto GetInstance()->FrameArenaPool&;
+
+	auto Create(uint32_t inFrameCount)->void;
+
+	auto Destroy()->void;
+
+	// The frame slot is free again, rewind its arenas and allocate from them from now on
+	auto StartFrame(uint32_t inFrameIndex)->void;
+
+	// Arena of the calling thread for the current frame, the default resource on threads
+	// the task scheduler doesn't know or before the pool is created
+	auto GetThreadResource()->std::pmr::memory_resource*;
+};
@@ -1,65 +1,156 @@
 #include "frame_graph.h"
 #include "frame_graph_node.h"
-#include <queue>
+#include "event_allocator.h"
+#include "frame_graph_scheduler.h"
+#include "render_pass.h"
+#include "device.h"
+#include "image.h"
+#include "buffer.h"
+#include <algorithm>
 
 namespace
 {
 	uint32_t _GetThreadByQueueType(FrameGraphQueueType inQueueType)
 	{
-		return 0;
+		const MyTaskScheduler& taskScheduler = MyTaskScheduler::GetInstance();
+
+		switch (inQueueType)
+		{
+		case FrameGraphQueueType::GRAPHICS:
+			return taskScheduler.GetGraphicsThreadIndex();
+		case FrameGraphQueueType::COMPUTE:
+			return taskScheduler.GetComputeThreadIndex();
+		default:
+			return 0;
+		}
+	}
+
+	auto _MakeDependencyInfo(
+		const std::vector<VkBufferMemoryBarrier2KHR>& inBufferBarriers,
+		const std::vector<VkImageMemoryBarrier2KHR>& inImageBarriers) -> VkDependencyInfoKHR
+	{
+		VkDependencyInfoKHR dependencyInfo{ VK_STRUCTURE_TYPE_DEPENDENCY_INFO_KHR };
+
+		dependencyInfo.bufferMemoryBarrierCount = static_cast<uint32_t>(inBufferBarriers.size());
+		dependencyInfo.pBufferMemoryBarriers = inBufferBarriers.data();
+		dependencyInfo.imageMemoryBarrierCount = static_cast<uint32_t>(inImageBarriers.size());
+		dependencyInfo.pImageMemoryBarriers = inImageBarriers.data();
+		return dependencyInfo;
 	}
 }
 
-void FrameGraph::_TopologicalSortFrameGraphNodes(std::vector<std::set<FrameGraphNode*>>& outOrderedNodeIndex)
+FrameGraph::FrameGraph() = default;
+
+FrameGraph::~FrameGraph()
 {
-	size_t remainCount = 0;
-	std::unordered_map<FrameGraphNode*, size_t> nodeInDegree;
-	std::queue<FrameGraphNode*> zeroInNodes;
+	_ReleaseDeviceObjects();
+}
 
-	for (const auto& uptrNode : m_nodes)
+void FrameGraph::_ReleaseDeviceObjects()
+{
+	for (auto& group : m_renderPassGroups)
 	{
-		std::set<FrameGraphNode*> preNodes;
-		uptrNode->GetPreGraphNodes(preNodes);
-		nodeInDegree.insert({ uptrNode.get(), preNodes.size() });
-		++remainCount;
-		if (preNodes.size() == 0)
+		group.uptrFramebuffer->Destroy();
+		group.uptrRenderPass->Destroy();
+	}
+	m_renderPassGroups.clear();
+
+	// events are unsignaled after every frame, so they can go back to the pool
+	if (m_uptrEventAllocator != nullptr)
+	{
+		for (const auto& splitBarrier : m_splitBarriers)
 		{
-			zeroInNodes.push(uptrNode.get());
+			m_uptrEventAllocator->FreeVkEvent(&splitBarrier.vkEvent, 1);
 		}
 	}
+	m_splitBarriers.clear();
+	m_aliasingBarriers.clear();
 
-	while (!zeroInNodes.empty())
+	// aliased resources must be gone before the memory they are bound to
+	for (auto& uptrImage : m_internalImages)
+	{
+		uptrImage->Destroy();
+	}
+	m_internalImages.clear();
+	for (auto& uptrBuffer : m_internalBuffers)
 	{
-		size_t n = zeroInNodes.size();
-		outOrderedNodeIndex.push_back({});
-		auto& currentLayerNodes = outOrderedNodeIndex.back();
+		uptrBuffer->Destroy();
+	}
+	m_internalBuffers.clear();
+	m_externalImages.clear();
+	m_externalBuffers.clear();
+	m_handleToImage.clear();
+	m_handleToBuffer.clear();
 
-		for (size_t i = 0; i < n; ++i)
-		{
-			FrameGraphNode* pNode = zeroInNodes.front();
-			std::set<FrameGraphNode*> postNodes;
+	auto pAllocator = MyDevice::GetInstance().GetMemoryAllocator();
+	for (VmaAllocation memory : m_aliasingMemories)
+	{
+		pAllocator->FreeAliasingMemory(memory);
+	}
+	m_aliasingMemories.clear();
+	for (VmaAllocation memory : m_swapchainSizedAliasingMemories)
+	{
+		pAllocator->FreeAliasingMemory(memory);
+	}
+	m_swapchainSizedAliasingMemories.clear();
+
+	m_nodeBatches.clear();
+	m_culledNodes.clear();
+}
 
-			zeroInNodes.pop();
-			
-			// node with zero in degree should be in front
-			currentLayerNodes.insert(pNode);
-			pNode->GetPostGraphNodes(postNodes);
+void FrameGraph::_TopologicalSortFrameGraphNodes(std::vector<std::set<FrameGraphNode*>>& outOrderedNodeIndex)
+{
+	FrameGraphScheduler scheduler;
+	std::vector<std::vector<size_t>> batches;
+	std::unordered_map<FrameGraphNode*, size_t> nodeIndices;
 
-			// update post node in degree, if it reaches 0, add it to queue
-			for (auto pPostNode : postNodes)
+	// split and aliasing barriers refer to the batches the builder arranged, so keep them as they are
+	if (!m_nodeBatches.empty())
+	{
+		for (const auto& batch : m_nodeBatches)
+		{
+			auto& currentLayerNodes = outOrderedNodeIndex.emplace_back();
+			for (FrameGraphNodeHandle handle : batch)
 			{
-				auto& currentNodeInDegree = nodeInDegree[pPostNode];
-				CHECK_TRUE(currentNodeInDegree > 0);
-				--currentNodeInDegree;
-				if (currentNodeInDegree == 0)
-				{
-					zeroInNodes.push(pPostNode);
-				}
+				currentLayerNodes.insert(m_nodes[handle.handle].get());
 			}
 		}
-		remainCount -= n;
+		return;
+	}
+
+	// nodes carry no cost estimate here, so the critical path is the longest chain of nodes
+	std::vector<FrameGraphNode*> scheduledNodes;
+	for (size_t i = 0; i < m_nodes.size(); ++i)
+	{
+		if (IsNodeCulled(FrameGraphNodeHandle{ static_cast<uint32_t>(i) })) continue;
+
+		nodeIndices.insert({ m_nodes[i].get(), scheduler.AddNode(m_nodes[i]->GetQueueType()) });
+		scheduledNodes.push_back(m_nodes[i].get());
+	}
+	for (auto pNode : scheduledNodes)
+	{
+		std::set<FrameGraphNode*> postNodes;
+
+		pNode->GetPostGraphNodes(postNodes);
+		for (auto pPostNode : postNodes)
+		{
+			// nothing a culled node produces is used, so it has no live successor
+			auto iter = nodeIndices.find(pPostNode);
+			if (iter == nodeIndices.end()) continue;
+
+			scheduler.AddDependency(nodeIndices.at(pNode), iter->second);
+		}
+	}
+
+	scheduler.Schedule(batches);
+	for (const auto& batch : batches)
+	{
+		auto& currentLayerNodes = outOrderedNodeIndex.emplace_back();
+		for (size_t index : batch)
+		{
+			currentLayerNodes.insert(scheduledNodes[index]);
+		}
 	}
-	CHECK_TRUE(remainCount == 0);
 }
 
 void FrameGraph::_GenerateFrameGraphNodeBatchPrologue(const std::set<FrameGraphNode*>& inNodeBatch)
@@ -78,26 +169,25 @@ void FrameGraph::_GenerateFrameGraphNodeBatchPrologue(const std::set<FrameGraphN
 void FrameGraph::_GenerateFrameGraphNodeBatchExecutionTasks(const std::set<size_t>& inNodeBatch)
 {
 	std::set<FrameGraphNode*> nodePtrs;
-	MySinglThreadTask* prologueTask;
-	MySinglThreadTask* epilogueTask;
+	TaskGraph::NodeId prologueTask = TaskGraph::INVALID_NODE;
+	TaskGraph::NodeId epilogueTask = TaskGraph::INVALID_NODE;
 
 	for (auto nodePtr : nodePtrs)
 	{
-		std::unique_ptr<MySinglThreadTask> newTask = std::make_unique<MySinglThreadTask>(
+		TaskGraph::NodeId newTask = m_hostExecution.AddSingleThreadNode(
 			[=]()
 			{
 				nodePtr->Execute();
 			},
 			_GetThreadByQueueType(nodePtr->GetQueueType()));
+		m_hostExecution.SetNodePriority(newTask, TaskPriority::FRAME_CRITICAL);
 
 		if (!nodePtr->UseExternalCommandPool())
 		{
-			epilogueTask->DependOn(newTask.get());
+			m_hostExecution.AddEdge(newTask, epilogueTask);
 		}
-		newTask->DependOn(prologueTask);
+		m_hostExecution.AddEdge(prologueTask, newTask);
 		//if ()
-
-		m_hostExecution.push_back(std::move(newTask));
 	}
 }
 
@@ -106,31 +196,27 @@ void FrameGraph::_GenerateFrameGraphNodeBatchEpilogue(const std::set<size_t>& in
 	std::vector<VkSemaphore> toSubmit;
 	std::vector<VkSemaphore> toWait;
 	bool needSubmitCmd = false;
-	MySinglThreadTask* epilogueTask = nullptr;
+	TaskGraph::NodeId epilogueTask = TaskGraph::INVALID_NODE;
 
 	if (needSubmitCmd)
 	{
 		// create new cmd
-		std::unique_ptr<MySinglThreadTask> task = std::make_unique<MySinglThreadTask>(
+		epilogueTask = m_hostExecution.AddSingleThreadNode(
 			[]()
 			{
 				// add barrier
 				// submit queue
 			}
 			);
-		epilogueTask = task.get();
-		m_hostExecution.push_back(std::move(task));
 	}
 	else
 	{
-		std::unique_ptr<MySinglThreadTask> task = std::make_unique<MySinglThreadTask>(
+		epilogueTask = m_hostExecution.AddSingleThreadNode(
 			[]()
 			{
 				// add barrier
 			}
 			);
-		epilogueTask = task.get();
-		m_hostExecution.push_back(std::move(task));
 	}
 }
 
@@ -171,7 +257,8 @@ void FrameGraph::Compile()
 			nodePtr->RequireInputResourceState();
 		}
 
-		// build a single thread task T1 to record barrier
+		// build a single thread task T1 to record barrier and the aliasing barriers (see RecordAliasingBarriers),
+		// and wait the split barriers this batch consumes, see RecordSplitBarrierWaits
 
 		// update resource state after barriers complete
 
@@ -196,7 +283,8 @@ void FrameGraph::Compile()
 			nodePtr->PresageResourceStateTransfer();
 		}
 		
-		// build a single thread task T2 to record barrier,
+		// build a single thread task T2 to record barrier and set the events of split barriers
+		// produced by this batch (see RecordSplitBarrierSignals),
 		// if there is queue ownership transfer, submit queue with stored wait semaphore info
 		// and semaphore to signal
 
@@ -206,3 +294,93 @@ void FrameGraph::Compile()
 
 	// we collect tasks from first node batch as initial task
 }
+
+void FrameGraph::RecordSplitBarrierSignals(FrameGraphQueueType inQueue, size_t inBatch, VkCommandBuffer inVkCommandBuffer) const
+{
+	for (const auto& splitBarrier : m_splitBarriers)
+	{
+		if (splitBarrier.queueType != inQueue || splitBarrier.signalBatch != inBatch)
+		{
+			continue;
+		}
+
+		// the dependency info must match the one given to the wait
+		VkDependencyInfoKHR dependencyInfo = _MakeDependencyInfo(splitBarrier.bufferBarriers, splitBarrier.imageBarriers);
+		vkCmdSetEvent2KHR(inVkCommandBuffer, splitBarrier.vkEvent, &dependencyInfo);
+	}
+}
+
+void FrameGraph::RecordSplitBarrierWaits(FrameGraphQueueType inQueue, size_t inBatch, VkCommandBuffer inVkCommandBuffer) const
+{
+	std::vector<VkEvent> events;
+	std::vector<VkDependencyInfoKHR> dependencyInfos;
+	VkPipelineStageFlags2KHR waitStages = 0;
+
+	for (const auto& splitBarrier : m_splitBarriers)
+	{
+		if (splitBarrier.queueType != inQueue || splitBarrier.waitBatch != inBatch)
+		{
+			continue;
+		}
+
+		events.push_back(splitBarrier.vkEvent);
+		dependencyInfos.push_back(_MakeDependencyInfo(splitBarrier.bufferBarriers, splitBarrier.imageBarriers));
+		for (const auto& barrier : splitBarrier.bufferBarriers)
+		{
+			waitStages |= barrier.dstStageMask;
+		}
+		for (const auto& barrier : splitBarrier.imageBarriers)
+		{
+			waitStages |= barrier.dstStageMask;
+		}
+	}
+
+	if (events.empty())
+	{
+		return;
+	}
+
+	vkCmdWaitEvents2KHR(inVkCommandBuffer, static_cast<uint32_t>(events.size()), events.data(), dependencyInfos.data());
+
+	// unsignal the events for the next frame once the consumer stages are past the wait
+	for (VkEvent event : events)
+	{
+		vkCmdResetEvent2KHR(inVkCommandBuffer, event, waitStages);
+	}
+}
+
+void FrameGraph::RecordAliasingBarriers(FrameGraphQueueType inQueue, size_t inBatch, VkCommandBuffer inVkCommandBuffer) const
+{
+	for (const auto& aliasingBarrier : m_aliasingBarriers)
+	{
+		if (aliasingBarrier.queueType != inQueue || aliasingBarrier.batch != inBatch)
+		{
+			continue;
+		}
+
+		VkDependencyInfoKHR dependencyInfo = _MakeDependencyInfo(aliasingBarrier.bufferBarriers, aliasingBarrier.imageBarriers);
+		vkCmdPipelineBarrier2KHR(inVkCommandBuffer, &dependencyInfo);
+	}
+}
+
+bool FrameGraph::IsNodeCulled(FrameGraphNodeHandle inHandle) const
+{
+	return inHandle.handle < m_culledNodes.size() && m_culledNodes[inHandle.handle];
+}
+
+bool FrameGraph::GetSubpassOfNode(FrameGraphNodeHandle inHandle, const RenderPass*& outRenderPass, const Framebuffer*& outFramebuffer, uint32_t& outSubpass) const
+{
+	for (const auto& group : m_renderPassGroups)
+	{
+		auto iter = std::find(group.nodes.begin(), group.nodes.end(), inHandle);
+
+		if (iter != group.nodes.end())
+		{
+			outRenderPass = group.uptrRenderPass.get();
+			outFramebuffer = group.uptrFramebuffer.get();
+			outSubpass = static_cast<uint32_t>(iter - group.nodes.begin());
+			return true;
+		}
+	}
+	return false;
+}
@@ -3,6 +3,7 @@
 #include "frame_graph_resource.h"
 #include "frame_graph_compile_context.h"
 #include "task_scheduler.h"
+#include "memory_allocator.h"
 
 class FrameGraphNode;
 class Image;
@@ -10,26 +11,73 @@ class Buffer;
 class CommandBuffer;
 class FrameGraphBuilder;
 class FrameGraphBlueprint;
+class EventAllocator;
+class RenderPass;
+class Framebuffer;
 
 class FrameGraph
 {
 private:
+	// A barrier whose producer and consumer batches are far apart on the same queue. The event is set
+	// right after the producer batch and waited right before the consumer batch, so the batches in between
+	// overlap with the transition instead of the consumer taking a full wait in its prologue
+	struct SplitBarrier
+	{
+		FrameGraphQueueType queueType;
+		size_t signalBatch;
+		size_t waitBatch;
+		VkEvent vkEvent = VK_NULL_HANDLE;
+		std::vector<VkBufferMemoryBarrier2KHR> bufferBarriers;
+		std::vector<VkImageMemoryBarrier2KHR> imageBarriers;
+	};
+
 	std::vector<std::unique_ptr<FrameGraphNode>> m_nodes;
 	std::vector<std::unique_ptr<Image>> m_internalImages;
 	std::vector<std::unique_ptr<Buffer>> m_internalBuffers;
 	std::vector<Image*> m_externalImages;
 	std::vector<Buffer*> m_externalBuffers;
+	std::vector<VmaAllocation> m_aliasingMemories; // shared by internal resources whose lifetimes don't overlap
+	std::vector<VmaAllocation> m_swapchainSizedAliasingMemories; // only bound by swapchain sized images, replaced on resize
+	std::vector<std::vector<FrameGraphNodeHandle>> m_nodeBatches; // [batch], as FrameGraphBuilder arranged them
+	std::vector<bool> m_culledNodes; // [node], passes FrameGraphBuilder culled are never scheduled or recorded
 
 	std::vector<std::function<void(FrameGraph*)>> m_serializedTask;
 	std::vector<std::vector<size_t>> m_batchPrologues; // [batch][step] -> index in m_serializedTask
 	std::vector<std::vector<size_t>> m_batchEpilogues; // [batch][step] -> index in m_serializedTask
 
-	std::vector<std::unique_ptr<ISingleThreadTask>> m_hostExecution; // graph node recording tasks
+	std::vector<SplitBarrier> m_splitBarriers;
+
+	// Memory shared by internal resources changes hands at the first use of the next resource placed in it.
+	// Recorded before the batch on its queue, resources on different queues never share memory
+	struct AliasingBarrier
+	{
+		FrameGraphQueueType queueType;
+		size_t batch;
+		std::vector<VkBufferMemoryBarrier2KHR> bufferBarriers;
+		std::vector<VkImageMemoryBarrier2KHR> imageBarriers;
+	};
+	std::vector<AliasingBarrier> m_aliasingBarriers;
+	std::unique_ptr<EventAllocator> m_uptrEventAllocator;
+
+	// Graphics nodes recorded as the subpasses of one render pass, in subpass order
+	struct RenderPassGroup
+	{
+		std::vector<FrameGraphNodeHandle> nodes;
+		std::vector<FrameGraphImageHandle> attachments; // [attachment of the render pass]
+		std::unique_ptr<RenderPass> uptrRenderPass;
+		std::unique_ptr<Framebuffer> uptrFramebuffer;
+	};
+	std::vector<RenderPassGroup> m_renderPassGroups;
+
+	TaskGraph m_hostExecution; // graph node recording tasks, built in Compile and launched every frame
 	FrameGraphCompileContext m_currentContext;
 
 	std::unordered_map<FrameGraphImageHandle, Image*> m_handleToImage;
 	std::unordered_map<FrameGraphBufferHandle, Buffer*> m_handleToBuffer;
 
+	// Destroy what the last arrangement created, before the graph is arranged again or destroyed
+	void _ReleaseDeviceObjects();
+
 	void _TopologicalSortFrameGraphNodes(std::vector<std::set<FrameGraphNode*>>& outOrderedNodeIndex);
 
 	void _CreateRequiredDeviceRescource(const std::set<FrameGraphNode*>& inNodeBatch);
@@ -56,18 +104,40 @@ private:
 	};
 
 public:	
+	FrameGraph();
+	~FrameGraph();
+
 	void ReturnBufferResource(FrameGraphBufferHandle inBufferHandle);
 	
 	void ReturnImageResource(FrameGraphImageHandle inImageHandle);
 
 	size_t GetBatchOfNode(FrameGraphNodeHandle inHandle);
 
+	// Whether the builder culled the node, its outputs never reach an external resource
+	bool IsNodeCulled(FrameGraphNodeHandle inHandle) const;
+
 	CommandBuffer* GetCommandBuffer(FrameGraphQueueType inQueue, size_t inBatch);
 
 	Image* GetImage(const FrameGraphImageHandle& inHandle);
 
 	Buffer* GetBuffer(const FrameGraphBufferHandle& inHandle);
 
+	// Set the events of split barriers produced by the batch, record it after the batch's commands
+	void RecordSplitBarrierSignals(FrameGraphQueueType inQueue, size_t inBatch, VkCommandBuffer inVkCommandBuffer) const;
+
+	// Wait the split barriers consumed by the batch and reset their events,
+	// record it before the batch's commands, next to the prologue barriers
+	void RecordSplitBarrierWaits(FrameGraphQueueType inQueue, size_t inBatch, VkCommandBuffer inVkCommandBuffer) const;
+
+	// Make the first users of aliased memory in the batch wait for its previous users and discard
+	// what they left, record it before the batch's commands, next to the prologue barriers
+	void RecordAliasingBarriers(FrameGraphQueueType inQueue, size_t inBatch, VkCommandBuffer inVkCommandBuffer) const;
+
+	// Get the render pass, framebuffer and subpass of a node merged with its neighbours, return false if it isn't merged.
+	// The node of subpass 0 begins the render pass with the clear values of the render pass, the others move on
+	// with vkCmdNextSubpass, and the last one ends it
+	bool GetSubpassOfNode(FrameGraphNodeHandle inHandle, const RenderPass*& outRenderPass, const Framebuffer*& outFramebuffer, uint32_t& outSubpass) const;
+
 	void SetUp(FrameGraphBlueprint* inBlueprint);
 
 	// Decide static process based in input, only do once,
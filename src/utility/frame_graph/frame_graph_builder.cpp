@@ -1,5 +1,16 @@
 #include "frame_graph_builder.h"
 #include "frame_graph.h"
+#include "device.h"
+#include "memory_allocator.h"
+#include "event_allocator.h"
+#include "frame_graph_scheduler.h"
+#include "render_pass.h"
+#include "utils.h"
+#include "utility/hash_util.h"
+#include <algorithm>
+#include <bit>
+#include <map>
+#include <tuple>
 
 namespace
 {
@@ -44,8 +55,225 @@ namespace
         barrier.subresourceRange = inRange;
         return barrier;
     }
+
+    // Split barriers between adjacent batches gain nothing over a prologue barrier
+    constexpr size_t MIN_SPLIT_BARRIER_BATCH_DISTANCE = 2;
+
+    auto MakeBufferBarrier2(
+        const VkBufferMemoryBarrier& inBarrier,
+        VkPipelineStageFlags inSrcStage,
+        VkPipelineStageFlags inDstStage,
+        VkBuffer inBuffer) -> VkBufferMemoryBarrier2KHR
+    {
+        VkBufferMemoryBarrier2KHR barrier{ VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2_KHR };
+        barrier.srcStageMask = inSrcStage;
+        barrier.srcAccessMask = inBarrier.srcAccessMask;
+        barrier.dstStageMask = inDstStage;
+        barrier.dstAccessMask = inBarrier.dstAccessMask;
+        barrier.srcQueueFamilyIndex = inBarrier.srcQueueFamilyIndex;
+        barrier.dstQueueFamilyIndex = inBarrier.dstQueueFamilyIndex;
+        barrier.buffer = inBuffer;
+        barrier.offset = inBarrier.offset;
+        barrier.size = inBarrier.size;
+        return barrier;
+    }
+
+    auto MakeImageBarrier2(
+        const VkImageMemoryBarrier& inBarrier,
+        VkPipelineStageFlags inSrcStage,
+        VkPipelineStageFlags inDstStage,
+        VkImage inImage) -> VkImageMemoryBarrier2KHR
+    {
+        VkImageMemoryBarrier2KHR barrier{ VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2_KHR };
+        barrier.srcStageMask = inSrcStage;
+        barrier.srcAccessMask = inBarrier.srcAccessMask;
+        barrier.dstStageMask = inDstStage;
+        barrier.dstAccessMask = inBarrier.dstAccessMask;
+        barrier.oldLayout = inBarrier.oldLayout;
+        barrier.newLayout = inBarrier.newLayout;
+        barrier.srcQueueFamilyIndex = inBarrier.srcQueueFamilyIndex;
+        barrier.dstQueueFamilyIndex = inBarrier.dstQueueFamilyIndex;
+        barrier.image = inImage;
+        barrier.subresourceRange = inBarrier.subresourceRange;
+        return barrier;
+    }
+
+    // Rough time a semaphore hand-off between queues costs, submission split included
+    constexpr float ASYNC_COMPUTE_SYNC_COST = 50.0f; // microseconds
+
+    constexpr VkPipelineStageFlags COMPUTE_QUEUE_STAGES =
+        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT |
+        VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT |
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT |
+        VK_PIPELINE_STAGE_TRANSFER_BIT |
+        VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT |
+        VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+
+    // Whether a compute queue can use the resource in the state
+    auto IsComputeQueueState(const FRAME_GRAPH_SUBRESOURCE_STATE& inState) -> bool
+    {
+        if (std::holds_alternative<FrameGraphBufferSubResourceState>(inState))
+        {
+            return (std::get<FrameGraphBufferSubResourceState>(inState).stage & ~COMPUTE_QUEUE_STAGES) == 0;
+        }
+        if (std::holds_alternative<FrameGraphImageSubResourceState>(inState))
+        {
+            return (std::get<FrameGraphImageSubResourceState>(inState).stage & ~COMPUTE_QUEUE_STAGES) == 0;
+        }
+        return false;
+    }
+
+    auto GetQueueFamily(FRAME_GRAPH_SUBRESOURCE_STATE& inoutState) -> uint32_t*
+    {
+        if (std::holds_alternative<FrameGraphBufferSubResourceState>(inoutState))
+        {
+            return &std::get<FrameGraphBufferSubResourceState>(inoutState).queueFamily;
+        }
+        if (std::holds_alternative<FrameGraphImageSubResourceState>(inoutState))
+        {
+            return &std::get<FrameGraphImageSubResourceState>(inoutState).queueFamily;
+        }
+        return nullptr;
+    }
+
+    // Return true if the state left the queue family to us and got the one passed
+    auto FillQueueFamily(FRAME_GRAPH_SUBRESOURCE_STATE& inoutState, uint32_t inQueueFamily) -> bool
+    {
+        uint32_t* pQueueFamily = GetQueueFamily(inoutState);
+
+        if (pQueueFamily == nullptr || *pQueueFamily != VK_QUEUE_FAMILY_IGNORED)
+        {
+            return false;
+        }
+        *pQueueFamily = inQueueFamily;
+        return true;
+    }
+
+    enum class AttachmentRole
+    {
+        NONE,
+        INPUT,
+        COLOR,
+        DEPTH_STENCIL,
+    };
+
+    // How a graphics pass uses an image in the state, every role but NONE only touches the pixel being shaded
+    auto GetAttachmentRole(const FRAME_GRAPH_SUBRESOURCE_STATE& inState) -> AttachmentRole
+    {
+        if (!std::holds_alternative<FrameGraphImageSubResourceState>(inState))
+        {
+            return AttachmentRole::NONE;
+        }
+
+        VkAccessFlags access = std::get<FrameGraphImageSubResourceState>(inState).access;
+        if ((access & VK_ACCESS_INPUT_ATTACHMENT_READ_BIT) != 0)
+        {
+            return AttachmentRole::INPUT;
+        }
+        if ((access & (VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT)) != 0)
+        {
+            return AttachmentRole::COLOR;
+        }
+        if ((access & (VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT)) != 0)
+        {
+            return AttachmentRole::DEPTH_STENCIL;
+        }
+        return AttachmentRole::NONE;
+    }
+
+    // Index of every element, for things that point to each other to be described without pointers
+    template<class T>
+    auto MakeIndexMap(const std::vector<std::unique_ptr<T>>& inElements) -> std::unordered_map<const T*, size_t>
+    {
+        std::unordered_map<const T*, size_t> indices;
+
+        for (size_t i = 0; i < inElements.size(); ++i)
+        {
+            indices[inElements[i].get()] = i;
+        }
+
+        return indices;
+    }
+
+    struct AliasingRequest
+    {
+        size_t firstBatch;
+        size_t lastBatch;
+        uint32_t queueMask;
+        VkMemoryRequirements requirements;
+        VkDeviceSize offset = 0;
+        Image* image = nullptr;
+        Buffer* buffer = nullptr;
+        VkPipelineStageFlags firstStage = 0;
+        VkAccessFlags firstAccess = 0;
+        VkImageLayout firstLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkImageAspectFlags aspectMask = 0;
+        VkPipelineStageFlags lastStage = 0;
+        VkAccessFlags lastAccess = 0;
+    };
+
+    // Only a pipeline barrier hands memory over, so requests used on more than one queue, or on different
+    // queues, are kept apart as if they were alive at the same time
+    auto IsAliasingConflicted(const AliasingRequest& inLhs, const AliasingRequest& inRhs) -> bool
+    {
+        const bool singleQueue = inLhs.queueMask != 0 && (inLhs.queueMask & (inLhs.queueMask - 1)) == 0;
+
+        return !singleQueue ||
+            inLhs.queueMask != inRhs.queueMask ||
+            (inLhs.firstBatch <= inRhs.lastBatch && inRhs.firstBatch <= inLhs.lastBatch);
+    }
+
+    // First-fit placement: larger requests go first, each one takes the lowest aligned offset
+    // that doesn't overlap any placed request it conflicts with, return the total size needed
+    auto PlaceAliasingRequests(std::vector<AliasingRequest*>& inoutRequests) -> VkDeviceSize
+    {
+        VkDeviceSize memorySize = 0;
+        std::vector<const AliasingRequest*> placed;
+
+        std::stable_sort(inoutRequests.begin(), inoutRequests.end(),
+            [](const AliasingRequest* inLhs, const AliasingRequest* inRhs)
+            {
+                return inLhs->requirements.size > inRhs->requirements.size;
+            });
+
+        for (auto request : inoutRequests)
+        {
+            std::vector<const AliasingRequest*> conflicts;
+            const VkDeviceSize alignment = std::max<VkDeviceSize>(request->requirements.alignment, 1);
+            VkDeviceSize candidate = 0;
+
+            for (auto other : placed)
+            {
+                if (IsAliasingConflicted(*request, *other))
+                {
+                    conflicts.push_back(other);
+                }
+            }
+            std::sort(conflicts.begin(), conflicts.end(),
+                [](const AliasingRequest* inLhs, const AliasingRequest* inRhs)
+                {
+                    return inLhs->offset < inRhs->offset;
+                });
+
+            for (auto other : conflicts)
+            {
+                if (common_utils::AlignUp(candidate, alignment) + request->requirements.size <= other->offset)
+                {
+                    break;
+                }
+                candidate = std::max(candidate, other->offset + other->requirements.size);
+            }
+
+            request->offset = common_utils::AlignUp(candidate, alignment);
+            memorySize = std::max(memorySize, request->offset + request->requirements.size);
+            placed.push_back(request);
+        }
+
+        return memorySize;
+    }
 }
 
+
 FrameGraphPassBind& FrameGraphPassBind::BindInAttachment(uint32_t inAttachmentIndex, const std::string& inName)
 {
     Data data{};
@@ -141,6 +369,34 @@ FrameGraphPassBind& FrameGraphPassBind::SetQueueType(FrameGraphQueueType inType)
     return *this;
 }
 
+FrameGraphPassBind& FrameGraphPassBind::SetEstimatedCost(float inMicroseconds)
+{
+    m_estimatedCost = inMicroseconds;
+
+    return *this;
+}
+
+FrameGraphPassBind& FrameGraphPassBind::CustomizeNeverCull()
+{
+    m_neverCull = true;
+
+    return *this;
+}
+
+FrameGraphPassBind& FrameGraphPassBind::CustomizeAttachmentClear(uint32_t inAttachmentIndex, const VkClearValue& inClearValue)
+{
+    auto iter = std::find_if(m_data.begin(), m_data.end(),
+        [inAttachmentIndex](const Data& inData)
+        {
+            return inData.id == inAttachmentIndex;
+        });
+
+    CHECK_TRUE(iter != m_data.end(), "Bind the attachment before customizing its clear!");
+    iter->clearValue = inClearValue;
+
+    return *this;
+}
+
 FrameGraphBuilder::NodeBlueprint* FrameGraphBuilder::_GetNodeBlueprint(FrameGraphNodeHandle inHandle)
 {
     return m_nodeBlueprints.at(inHandle.handle).get();
@@ -190,62 +446,241 @@ auto FrameGraphBuilder::_GetResourceState(FrameGraphBufferHandle inHandle) -> Fr
     return result;
 }
 
-void FrameGraphBuilder::_TopologicalSort(std::vector<std::set<NodeBlueprint*>>& outBatches)
+void FrameGraphBuilder::_CullNodes()
 {
-    std::vector<size_t> indegree(m_nodeBlueprints.size(), 0);
-    std::queue<size_t> processQueue;
-    std::unordered_map<NodeBlueprint*, size_t> ptrToIndex;
+    std::vector<NodeBlueprint*> processStack;
+    std::set<NodeBlueprint*> alive;
+    auto funcIsExternal = [this](const FRAME_GRAPH_RESOURCE_HANDLE& inHandle)
+        {
+            if (std::holds_alternative<FrameGraphBufferHandle>(inHandle))
+            {
+                return _GetBufferBlueprint(std::get<FrameGraphBufferHandle>(inHandle))->external;
+            }
+            if (std::holds_alternative<FrameGraphImageHandle>(inHandle))
+            {
+                return _GetImageBlueprint(std::get<FrameGraphImageHandle>(inHandle))->external;
+            }
+            return false;
+        };
 
-    for (size_t i = 0; i < m_nodeBlueprints.size(); ++i)
+    // roots are passes writing external resources, e.g. swapchain images or readback buffers
+    for (auto& node : m_nodeBlueprints)
+    {
+        bool isRoot = node->neverCull;
+
+        for (const auto& output : node->outputs)
+        {
+            isRoot = isRoot || funcIsExternal(output->handle);
+        }
+        if (isRoot)
+        {
+            alive.insert(node.get());
+            processStack.push_back(node.get());
+        }
+    }
+
+    // everything a root depends on is alive
+    while (!processStack.empty())
     {
-        auto currentNode = m_nodeBlueprints[i].get();
+        NodeBlueprint* current = processStack.back();
         std::set<NodeBlueprint*> prevs{};
 
-        ptrToIndex[currentNode] = i;
-        currentNode->GetFullPrev(prevs);
-        indegree[i] = prevs.size();
+        processStack.pop_back();
+        current->GetFullPrev(prevs);
+        for (auto prevNode : prevs)
+        {
+            if (alive.insert(prevNode).second)
+            {
+                processStack.push_back(prevNode);
+            }
+        }
+    }
+
+    for (auto& node : m_nodeBlueprints)
+    {
+        node->culled = alive.find(node.get()) == alive.end();
+    }
+}
+
+void FrameGraphBuilder::_BuildScheduler(FrameGraphScheduler& outScheduler, std::vector<size_t>& outNodeIndices) const
+{
+    std::unordered_map<const NodeBlueprint*, size_t> schedulerIndices;
+
+    outScheduler.SetCrossQueueLatency(ASYNC_COMPUTE_SYNC_COST);
+    for (size_t i = 0; i < m_nodeBlueprints.size(); ++i)
+    {
+        const NodeBlueprint* node = m_nodeBlueprints[i].get();
+
+        if (node->culled) continue;
+
+        schedulerIndices[node] = outScheduler.AddNode(node->type, node->estimatedCost);
+        outNodeIndices.push_back(i);
+    }
+    for (size_t i = 0; i < outNodeIndices.size(); ++i)
+    {
+        std::set<NodeBlueprint*> nexts{};
+
+        m_nodeBlueprints[outNodeIndices[i]]->GetFullNext(nexts);
+        for (auto nextNode : nexts)
+        {
+            if (nextNode->culled) continue;
+
+            outScheduler.AddDependency(i, schedulerIndices.at(nextNode));
+        }
+    }
+}
+
+void FrameGraphBuilder::_PlaceAsyncCompute()
+{
+    FrameGraphScheduler scheduler;
+    std::vector<size_t> nodeIndices;
+    std::vector<std::vector<size_t>> batches;
+    std::vector<size_t> candidates; // index in scheduler
+    std::vector<FrameGraphQueueType> queueTypes;
+    float bestMakespan = 0.0f;
+
+    // start from the queues as bound, a placement of an earlier arrangement is not kept
+    for (const auto& node : m_nodeBlueprints)
+    {
+        queueTypes.push_back(node->requestedType);
+    }
+    _ApplyNodeQueueTypes(queueTypes);
+
+    _BuildScheduler(scheduler, nodeIndices);
+    for (size_t i = 0; i < nodeIndices.size(); ++i)
+    {
+        const NodeBlueprint* node = m_nodeBlueprints[nodeIndices[i]].get();
+        bool computeOnly = !node->queueFixed && node->requestedType == FrameGraphQueueType::GRAPHICS;
 
-        if (indegree[i] == 0)
+        for (const auto& input : node->inputs)
+        {
+            computeOnly = computeOnly && IsComputeQueueState(input->state);
+        }
+        for (const auto& output : node->outputs)
+        {
+            computeOnly = computeOnly && IsComputeQueueState(output->state);
+        }
+        for (const auto& transient : node->transients)
+        {
+            computeOnly = computeOnly && IsComputeQueueState(transient->initialState) && IsComputeQueueState(transient->finalState);
+        }
+        if (computeOnly)
         {
-            processQueue.push(i);
+            candidates.push_back(i);
         }
     }
+    if (candidates.empty())
+    {
+        return;
+    }
 
-    while (!processQueue.empty())
+    // Greedy, expensive passes first since they have the most to overlap. The scheduler charges
+    // cross queue dependencies with the sync cost, so a pass on the critical path or one whose inputs
+    // come late gains nothing and stays on graphics
+    std::stable_sort(candidates.begin(), candidates.end(),
+        [&](size_t inLhs, size_t inRhs)
+        {
+            return m_nodeBlueprints[nodeIndices[inLhs]]->estimatedCost > m_nodeBlueprints[nodeIndices[inRhs]]->estimatedCost;
+        });
+    bestMakespan = scheduler.Schedule(batches);
+    for (size_t candidate : candidates)
     {
-        size_t n = processQueue.size();
-        
-        outBatches.push_back({});
-        
-        std::set<NodeBlueprint*>& currentBatch = outBatches.back();
-        for (size_t i = 0; i < n; ++i)
+        scheduler.SetQueueType(candidate, FrameGraphQueueType::COMPUTE);
+
+        float makespan = scheduler.Schedule(batches);
+        if (makespan < bestMakespan)
         {
-            auto currentNode = m_nodeBlueprints[processQueue.front()].get();
-            std::set<NodeBlueprint*> nexts{};
-            
-            currentBatch.insert(currentNode);
-            processQueue.pop();
-            currentNode->GetFullNext(nexts);
-            for (auto nextNode : nexts)
-            {
-                size_t index = ptrToIndex.at(nextNode);
+            bestMakespan = makespan;
+            queueTypes[nodeIndices[candidate]] = FrameGraphQueueType::COMPUTE;
+        }
+        else
+        {
+            scheduler.SetQueueType(candidate, FrameGraphQueueType::GRAPHICS);
+        }
+    }
 
-                --indegree[index];
-                if (indegree[index] == 0)
-                {
-                    processQueue.push(index);
-                }
+    _ApplyNodeQueueTypes(queueTypes);
+}
+
+void FrameGraphBuilder::_ApplyNodeQueueTypes(const std::vector<FrameGraphQueueType>& inQueueTypes)
+{
+    bool anyMoved = false;
+
+    CHECK_TRUE(inQueueTypes.size() == m_nodeBlueprints.size());
+    for (const FRAME_GRAPH_SUBRESOURCE_STATE* pState : m_placedQueueFamilyStates)
+    {
+        *GetQueueFamily(const_cast<FRAME_GRAPH_SUBRESOURCE_STATE&>(*pState)) = VK_QUEUE_FAMILY_IGNORED;
+    }
+    m_placedQueueFamilyStates.clear();
+    for (size_t i = 0; i < m_nodeBlueprints.size(); ++i)
+    {
+        anyMoved = anyMoved || m_nodeBlueprints[i]->requestedType != inQueueTypes[i];
+        m_nodeBlueprints[i]->type = inQueueTypes[i];
+    }
+    if (!anyMoved)
+    {
+        return;
+    }
+
+    // Resources now cross queues where the user didn't plan for it. States that leave the queue family
+    // to us get the family of their pass, then queue ownership release and acquire are generated
+    // along with the semaphores, see FrameGraphCompileContext::PresageSubResourceStateNextPass
+    auto& device = MyDevice::GetInstance();
+    const uint32_t graphicsFamily = device.GetQueueFamilyIndexOfType(QueueFamilyType::GRAPHICS);
+    const uint32_t computeFamily = device.GetQueueFamilyIndexOfType(QueueFamilyType::COMPUTE);
+    auto funcFill = [this](FRAME_GRAPH_SUBRESOURCE_STATE& inoutState, uint32_t inQueueFamily)
+        {
+            if (FillQueueFamily(inoutState, inQueueFamily))
+            {
+                m_placedQueueFamilyStates.insert(&inoutState);
             }
+        };
+
+    for (auto& node : m_nodeBlueprints)
+    {
+        uint32_t queueFamily = node->type == FrameGraphQueueType::COMPUTE ? computeFamily : graphicsFamily;
+
+        for (auto& input : node->inputs)
+        {
+            funcFill(input->state, queueFamily);
+        }
+        for (auto& output : node->outputs)
+        {
+            funcFill(output->state, queueFamily);
+        }
+        for (auto& transient : node->transients)
+        {
+            funcFill(transient->initialState, queueFamily);
+            funcFill(transient->finalState, queueFamily);
         }
     }
+}
+
+void FrameGraphBuilder::_ScheduleNodes(std::vector<std::set<NodeBlueprint*>>& outBatches)
+{
+    FrameGraphScheduler scheduler;
+    std::vector<size_t> nodeIndices;
+    std::vector<std::vector<size_t>> batches;
 
+    _BuildScheduler(scheduler, nodeIndices);
+    scheduler.Schedule(batches);
+    for (const auto& batch : batches)
+    {
+        auto& nodeBatch = outBatches.emplace_back();
+        for (size_t index : batch)
+        {
+            nodeBatch.insert(m_nodeBlueprints[nodeIndices[index]].get());
+        }
+    }
 }
 
-void FrameGraphBuilder::_GenerateResourceCreationTask(const std::vector<std::set<NodeBlueprint*>>& inBatches)
+void FrameGraphBuilder::_AssignResources(const std::vector<std::set<NodeBlueprint*>>& inBatches)
 {
-    // first we will do device object creation for each internal device resource
-    for (const auto& nodeBatch : inBatches)
+    // first we will assign a device object to each handle of internal device resource
+    for (size_t batchIndex = 0; batchIndex < inBatches.size(); ++batchIndex)
     {
+        const auto& nodeBatch = inBatches[batchIndex];
+
         // Here, we check resource handle generate inside, if we already assign device object,
         // we're good. If not, we check if there is a no longer referenced device object,
         // if there is one, we assign this object to the handle, and attach a prologue barrier to the node;
@@ -311,6 +746,7 @@ void FrameGraphBuilder::_GenerateResourceCreationTask(const std::vector<std::set
                     auto index = bufferBlueprint->handleToIndex[handle];
 
                     bufferBlueprint->refCounts[index]++;
+                    bufferBlueprint->lifetimes[index].lastBatch = batchIndex;
                     
                     continue;
                 }
@@ -324,8 +760,9 @@ void FrameGraphBuilder::_GenerateResourceCreationTask(const std::vector<std::set
                         haveFreeResource = true;
                         refCounts[i] = 1;
                         bufferBlueprint->handleToIndex[handle] = i;
+                        bufferBlueprint->lifetimes[i].lastBatch = batchIndex;
 
-                        continue;
+                        break;
                     }
                 }
                 if (haveFreeResource)
@@ -333,34 +770,13 @@ void FrameGraphBuilder::_GenerateResourceCreationTask(const std::vector<std::set
                     continue;
                 }
 
-                // ok, we need to create a new resource, presage it to frame graph
-                // 1. update blueprint
-                // 2. create new buffer
+                // ok, we need a new resource, the device object is created in resource creation task
                 {
                     size_t resourceLocation = refCounts.size();
                     bufferBlueprint->handleToIndex[handle] = resourceLocation;
                     bufferBlueprint->refCounts.push_back(1);
                     bufferBlueprint->states.emplace_back(std::make_unique<FrameGraphBufferResourceState>(*bufferBlueprint->initialState));
-                    auto funcCreateBuffer = [=, this](FrameGraph* toInit)
-                        {
-                            std::unique_ptr<Buffer> newBuffer = std::make_unique<Buffer>();
-                            std::set<FrameGraphBufferHandle> handleShareThisResource{};
-                            
-                            newBuffer->Create(bufferBlueprint->createInfo.get());
-                            
-                            // find out handles that point to the new resource, associate them with it
-                            for (auto& p : bufferBlueprint->handleToIndex)
-                            {
-                                if (p.second == resourceLocation)
-                                {
-                                    _RegisterHandleToResource(toInit, p.first, newBuffer.get());
-                                }
-                            }
-
-                            _AddInternalBufferToGraph(toInit, std::move(newBuffer));
-                        };
-
-                    m_initResourceProcesses.push_back(std::move(funcCreateBuffer));
+                    bufferBlueprint->lifetimes.push_back({ batchIndex, batchIndex });
                 }
             }
             for (auto handle : imageToCreate)
@@ -372,6 +788,7 @@ void FrameGraphBuilder::_GenerateResourceCreationTask(const std::vector<std::set
                     auto index = imageBlueprint->handleToIndex[handle];
 
                     imageBlueprint->refCounts[index]++;
+                    imageBlueprint->lifetimes[index].lastBatch = batchIndex;
 
                     continue;
                 }
@@ -385,38 +802,23 @@ void FrameGraphBuilder::_GenerateResourceCreationTask(const std::vector<std::set
                         haveFreeResource = true;
                         refCounts[i] = 1;
                         imageBlueprint->handleToIndex[handle] = i;
+                        imageBlueprint->lifetimes[i].lastBatch = batchIndex;
 
-                        continue;
+                        break;
                     }
                 }
+                if (haveFreeResource)
+                {
+                    continue;
+                }
 
-                // ok, we need to create a new resource, presage it to frame graph
-                // 1. update blueprint
-                // 2. create new image
+                // ok, we need a new resource, the device object is created in resource creation task
                 {
                     size_t resourceLocation = refCounts.size();
                     imageBlueprint->handleToIndex[handle] = resourceLocation;
                     imageBlueprint->refCounts.push_back(1);
                     imageBlueprint->states.emplace_back(std::make_unique<FrameGraphImageResourceState>(*imageBlueprint->initialState));
-                    auto funcCreateImage = [=, this](FrameGraph* toInit)
-                        {
-                            std::unique_ptr<Image> newImage = std::make_unique<Image>();
-
-                            newImage->Create(imageBlueprint->createInfo.get());
-
-                            // find out handles that point to the new resource, associate them with it
-                            for (auto& p : imageBlueprint->handleToIndex)
-                            {
-                                if (p.second == resourceLocation)
-                                {
-                                    _RegisterHandleToResource(toInit, p.first, newImage.get());
-                                }
-                            }
-
-                            _AddInternalImageToGraph(toInit, std::move(newImage));
-                        };
-
-                    m_initResourceProcesses.push_back(std::move(funcCreateImage));
+                    imageBlueprint->lifetimes.push_back({ batchIndex, batchIndex });
                 }
             }
         }
@@ -433,14 +835,16 @@ void FrameGraphBuilder::_GenerateResourceCreationTask(const std::vector<std::set
                         CHECK_TRUE(blueprint->HaveResourceAssigned(handle));
                         auto index = blueprint->handleToIndex[handle];
 
+                        blueprint->lifetimes[index].lastBatch = std::max(blueprint->lifetimes[index].lastBatch, batchIndex);
+
                         if (release)
                         {
-                            CHECK_TRUE(blueprint->refCounts[index] > 0);
-                            --blueprint->refCounts[index];
+                            CHECK_TRUE(blueprint->refCounts[index] >= amt);
+                            blueprint->refCounts[index] -= amt;
                         }
                         else
                         {
-                            ++blueprint->refCounts[index];
+                            blueprint->refCounts[index] += amt;
                         }
                     }
                     else if (std::holds_alternative<FrameGraphImageHandle>(inHandle))
@@ -449,6 +853,8 @@ void FrameGraphBuilder::_GenerateResourceCreationTask(const std::vector<std::set
                         auto blueprint = _GetImageBlueprint(handle);
                         CHECK_TRUE(blueprint->HaveResourceAssigned(handle));
                         auto index = blueprint->handleToIndex[handle];
+
+                        blueprint->lifetimes[index].lastBatch = std::max(blueprint->lifetimes[index].lastBatch, batchIndex);
                         
                         if (release)
                         {
@@ -493,96 +899,1068 @@ void FrameGraphBuilder::_GenerateResourceCreationTask(const std::vector<std::set
             {
                 auto& nexts = output->nexts;
                 auto& handle = output->handle;
+                auto liveNextCount = std::count_if(nexts.begin(), nexts.end(),
+                    [](const NodeInput* inNext)
+                    {
+                        return !inNext->owner->culled;
+                    });
 
-                // presage ref count for next batches
-                funcUpdateRef(handle, false, static_cast<uint32_t>(nexts.size()));
+                // presage ref count for next batches, culled passes never release theirs
+                funcUpdateRef(handle, false, static_cast<uint32_t>(liveNextCount));
             }
         }
     }
 }
 
-void FrameGraphBuilder::_GenerateSyncTask(const std::vector<std::set<NodeBlueprint*>>& inBatches)
+void FrameGraphBuilder::_CollectResourceUsages(const std::vector<std::set<NodeBlueprint*>>& inBatches)
 {
-    size_t wave = 0;
-
-    for (const auto& nodeBatch : inBatches)
+    for (size_t batchIndex = 0; batchIndex < inBatches.size(); ++batchIndex)
     {
-        std::vector<BufferMemoryBarrierBlueprint> bufBarriers;
-        std::vector<ImageMemoryBarrierBlueprint> imgBarriers;
-
-        for (const NodeBlueprint* node : nodeBatch)
+        for (const NodeBlueprint* node : inBatches[batchIndex])
         {
-            // collect prologue barriers
-            for (const auto& curInput : node->inputs)
-            {
-                if (std::holds_alternative<FrameGraphBufferHandle>(curInput->handle))
+            // inBegin: the state is what the pass needs when it starts
+            auto funcUse = [&](const FRAME_GRAPH_RESOURCE_HANDLE& inHandle, const FRAME_GRAPH_SUBRESOURCE_STATE& inState, bool inBegin)
                 {
-                    std::vector<FrameGraphBufferSubResourceState> curStates;
-                    FrameGraphBufferHandle curHandle = std::get<FrameGraphBufferHandle>(curInput->handle);
-                    auto pResourceState = _GetResourceState(curHandle);
-                    auto aimState = std::get<FrameGraphBufferSubResourceState>(curInput->state);
-                    
-                    pResourceState->GetSubResourceState(
-                        aimState.offset, 
-                        aimState.size, 
-                        curStates);
-                    for (const auto& curState : curStates)
-                    {
-                        bool queueTransfer = curState.queueFamily == ~0 ? false : curState.queueFamily != aimState.queueFamily;
-                        BufferMemoryBarrierBlueprint barrierBlueprint{};
+                    ResourceLifetime* lifetime = nullptr;
+                    VkPipelineStageFlags stage = 0;
+                    VkAccessFlags access = 0;
 
-                        barrierBlueprint.barrier = MakeBufferBarrier(
-                            VK_NULL_HANDLE,
-                            curState.offset,
-                            curState.size,
-                            queueTransfer ? curState.queueFamily : VK_QUEUE_FAMILY_IGNORED,
-                            queueTransfer ? aimState.queueFamily : VK_QUEUE_FAMILY_IGNORED,
-                            curState.access,
-                            aimState.access);
-                        barrierBlueprint.resourceHandle = curHandle;
-                        barrierBlueprint.srcStage = curState.stage;
-                        barrierBlueprint.dstStage = aimState.stage;
+                    if (std::holds_alternative<FrameGraphBufferHandle>(inHandle))
+                    {
+                        auto handle = std::get<FrameGraphBufferHandle>(inHandle);
+                        auto blueprint = _GetBufferBlueprint(handle);
+                        const auto& state = std::get<FrameGraphBufferSubResourceState>(inState);
 
-                        bufBarriers.emplace_back(barrierBlueprint);
+                        lifetime = &blueprint->lifetimes[blueprint->handleToIndex.at(handle)];
+                        stage = state.stage;
+                        access = state.access;
                     }
-                }
-                else if (std::holds_alternative<FrameGraphImageHandle>(curInput->handle))
-                {
-                    std::vector<FrameGraphImageSubResourceState> curStates;
-                    FrameGraphImageHandle curHandle = std::get<FrameGraphImageHandle>(curInput->handle);
-                    auto pResourceState = _GetResourceState(curHandle);
-                    auto aimState = std::get<FrameGraphImageSubResourceState>(curInput->state);
-
-                    pResourceState->GetSubResourceState(aimState.range, curStates);
-                    for (const auto& curState : curStates)
+                    else if (std::holds_alternative<FrameGraphImageHandle>(inHandle))
                     {
-                        ImageMemoryBarrierBlueprint barrierBlueprint{};
+                        auto handle = std::get<FrameGraphImageHandle>(inHandle);
+                        auto blueprint = _GetImageBlueprint(handle);
+                        const auto& state = std::get<FrameGraphImageSubResourceState>(inState);
+
+                        lifetime = &blueprint->lifetimes[blueprint->handleToIndex.at(handle)];
+                        stage = state.stage;
+                        access = state.access;
+                        lifetime->aspectMask |= state.range.aspectMask;
+                        if (inBegin && batchIndex == lifetime->firstBatch && lifetime->firstLayout == VK_IMAGE_LAYOUT_UNDEFINED)
+                        {
+                            lifetime->firstLayout = state.layout;
+                        }
+                    }
+                    else
+                    {
+                        CHECK_TRUE(false);
+                        return;
+                    }
+
+                    lifetime->queueMask |= 1u << static_cast<uint32_t>(node->type);
+                    if (batchIndex == lifetime->firstBatch)
+                    {
+                        lifetime->firstStage |= stage;
+                        lifetime->firstAccess |= access;
+                    }
+                    if (batchIndex == lifetime->lastBatch)
+                    {
+                        lifetime->lastStage |= stage;
+                        lifetime->lastAccess |= access;
+                    }
+                };
+
+            for (const auto& input : node->inputs)
+            {
+                funcUse(input->handle, input->state, true);
+            }
+            for (const auto& output : node->outputs)
+            {
+                funcUse(output->handle, output->state, output->prev == nullptr);
+            }
+            for (const auto& transient : node->transients)
+            {
+                funcUse(transient->handle, transient->initialState, true);
+                funcUse(transient->handle, transient->finalState, false);
+            }
+        }
+    }
+}
+
+void FrameGraphBuilder::_MergeRenderPasses(const std::vector<std::set<NodeBlueprint*>>& inBatches, std::vector<RenderPassGroupBlueprint>& outGroups)
+{
+    std::unordered_map<const NodeBlueprint*, size_t> batchOfNode;
+    auto nodeIndices = MakeIndexMap(m_nodeBlueprints);
+    std::vector<NodeBlueprint*> group;
+    size_t groupFirstBatch = 0;
+    const ImageCreateInfo* groupRenderArea = nullptr;
+
+    for (size_t batchIndex = 0; batchIndex < inBatches.size(); ++batchIndex)
+    {
+        for (const NodeBlueprint* node : inBatches[batchIndex])
+        {
+            batchOfNode[node] = batchIndex;
+        }
+    }
+
+    auto funcIsInGroup = [&group](const NodeBlueprint* inNode)
+        {
+            return std::find(group.begin(), group.end(), inNode) != group.end();
+        };
+
+    // Return the create info all attachments of the pass share the extent with,
+    // or null if the pass can't be a subpass
+    auto funcGetRenderArea = [this](const NodeBlueprint* inNode) -> const ImageCreateInfo*
+        {
+            const ImageCreateInfo* renderArea = nullptr;
+            bool valid = inNode->type == FrameGraphQueueType::GRAPHICS;
+            bool anyTarget = false;
+            auto funcCheckAttachment = [&](const FRAME_GRAPH_RESOURCE_HANDLE& inHandle, const FRAME_GRAPH_SUBRESOURCE_STATE& inState)
+                {
+                    AttachmentRole role = GetAttachmentRole(inState);
+
+                    if (role == AttachmentRole::NONE) return;
+
+                    const ImageBlueprint* blueprint = _GetImageBlueprint(std::get<FrameGraphImageHandle>(inHandle));
+                    // external images, e.g. swapchain images, keep render passes of their own
+                    if (blueprint->external || blueprint->createInfo == nullptr)
+                    {
+                        valid = false;
+                        return;
+                    }
+                    if (renderArea == nullptr)
+                    {
+                        renderArea = blueprint->createInfo.get();
+                    }
+                    valid = valid && renderArea->HasSameExtent(*blueprint->createInfo);
+                    anyTarget = anyTarget || role != AttachmentRole::INPUT;
+                };
+
+            for (const auto& input : inNode->inputs)
+            {
+                funcCheckAttachment(input->handle, input->state);
+            }
+            for (const auto& output : inNode->outputs)
+            {
+                funcCheckAttachment(output->handle, output->state);
+            }
+            for (const auto& transient : inNode->transients)
+            {
+                funcCheckAttachment(transient->handle, transient->initialState);
+                funcCheckAttachment(transient->handle, transient->finalState);
+            }
+            return valid && anyTarget ? renderArea : nullptr;
+        };
+
+    // Whether the pass can follow the last pass of the group as the next subpass
+    auto funcCanJoin = [&](NodeBlueprint* inNode, const ImageCreateInfo* inRenderArea)
+        {
+            std::set<NodeBlueprint*> prevs{};
+
+            if (group.empty() || !inRenderArea->HasSameExtent(*groupRenderArea))
+            {
+                return false;
+            }
+
+            inNode->GetFullPrev(prevs);
+            if (prevs.find(group.back()) == prevs.end())
+            {
+                return false;
+            }
+            for (auto prevNode : prevs)
+            {
+                // the render pass begins with the group, anything else the pass needs has to be done by then
+                if (!funcIsInGroup(prevNode) && batchOfNode.at(prevNode) >= groupFirstBatch)
+                {
+                    return false;
+                }
+            }
+            for (const auto& input : inNode->inputs)
+            {
+                // reading anything but the pixel being shaded needs the whole image stored first
+                if (input->prev != nullptr && funcIsInGroup(input->prev->owner) && GetAttachmentRole(input->state) == AttachmentRole::NONE)
+                {
+                    return false;
+                }
+            }
+            return true;
+        };
+
+    auto funcMakeGroup = [&]()
+        {
+            RenderPassGroupBlueprint groupBlueprint{};
+            std::unordered_map<FrameGraphImageHandle, uint32_t> attachmentIndices;
+            std::vector<std::set<uint32_t>> subpassAttachments;
+
+            for (const NodeBlueprint* node : group)
+            {
+                RenderPassGroupBlueprint::Subpass subpass{};
+                std::map<uint32_t, RenderPassGroupBlueprint::Dependency> dependencies; // keyed by source subpass
+                auto& touched = subpassAttachments.emplace_back();
+                auto funcUseAttachment = [&](
+                    const FRAME_GRAPH_RESOURCE_HANDLE& inHandle,
+                    AttachmentRole inRole,
+                    const FrameGraphImageSubResourceState& inRequiredState,
+                    const FrameGraphImageSubResourceState& inFinalState,
+                    bool inLoad,
+                    const std::optional<VkClearValue>& inClearValue)
+                    {
+                        auto handle = std::get<FrameGraphImageHandle>(inHandle);
+                        auto iter = attachmentIndices.find(handle);
+
+                        if (iter == attachmentIndices.end())
+                        {
+                            const ImageBlueprint* blueprint = _GetImageBlueprint(handle);
+                            RenderPassGroupBlueprint::Attachment attachment{};
+
+                            // store operation is decided once the whole group is known
+                            attachment.handle = handle;
+                            attachment.format = blueprint->createInfo->GetFormat();
+                            attachment.sampleCount = blueprint->createInfo->GetSampleCount();
+                            attachment.depthStencil = false;
+                            // the render pass clears on behalf of the pass, which can't begin one of its own
+                            attachment.loadOp = inLoad ? VK_ATTACHMENT_LOAD_OP_LOAD
+                                : inClearValue.has_value() ? VK_ATTACHMENT_LOAD_OP_CLEAR : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+                            attachment.clearValue = inClearValue.value_or(VkClearValue{});
+                            attachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+                            attachment.initialLayout = inLoad ? inRequiredState.layout : VK_IMAGE_LAYOUT_UNDEFINED;
+                            iter = attachmentIndices.insert({ handle, static_cast<uint32_t>(groupBlueprint.attachments.size()) }).first;
+                            groupBlueprint.attachments.push_back(attachment);
+                        }
+
+                        uint32_t index = iter->second;
+                        auto& attachment = groupBlueprint.attachments[index];
+
+                        attachment.depthStencil = attachment.depthStencil || inRole == AttachmentRole::DEPTH_STENCIL;
+                        attachment.finalLayout = inFinalState.layout;
+                        switch (inRole)
+                        {
+                        case AttachmentRole::INPUT:
+                            subpass.inputAttachments.push_back({ index, inRequiredState.layout });
+                            break;
+                        case AttachmentRole::COLOR:
+                            subpass.colorAttachments.push_back({ index, inFinalState.layout });
+                            break;
+                        case AttachmentRole::DEPTH_STENCIL:
+                            subpass.depthStencilAttachment = VkAttachmentReference{ index, inFinalState.layout };
+                            break;
+                        default:
+                            break;
+                        }
+                        if (inRole != AttachmentRole::INPUT)
+                        {
+                            subpass.availableStage |= inFinalState.stage;
+                            subpass.availableAccess |= inFinalState.access;
+                        }
+
+                        // wait for the earlier subpasses that touched it, only at the same pixel
+                        for (uint32_t srcSubpass = 0; srcSubpass + 1 < subpassAttachments.size(); ++srcSubpass)
+                        {
+                            if (subpassAttachments[srcSubpass].count(index) == 0 || inRequiredState.stage == 0) continue;
+
+                            auto& dependency = dependencies.try_emplace(srcSubpass, RenderPassGroupBlueprint::Dependency{ srcSubpass, 0, 0 }).first->second;
+                            dependency.dstStage |= inRequiredState.stage;
+                            dependency.dstAccess |= inRequiredState.access;
+                        }
+                        touched.insert(index);
+                    };
+
+                subpass.node = nodeIndices.at(node);
+                for (const auto& input : node->inputs)
+                {
+                    const auto& requiredState = input->state;
+                    const auto& finalState = input->next != nullptr ? input->next->state : input->state;
+                    AttachmentRole role = GetAttachmentRole(finalState);
+
+                    role = role != AttachmentRole::NONE ? role : GetAttachmentRole(requiredState);
+                    if (role == AttachmentRole::NONE) continue;
+
+                    funcUseAttachment(
+                        input->handle,
+                        role,
+                        std::get<FrameGraphImageSubResourceState>(requiredState),
+                        std::get<FrameGraphImageSubResourceState>(finalState),
+                        true,
+                        std::nullopt);
+                }
+                for (const auto& output : node->outputs)
+                {
+                    AttachmentRole role = GetAttachmentRole(output->state);
+
+                    // outputs that modify an input are done with the input
+                    if (output->prev != nullptr || role == AttachmentRole::NONE) continue;
+
+                    const auto& state = std::get<FrameGraphImageSubResourceState>(output->state);
+                    funcUseAttachment(output->handle, role, state, state, false, output->clearValue);
+                }
+                for (const auto& transient : node->transients)
+                {
+                    AttachmentRole role = GetAttachmentRole(transient->finalState);
+
+                    if (role == AttachmentRole::NONE) continue;
+
+                    funcUseAttachment(
+                        transient->handle,
+                        role,
+                        std::get<FrameGraphImageSubResourceState>(transient->initialState),
+                        std::get<FrameGraphImageSubResourceState>(transient->finalState),
+                        false,
+                        transient->clearValue);
+                }
+
+                for (const auto& p : dependencies)
+                {
+                    subpass.dependencies.push_back(p.second);
+                }
+                groupBlueprint.subpasses.push_back(std::move(subpass));
+            }
+
+            // only what passes after the group read is stored, the rest never leaves tile memory
+            for (const auto& node : m_nodeBlueprints)
+            {
+                if (node->culled || funcIsInGroup(node.get())) continue;
+
+                for (const auto& input : node->inputs)
+                {
+                    if (!std::holds_alternative<FrameGraphImageHandle>(input->handle)) continue;
+
+                    auto iter = attachmentIndices.find(std::get<FrameGraphImageHandle>(input->handle));
+                    if (iter != attachmentIndices.end())
+                    {
+                        groupBlueprint.attachments[iter->second].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+                    }
+                }
+            }
+
+            return groupBlueprint;
+        };
+    auto funcCloseGroup = [&]()
+        {
+            if (group.size() > 1)
+            {
+                outGroups.push_back(funcMakeGroup());
+            }
+            group.clear();
+        };
+
+    for (size_t batchIndex = 0; batchIndex < inBatches.size(); ++batchIndex)
+    {
+        NodeBlueprint* graphicsNode = nullptr;
+        size_t graphicsNodeCount = 0;
+        bool otherDependsOnGroup = false;
+
+        for (auto node : inBatches[batchIndex])
+        {
+            if (node->type == FrameGraphQueueType::GRAPHICS)
+            {
+                graphicsNode = node;
+                ++graphicsNodeCount;
+            }
+        }
+        for (auto node : inBatches[batchIndex])
+        {
+            std::set<NodeBlueprint*> prevs{};
+
+            if (node == graphicsNode) continue;
+
+            // e.g. async compute can't read attachments before the render pass ends
+            node->GetFullPrev(prevs);
+            for (auto prevNode : prevs)
+            {
+                otherDependsOnGroup = otherDependsOnGroup || funcIsInGroup(prevNode);
+            }
+        }
+
+        // with one graphics pass in the batch nothing else is recorded between the subpasses
+        const ImageCreateInfo* renderArea = graphicsNodeCount == 1 ? funcGetRenderArea(graphicsNode) : nullptr;
+        if (renderArea != nullptr && !otherDependsOnGroup && funcCanJoin(graphicsNode, renderArea))
+        {
+            group.push_back(graphicsNode);
+            continue;
+        }
+
+        funcCloseGroup();
+        if (renderArea != nullptr)
+        {
+            group.push_back(graphicsNode);
+            groupFirstBatch = batchIndex;
+            groupRenderArea = renderArea;
+        }
+    }
+    funcCloseGroup();
+}
+
+auto FrameGraphBuilder::_IsPlanOfStructure(const ExecutionPlan& inPlan, size_t inStructureHash, const std::vector<size_t>& inStructureKey) const -> bool
+{
+    if (inPlan.structureHash != inStructureHash || inPlan.structureKey != inStructureKey)
+    {
+        return false;
+    }
+
+    // the key gives the blueprint counts, so the create infos line up
+    for (size_t i = 0; i < m_imageBlueprints.size(); ++i)
+    {
+        if (!(inPlan.imageCreateInfos[i] == *m_imageBlueprints[i]->createInfo))
+        {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < m_bufferBlueprints.size(); ++i)
+    {
+        if (!(inPlan.bufferCreateInfos[i] == *m_bufferBlueprints[i]->createInfo))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+auto FrameGraphBuilder::_BuildExecutionPlan(
+    size_t inStructureHash,
+    std::vector<size_t> inStructureKey,
+    const std::vector<std::set<NodeBlueprint*>>& inBatches,
+    const std::vector<SplitBarrierBlueprint>& inSplitBarriers,
+    const std::vector<RenderPassGroupBlueprint>& inRenderPassGroups) const -> std::unique_ptr<ExecutionPlan>
+{
+    auto uptrPlan = std::make_unique<ExecutionPlan>();
+    auto nodeIndices = MakeIndexMap(m_nodeBlueprints);
+
+    uptrPlan->structureHash = inStructureHash;
+    uptrPlan->structureKey = std::move(inStructureKey);
+    for (const auto& node : m_nodeBlueprints)
+    {
+        uptrPlan->nodeCulled.push_back(node->culled);
+        uptrPlan->nodeQueueTypes.push_back(node->type);
+    }
+    for (const auto& nodeBatch : inBatches)
+    {
+        auto& batch = uptrPlan->nodeBatches.emplace_back();
+        for (const NodeBlueprint* node : nodeBatch)
+        {
+            batch.push_back(nodeIndices.at(node));
+        }
+    }
+    for (const auto& blueprint : m_imageBlueprints)
+    {
+        uptrPlan->imageCreateInfos.push_back(*blueprint->createInfo);
+        uptrPlan->imageAssignments.push_back({ blueprint->handleToIndex, blueprint->lifetimes });
+    }
+    for (const auto& blueprint : m_bufferBlueprints)
+    {
+        uptrPlan->bufferCreateInfos.push_back(*blueprint->createInfo);
+        uptrPlan->bufferAssignments.push_back({ blueprint->handleToIndex, blueprint->lifetimes });
+    }
+    uptrPlan->splitBarriers = inSplitBarriers;
+    uptrPlan->renderPassGroups = inRenderPassGroups;
+
+    return uptrPlan;
+}
+
+void FrameGraphBuilder::_ApplyExecutionPlan(const ExecutionPlan& inPlan)
+{
+    // same structure, so blueprints line up with the ones the plan was built from
+    CHECK_TRUE(inPlan.imageAssignments.size() == m_imageBlueprints.size());
+    CHECK_TRUE(inPlan.bufferAssignments.size() == m_bufferBlueprints.size());
+
+    // culling isn't run again, so a pass culled in the plan stays out of the graph
+    for (size_t i = 0; i < m_nodeBlueprints.size(); ++i)
+    {
+        m_nodeBlueprints[i]->culled = inPlan.nodeCulled[i];
+    }
+    _ApplyNodeQueueTypes(inPlan.nodeQueueTypes);
+
+    for (size_t i = 0; i < m_imageBlueprints.size(); ++i)
+    {
+        auto& blueprint = m_imageBlueprints[i];
+        const auto& assignment = inPlan.imageAssignments[i];
+
+        blueprint->handleToIndex = assignment.handleToIndex;
+        blueprint->lifetimes = assignment.lifetimes;
+        blueprint->refCounts.assign(assignment.lifetimes.size(), 0);
+        blueprint->states.clear();
+        for (size_t j = 0; j < assignment.lifetimes.size(); ++j)
+        {
+            blueprint->states.emplace_back(std::make_unique<FrameGraphImageResourceState>(*blueprint->initialState));
+        }
+    }
+    for (size_t i = 0; i < m_bufferBlueprints.size(); ++i)
+    {
+        auto& blueprint = m_bufferBlueprints[i];
+        const auto& assignment = inPlan.bufferAssignments[i];
+
+        blueprint->handleToIndex = assignment.handleToIndex;
+        blueprint->lifetimes = assignment.lifetimes;
+        blueprint->refCounts.assign(assignment.lifetimes.size(), 0);
+        blueprint->states.clear();
+        for (size_t j = 0; j < assignment.lifetimes.size(); ++j)
+        {
+            blueprint->states.emplace_back(std::make_unique<FrameGraphBufferResourceState>(*blueprint->initialState));
+        }
+    }
+}
+
+void FrameGraphBuilder::_GenerateResetTask()
+{
+    auto funcReset = [](FrameGraph* toInit)
+        {
+            toInit->_ReleaseDeviceObjects();
+        };
+
+    m_initResourceProcesses.push_back(std::move(funcReset));
+}
+
+void FrameGraphBuilder::_GenerateScheduleTask(const std::vector<std::vector<size_t>>& inNodeBatches, const std::vector<bool>& inNodeCulled)
+{
+    auto funcSetSchedule = [=](FrameGraph* toInit)
+        {
+            toInit->m_culledNodes = inNodeCulled;
+
+            for (const auto& batch : inNodeBatches)
+            {
+                auto& nodes = toInit->m_nodeBatches.emplace_back();
+                for (size_t node : batch)
+                {
+                    nodes.push_back(FrameGraphNodeHandle{ static_cast<uint32_t>(node) });
+                }
+            }
+        };
+
+    m_initResourceProcesses.push_back(std::move(funcSetSchedule));
+}
+
+void FrameGraphBuilder::_GenerateResourceCreationTask()
+{
+    // one device object for each resource instance, handles sharing the instance share the object
+    for (auto& uptrBlueprint : m_bufferBlueprints)
+    {
+        auto bufferBlueprint = uptrBlueprint.get();
+
+        for (size_t resourceLocation = 0; resourceLocation < bufferBlueprint->lifetimes.size(); ++resourceLocation)
+        {
+            auto funcCreateBuffer = [=, this](FrameGraph* toInit)
+                {
+                    std::unique_ptr<Buffer> newBuffer = std::make_unique<Buffer>();
+                    BufferCreateInfo createInfo = *bufferBlueprint->createInfo;
+
+                    // memory is bound later in the aliasing task
+                    if (!bufferBlueprint->external)
+                    {
+                        createInfo.CustomizeMemoryAliasing();
+                    }
+                    newBuffer->Create(&createInfo);
+
+                    // find out handles that point to the new resource, associate them with it
+                    for (auto& p : bufferBlueprint->handleToIndex)
+                    {
+                        if (p.second == resourceLocation)
+                        {
+                            _RegisterHandleToResource(toInit, p.first, newBuffer.get());
+                        }
+                    }
+
+                    _AddInternalBufferToGraph(toInit, std::move(newBuffer));
+                };
+
+            m_initResourceProcesses.push_back(std::move(funcCreateBuffer));
+        }
+    }
+    for (auto& uptrBlueprint : m_imageBlueprints)
+    {
+        auto imageBlueprint = uptrBlueprint.get();
+
+        for (size_t resourceLocation = 0; resourceLocation < imageBlueprint->lifetimes.size(); ++resourceLocation)
+        {
+            auto funcCreateImage = [=, this](FrameGraph* toInit)
+                {
+                    _AddInternalImageToGraph(toInit, _CreateImageInstance(toInit, imageBlueprint, resourceLocation));
+                };
+
+            m_initResourceProcesses.push_back(std::move(funcCreateImage));
+        }
+    }
+}
+
+void FrameGraphBuilder::_GenerateMemoryAliasingTask()
+{
+    // Internal resources are created without memory, here we pack resource instances whose lifetimes
+    // don't overlap into shared memory. Consecutive batches overlap on the device, so the first use
+    // of an instance waits for the last use of every instance placed over it before, see
+    // FrameGraph::RecordAliasingBarriers. Images and buffers never share memory,
+    // so we don't need to care about bufferImageGranularity
+    auto funcAliasMemory = [this](FrameGraph* toInit)
+        {
+            _AliasMemory(toInit, false);
+        };
+
+    m_initResourceProcesses.push_back(std::move(funcAliasMemory));
+}
+
+void FrameGraphBuilder::_GenerateResizeTask()
+{
+    auto funcResize = [this](FrameGraph* toInit)
+        {
+            _RecreateSwapchainSizedImages(toInit);
+        };
+
+    m_initResourceProcesses.push_back(std::move(funcResize));
+}
+
+void FrameGraphBuilder::_GenerateSplitBarriers(const std::vector<std::set<NodeBlueprint*>>& inBatches, std::vector<SplitBarrierBlueprint>& outSplitBarriers)
+{
+    size_t wave = 0;
+    // keyed by resource state, handles that share a resource instance share its state
+    std::unordered_map<const void*, ResourceAccess> accesses;
+
+    // Return the batch to signal in if the barrier for the resource instance can be split, that is the instance
+    // was written on the same queue some batches ago and nothing touched it since
+    auto funcGetSplitSignalBatch = [&](const void* inState, FrameGraphQueueType inQueue) -> std::optional<size_t>
+        {
+            auto iter = accesses.find(inState);
+            if (iter == accesses.end())
+            {
+                return std::nullopt;
+            }
+
+            const ResourceAccess& access = iter->second;
+            if (access.lastAccessBatch != access.lastWriteBatch ||
+                access.writeQueue != inQueue ||
+                wave < access.lastWriteBatch + MIN_SPLIT_BARRIER_BATCH_DISTANCE)
+            {
+                return std::nullopt;
+            }
+            return access.lastWriteBatch;
+        };
+    auto funcGetSplitBarrier = [&](FrameGraphQueueType inQueue, size_t inSignalBatch) -> SplitBarrierBlueprint&
+        {
+            for (auto& splitBarrier : outSplitBarriers)
+            {
+                if (splitBarrier.queueType == inQueue && splitBarrier.signalBatch == inSignalBatch && splitBarrier.waitBatch == wave)
+                {
+                    return splitBarrier;
+                }
+            }
+            outSplitBarriers.push_back(SplitBarrierBlueprint{ inQueue, inSignalBatch, wave });
+            return outSplitBarriers.back();
+        };
+    auto funcRecordAccess = [&](const void* inState, FrameGraphQueueType inQueue, bool inWrite)
+        {
+            auto iter = accesses.try_emplace(inState, ResourceAccess{ ~size_t(0), wave, inQueue }).first;
+
+            iter->second.lastAccessBatch = wave;
+            if (inWrite)
+            {
+                iter->second.lastWriteBatch = wave;
+                iter->second.writeQueue = inQueue;
+            }
+        };
+
+    for (const auto& nodeBatch : inBatches)
+    {
+        std::vector<BufferMemoryBarrierBlueprint> bufBarriers;
+        std::vector<ImageMemoryBarrierBlueprint> imgBarriers;
+
+        for (const NodeBlueprint* node : nodeBatch)
+        {
+            // collect prologue barriers, or split barriers when the producer is far enough away
+            for (const auto& curInput : node->inputs)
+            {
+                if (std::holds_alternative<FrameGraphBufferHandle>(curInput->handle))
+                {
+                    std::vector<FrameGraphBufferSubResourceState> curStates;
+                    std::vector<BufferMemoryBarrierBlueprint> inputBarriers;
+                    bool anyQueueTransfer = false;
+                    FrameGraphBufferHandle curHandle = std::get<FrameGraphBufferHandle>(curInput->handle);
+                    auto pResourceState = _GetResourceState(curHandle);
+                    auto aimState = std::get<FrameGraphBufferSubResourceState>(curInput->state);
+                    
+                    pResourceState->GetSubResourceState(
+                        aimState.offset, 
+                        aimState.size, 
+                        curStates);
+                    for (const auto& curState : curStates)
+                    {
+                        bool queueTransfer = curState.queueFamily == ~0 ? false : curState.queueFamily != aimState.queueFamily;
+                        BufferMemoryBarrierBlueprint barrierBlueprint{};
+
+                        barrierBlueprint.barrier = MakeBufferBarrier(
+                            VK_NULL_HANDLE,
+                            curState.offset,
+                            curState.size,
+                            queueTransfer ? curState.queueFamily : VK_QUEUE_FAMILY_IGNORED,
+                            queueTransfer ? aimState.queueFamily : VK_QUEUE_FAMILY_IGNORED,
+                            curState.access,
+                            aimState.access);
+                        barrierBlueprint.resourceHandle = curHandle;
+                        barrierBlueprint.srcStage = curState.stage;
+                        barrierBlueprint.dstStage = aimState.stage;
+
+                        anyQueueTransfer = anyQueueTransfer || queueTransfer;
+                        inputBarriers.emplace_back(barrierBlueprint);
+                    }
+
+                    // queue ownership transfers need semaphores anyway
+                    auto signalBatch = anyQueueTransfer ? std::nullopt : funcGetSplitSignalBatch(pResourceState, node->type);
+                    auto& barriers = signalBatch.has_value() ? funcGetSplitBarrier(node->type, signalBatch.value()).bufferBarriers : bufBarriers;
+                    barriers.insert(barriers.end(), inputBarriers.begin(), inputBarriers.end());
+                }
+                else if (std::holds_alternative<FrameGraphImageHandle>(curInput->handle))
+                {
+                    std::vector<FrameGraphImageSubResourceState> curStates;
+                    std::vector<ImageMemoryBarrierBlueprint> inputBarriers;
+                    bool anyQueueTransfer = false;
+                    FrameGraphImageHandle curHandle = std::get<FrameGraphImageHandle>(curInput->handle);
+                    auto pResourceState = _GetResourceState(curHandle);
+                    auto aimState = std::get<FrameGraphImageSubResourceState>(curInput->state);
+
+                    pResourceState->GetSubResourceState(aimState.range, curStates);
+                    for (const auto& curState : curStates)
+                    {
+                        ImageMemoryBarrierBlueprint barrierBlueprint{};
                         bool queueTransfer = curState.queueFamily == ~0 ? false : curState.queueFamily != aimState.queueFamily;
 
-                        barrierBlueprint.barrier = MakeImageBarrier(
-                            VK_NULL_HANDLE,
-                            curState.layout,
-                            aimState.layout,
-                            curState.range,
-                            queueTransfer ? curState.queueFamily : VK_QUEUE_FAMILY_IGNORED,
-                            queueTransfer ? aimState.queueFamily : VK_QUEUE_FAMILY_IGNORED,
-                            curState.access,
-                            aimState.access);
-                        barrierBlueprint.srcStage = curState.stage;
-                        barrierBlueprint.dstStage = aimState.stage;
-                        barrierBlueprint.resourceHandle = curHandle;
+                        barrierBlueprint.barrier = MakeImageBarrier(
+                            VK_NULL_HANDLE,
+                            curState.layout,
+                            aimState.layout,
+                            curState.range,
+                            queueTransfer ? curState.queueFamily : VK_QUEUE_FAMILY_IGNORED,
+                            queueTransfer ? aimState.queueFamily : VK_QUEUE_FAMILY_IGNORED,
+                            curState.access,
+                            aimState.access);
+                        barrierBlueprint.srcStage = curState.stage;
+                        barrierBlueprint.dstStage = aimState.stage;
+                        barrierBlueprint.resourceHandle = curHandle;
+
+                        anyQueueTransfer = anyQueueTransfer || queueTransfer;
+                        inputBarriers.emplace_back(barrierBlueprint);
+                    }
+
+                    // queue ownership transfers need semaphores anyway
+                    auto signalBatch = anyQueueTransfer ? std::nullopt : funcGetSplitSignalBatch(pResourceState, node->type);
+                    auto& barriers = signalBatch.has_value() ? funcGetSplitBarrier(node->type, signalBatch.value()).imageBarriers : imgBarriers;
+                    barriers.insert(barriers.end(), inputBarriers.begin(), inputBarriers.end());
+                }
+                else
+                {
+                    CHECK_TRUE(false);
+                }
+            }
+        }
+
+        // nodes in one batch don't depend on each other, so states change only after the whole batch is looked at
+        for (const NodeBlueprint* node : nodeBatch)
+        {
+            for (const auto& curInput : node->inputs)
+            {
+                if (std::holds_alternative<FrameGraphBufferHandle>(curInput->handle))
+                {
+                    auto pResourceState = _GetResourceState(std::get<FrameGraphBufferHandle>(curInput->handle));
+
+                    pResourceState->SetSubResourceState(std::get<FrameGraphBufferSubResourceState>(curInput->state));
+                    funcRecordAccess(pResourceState, node->type, false);
+                }
+                else if (std::holds_alternative<FrameGraphImageHandle>(curInput->handle))
+                {
+                    auto pResourceState = _GetResourceState(std::get<FrameGraphImageHandle>(curInput->handle));
+
+                    pResourceState->SetSubResourceState(std::get<FrameGraphImageSubResourceState>(curInput->state));
+                    funcRecordAccess(pResourceState, node->type, false);
+                }
+            }
+            for (const auto& curOutput : node->outputs)
+            {
+                if (std::holds_alternative<FrameGraphBufferHandle>(curOutput->handle))
+                {
+                    auto pResourceState = _GetResourceState(std::get<FrameGraphBufferHandle>(curOutput->handle));
+
+                    pResourceState->SetSubResourceState(std::get<FrameGraphBufferSubResourceState>(curOutput->state));
+                    funcRecordAccess(pResourceState, node->type, true);
+                }
+                else if (std::holds_alternative<FrameGraphImageHandle>(curOutput->handle))
+                {
+                    auto pResourceState = _GetResourceState(std::get<FrameGraphImageHandle>(curOutput->handle));
+
+                    pResourceState->SetSubResourceState(std::get<FrameGraphImageSubResourceState>(curOutput->state));
+                    funcRecordAccess(pResourceState, node->type, true);
+                }
+            }
+        }
+
+        wave++;
+    }
+}
+
+void FrameGraphBuilder::_GenerateSyncTask(const std::vector<SplitBarrierBlueprint>& inSplitBarriers)
+{
+    for (const auto& splitBarrier : inSplitBarriers)
+    {
+        auto funcAddSplitBarrier = [=, this](FrameGraph* toInit)
+            {
+                _AddSplitBarrierToGraph(toInit, splitBarrier);
+            };
+
+        m_initResourceProcesses.push_back(std::move(funcAddSplitBarrier));
+    }
+}
+
+void FrameGraphBuilder::_GenerateRenderPassTask(const std::vector<RenderPassGroupBlueprint>& inGroups)
+{
+    for (const auto& group : inGroups)
+    {
+        auto funcAddRenderPassGroup = [=, this](FrameGraph* toInit)
+            {
+                _AddRenderPassGroupToGraph(toInit, group);
+            };
+
+        m_initResourceProcesses.push_back(std::move(funcAddRenderPassGroup));
+    }
+}
+
+auto FrameGraphBuilder::_CreateImageInstance(FrameGraph* inGraph, const ImageBlueprint* inBlueprint, size_t inInstance) const -> std::unique_ptr<Image>
+{
+    std::unique_ptr<Image> newImage = std::make_unique<Image>();
+    ImageCreateInfo createInfo = *inBlueprint->createInfo;
+
+    // memory is bound later in the aliasing task
+    if (!inBlueprint->external)
+    {
+        createInfo.CustomizeMemoryAliasing();
+    }
+    newImage->Create(&createInfo);
+
+    // find out handles that point to the new resource, associate them with it
+    for (auto& p : inBlueprint->handleToIndex)
+    {
+        if (p.second == inInstance)
+        {
+            _RegisterHandleToResource(inGraph, p.first, newImage.get());
+        }
+    }
+
+    return newImage;
+}
 
-                        imgBarriers.emplace_back(barrierBlueprint);
-                    }
-                }
-                else
+void FrameGraphBuilder::_RecreateSwapchainSizedImages(FrameGraph* inGraph) const
+{
+    std::unordered_map<VkImage, VkImage> oldToNew;
+
+    // framebuffers take the size of their attachments, they are created again once the images are
+    for (auto& group : inGraph->m_renderPassGroups)
+    {
+        group.uptrFramebuffer->Destroy();
+    }
+
+    for (const auto& blueprint : m_imageBlueprints)
+    {
+        if (!blueprint->createInfo->IsSwapchainSized()) continue;
+
+        for (size_t instance = 0; instance < blueprint->lifetimes.size(); ++instance)
+        {
+            auto iterHandle = std::find_if(blueprint->handleToIndex.begin(), blueprint->handleToIndex.end(),
+                [instance](const std::pair<const FrameGraphImageHandle, size_t>& inPair)
                 {
-                    CHECK_TRUE(false);
-                }
+                    return inPair.second == instance;
+                });
+            if (iterHandle == blueprint->handleToIndex.end()) continue;
+
+            Image* oldImage = _GetRegisteredResource(inGraph, iterHandle->first);
+            auto iterOwner = std::find_if(inGraph->m_internalImages.begin(), inGraph->m_internalImages.end(),
+                [oldImage](const std::unique_ptr<Image>& inImage)
+                {
+                    return inImage.get() == oldImage;
+                });
+            CHECK_TRUE(iterOwner != inGraph->m_internalImages.end());
+
+            const VkImage oldVkImage = oldImage->GetVkImage();
+            oldImage->Destroy();
+            *iterOwner = _CreateImageInstance(inGraph, blueprint.get(), instance);
+            oldToNew[oldVkImage] = (*iterOwner)->GetVkImage();
+        }
+    }
+
+    // the memory was only bound by the images just destroyed
+    auto pAllocator = MyDevice::GetInstance().GetMemoryAllocator();
+    for (VmaAllocation memory : inGraph->m_swapchainSizedAliasingMemories)
+    {
+        pAllocator->FreeAliasingMemory(memory);
+    }
+    inGraph->m_swapchainSizedAliasingMemories.clear();
+
+    // images keep their layouts and stages, so split barriers only need the new handles. Aliasing barriers
+    // follow the placement, which changes with the size, so those of the new images are generated again
+    for (auto& splitBarrier : inGraph->m_splitBarriers)
+    {
+        for (auto& barrier : splitBarrier.imageBarriers)
+        {
+            auto iter = oldToNew.find(barrier.image);
+            barrier.image = iter != oldToNew.end() ? iter->second : barrier.image;
+        }
+    }
+    for (auto& aliasingBarrier : inGraph->m_aliasingBarriers)
+    {
+        std::erase_if(aliasingBarrier.imageBarriers,
+            [&oldToNew](const VkImageMemoryBarrier2KHR& inBarrier)
+            {
+                return oldToNew.find(inBarrier.image) != oldToNew.end();
+            });
+    }
+    std::erase_if(inGraph->m_aliasingBarriers,
+        [](const FrameGraph::AliasingBarrier& inAliasingBarrier)
+        {
+            return inAliasingBarrier.bufferBarriers.empty() && inAliasingBarrier.imageBarriers.empty();
+        });
+
+    _AliasMemory(inGraph, true);
+
+    for (size_t i = 0; i < inGraph->m_renderPassGroups.size(); ++i)
+    {
+        _CreateFramebuffer(inGraph, i);
+    }
+}
+
+void FrameGraphBuilder::_AliasMemory(FrameGraph* inGraph, bool inSwapchainSizedOnly) const
+{
+    // is image, swapchain sized, memory type bits, property. Swapchain sized images get memory of their own,
+    // so a resize replaces it without moving anything else
+    using AliasingGroupKey = std::tuple<bool, bool, uint32_t, VkMemoryPropertyFlags>;
+    std::map<AliasingGroupKey, std::vector<AliasingRequest>> groups;
+    auto pAllocator = MyDevice::GetInstance().GetMemoryAllocator();
+    auto funcFillUsage = [](const ResourceLifetime& inLifetime, AliasingRequest& outRequest)
+        {
+            outRequest.firstBatch = inLifetime.firstBatch;
+            outRequest.lastBatch = inLifetime.lastBatch;
+            outRequest.queueMask = inLifetime.queueMask;
+            outRequest.firstStage = inLifetime.firstStage;
+            outRequest.firstAccess = inLifetime.firstAccess;
+            outRequest.firstLayout = inLifetime.firstLayout;
+            outRequest.aspectMask = inLifetime.aspectMask;
+            outRequest.lastStage = inLifetime.lastStage;
+            outRequest.lastAccess = inLifetime.lastAccess;
+        };
+
+    for (auto& blueprint : m_imageBlueprints)
+    {
+        const bool swapchainSized = blueprint->createInfo->IsSwapchainSized();
+
+        if (blueprint->external || (inSwapchainSizedOnly && !swapchainSized)) continue;
+
+        std::vector<bool> visited(blueprint->refCounts.size(), false);
+        for (auto& p : blueprint->handleToIndex)
+        {
+            if (visited[p.second]) continue;
+            visited[p.second] = true;
+
+            AliasingRequest request{};
+            request.image = _GetRegisteredResource(inGraph, p.first);
+            request.requirements = request.image->GetMemoryRequirements();
+            funcFillUsage(blueprint->lifetimes[p.second], request);
+
+            AliasingGroupKey key{ true, swapchainSized, request.requirements.memoryTypeBits, request.image->GetImageInformation().memoryProperty };
+            groups[key].push_back(request);
+        }
+    }
+    for (auto& blueprint : m_bufferBlueprints)
+    {
+        if (blueprint->external || inSwapchainSizedOnly) continue;
+
+        std::vector<bool> visited(blueprint->refCounts.size(), false);
+        for (auto& p : blueprint->handleToIndex)
+        {
+            if (visited[p.second]) continue;
+            visited[p.second] = true;
+
+            AliasingRequest request{};
+            request.buffer = _GetRegisteredResource(inGraph, p.first);
+            request.requirements = request.buffer->GetMemoryRequirements();
+            funcFillUsage(blueprint->lifetimes[p.second], request);
+
+            AliasingGroupKey key{ false, false, request.requirements.memoryTypeBits, request.buffer->GetBufferInformation().memoryProperty };
+            groups[key].push_back(request);
+        }
+    }
+
+    for (auto& group : groups)
+    {
+        std::vector<AliasingRequest*> requests;
+        VkMemoryRequirements memoryRequirements{};
+
+        memoryRequirements.memoryTypeBits = std::get<2>(group.first);
+        memoryRequirements.alignment = 1;
+        for (auto& request : group.second)
+        {
+            memoryRequirements.alignment = std::max(memoryRequirements.alignment, request.requirements.alignment);
+            requests.push_back(&request);
+        }
+        memoryRequirements.size = PlaceAliasingRequests(requests);
+
+        VmaAllocation memory = pAllocator->AllocateAliasingMemory(memoryRequirements, std::get<3>(group.first));
+        for (auto request : requests)
+        {
+            if (request->image != nullptr)
+            {
+                pAllocator->BindVkImageToAliasingMemory(request->image->GetVkImage(), memory, request->offset);
+            }
+            else
+            {
+                pAllocator->BindVkBufferToAliasingMemory(request->buffer->GetVkBuffer(), memory, request->offset);
             }
         }
 
-        wave++;
+        // requests sharing bytes never conflict, so they are on the same queue one after another
+        for (auto request : requests)
+        {
+            VkPipelineStageFlags srcStage = 0;
+            VkAccessFlags srcAccess = 0;
+
+            for (auto other : requests)
+            {
+                const bool shareBytes =
+                    other->offset < request->offset + request->requirements.size &&
+                    request->offset < other->offset + other->requirements.size;
+
+                if (other == request || !shareBytes || other->lastBatch >= request->firstBatch) continue;
+
+                srcStage |= other->lastStage;
+                srcAccess |= other->lastAccess;
+            }
+            if (srcStage == 0 && srcAccess == 0) continue;
+
+            const auto queueType = static_cast<FrameGraphQueueType>(std::countr_zero(request->queueMask));
+            const VkPipelineStageFlags dstStage = request->firstStage != 0 ? request->firstStage : VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+            srcStage = srcStage != 0 ? srcStage : VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+            if (request->image != nullptr)
+            {
+                // content left by the previous users is discarded
+                VkImageSubresourceRange range{ request->aspectMask, 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS };
+                VkImageLayout layout = request->firstLayout != VK_IMAGE_LAYOUT_UNDEFINED ? request->firstLayout : VK_IMAGE_LAYOUT_GENERAL;
+                VkImageMemoryBarrier barrier = MakeImageBarrier(
+                    VK_NULL_HANDLE,
+                    VK_IMAGE_LAYOUT_UNDEFINED,
+                    layout,
+                    range,
+                    VK_QUEUE_FAMILY_IGNORED,
+                    VK_QUEUE_FAMILY_IGNORED,
+                    srcAccess,
+                    request->firstAccess);
+
+                _AddAliasingBarrierToGraph(inGraph, queueType, request->firstBatch, MakeImageBarrier2(barrier, srcStage, dstStage, request->image->GetVkImage()));
+            }
+            else
+            {
+                VkBufferMemoryBarrier barrier = MakeBufferBarrier(
+                    VK_NULL_HANDLE,
+                    0,
+                    VK_WHOLE_SIZE,
+                    VK_QUEUE_FAMILY_IGNORED,
+                    VK_QUEUE_FAMILY_IGNORED,
+                    srcAccess,
+                    request->firstAccess);
+
+                _AddAliasingBarrierToGraph(inGraph, queueType, request->firstBatch, MakeBufferBarrier2(barrier, srcStage, dstStage, request->buffer->GetVkBuffer()));
+            }
+        }
+
+        _AddAliasingMemoryToGraph(inGraph, memory, std::get<1>(group.first));
     }
 }
 
@@ -616,6 +1994,164 @@ void FrameGraphBuilder::_RegisterHandleToResource(FrameGraph* inGraph, FrameGrap
     inGraph->m_handleToImage[inHandle] = inResource;
 }
 
+void FrameGraphBuilder::_AddAliasingMemoryToGraph(FrameGraph* inGraph, VmaAllocation inMemoryToOwn, bool inSwapchainSized) const
+{
+    if (inSwapchainSized)
+    {
+        inGraph->m_swapchainSizedAliasingMemories.push_back(inMemoryToOwn);
+    }
+    else
+    {
+        inGraph->m_aliasingMemories.push_back(inMemoryToOwn);
+    }
+}
+
+void FrameGraphBuilder::_AddSplitBarrierToGraph(FrameGraph* inGraph, const SplitBarrierBlueprint& inBlueprint) const
+{
+    FrameGraph::SplitBarrier splitBarrier{ inBlueprint.queueType, inBlueprint.signalBatch, inBlueprint.waitBatch };
+
+    if (inGraph->m_uptrEventAllocator == nullptr)
+    {
+        inGraph->m_uptrEventAllocator = std::make_unique<EventAllocator>();
+        inGraph->m_uptrEventAllocator->Create();
+    }
+    splitBarrier.vkEvent = inGraph->m_uptrEventAllocator->CreateOrGetVkEvent();
+
+    for (const auto& barrierBlueprint : inBlueprint.bufferBarriers)
+    {
+        Buffer* buffer = _GetRegisteredResource(inGraph, barrierBlueprint.resourceHandle);
+        splitBarrier.bufferBarriers.push_back(MakeBufferBarrier2(barrierBlueprint.barrier, barrierBlueprint.srcStage, barrierBlueprint.dstStage, buffer->GetVkBuffer()));
+    }
+    for (const auto& barrierBlueprint : inBlueprint.imageBarriers)
+    {
+        Image* image = _GetRegisteredResource(inGraph, barrierBlueprint.resourceHandle);
+        splitBarrier.imageBarriers.push_back(MakeImageBarrier2(barrierBlueprint.barrier, barrierBlueprint.srcStage, barrierBlueprint.dstStage, image->GetVkImage()));
+    }
+
+    inGraph->m_splitBarriers.push_back(std::move(splitBarrier));
+}
+
+void FrameGraphBuilder::_AddAliasingBarrierToGraph(FrameGraph* inGraph, FrameGraphQueueType inQueue, size_t inBatch, const VkBufferMemoryBarrier2KHR& inBarrier) const
+{
+    auto iter = std::find_if(inGraph->m_aliasingBarriers.begin(), inGraph->m_aliasingBarriers.end(),
+        [=](const FrameGraph::AliasingBarrier& inAliasingBarrier)
+        {
+            return inAliasingBarrier.queueType == inQueue && inAliasingBarrier.batch == inBatch;
+        });
+
+    if (iter == inGraph->m_aliasingBarriers.end())
+    {
+        iter = inGraph->m_aliasingBarriers.insert(iter, FrameGraph::AliasingBarrier{ inQueue, inBatch });
+    }
+    iter->bufferBarriers.push_back(inBarrier);
+}
+
+void FrameGraphBuilder::_AddAliasingBarrierToGraph(FrameGraph* inGraph, FrameGraphQueueType inQueue, size_t inBatch, const VkImageMemoryBarrier2KHR& inBarrier) const
+{
+    auto iter = std::find_if(inGraph->m_aliasingBarriers.begin(), inGraph->m_aliasingBarriers.end(),
+        [=](const FrameGraph::AliasingBarrier& inAliasingBarrier)
+        {
+            return inAliasingBarrier.queueType == inQueue && inAliasingBarrier.batch == inBatch;
+        });
+
+    if (iter == inGraph->m_aliasingBarriers.end())
+    {
+        iter = inGraph->m_aliasingBarriers.insert(iter, FrameGraph::AliasingBarrier{ inQueue, inBatch });
+    }
+    iter->imageBarriers.push_back(inBarrier);
+}
+
+void FrameGraphBuilder::_AddRenderPassGroupToGraph(FrameGraph* inGraph, const RenderPassGroupBlueprint& inBlueprint) const
+{
+    RenderPassCreateInfo createInfo{};
+    FrameGraph::RenderPassGroup group{};
+
+    for (const auto& attachment : inBlueprint.attachments)
+    {
+        RenderPassCreateInfo::AttachmentDescription description{};
+
+        // clear values only matter for attachments a pass asked to clear
+        if (attachment.depthStencil)
+        {
+            const VkClearDepthStencilValue& clearValue = attachment.clearValue.depthStencil;
+            description.CustomizeFormat(attachment.format, std::pair<float, uint32_t>{ clearValue.depth, clearValue.stencil });
+            description.CustomizeStencilStoreLoadOperation(attachment.loadOp, attachment.storeOp);
+        }
+        else
+        {
+            const float* clearColor = attachment.clearValue.color.float32;
+            description.CustomizeFormat(attachment.format, glm::vec4(clearColor[0], clearColor[1], clearColor[2], clearColor[3]));
+        }
+        group.attachments.push_back(attachment.handle);
+        description.CustomizeSampleCount(attachment.sampleCount);
+        description.CustomizeLoadOperation(attachment.loadOp);
+        description.CustomizeStoreOperation(attachment.storeOp);
+        description.CustomizeInitialLayout(attachment.initialLayout);
+        description.CustomizeFinalLayout(attachment.finalLayout);
+        createInfo.AddAttachment(description);
+    }
+    for (const auto& subpass : inBlueprint.subpasses)
+    {
+        RenderPassCreateInfo::SubpassDescription description{};
+
+        for (uint32_t i = 0; i < static_cast<uint32_t>(subpass.inputAttachments.size()); ++i)
+        {
+            description.AddInputAttachment(i, subpass.inputAttachments[i].attachment, subpass.inputAttachments[i].layout);
+        }
+        for (uint32_t i = 0; i < static_cast<uint32_t>(subpass.colorAttachments.size()); ++i)
+        {
+            description.AddColorAttachment(i, subpass.colorAttachments[i].attachment, subpass.colorAttachments[i].layout);
+        }
+        if (subpass.depthStencilAttachment.has_value())
+        {
+            description.AddDepthStencilAttachment(subpass.depthStencilAttachment->attachment, subpass.depthStencilAttachment->layout);
+        }
+        if (subpass.availableStage != 0)
+        {
+            description.CustomizeAvailableState(subpass.availableStage, subpass.availableAccess);
+        }
+        for (const auto& dependency : subpass.dependencies)
+        {
+            description.AddDependencyOnSubpass(dependency.srcSubpass, dependency.dstStage, dependency.dstAccess);
+        }
+        // attachments are only read at the pixel they were written
+        description.AllowLocalPipelineBarrier();
+
+        createInfo.AddSubpass(description);
+        group.nodes.push_back(FrameGraphNodeHandle{ static_cast<uint32_t>(subpass.node) });
+    }
+
+    group.uptrRenderPass = std::make_unique<RenderPass>();
+    group.uptrRenderPass->Create(&createInfo);
+    inGraph->m_renderPassGroups.push_back(std::move(group));
+    _CreateFramebuffer(inGraph, inGraph->m_renderPassGroups.size() - 1);
+}
+
+void FrameGraphBuilder::_CreateFramebuffer(FrameGraph* inGraph, size_t inGroupIndex) const
+{
+    FramebufferCreateInfo createInfo{};
+    auto& group = inGraph->m_renderPassGroups[inGroupIndex];
+
+    createInfo.SetRenderPass(group.uptrRenderPass.get());
+    for (uint32_t i = 0; i < static_cast<uint32_t>(group.attachments.size()); ++i)
+    {
+        createInfo.SetImageView(i, _GetRegisteredResource(inGraph, group.attachments[i])->View());
+    }
+
+    group.uptrFramebuffer = std::make_unique<Framebuffer>();
+    group.uptrFramebuffer->Create(&createInfo);
+}
+
+auto FrameGraphBuilder::_GetRegisteredResource(FrameGraph* inGraph, FrameGraphBufferHandle inHandle) const -> Buffer*
+{
+    return inGraph->m_handleToBuffer.at(inHandle);
+}
+
+auto FrameGraphBuilder::_GetRegisteredResource(FrameGraph* inGraph, FrameGraphImageHandle inHandle) const -> Image*
+{
+    return inGraph->m_handleToImage.at(inHandle);
+}
+
 auto FrameGraphBuilder::AddFrameGraphPass(const FrameGraphPassBind* inPassBind) -> FrameGraphNodeHandle
 {
     FrameGraphNodeHandle handle{};
@@ -640,11 +2176,13 @@ auto FrameGraphBuilder::AddFrameGraphPass(const FrameGraphPassBind* inPassBind)
                 {
                     output->handle = upd.handle;
                     output->name = upd.name;
+                    output->clearValue = upd.clearValue;
                 }
                 if (transient != nullptr)
                 {
                     transient->handle = upd.handle;
                     transient->name = upd.name;
+                    transient->clearValue = upd.clearValue;
                 }
             };
 
@@ -751,6 +2289,12 @@ auto FrameGraphBuilder::AddFrameGraphPass(const FrameGraphPassBind* inPassBind)
         ++i;
     }
 
+    newNode->requestedType = inPassBind->m_type.value_or(FrameGraphQueueType::GRAPHICS);
+    newNode->type = newNode->requestedType;
+    newNode->queueFixed = inPassBind->m_type.has_value();
+    newNode->neverCull = inPassBind->m_neverCull;
+    newNode->estimatedCost = inPassBind->m_estimatedCost;
+
     handle.handle = static_cast<uint32_t>(m_nodeBlueprints.size());
     m_nodeBlueprints.push_back(std::move(newNode));
 
@@ -766,13 +2310,241 @@ void FrameGraphBuilder::AddExtraDependency(FrameGraphNodeHandle inSooner, FrameG
     second->extraPrevs.insert(first);
 }
 
+void FrameGraphBuilder::SetPassCost(FrameGraphNodeHandle inHandle, float inMicroseconds)
+{
+    _GetNodeBlueprint(inHandle)->estimatedCost = inMicroseconds;
+}
+
+void FrameGraphBuilder::_GetStructureKey(std::vector<size_t>& outKey) const
+{
+    auto nodeIndices = MakeIndexMap(m_nodeBlueprints);
+    auto funcAddHandle = [&outKey](const FRAME_GRAPH_RESOURCE_HANDLE& inHandle)
+        {
+            outKey.push_back(inHandle.index());
+            if (std::holds_alternative<FrameGraphBufferHandle>(inHandle))
+            {
+                outKey.push_back(std::get<FrameGraphBufferHandle>(inHandle).handle);
+            }
+            else if (std::holds_alternative<FrameGraphImageHandle>(inHandle))
+            {
+                outKey.push_back(std::get<FrameGraphImageHandle>(inHandle).handle);
+            }
+        };
+    auto funcAddClearValue = [&outKey](const std::optional<VkClearValue>& inClearValue)
+        {
+            const VkClearValue clearValue = inClearValue.value_or(VkClearValue{});
+
+            outKey.push_back(inClearValue.has_value());
+            for (uint32_t word : clearValue.color.uint32)
+            {
+                outKey.push_back(word);
+            }
+        };
+    // a queue family filled by async compute placement is not part of the structure
+    auto funcAddState = [this, &outKey](const FRAME_GRAPH_SUBRESOURCE_STATE& inState)
+        {
+            const bool placed = m_placedQueueFamilyStates.contains(&inState);
+
+            outKey.push_back(inState.index());
+            if (std::holds_alternative<FrameGraphBufferSubResourceState>(inState))
+            {
+                const auto& state = std::get<FrameGraphBufferSubResourceState>(inState);
+
+                outKey.push_back(static_cast<size_t>(state.offset));
+                outKey.push_back(static_cast<size_t>(state.size));
+                outKey.push_back(static_cast<size_t>(placed ? VK_QUEUE_FAMILY_IGNORED : state.queueFamily));
+                outKey.push_back(static_cast<size_t>(state.access));
+                outKey.push_back(static_cast<size_t>(state.stage));
+            }
+            else if (std::holds_alternative<FrameGraphImageSubResourceState>(inState))
+            {
+                const auto& state = std::get<FrameGraphImageSubResourceState>(inState);
+
+                outKey.push_back(static_cast<size_t>(state.range.aspectMask));
+                outKey.push_back(static_cast<size_t>(state.range.baseMipLevel));
+                outKey.push_back(static_cast<size_t>(state.range.levelCount));
+                outKey.push_back(static_cast<size_t>(state.range.baseArrayLayer));
+                outKey.push_back(static_cast<size_t>(state.range.layerCount));
+                outKey.push_back(static_cast<size_t>(state.layout));
+                outKey.push_back(static_cast<size_t>(placed ? VK_QUEUE_FAMILY_IGNORED : state.queueFamily));
+                outKey.push_back(static_cast<size_t>(state.access));
+                outKey.push_back(static_cast<size_t>(state.stage));
+            }
+        };
+
+    // passes, their bindings and dependencies, names are left out since links are already resolved
+    outKey.push_back(m_nodeBlueprints.size());
+    for (const auto& node : m_nodeBlueprints)
+    {
+        outKey.push_back(static_cast<size_t>(node->requestedType));
+        outKey.push_back(static_cast<size_t>(node->queueFixed));
+        outKey.push_back(static_cast<size_t>(node->neverCull));
+        outKey.push_back(std::bit_cast<uint32_t>(node->estimatedCost));
+        outKey.push_back(node->inputs.size());
+        for (const auto& input : node->inputs)
+        {
+            funcAddHandle(input->handle);
+            funcAddState(input->state);
+            outKey.push_back(input->prev != nullptr ? nodeIndices.at(input->prev->owner) : ~size_t(0));
+        }
+        outKey.push_back(node->outputs.size());
+        for (const auto& output : node->outputs)
+        {
+            funcAddHandle(output->handle);
+            funcAddState(output->state);
+            funcAddClearValue(output->clearValue);
+        }
+        outKey.push_back(node->transients.size());
+        for (const auto& transient : node->transients)
+        {
+            funcAddHandle(transient->handle);
+            funcAddState(transient->initialState);
+            funcAddState(transient->finalState);
+            funcAddClearValue(transient->clearValue);
+        }
+        outKey.push_back(node->extraNexts.size());
+        for (const NodeBlueprint* next : node->extraNexts)
+        {
+            outKey.push_back(nodeIndices.at(next));
+        }
+    }
+
+    // resource descriptions, create infos are compared on their own
+    outKey.push_back(m_imageBlueprints.size());
+    for (const auto& blueprint : m_imageBlueprints)
+    {
+        outKey.push_back(static_cast<size_t>(blueprint->external));
+        outKey.push_back(static_cast<size_t>(blueprint->initialState->GetMipLevelCount()));
+        outKey.push_back(static_cast<size_t>(blueprint->initialState->GetArrayLayerCount()));
+    }
+    outKey.push_back(m_bufferBlueprints.size());
+    for (const auto& blueprint : m_bufferBlueprints)
+    {
+        outKey.push_back(static_cast<size_t>(blueprint->external));
+        outKey.push_back(static_cast<size_t>(blueprint->initialState->GetSize()));
+    }
+
+    // unordered maps don't iterate in a stable order
+    std::vector<std::pair<uint32_t, size_t>> imageHandles;
+    std::vector<std::pair<uint32_t, size_t>> bufferHandles;
+    for (const auto& p : m_handleToImageBlueprint)
+    {
+        imageHandles.emplace_back(p.first.handle, p.second);
+    }
+    for (const auto& p : m_handleToBufferBlueprint)
+    {
+        bufferHandles.emplace_back(p.first.handle, p.second);
+    }
+    std::sort(imageHandles.begin(), imageHandles.end());
+    std::sort(bufferHandles.begin(), bufferHandles.end());
+    for (const auto& p : imageHandles)
+    {
+        outKey.push_back(p.first);
+        outKey.push_back(p.second);
+    }
+    for (const auto& p : bufferHandles)
+    {
+        outKey.push_back(p.first);
+        outKey.push_back(p.second);
+    }
+}
+
+auto FrameGraphBuilder::_HashStructureKey(const std::vector<size_t>& inStructureKey) const -> size_t
+{
+    size_t seed = 0;
+
+    for (size_t value : inStructureKey)
+    {
+        hash_combine(seed, value);
+    }
+    for (const auto& blueprint : m_imageBlueprints)
+    {
+        hash_combine(seed, blueprint->createInfo->GetHash());
+    }
+    for (const auto& blueprint : m_bufferBlueprints)
+    {
+        hash_combine(seed, blueprint->createInfo->GetHash());
+    }
+
+    return seed;
+}
+
+auto FrameGraphBuilder::GetStructureHash() const -> size_t
+{
+    std::vector<size_t> structureKey;
+
+    _GetStructureKey(structureKey);
+    return _HashStructureKey(structureKey);
+}
+
 void FrameGraphBuilder::ArrangePasses()
 {
-    std::vector<std::set<NodeBlueprint*>> nodeBatches;
+    std::vector<size_t> structureKey;
+
+    m_initResourceProcesses.clear();
+
+    _GetStructureKey(structureKey);
+    const size_t structureHash = _HashStructureKey(structureKey);
+    auto iter = std::find_if(m_cachedPlans.begin(), m_cachedPlans.end(),
+        [&](const std::unique_ptr<ExecutionPlan>& inPlan)
+        {
+            return _IsPlanOfStructure(*inPlan, structureHash, structureKey);
+        });
+
+    if (iter != m_cachedPlans.end())
+    {
+        // move it to the back as the most recently used
+        std::rotate(iter, iter + 1, m_cachedPlans.end());
+        _ApplyExecutionPlan(*m_cachedPlans.back());
+    }
+    else
+    {
+        std::vector<std::set<NodeBlueprint*>> nodeBatches;
+        std::vector<SplitBarrierBlueprint> splitBarriers;
+        std::vector<RenderPassGroupBlueprint> renderPassGroups;
+
+        _CullNodes();
+
+        _PlaceAsyncCompute();
+
+        _ScheduleNodes(nodeBatches);
+
+        _AssignResources(nodeBatches);
+
+        _CollectResourceUsages(nodeBatches);
+
+        _GenerateSplitBarriers(nodeBatches, splitBarriers);
+
+        _MergeRenderPasses(nodeBatches, renderPassGroups);
+
+        if (m_cachedPlans.size() >= MAX_CACHED_PLAN_COUNT)
+        {
+            m_cachedPlans.erase(m_cachedPlans.begin());
+        }
+        m_cachedPlans.push_back(_BuildExecutionPlan(structureHash, std::move(structureKey), nodeBatches, splitBarriers, renderPassGroups));
+    }
+
+    const ExecutionPlan* pPlan = m_cachedPlans.back().get();
+
+    // the graph already runs this plan, only the swapchain size may have changed
+    if (pPlan == m_pArrangedPlan)
+    {
+        _GenerateResizeTask();
+        return;
+    }
+    m_pArrangedPlan = pPlan;
+
+    _GenerateResetTask();
+
+    _GenerateScheduleTask(pPlan->nodeBatches, pPlan->nodeCulled);
+
+    _GenerateResourceCreationTask();
+
+    _GenerateMemoryAliasingTask();
 
-    _TopologicalSort(nodeBatches);
+    _GenerateSyncTask(pPlan->splitBarriers);
 
-    _GenerateResourceCreationTask(nodeBatches);
+    _GenerateRenderPassTask(pPlan->renderPassGroups);
 }
 
 void FrameGraphBuilder::NodeBlueprint::GetFullNext(std::set<NodeBlueprint*>& output)
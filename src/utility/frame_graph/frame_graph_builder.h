@@ -4,8 +4,10 @@
 #include "image.h"
 #include "buffer.h"
 #include "command_buffer.h"
+#include <unordered_set>
 
 class FrameGraphBuilder;
+class FrameGraphScheduler;
 
 class FrameGraphBufferResourceAllocator
 {
@@ -60,9 +62,12 @@ private:
 		std::string name;
 		uint32_t id;
 		FRAME_GRAPH_RESOURCE_HANDLE handle;
+		std::optional<VkClearValue> clearValue;
 	};
 	std::vector<Data> m_data;
-	FrameGraphQueueType m_type;
+	std::optional<FrameGraphQueueType> m_type;
+	float m_estimatedCost = 1.0f;
+	bool m_neverCull = false;
 	const FrameGraphPass* m_pass;
 
 public:
@@ -91,7 +96,20 @@ public:
 		uint32_t inAttachmentIndex,
 		const std::string& inName,
 		const FrameGraphImageHandle& inHandle);
+	// Optional, pins the pass to the queue. Otherwise the pass runs on graphics, unless it only
+	// touches resources in compute or transfer stages and FrameGraphBuilder finds that moving it
+	// to async compute shortens the frame
 	FrameGraphPassBind& SetQueueType(FrameGraphQueueType inType);
+	// Optional, default: 1. Rough time the pass takes in microseconds, the longer of device time and
+	// recording time, used to schedule passes on the critical path first. See FrameGraphScheduler
+	FrameGraphPassBind& SetEstimatedCost(float inMicroseconds);
+	// Optional, default: false. Passes whose outputs never reach an external resource are culled,
+	// enable this for a pass with effects the frame graph can't see, e.g. writing a host mapped buffer
+	// that isn't registered
+	FrameGraphPassBind& CustomizeNeverCull();
+	// Optional, clear the image bound as out or transient attachment at the index when the pass begins,
+	// otherwise what it held before the pass is undefined. Render passes merging the pass clear it for it
+	FrameGraphPassBind& CustomizeAttachmentClear(uint32_t inAttachmentIndex, const VkClearValue& inClearValue);
 
 	friend class FrameGraphBuilder;
 };
@@ -124,6 +142,7 @@ private:
 		std::set<NodeInput*> nexts;
 		FRAME_GRAPH_RESOURCE_HANDLE handle;
 		FRAME_GRAPH_SUBRESOURCE_STATE state;
+		std::optional<VkClearValue> clearValue; // see FrameGraphPassBind::CustomizeAttachmentClear
 		std::string name;
 	};
 	struct NodeTransient
@@ -132,6 +151,7 @@ private:
 		FRAME_GRAPH_RESOURCE_HANDLE handle;
 		FRAME_GRAPH_SUBRESOURCE_STATE initialState;
 		FRAME_GRAPH_SUBRESOURCE_STATE finalState;
+		std::optional<VkClearValue> clearValue; // see FrameGraphPassBind::CustomizeAttachmentClear
 		std::string name;
 	};
 	struct NodeBlueprint
@@ -141,10 +161,29 @@ private:
 		std::vector<std::unique_ptr<NodeTransient>> transients;
 		std::set<NodeBlueprint*> extraNexts;
 		std::set<NodeBlueprint*> extraPrevs;
-		FrameGraphQueueType type;
+		FrameGraphQueueType requestedType; // as bound, the key is made of it
+		FrameGraphQueueType type; // after async compute placement
+		bool queueFixed; // see FrameGraphPassBind::SetQueueType
+		bool neverCull; // see FrameGraphPassBind::CustomizeNeverCull
+		bool culled = false;
+		float estimatedCost; // microseconds
 		void GetFullNext(std::set<NodeBlueprint*>& output);
 		void GetFullPrev(std::set<NodeBlueprint*>& output);
 	};
+	// Batch interval that a resource instance is referenced in, inclusive, and how it is used at both
+	// ends, so memory can be handed from one instance to the next one aliasing it
+	struct ResourceLifetime
+	{
+		size_t firstBatch;
+		size_t lastBatch;
+		uint32_t queueMask = 0; // bit per FrameGraphQueueType the instance is used on
+		VkPipelineStageFlags firstStage = 0;
+		VkAccessFlags firstAccess = 0;
+		VkImageLayout firstLayout = VK_IMAGE_LAYOUT_UNDEFINED; // images only
+		VkImageAspectFlags aspectMask = 0; // images only
+		VkPipelineStageFlags lastStage = 0;
+		VkAccessFlags lastAccess = 0;
+	};
 	struct ImageBlueprint
 	{
 		bool external;
@@ -155,6 +194,7 @@ private:
 		std::unordered_map<FrameGraphImageHandle, size_t> handleToIndex; // index of 'refCounts' 'states'
 		std::vector<uint32_t> refCounts;
 		std::vector<std::unique_ptr<FrameGraphImageResourceState>> states;
+		std::vector<ResourceLifetime> lifetimes;
 		
 		bool HaveResourceAssigned(FrameGraphImageHandle inHandle);
 	};
@@ -168,6 +208,7 @@ private:
 		std::unordered_map<FrameGraphBufferHandle, size_t> handleToIndex; // index of 'refCounts' 'states'
 		std::vector<uint32_t> refCounts;
 		std::vector<std::unique_ptr<FrameGraphBufferResourceState>> states;
+		std::vector<ResourceLifetime> lifetimes;
 		
 		bool HaveResourceAssigned(FrameGraphBufferHandle inHandle);
 	};
@@ -203,6 +244,87 @@ private:
 		VkBufferMemoryBarrier barrier;
 		FrameGraphBufferHandle resourceHandle;
 	};
+	// Barriers set after signalBatch and waited before waitBatch, see FrameGraph::SplitBarrier
+	struct SplitBarrierBlueprint
+	{
+		FrameGraphQueueType queueType;
+		size_t signalBatch;
+		size_t waitBatch;
+		std::vector<BufferMemoryBarrierBlueprint> bufferBarriers;
+		std::vector<ImageMemoryBarrierBlueprint> imageBarriers;
+	};
+	// Graphics passes in consecutive batches recorded as the subpasses of one render pass, so
+	// attachments passed between them stay on chip, see _MergeRenderPasses
+	struct RenderPassGroupBlueprint
+	{
+		struct Attachment
+		{
+			FrameGraphImageHandle handle;
+			VkFormat format;
+			VkSampleCountFlagBits sampleCount;
+			bool depthStencil;
+			VkAttachmentLoadOp loadOp;
+			VkAttachmentStoreOp storeOp;
+			VkClearValue clearValue; // used by VK_ATTACHMENT_LOAD_OP_CLEAR
+			VkImageLayout initialLayout;
+			VkImageLayout finalLayout;
+		};
+		struct Dependency
+		{
+			uint32_t srcSubpass;
+			VkPipelineStageFlags dstStage;
+			VkAccessFlags dstAccess;
+		};
+		struct Subpass
+		{
+			size_t node; // index in m_nodeBlueprints
+			std::vector<VkAttachmentReference> inputAttachments; // attachment is index in 'attachments'
+			std::vector<VkAttachmentReference> colorAttachments;
+			std::optional<VkAttachmentReference> depthStencilAttachment;
+			VkPipelineStageFlags availableStage = 0;
+			VkAccessFlags availableAccess = 0;
+			std::vector<Dependency> dependencies;
+		};
+		std::vector<Attachment> attachments;
+		std::vector<Subpass> subpasses;
+	};
+	// Batches a resource instance was last written and accessed in, while generating sync tasks
+	struct ResourceAccess
+	{
+		size_t lastWriteBatch;
+		size_t lastAccessBatch;
+		FrameGraphQueueType writeQueue;
+	};
+	// Which resource instance every handle of a blueprint uses
+	template<class HandleType>
+	struct ResourceAssignment
+	{
+		std::unordered_map<HandleType, size_t> handleToIndex;
+		std::vector<ResourceLifetime> lifetimes; // [instance]
+	};
+	// What ArrangePasses works out from the structure of the graph. It is immutable once built, and
+	// cached by the builder so toggling passes back to a known structure skips the work
+	struct ExecutionPlan
+	{
+		size_t structureHash;
+		std::vector<size_t> structureKey; // see _GetStructureKey, compared so a hash collision can't pick a wrong plan
+		std::vector<ImageCreateInfo> imageCreateInfos; // [image blueprint]
+		std::vector<BufferCreateInfo> bufferCreateInfos; // [buffer blueprint]
+		std::vector<bool> nodeCulled; // [node]
+		std::vector<FrameGraphQueueType> nodeQueueTypes; // [node], after async compute placement
+		std::vector<std::vector<size_t>> nodeBatches; // [batch] -> index in m_nodeBlueprints
+		std::vector<ResourceAssignment<FrameGraphImageHandle>> imageAssignments; // [image blueprint]
+		std::vector<ResourceAssignment<FrameGraphBufferHandle>> bufferAssignments; // [buffer blueprint]
+		std::vector<SplitBarrierBlueprint> splitBarriers;
+		std::vector<RenderPassGroupBlueprint> renderPassGroups;
+	};
+
+	// enough for a few debug passes to be toggled back and forth
+	static constexpr size_t MAX_CACHED_PLAN_COUNT = 8;
+	std::vector<std::unique_ptr<ExecutionPlan>> m_cachedPlans; // least recently used first
+	const ExecutionPlan* m_pArrangedPlan = nullptr; // plan the graph was last set up with
+	// states left to us whose queue family _ApplyNodeQueueTypes filled, the key sees them unset
+	std::unordered_set<const FRAME_GRAPH_SUBRESOURCE_STATE*> m_placedQueueFamilyStates;
 
 	std::unordered_map<std::string, NodeOutput*> m_nameToOutput;
 	std::vector<std::unique_ptr<NodeBlueprint>> m_nodeBlueprints;
@@ -219,10 +341,57 @@ private:
 	auto _GetResourceState(FrameGraphImageHandle inHandle) -> FrameGraphImageResourceState*;
 	auto _GetResourceState(FrameGraphBufferHandle inHandle) -> FrameGraphBufferResourceState*;
 
-	void _TopologicalSort(std::vector<std::set<NodeBlueprint*>>& outBatches);
-	void _GenerateResourceCreationTask(const std::vector<std::set<NodeBlueprint*>>& inBatches);
-	void _GenerateSyncTask(const std::vector<std::set<NodeBlueprint*>>& inBatches);
+	// Mark passes that no external resource or never culled pass depends on, they and their
+	// transient resources take no part in scheduling, resource creation and barriers
+	void _CullNodes();
+	// Scheduler of the passes not culled, outNodeIndices maps its node indices to indices in m_nodeBlueprints
+	void _BuildScheduler(FrameGraphScheduler& outScheduler, std::vector<size_t>& outNodeIndices) const;
+	// Move passes that may run on compute from graphics to compute, as long as the estimated frame gets shorter
+	void _PlaceAsyncCompute();
+	// Passes changing queue must name the queue family of their resource states, so ownership is transferred.
+	// A previous placement is undone first, so the blueprints only ever hold one
+	void _ApplyNodeQueueTypes(const std::vector<FrameGraphQueueType>& inQueueTypes);
+	// Order passes by critical path into batches, nodes in a batch don't depend on each other
+	void _ScheduleNodes(std::vector<std::set<NodeBlueprint*>>& outBatches);
+	// Decide resource instance of every handle, instances whose lifetimes don't overlap are reused
+	void _AssignResources(const std::vector<std::set<NodeBlueprint*>>& inBatches);
+	// Fill the queues and the first and last use of every resource lifetime, after resources are assigned
+	void _CollectResourceUsages(const std::vector<std::set<NodeBlueprint*>>& inBatches);
+	void _GenerateSplitBarriers(const std::vector<std::set<NodeBlueprint*>>& inBatches, std::vector<SplitBarrierBlueprint>& outSplitBarriers);
+	// Find chains of graphics passes, one in each consecutive batch, that draw the same render area and only
+	// pass attachments to each other read at the same pixel, e.g. G-buffer and lighting reading it as input attachments
+	void _MergeRenderPasses(const std::vector<std::set<NodeBlueprint*>>& inBatches, std::vector<RenderPassGroupBlueprint>& outGroups);
+	// Everything that decides the arrangement but the resource create infos, as plain values
+	void _GetStructureKey(std::vector<size_t>& outKey) const;
+	// Hash of the key and the resource create infos, see GetStructureHash
+	auto _HashStructureKey(const std::vector<size_t>& inStructureKey) const -> size_t;
+	auto _IsPlanOfStructure(const ExecutionPlan& inPlan, size_t inStructureHash, const std::vector<size_t>& inStructureKey) const -> bool;
+	auto _BuildExecutionPlan(
+		size_t inStructureHash,
+		std::vector<size_t> inStructureKey,
+		const std::vector<std::set<NodeBlueprint*>>& inBatches,
+		const std::vector<SplitBarrierBlueprint>& inSplitBarriers,
+		const std::vector<RenderPassGroupBlueprint>& inRenderPassGroups) const -> std::unique_ptr<ExecutionPlan>;
+	// Restore resource instances from a cached plan instead of assigning them again
+	void _ApplyExecutionPlan(const ExecutionPlan& inPlan);
+	// Release what the previous arrangement set up in the graph
+	void _GenerateResetTask();
+	// Hand the batches and culled passes to the graph, so culled passes are neither scheduled nor recorded
+	void _GenerateScheduleTask(const std::vector<std::vector<size_t>>& inNodeBatches, const std::vector<bool>& inNodeCulled);
+	void _GenerateResourceCreationTask();
+	void _GenerateMemoryAliasingTask();
+	// The graph is already set up with this plan, only images sized by the swapchain are created again
+	void _GenerateResizeTask();
+	void _GenerateSyncTask(const std::vector<SplitBarrierBlueprint>& inSplitBarriers);
+	void _GenerateRenderPassTask(const std::vector<RenderPassGroupBlueprint>& inGroups);
 	
+	auto _CreateImageInstance(FrameGraph* inGraph, const ImageBlueprint* inBlueprint, size_t inInstance) const -> std::unique_ptr<Image>;
+	// Place internal resources in shared memory and bind them, see _GenerateMemoryAliasingTask
+	void _AliasMemory(FrameGraph* inGraph, bool inSwapchainSizedOnly) const;
+	void _RecreateSwapchainSizedImages(FrameGraph* inGraph) const;
+	// Framebuffer of a render pass group in the graph, from the images registered for its attachments
+	void _CreateFramebuffer(FrameGraph* inGraph, size_t inGroupIndex) const;
+
 	// update frame graph private member
 	void _AddInternalBufferToGraph(FrameGraph* inGraph, std::unique_ptr<Buffer> inBufferToOwn) const;
 	void _AddExternalBufferToGraph(FrameGraph* inGraph, Buffer* inBuffer) const;
@@ -230,6 +399,13 @@ private:
 	void _AddExternalImageToGraph(FrameGraph* inGraph, Image* inImage) const;
 	void _RegisterHandleToResource(FrameGraph* inGraph, FrameGraphBufferHandle inHandle, Buffer* inResource) const;
 	void _RegisterHandleToResource(FrameGraph* inGraph, FrameGraphImageHandle inHandle, Image* inResource) const;
+	void _AddAliasingMemoryToGraph(FrameGraph* inGraph, VmaAllocation inMemoryToOwn, bool inSwapchainSized) const;
+	void _AddSplitBarrierToGraph(FrameGraph* inGraph, const SplitBarrierBlueprint& inBlueprint) const;
+	void _AddAliasingBarrierToGraph(FrameGraph* inGraph, FrameGraphQueueType inQueue, size_t inBatch, const VkBufferMemoryBarrier2KHR& inBarrier) const;
+	void _AddAliasingBarrierToGraph(FrameGraph* inGraph, FrameGraphQueueType inQueue, size_t inBatch, const VkImageMemoryBarrier2KHR& inBarrier) const;
+	void _AddRenderPassGroupToGraph(FrameGraph* inGraph, const RenderPassGroupBlueprint& inBlueprint) const;
+	auto _GetRegisteredResource(FrameGraph* inGraph, FrameGraphBufferHandle inHandle) const -> Buffer*;
+	auto _GetRegisteredResource(FrameGraph* inGraph, FrameGraphImageHandle inHandle) const -> Image*;
 
 public:
 	struct ExternalImageResourceRegisterInfo
@@ -248,5 +424,15 @@ public:
 	auto PromiseInternalResource(const FrameGraphBufferResourceAllocator& inAllocator) -> FrameGraphBufferHandle;
 	auto AddFrameGraphPass(const FrameGraphPassBind* inPassBind) -> FrameGraphNodeHandle;
 	void AddExtraDependency(FrameGraphNodeHandle inSooner, FrameGraphNodeHandle inLater);
+	// Replace the estimated cost of a pass, e.g. with timings measured in previous frames. It changes
+	// the structure hash, so only feed it when timings moved enough to be worth a new arrangement
+	void SetPassCost(FrameGraphNodeHandle inHandle, float inMicroseconds);
+	// Hash of everything that decides the arrangement: passes, their bindings and dependencies, and
+	// resource descriptions. Sizes of swapchain sized images are left out, so a resize keeps the hash
+	auto GetStructureHash() const -> size_t;
+	// Sort passes, assign resources and generate barriers, or take them from the plan cache when a graph
+	// of the same structure was arranged before. The init processes then bring the graph set up from the
+	// previous arrangement to this one: when the structure didn't change, e.g. on a resize, only images
+	// sized by the swapchain are created again, otherwise everything is. The device must be idle
 	void ArrangePasses();
 };
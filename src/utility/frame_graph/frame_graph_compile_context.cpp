@@ -1,5 +1,7 @@
 #include "frame_graph_compile_context.h"
 #include "device.h"
+#include "barrier_batcher.h"
+#include <algorithm>
 
 #define REF_COUNT_SEG_TREE(intervalType) frame_graph_util::SegmentTree<RefCount<intervalType>, intervalType>
 
@@ -300,6 +302,45 @@ void FrameGraphCompileContext::_PullPendingSemaphore(
 	outSemaphoresToWait.clear();
 }
 
+void FrameGraphCompileContext::_AddLocalSync(
+	std::vector<LocalSyncInfo>& inoutSyncInfos,
+	FrameGraphQueueType inQueueToSync,
+	VkPipelineStageFlags inSrcStage,
+	VkPipelineStageFlags inDstStage,
+	const std::vector<VkMemoryBarrier>& inBarriers,
+	const std::vector<VkBufferMemoryBarrier>& inBufferBarriers,
+	const std::vector<VkImageMemoryBarrier>& inImageBarriers)
+{
+	auto iter = std::find_if(inoutSyncInfos.begin(), inoutSyncInfos.end(), [&](const LocalSyncInfo& inSyncInfo)
+		{
+			return inSyncInfo.queueType == inQueueToSync && inSyncInfo.srcStage == inSrcStage && inSyncInfo.dstStage == inDstStage;
+		});
+	if (iter == inoutSyncInfos.end())
+	{
+		inoutSyncInfos.push_back(LocalSyncInfo{ inQueueToSync, inSrcStage, inDstStage });
+		iter = std::prev(inoutSyncInfos.end());
+	}
+
+	// subresource state slices of one resource often produce the same barrier
+	auto appendUnique = [](auto& inoutBarriers, const auto& inNewBarriers)
+		{
+			for (const auto& newBarrier : inNewBarriers)
+			{
+				bool found = std::any_of(inoutBarriers.begin(), inoutBarriers.end(), [&](const auto& inBarrier)
+					{
+						return BarrierBatcher::IsSameBarrier(inBarrier, newBarrier);
+					});
+				if (!found)
+				{
+					inoutBarriers.push_back(newBarrier);
+				}
+			}
+		};
+	appendUnique(iter->memoryBarriers, inBarriers);
+	appendUnique(iter->bufferBarriers, inBufferBarriers);
+	appendUnique(iter->imageBarriers, inImageBarriers);
+}
+
 void FrameGraphCompileContext::_AddPrologueBarrier(
 	FrameGraphQueueType inQueueToSync,
 	VkPipelineStageFlags inSrcStage,
@@ -308,14 +349,7 @@ void FrameGraphCompileContext::_AddPrologueBarrier(
 	const std::vector<VkBufferMemoryBarrier>& inBufferBarriers,
 	const std::vector<VkImageMemoryBarrier>& inImageBarriers)
 {
-	m_prologueLocalSync.push_back(LocalSyncInfo{
-		inQueueToSync,
-		inSrcStage,
-		inDstStage,
-		inBarriers,
-		inBufferBarriers,
-		inImageBarriers
-	});
+	_AddLocalSync(m_prologueLocalSync, inQueueToSync, inSrcStage, inDstStage, inBarriers, inBufferBarriers, inImageBarriers);
 }
 
 void FrameGraphCompileContext::_AddEpilogueBarrier(
@@ -326,14 +360,7 @@ void FrameGraphCompileContext::_AddEpilogueBarrier(
 	const std::vector<VkBufferMemoryBarrier>& inBufferBarriers,
 	const std::vector<VkImageMemoryBarrier>& inImageBarriers)
 {
-	m_epilogueLocalSync.push_back(LocalSyncInfo{
-		inQueueToSync,
-		inSrcStage,
-		inDstStage,
-		inBarriers,
-		inBufferBarriers,
-		inImageBarriers
-	});
+	_AddLocalSync(m_epilogueLocalSync, inQueueToSync, inSrcStage, inDstStage, inBarriers, inBufferBarriers, inImageBarriers);
 }
 
 void FrameGraphCompileContext::ApplyPrologueSynchronization()
@@ -77,6 +77,16 @@ private:
 		VkDeviceSize inSize,
 		std::vector<VkSemaphore>& outSemaphoresToWait);
 
+	// Barriers of the same queue and stages share one LocalSyncInfo, identical ones are kept once
+	static void _AddLocalSync(
+		std::vector<LocalSyncInfo>& inoutSyncInfos,
+		FrameGraphQueueType inQueueToSync,
+		VkPipelineStageFlags inSrcStage,
+		VkPipelineStageFlags inDstStage,
+		const std::vector<VkMemoryBarrier>& inBarriers,
+		const std::vector<VkBufferMemoryBarrier>& inBufferBarriers,
+		const std::vector<VkImageMemoryBarrier>& inImageBarriers);
+
 	void _AddPrologueBarrier(
 		FrameGraphQueueType inQueueToSync,
 		VkPipelineStageFlags inSrcStage,
@@ -0,0 +1,190 @@
+#include "frame_graph_scheduler.h"
+#include <algorithm>
+#include <queue>
+
+namespace
+{
+	constexpr size_t LANE_COUNT = 2; // one for each FrameGraphQueueType
+}
+
+void FrameGraphScheduler::_GetTopologicalOrder(std::vector<size_t>& outOrder) const
+{
+	std::vector<size_t> indegree(m_nodes.size(), 0);
+	std::queue<size_t> zeroInNodes;
+
+	for (size_t i = 0; i < m_nodes.size(); ++i)
+	{
+		indegree[i] = m_nodes[i].prevs.size();
+		if (indegree[i] == 0)
+		{
+			zeroInNodes.push(i);
+		}
+	}
+
+	outOrder.clear();
+	outOrder.reserve(m_nodes.size());
+	while (!zeroInNodes.empty())
+	{
+		size_t current = zeroInNodes.front();
+
+		zeroInNodes.pop();
+		outOrder.push_back(current);
+		for (size_t next : m_nodes[current].nexts)
+		{
+			if (--indegree[next] == 0)
+			{
+				zeroInNodes.push(next);
+			}
+		}
+	}
+
+	// there is a cycle if some node never got free
+	CHECK_TRUE(outOrder.size() == m_nodes.size(), "Frame graph has cyclic dependency!");
+}
+
+size_t FrameGraphScheduler::AddNode(FrameGraphQueueType inQueueType, float inEstimatedCost)
+{
+	m_nodes.push_back({ inQueueType, std::max(inEstimatedCost, 0.0f) });
+
+	return m_nodes.size() - 1;
+}
+
+void FrameGraphScheduler::AddDependency(size_t inSooner, size_t inLater)
+{
+	auto& nexts = m_nodes.at(inSooner).nexts;
+
+	// dependencies from both resource flow and extra dependency may repeat
+	if (std::find(nexts.begin(), nexts.end(), inLater) != nexts.end())
+	{
+		return;
+	}
+	nexts.push_back(inLater);
+	m_nodes.at(inLater).prevs.push_back(inSooner);
+}
+
+void FrameGraphScheduler::SetQueueType(size_t inNode, FrameGraphQueueType inQueueType)
+{
+	m_nodes.at(inNode).queueType = inQueueType;
+}
+
+void FrameGraphScheduler::SetCrossQueueLatency(float inMicroseconds)
+{
+	m_crossQueueLatency = std::max(inMicroseconds, 0.0f);
+}
+
+float FrameGraphScheduler::Schedule(std::vector<std::vector<size_t>>& outBatches) const
+{
+	const size_t nodeCount = m_nodes.size();
+	std::vector<size_t> topologicalOrder;
+	std::vector<size_t> topologicalRank(nodeCount);
+	std::vector<float> bottomLevels(nodeCount, 0.0f); // cost of the longest path from the node to the end
+	std::vector<float> readyTimes(nodeCount, 0.0f);
+	std::vector<float> startTimes(nodeCount, 0.0f);
+	std::vector<size_t> remainPrevCounts(nodeCount);
+	std::vector<size_t> readyNodes;
+	float laneFreeTimes[LANE_COUNT]{};
+	float makespan = 0.0f;
+
+	_GetTopologicalOrder(topologicalOrder);
+	for (size_t i = 0; i < nodeCount; ++i)
+	{
+		topologicalRank[topologicalOrder[i]] = i;
+	}
+	for (auto iter = topologicalOrder.rbegin(); iter != topologicalOrder.rend(); ++iter)
+	{
+		const Node& node = m_nodes[*iter];
+		float longestNext = 0.0f;
+
+		for (size_t next : node.nexts)
+		{
+			longestNext = std::max(longestNext, bottomLevels[next]);
+		}
+		bottomLevels[*iter] = node.estimatedCost + longestNext;
+	}
+
+	for (size_t i = 0; i < nodeCount; ++i)
+	{
+		remainPrevCounts[i] = m_nodes[i].prevs.size();
+		if (remainPrevCounts[i] == 0)
+		{
+			readyNodes.push_back(i);
+		}
+	}
+
+	// simulate the lanes, place one node at a time
+	while (!readyNodes.empty())
+	{
+		auto funcEarliestStart = [&](size_t inNode)
+			{
+				size_t lane = static_cast<size_t>(m_nodes[inNode].queueType);
+				return std::max(readyTimes[inNode], laneFreeTimes[lane]);
+			};
+		auto iterPicked = std::min_element(readyNodes.begin(), readyNodes.end(),
+			[&](size_t inLhs, size_t inRhs)
+			{
+				float lhsStart = funcEarliestStart(inLhs);
+				float rhsStart = funcEarliestStart(inRhs);
+
+				if (lhsStart != rhsStart) return lhsStart < rhsStart;
+				if (bottomLevels[inLhs] != bottomLevels[inRhs]) return bottomLevels[inLhs] > bottomLevels[inRhs];
+				return topologicalRank[inLhs] < topologicalRank[inRhs];
+			});
+		size_t picked = *iterPicked;
+		const Node& node = m_nodes[picked];
+		size_t lane = static_cast<size_t>(node.queueType);
+		float finishTime = 0.0f;
+
+		readyNodes.erase(iterPicked);
+		startTimes[picked] = funcEarliestStart(picked);
+		finishTime = startTimes[picked] + node.estimatedCost;
+		laneFreeTimes[lane] = finishTime;
+		makespan = std::max(makespan, finishTime);
+
+		for (size_t next : node.nexts)
+		{
+			float latency = m_nodes[next].queueType != node.queueType ? m_crossQueueLatency : 0.0f;
+
+			readyTimes[next] = std::max(readyTimes[next], finishTime + latency);
+			if (--remainPrevCounts[next] == 0)
+			{
+				readyNodes.push_back(next);
+			}
+		}
+	}
+
+	// Cut batches along start times. A node joins the current batch unless it depends on a node
+	// in it, nodes that depend on each other never start at the same time except for free nodes,
+	// which topological rank keeps in order
+	std::vector<size_t> orderByStart(nodeCount);
+	std::vector<size_t> batchOfNode(nodeCount, 0);
+
+	for (size_t i = 0; i < nodeCount; ++i)
+	{
+		orderByStart[i] = i;
+	}
+	std::sort(orderByStart.begin(), orderByStart.end(),
+		[&](size_t inLhs, size_t inRhs)
+		{
+			if (startTimes[inLhs] != startTimes[inRhs]) return startTimes[inLhs] < startTimes[inRhs];
+			return topologicalRank[inLhs] < topologicalRank[inRhs];
+		});
+
+	outBatches.clear();
+	for (size_t current : orderByStart)
+	{
+		bool dependsOnCurrentBatch = outBatches.empty();
+
+		for (size_t prev : m_nodes[current].prevs)
+		{
+			dependsOnCurrentBatch = dependsOnCurrentBatch || batchOfNode[prev] == outBatches.size() - 1;
+		}
+		if (dependsOnCurrentBatch)
+		{
+			outBatches.push_back({});
+		}
+		batchOfNode[current] = outBatches.size() - 1;
+		outBatches.back().push_back(current);
+	}
+
+	return makespan;
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include "common.h"
+#include "frame_graph_resource.h"
+
+// Orders frame graph nodes by list scheduling instead of breadth first layers. Every queue type
+// is one lane, which stands for both the queue and the thread recording for it. A node starts once
+// its lane is free and the nodes it depends on finished, among the nodes able to start earliest the
+// one with the longest path to the end of the graph (the critical path) goes first. Batches are then
+// cut along the start times, so short independent nodes fill the gaps of a long chain instead of
+// all crowding into the first batch
+class FrameGraphScheduler final
+{
+private:
+	struct Node
+	{
+		FrameGraphQueueType queueType;
+		float estimatedCost; // microseconds
+		std::vector<size_t> prevs;
+		std::vector<size_t> nexts;
+	};
+	std::vector<Node> m_nodes;
+	float m_crossQueueLatency = 0.0f; // microseconds
+
+	// Return nodes so that every node comes after the nodes it depends on
+	void _GetTopologicalOrder(std::vector<size_t>& outOrder) const;
+
+public:
+	// The cost is the longer of the device time and the recording time of the node, in microseconds.
+	// Measured timings are better than guesses
+	size_t AddNode(FrameGraphQueueType inQueueType, float inEstimatedCost = 1.0f);
+
+	void AddDependency(size_t inSooner, size_t inLater);
+
+	void SetQueueType(size_t inNode, FrameGraphQueueType inQueueType);
+
+	// Optional, default: 0. Extra delay of a dependency between nodes on different queues,
+	// i.e. the submission split and semaphore hand-off it takes, in microseconds
+	void SetCrossQueueLatency(float inMicroseconds);
+
+	// Node indices in batches, nodes in one batch don't depend on each other.
+	// Return the estimated time all lanes are done
+	float Schedule(std::vector<std::vector<size_t>>& outBatches) const;
+};
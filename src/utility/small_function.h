@@ -0,0 +1,148 @@
+#pragma once
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+template<typename Signature, size_t InlineSize = 48>
+class SmallFunction;
+
+// Move-only callable that keeps small callables inline and only allocates
+// for captures larger than InlineSize, a std::function replacement for hot paths
+template<typename R, typename... Args, size_t InlineSize>
+class SmallFunction<R(Args...), InlineSize> final
+{
+private:
+	struct VTable
+	{
+		R(*invoke)(void* inStorage, Args&&... inArgs);
+		void(*move)(void* outDstStorage, void* inoutSrcStorage);
+		void(*destroy)(void* inoutStorage);
+	};
+
+	template<typename F>
+	static constexpr bool IS_INLINE =
+		sizeof(F) <= InlineSize &&
+		alignof(F) <= alignof(std::max_align_t) &&
+		std::is_nothrow_move_constructible_v<F>;
+
+	// inline callables live in the storage, others store a pointer to the heap
+	template<typename F>
+	static auto _GetCallable(void* inStorage)->F*
+	{
+		if constexpr (IS_INLINE<F>)
+		{
+			return std::launder(reinterpret_cast<F*>(inStorage));
+		}
+		else
+		{
+			return *reinterpret_cast<F**>(inStorage);
+		}
+	}
+
+	template<typename F>
+	static constexpr VTable VTABLE_OF{
+		[](void* inStorage, Args&&... inArgs)->R
+		{
+			return (*_GetCallable<F>(inStorage))(std::forward<Args>(inArgs)...);
+		},
+		[](void* outDstStorage, void* inoutSrcStorage)
+		{
+			if constexpr (IS_INLINE<F>)
+			{
+				F* pSrc = _GetCallable<F>(inoutSrcStorage);
+				::new (outDstStorage) F(std::move(*pSrc));
+				pSrc->~F();
+			}
+			else
+			{
+				*reinterpret_cast<F**>(outDstStorage) = *reinterpret_cast<F**>(inoutSrcStorage);
+			}
+		},
+		[](void* inoutStorage)
+		{
+			if constexpr (IS_INLINE<F>)
+			{
+				_GetCallable<F>(inoutStorage)->~F();
+			}
+			else
+			{
+				delete _GetCallable<F>(inoutStorage);
+			}
+		},
+	};
+
+	alignas(std::max_align_t) unsigned char m_storage[InlineSize];
+	const VTable* m_vtable = nullptr;
+
+public:
+	SmallFunction() = default;
+
+	template<typename F, typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, SmallFunction> && std::is_invocable_r_v<R, std::decay_t<F>&, Args...>>>
+	SmallFunction(F&& inCallable)
+	{
+		using Callable = std::decay_t<F>;
+
+		if constexpr (IS_INLINE<Callable>)
+		{
+			::new (static_cast<void*>(m_storage)) Callable(std::forward<F>(inCallable));
+		}
+		else
+		{
+			*reinterpret_cast<Callable**>(m_storage) = new Callable(std::forward<F>(inCallable));
+		}
+		m_vtable = &VTABLE_OF<Callable>;
+	}
+
+	SmallFunction(SmallFunction&& inoutOther) noexcept
+	{
+		if (inoutOther.m_vtable != nullptr)
+		{
+			inoutOther.m_vtable->move(m_storage, inoutOther.m_storage);
+			m_vtable = inoutOther.m_vtable;
+			inoutOther.m_vtable = nullptr;
+		}
+	}
+
+	SmallFunction& operator=(SmallFunction&& inoutOther) noexcept
+	{
+		if (this != &inoutOther)
+		{
+			Reset();
+			if (inoutOther.m_vtable != nullptr)
+			{
+				inoutOther.m_vtable->move(m_storage, inoutOther.m_storage);
+				m_vtable = inoutOther.m_vtable;
+				inoutOther.m_vtable = nullptr;
+			}
+		}
+		return *this;
+	}
+
+	SmallFunction(const SmallFunction&) = delete;
+	SmallFunction& operator=(const SmallFunction&) = delete;
+
+	~SmallFunction()
+	{
+		Reset();
+	}
+
+	auto Reset()->void
+	{
+		if (m_vtable != nullptr)
+		{
+			m_vtable->destroy(m_storage);
+			m_vtable = nullptr;
+		}
+	}
+
+	explicit operator bool() const
+	{
+		return m_vtable != nullptr;
+	}
+
+	R operator()(Args... inArgs)
+	{
+		return m_vtable->invoke(m_storage, std::forward<Args>(inArgs)...);
+	}
+};
@@ -0,0 +1,63 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+// Bounded lock-free queue for exactly one producer thread and one consumer thread.
+// Capacity must be a power of two, one slot is never used to tell full from empty
+template<typename T, size_t Capacity>
+class SpscQueue final
+{
+	static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two!");
+
+private:
+	static constexpr size_t CACHE_LINE_SIZE = 64;
+	static constexpr size_t INDEX_MASK = Capacity - 1;
+
+	std::array<T, Capacity> m_items;
+	alignas(CACHE_LINE_SIZE) std::atomic<size_t> m_head{ 0 }; // next slot to pop, owned by consumer
+	alignas(CACHE_LINE_SIZE) std::atomic<size_t> m_tail{ 0 }; // next slot to push, owned by producer
+
+public:
+	SpscQueue() = default;
+	SpscQueue(const SpscQueue&) = delete;
+	SpscQueue& operator=(const SpscQueue&) = delete;
+
+	// Producer only, the item is moved only if it returns true
+	auto TryPush(T& inoutItem)->bool
+	{
+		const size_t tail = m_tail.load(std::memory_order_relaxed);
+		const size_t nextTail = (tail + 1) & INDEX_MASK;
+
+		if (nextTail == m_head.load(std::memory_order_acquire))
+		{
+			return false;
+		}
+
+		m_items[tail] = std::move(inoutItem);
+		m_tail.store(nextTail, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer only
+	auto TryPop(T& outItem)->bool
+	{
+		const size_t head = m_head.load(std::memory_order_relaxed);
+
+		if (head == m_tail.load(std::memory_order_acquire))
+		{
+			return false;
+		}
+
+		outItem = std::move(m_items[head]);
+		m_items[head] = T{};
+		m_head.store((head + 1) & INDEX_MASK, std::memory_order_release);
+		return true;
+	}
+
+	auto IsEmpty() const->bool
+	{
+		return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire);
+	}
+};
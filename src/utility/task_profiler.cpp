@@ -0,0 +1,149 @@
+#include "task_profiler.h"
+#include "task_scheduler.h"
+#include <fstream>
+
+namespace
+{
+	auto _WriteJsonString(std::ofstream& inoutFile, const char* inText)->void
+	{
+		inoutFile << '"';
+		for (const char* pChar = (inText != nullptr ? inText : "unnamed"); *pChar != '\0'; ++pChar)
+		{
+			if (*pChar == '"' || *pChar == '\\')
+			{
+				inoutFile << '\\';
+			}
+			inoutFile << *pChar;
+		}
+		inoutFile << '"';
+	}
+}
+
+std::unique_ptr<TaskProfiler> TaskProfiler::s_uptrInstance;
+
+TaskProfiler::ScopedEvent::ScopedEvent(const char* inName, EventType inType, uint32_t inThreadIndex)
+	: m_name(inName), m_type(inType), m_threadIndex(inThreadIndex)
+{
+	TaskProfiler& profiler = TaskProfiler::GetInstance();
+
+	m_recording = profiler.IsEnabled();
+	if (m_recording)
+	{
+		m_startNs = profiler._Now();
+	}
+}
+
+TaskProfiler::ScopedEvent::~ScopedEvent()
+{
+	if (!m_recording)
+	{
+		return;
+	}
+
+	TaskProfiler& profiler = TaskProfiler::GetInstance();
+	Event event{};
+	event.name = m_name;
+	event.type = m_type;
+	event.startNs = m_startNs;
+	event.endNs = profiler._Now();
+	profiler._Record(m_threadIndex, event);
+}
+
+auto TaskProfiler::GetInstance()->TaskProfiler&
+{
+	if (s_uptrInstance == nullptr)
+	{
+		s_uptrInstance.reset(new TaskProfiler());
+	}
+
+	return *s_uptrInstance;
+}
+
+auto TaskProfiler::_Now() const->int64_t
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_origin).count();
+}
+
+auto TaskProfiler::_Record(uint32_t inThreadIndex, const Event& inEvent)->void
+{
+	if (inThreadIndex >= m_threadBuffers.size())
+	{
+		return;
+	}
+
+	// only the thread itself writes here
+	ThreadBuffer& buffer = m_threadBuffers[inThreadIndex];
+	if (buffer.count < buffer.events.size())
+	{
+		buffer.events[buffer.count++] = inEvent;
+	}
+	else
+	{
+		++buffer.droppedCount;
+	}
+}
+
+auto TaskProfiler::Enable(size_t inEventCapacityPerThread)->void
+{
+	CHECK_TRUE(!IsEnabled(), "Task profiler is already enabled!");
+	CHECK_TRUE(inEventCapacityPerThread > 0, "Invalid task profiler capacity!");
+
+	m_threadBuffers = std::vector<ThreadBuffer>(MyTaskScheduler::GetInstance().GetThreadCount());
+	for (ThreadBuffer& buffer : m_threadBuffers)
+	{
+		buffer.events.resize(inEventCapacityPerThread);
+	}
+	m_origin = std::chrono::steady_clock::now();
+	m_enabled.store(true, std::memory_order_release);
+}
+
+auto TaskProfiler::Disable()->void
+{
+	m_enabled.store(false, std::memory_order_release);
+}
+
+auto TaskProfiler::Clear()->void
+{
+	for (ThreadBuffer& buffer : m_threadBuffers)
+	{
+		buffer.count = 0;
+		buffer.droppedCount = 0;
+	}
+}
+
+auto TaskProfiler::ExportChromeTrace(const std::string& inFilePath) const->void
+{
+	std::ofstream file(inFilePath, std::ios::out | std::ios::trunc);
+	CHECK_TRUE(file.is_open(), "Failed to open trace file!");
+
+	bool firstEvent = true;
+	file << "{\"traceEvents\":[\n";
+
+	for (size_t threadIndex = 0; threadIndex < m_threadBuffers.size(); ++threadIndex)
+	{
+		const ThreadBuffer& buffer = m_threadBuffers[threadIndex];
+
+		// name the track so the viewer shows thread index instead of a raw tid
+		file << (firstEvent ? "" : ",\n")
+			<< "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << threadIndex
+			<< ",\"args\":{\"name\":\"" << (threadIndex == 0 ? "Main" : "Worker ") << (threadIndex == 0 ? std::string() : std::to_string(threadIndex))
+			<< "\",\"dropped\":" << buffer.droppedCount << "}}";
+		firstEvent = false;
+
+		for (size_t eventIndex = 0; eventIndex < buffer.count; ++eventIndex)
+		{
+			const Event& event = buffer.events[eventIndex];
+
+			// chrome trace timestamps are in microseconds
+			file << ",\n{\"name\":";
+			_WriteJsonString(file, event.name);
+			file << ",\"cat\":\"" << (event.type == EventType::WAIT ? "wait" : "task") << "\""
+				<< ",\"ph\":\"X\",\"pid\":0,\"tid\":" << threadIndex
+				<< ",\"ts\":" << static_cast<double>(event.startNs) / 1000.0
+				<< ",\"dur\":" << static_cast<double>(event.endNs - event.startNs) / 1000.0
+				<< "}";
+		}
+	}
+
+	file << "\n]}\n";
+}
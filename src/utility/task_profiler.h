@@ -0,0 +1,80 @@
+#pragma once
+#include "common.h"
+#include <atomic>
+#include <chrono>
+
+// Opt-in timeline of task execution and waits on task scheduler threads. Each thread
+// writes only its own preallocated buffer, so recording takes no lock and no allocation.
+// Buffers are read by Export/Clear, which must run when no task is executing, e.g. at frame end
+class TaskProfiler final
+{
+public:
+	enum class EventType
+	{
+		TASK, // a single thread task or one range of a multi thread task
+		WAIT, // a thread blocked in WaitForTask/WaitForAll
+	};
+
+	struct Event
+	{
+		const char* name = nullptr; // must outlive the export
+		EventType type = EventType::TASK;
+		int64_t startNs = 0;
+		int64_t endNs = 0;
+	};
+
+	// Record an event from construction to destruction if the profiler is enabled
+	class ScopedEvent final
+	{
+	private:
+		const char* m_name = nullptr;
+		EventType m_type = EventType::TASK;
+		uint32_t m_threadIndex = 0;
+		int64_t m_startNs = 0;
+		bool m_recording = false;
+
+	public:
+		ScopedEvent(const char* inName, EventType inType, uint32_t inThreadIndex);
+		ScopedEvent(const ScopedEvent&) = delete;
+		ScopedEvent& operator=(const ScopedEvent&) = delete;
+		~ScopedEvent();
+	};
+
+private:
+	static constexpr size_t CACHE_LINE_SIZE = 64;
+	static constexpr size_t DEFAULT_EVENT_CAPACITY = 16 * 1024;
+
+	struct alignas(CACHE_LINE_SIZE) ThreadBuffer
+	{
+		std::vector<Event> events; // sized once, [0, count) is valid
+		size_t count = 0;
+		uint64_t droppedCount = 0; // events lost because the buffer is full
+	};
+
+	static std::unique_ptr<TaskProfiler> s_uptrInstance;
+	std::vector<ThreadBuffer> m_threadBuffers;
+	std::atomic<bool> m_enabled{ false };
+	std::chrono::steady_clock::time_point m_origin;
+
+private:
+	TaskProfiler() = default;
+
+	auto _Now() const->int64_t;
+	auto _Record(uint32_t inThreadIndex, const Event& inEvent)->void;
+
+public:
+	static auto GetInstance()->TaskProfiler&;
+
+	// Allocate buffers for every task scheduler thread and start recording
+	auto Enable(size_t inEventCapacityPerThread = DEFAULT_EVENT_CAPACITY)->void;
+
+	auto Disable()->void;
+
+	auto IsEnabled() const->bool { return m_enabled.load(std::memory_order_relaxed); };
+
+	// Drop recorded events, keep the buffers
+	auto Clear()->void;
+
+	// Write recorded events as Chrome trace_event JSON, open it in chrome://tracing or Perfetto
+	auto ExportChromeTrace(const std::string& inFilePath) const->void;
+};
@@ -1,101 +1,197 @@
 #include "task_scheduler.h"
 #include "device.h"
+#include "task_profiler.h"
+#include "coroutine_task.h"
 #include <TaskScheduler.h>
+#include <thread>
+#include <algorithm>
+#include <deque>
+#include <chrono>
+#include <unordered_set>
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
 
 namespace
 {
-	template<typename T>
-	T* _UnpackImpl(T* inPtr)
-	{
-		T* piUnpacked{ inPtr };
-		IImplement* piImpl{ dynamic_cast<IImplement*>(piUnpacked) };
+	static_assert(enki::TASK_PRIORITY_NUM >= 3, "Task scheduler needs three enki priorities!");
 
-		// see if this has implement behind?
-		while (piImpl != nullptr)
+	enki::TaskPriority _ToEnkiPriority(TaskPriority inPriority)
+	{
+		switch (inPriority)
 		{
-			piUnpacked = static_cast<T*>(piImpl->GetRealImplement());
-			piImpl = dynamic_cast<IImplement*>(piUnpacked);
+		case TaskPriority::FRAME_CRITICAL:
+			return enki::TASK_PRIORITY_HIGH;
+		case TaskPriority::BACKGROUND:
+			return enki::TASK_PRIORITY_LOW;
+		default:
+			return enki::TASK_PRIORITY_MED;
 		}
+	}
 
-		return piUnpacked;
+	int64_t _GetSteadyClockNs()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	// enki calls it on each task thread when the thread starts
+	void _BindThreadToCore(uint32_t inThreadIndex)
+	{
+		const uint32_t coreCount = std::max(1u, std::thread::hardware_concurrency());
+		const uint32_t coreIndex = inThreadIndex % coreCount;
+
+#if defined(_WIN32)
+		SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << coreIndex);
+#elif defined(__linux__)
+		cpu_set_t cpuSet;
+		CPU_ZERO(&cpuSet);
+		CPU_SET(coreIndex, &cpuSet);
+		pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuSet);
+#endif
 	}
+}
+
+// Dependencies are linked by address inside enki, so they must never move.
+// The first few live inline, the rest go to a deque which keeps addresses stable
+class _DependencyList final
+{
+private:
+	struct Entry
+	{
+		enki::Dependency dependency;
+		const IWaitable* pPrecondition = nullptr;
+	};
+
+	static constexpr size_t INLINE_COUNT = 4;
+
+	std::array<Entry, INLINE_COUNT> m_inlineEntries;
+	std::deque<Entry> m_overflowEntries;
+	size_t m_count = 0;
 
-	template<typename T>
-	const T* _UnpackImpl(const T* inPtr)
+public:
+	auto Next(const IWaitable* pPrecondition)->enki::Dependency&
 	{
-		const T* piUnpacked{ inPtr };
-		const IImplement* piImpl{ dynamic_cast<const IImplement*>(piUnpacked) };
+		Entry& entry = (m_count < INLINE_COUNT ? m_inlineEntries[m_count] : m_overflowEntries.emplace_back());
+
+		++m_count;
+		entry.pPrecondition = pPrecondition;
+		return entry.dependency;
+	}
 
-		// see if this has implement behind?
-		while (piImpl != nullptr)
+	auto GetPreconditions(std::vector<const IWaitable*>& outPreconditions) const->void
+	{
+		for (size_t i = 0; i < std::min(m_count, INLINE_COUNT); ++i)
 		{
-			piUnpacked = static_cast<const T*>(piImpl->GetRealImplement());
-			piImpl = dynamic_cast<const IImplement*>(piUnpacked);
+			outPreconditions.push_back(m_inlineEntries[i].pPrecondition);
 		}
+		for (const Entry& entry : m_overflowEntries)
+		{
+			outPreconditions.push_back(entry.pPrecondition);
+		}
+	}
+};
+
+// Follows a task and tells the coroutine scheduler once it's done, a coroutine may be parked on it.
+// enki only links dependents before a task is added, so every task gets one when it's created
+class _CompletionNotifier final : public enki::ICompletable
+{
+private:
+	enki::Dependency m_dependency;
+	const enki::ICompletable* m_pTask = nullptr;
+
+public:
+	explicit _CompletionNotifier(const enki::ICompletable* pTask)
+		: m_pTask(pTask)
+	{
+		SetDependency(m_dependency, pTask);
+	};
 
-		return piUnpacked;
+	~_CompletionNotifier()
+	{
+		// enki may still be returning from the notification, it's only a few instructions
+		while (!GetIsComplete())
+		{
+			std::this_thread::yield();
+		}
+	};
+
+protected:
+	virtual void OnDependenciesComplete(enki::TaskScheduler* pTaskScheduler, uint32_t inThreadNum) override
+	{
+		CoroutineScheduler::NotifyTaskComplete(m_pTask);
+		enki::ICompletable::OnDependenciesComplete(pTaskScheduler, inThreadNum);
 	}
-}
+};
 
 std::unique_ptr<MyTaskScheduler> MyTaskScheduler::g_uptrInstance;
 
-class MySinglThreadTaskImpl final : public ISingleThreadTask, public enki::IPinnedTask
+class MySinglThreadTaskImpl final : public enki::IPinnedTask
 {
 private:
-	std::function<void()> m_function;
-	std::vector<enki::Dependency> m_dependencies;
+	SingleThreadTaskFunction m_function;
+	_DependencyList m_dependencies;
+	_CompletionNotifier m_completionNotifier{ this };
+	const char* m_name = nullptr;
 
 public:
-	MySinglThreadTaskImpl(std::function<void()> inFunction, uint32_t inThreadId = 0) 
-		: enki::IPinnedTask(inThreadId), m_function(inFunction){};
-	virtual void DependOn(IWaitable* pPrecondition) override;
+	MySinglThreadTaskImpl(SingleThreadTaskFunction inFunction, uint32_t inThreadId = 0)
+		: enki::IPinnedTask(inThreadId), m_function(std::move(inFunction))
+	{
+		m_Priority = _ToEnkiPriority(TaskPriority::NORMAL);
+	};
+	void SetName(const char* inName) { m_name = inName; };
+	void DependOn(IWaitable* pPrecondition);
+	void GetPreconditions(std::vector<const IWaitable*>& outPreconditions) const { m_dependencies.GetPreconditions(outPreconditions); };
 	virtual void Execute() override;
 };
 
-class MyMultiThreadTaskImpl final : public IMultiThreadTask, public enki::ITaskSet
+class MyMultiThreadTaskImpl final : public enki::ITaskSet
 {
 private:
-	std::function<void(uint32_t, uint32_t, uint32_t)> m_function;
-	std::vector<enki::Dependency> m_dependencies;
+	MultiThreadTaskFunction m_function;
+	_DependencyList m_dependencies;
+	_CompletionNotifier m_completionNotifier{ this };
+	const char* m_name = nullptr;
 
 public:
-	MyMultiThreadTaskImpl(std::function<void(uint32_t, uint32_t, uint32_t)> inFunction, uint32_t inSubTaskCount = 1) 
-		: enki::ITaskSet(inSubTaskCount), m_function(inFunction) {};
-	virtual void DependOn(IWaitable* pPrecondition) override;
-	virtual void ExecuteSubTask(uint32_t SubStart, uint32_t SubEnd, uint32_t inThreadIndex) override;
+	MyMultiThreadTaskImpl(MultiThreadTaskFunction inFunction, uint32_t inSubTaskCount = 1)
+		: enki::ITaskSet(inSubTaskCount), m_function(std::move(inFunction))
+	{
+		m_Priority = _ToEnkiPriority(TaskPriority::NORMAL);
+	};
+	void SetName(const char* inName) { m_name = inName; };
+	void DependOn(IWaitable* pPrecondition);
+	void GetPreconditions(std::vector<const IWaitable*>& outPreconditions) const { m_dependencies.GetPreconditions(outPreconditions); };
+	void ExecuteSubTask(uint32_t SubStart, uint32_t SubEnd, uint32_t inThreadIndex);
 	virtual void ExecuteRange(enki::TaskSetPartition inRange, uint32_t inThreadnum) override;
 };
 
-class MyTaskSchedulerImpl final : public ITaskScheduler, public enki::TaskScheduler
+class MyTaskSchedulerImpl final : public enki::TaskScheduler
 {
-public:
-	virtual void AddSingleThreadTask(ISingleThreadTask* pSingleThreadTask) override;
-	virtual void AddMutiThreadTask(IMultiThreadTask* pMultiThreadTask) override;
-	virtual void WaitForTask(const IWaitable* pToWait) override;
-	virtual void WaitForAll() override;
 };
 
 void MySinglThreadTaskImpl::DependOn(IWaitable* pPrecondition)
 {
-	enki::ICompletable* pCompletable = dynamic_cast<enki::ICompletable*>(pPrecondition);
-	CHECK_TRUE(pCompletable != nullptr);
-	m_dependencies.push_back({});
-	this->SetDependency(m_dependencies.back(), pCompletable);
+	CHECK_TRUE(pPrecondition != nullptr);
+	this->SetDependency(m_dependencies.Next(pPrecondition), pPrecondition->GetCompletable());
 }
 
 void MySinglThreadTaskImpl::Execute()
 {
+	TaskProfiler::ScopedEvent scopedEvent(m_name, TaskProfiler::EventType::TASK, threadNum);
 	m_function();
 }
 
 void MyMultiThreadTaskImpl::DependOn(IWaitable* pPrecondition)
 {
-	IImplement* pImpl = dynamic_cast<IImplement*>(pPrecondition);
-	CHECK_TRUE(pImpl != nullptr);
-	enki::ICompletable* pCompletable = static_cast<enki::ICompletable*>(pImpl->GetRealImplement());
-	CHECK_TRUE(pCompletable != nullptr);
-	m_dependencies.push_back({});
-	this->SetDependency(m_dependencies.back(), pCompletable);
+	CHECK_TRUE(pPrecondition != nullptr);
+	this->SetDependency(m_dependencies.Next(pPrecondition), pPrecondition->GetCompletable());
 }
 
 void MyMultiThreadTaskImpl::ExecuteSubTask(uint32_t SubStart, uint32_t SubEnd, uint32_t inThreadIndex)
@@ -105,68 +201,79 @@ void MyMultiThreadTaskImpl::ExecuteSubTask(uint32_t SubStart, uint32_t SubEnd, u
 
 void MyMultiThreadTaskImpl::ExecuteRange(enki::TaskSetPartition inRange, uint32_t inThreadnum)
 {
+	TaskProfiler::ScopedEvent scopedEvent(m_name, TaskProfiler::EventType::TASK, inThreadnum);
 	ExecuteSubTask(inRange.start, inRange.end, inThreadnum);
 }
 
-void MyTaskSchedulerImpl::AddSingleThreadTask(ISingleThreadTask* pSingleThreadTask)
+MySinglThreadTask::MySinglThreadTask(SingleThreadTaskFunction inFunction, uint32_t inThreadIndex)
+	:m_uptrImpl(std::make_unique<MySinglThreadTaskImpl>(std::move(inFunction), inThreadIndex))
 {
-	enki::IPinnedTask* piPinned = dynamic_cast<enki::IPinnedTask*>(pSingleThreadTask);
-	CHECK_TRUE(piPinned != nullptr);
-	this->AddPinnedTask(piPinned);
 }
 
-void MyTaskSchedulerImpl::AddMutiThreadTask(IMultiThreadTask* pMultiThreadTask)
+MySinglThreadTask::~MySinglThreadTask() = default;
+
+void MySinglThreadTask::SetName(const char* inName)
 {
-	enki::ITaskSet* piTaskSet = dynamic_cast<enki::ITaskSet*>(pMultiThreadTask);
-	CHECK_TRUE(piTaskSet != nullptr);
-	this->AddTaskSetToPipe(piTaskSet);
+	m_uptrImpl->SetName(inName);
 }
 
-void MyTaskSchedulerImpl::WaitForTask(const IWaitable* pToWait)
+void MySinglThreadTask::SetPriority(TaskPriority inPriority)
 {
-	const enki::ICompletable* piComplete = dynamic_cast<const enki::ICompletable*>(pToWait);
-	CHECK_TRUE(piComplete != nullptr);
-	this->enki::TaskScheduler::WaitforTask(piComplete);
+	m_uptrImpl->m_Priority = _ToEnkiPriority(inPriority);
 }
 
-void MyTaskSchedulerImpl::WaitForAll()
+void MySinglThreadTask::DependOn(IWaitable* pPrecondition)
 {
-	this->enki::TaskScheduler::WaitforAll();
+	CHECK_TRUE(pPrecondition != nullptr);
+	m_uptrImpl->DependOn(pPrecondition);
 }
 
-MySinglThreadTask::MySinglThreadTask(std::function<void()> inFunction, uint32_t inThreadIndex)
-	:m_uptrImpl(std::make_unique<MySinglThreadTaskImpl>(inFunction, inThreadIndex))
+void MySinglThreadTask::Execute()
 {
+	m_uptrImpl->Execute();
 }
 
-void MySinglThreadTask::DependOn(IWaitable* pPrecondition)
+enki::ICompletable* MySinglThreadTask::GetCompletable()
 {
-	m_uptrImpl->DependOn(_UnpackImpl(pPrecondition));
+	return m_uptrImpl.get();
 }
 
-void MySinglThreadTask::Execute()
+const enki::ICompletable* MySinglThreadTask::GetCompletable() const
 {
-	m_uptrImpl->Execute();
+	return m_uptrImpl.get();
 }
 
-void* MySinglThreadTask::GetRealImplement()
+void MySinglThreadTask::GetPreconditions(std::vector<const IWaitable*>& outPreconditions) const
 {
-	return m_uptrImpl.get();
+	m_uptrImpl->GetPreconditions(outPreconditions);
 }
 
-const void* MySinglThreadTask::GetRealImplement() const
+enki::IPinnedTask* MySinglThreadTask::GetPinnedTask()
 {
 	return m_uptrImpl.get();
 }
 
-MyMultiThreadTask::MyMultiThreadTask(std::function<void(uint32_t, uint32_t, uint32_t)> inFunction, uint32_t inSubTaskCount)
-	:m_uptrImpl(std::make_unique<MyMultiThreadTaskImpl>(inFunction, inSubTaskCount))
+MyMultiThreadTask::MyMultiThreadTask(MultiThreadTaskFunction inFunction, uint32_t inSubTaskCount)
+	:m_uptrImpl(std::make_unique<MyMultiThreadTaskImpl>(std::move(inFunction), inSubTaskCount))
+{
+}
+
+MyMultiThreadTask::~MyMultiThreadTask() = default;
+
+void MyMultiThreadTask::SetName(const char* inName)
+{
+	m_uptrImpl->SetName(inName);
+}
+
+void MyMultiThreadTask::SetPriority(TaskPriority inPriority)
 {
+	m_uptrImpl->m_Priority = _ToEnkiPriority(inPriority);
 }
 
 void MyMultiThreadTask::DependOn(IWaitable* pPrecondition)
 {
-	m_uptrImpl->DependOn(_UnpackImpl(pPrecondition));
+	CHECK_TRUE(pPrecondition != nullptr);
+	m_uptrImpl->DependOn(pPrecondition);
 }
 
 void MyMultiThreadTask::ExecuteSubTask(uint32_t SubStart, uint32_t SubEnd, uint32_t inThreadIndex)
@@ -174,21 +281,172 @@ void MyMultiThreadTask::ExecuteSubTask(uint32_t SubStart, uint32_t SubEnd, uint3
 	m_uptrImpl->ExecuteSubTask(SubStart, SubEnd, inThreadIndex);
 }
 
-void* MyMultiThreadTask::GetRealImplement()
+enki::ICompletable* MyMultiThreadTask::GetCompletable()
 {
 	return m_uptrImpl.get();
 }
 
-const void* MyMultiThreadTask::GetRealImplement() const
+const enki::ICompletable* MyMultiThreadTask::GetCompletable() const
 {
 	return m_uptrImpl.get();
 }
 
+void MyMultiThreadTask::GetPreconditions(std::vector<const IWaitable*>& outPreconditions) const
+{
+	m_uptrImpl->GetPreconditions(outPreconditions);
+}
+
+enki::ITaskSet* MyMultiThreadTask::GetTaskSet()
+{
+	return m_uptrImpl.get();
+}
+
+TaskGraph::~TaskGraph()
+{
+	Wait();
+}
+
+auto TaskGraph::_GetWaitable(NodeId inNode)->IWaitable*
+{
+	CHECK_TRUE(inNode < m_nodes.size(), "Invalid task graph node!");
+	Node& node = m_nodes[inNode];
+
+	if (node.uptrSingleThreadTask != nullptr)
+	{
+		return node.uptrSingleThreadTask.get();
+	}
+	return node.uptrMultiThreadTask.get();
+}
+
+auto TaskGraph::_UpdateRootAndLeafNodes()->void
+{
+	m_rootNodes.clear();
+	m_leafNodes.clear();
+
+	for (NodeId nodeId = 0; nodeId < m_nodes.size(); ++nodeId)
+	{
+		if (m_nodes[nodeId].predecessorCount == 0)
+		{
+			m_rootNodes.push_back(nodeId);
+		}
+		if (m_nodes[nodeId].successorCount == 0)
+		{
+			m_leafNodes.push_back(nodeId);
+		}
+	}
+
+	m_dirty = false;
+}
+
+auto TaskGraph::AddSingleThreadNode(SingleThreadTaskFunction inFunction, uint32_t inThreadIndex, const char* inName)->NodeId
+{
+	CHECK_TRUE(!m_launched, "Can't change a running task graph!");
+
+	Node& node = m_nodes.emplace_back();
+	node.uptrSingleThreadTask = std::make_unique<MySinglThreadTask>(std::move(inFunction), inThreadIndex);
+	node.uptrSingleThreadTask->SetName(inName);
+	m_dirty = true;
+
+	return static_cast<NodeId>(m_nodes.size() - 1);
+}
+
+auto TaskGraph::AddMultiThreadNode(MultiThreadTaskFunction inFunction, uint32_t inSubTaskCount, const char* inName)->NodeId
+{
+	CHECK_TRUE(!m_launched, "Can't change a running task graph!");
+
+	Node& node = m_nodes.emplace_back();
+	node.uptrMultiThreadTask = std::make_unique<MyMultiThreadTask>(std::move(inFunction), inSubTaskCount);
+	node.uptrMultiThreadTask->SetName(inName);
+	m_dirty = true;
+
+	return static_cast<NodeId>(m_nodes.size() - 1);
+}
+
+auto TaskGraph::SetNodePriority(NodeId inNode, TaskPriority inPriority)->void
+{
+	CHECK_TRUE(!m_launched, "Can't change a running task graph!");
+	CHECK_TRUE(inNode < m_nodes.size(), "Invalid task graph node!");
+	Node& node = m_nodes[inNode];
+
+	if (node.uptrSingleThreadTask != nullptr)
+	{
+		node.uptrSingleThreadTask->SetPriority(inPriority);
+	}
+	else
+	{
+		node.uptrMultiThreadTask->SetPriority(inPriority);
+	}
+}
+
+auto TaskGraph::AddEdge(NodeId inFrom, NodeId inTo)->void
+{
+	CHECK_TRUE(!m_launched, "Can't change a running task graph!");
+	CHECK_TRUE(inFrom != inTo, "Task graph node can't depend on itself!");
+
+	_GetWaitable(inTo)->DependOn(_GetWaitable(inFrom));
+	++m_nodes[inFrom].successorCount;
+	++m_nodes[inTo].predecessorCount;
+	m_dirty = true;
+}
+
+auto TaskGraph::Launch()->void
+{
+	CHECK_TRUE(!m_launched, "Task graph is still running!");
+
+	if (m_dirty)
+	{
+		_UpdateRootAndLeafNodes();
+	}
+
+	auto& taskScheduler = MyTaskScheduler::GetInstance();
+	for (NodeId nodeId : m_rootNodes)
+	{
+		Node& node = m_nodes[nodeId];
+		if (node.uptrSingleThreadTask != nullptr)
+		{
+			taskScheduler.AddSingleThreadTask(node.uptrSingleThreadTask.get());
+		}
+		else
+		{
+			taskScheduler.AddMutiThreadTask(node.uptrMultiThreadTask.get());
+		}
+	}
+
+	m_launched = !m_rootNodes.empty();
+}
+
+auto TaskGraph::Wait()->void
+{
+	if (!m_launched)
+	{
+		return;
+	}
+
+	auto& taskScheduler = MyTaskScheduler::GetInstance();
+	for (NodeId nodeId : m_leafNodes)
+	{
+		taskScheduler.WaitForTask(_GetWaitable(nodeId));
+	}
+
+	m_launched = false;
+}
+
+auto TaskGraph::Clear()->void
+{
+	Wait();
+	m_nodes.clear();
+	m_rootNodes.clear();
+	m_leafNodes.clear();
+	m_dirty = false;
+}
+
 MyTaskScheduler::MyTaskScheduler()
 	:m_uptrImpl(std::make_unique<MyTaskSchedulerImpl>())
 {
 }
 
+MyTaskScheduler::~MyTaskScheduler() = default;
+
 MyTaskScheduler& MyTaskScheduler::GetInstance()
 {
 	if (g_uptrInstance == nullptr)
@@ -199,36 +457,234 @@ MyTaskScheduler& MyTaskScheduler::GetInstance()
 	return *g_uptrInstance;
 }
 
-void MyTaskScheduler::Create()
+void MyTaskScheduler::Create(const TaskSchedulerConfig& inConfig)
 {
-	enki::TaskScheduler* piImpl = dynamic_cast<enki::TaskScheduler*>(m_uptrImpl.get());
-	CHECK_TRUE(piImpl != nullptr);
-	piImpl->Initialize(4);
+	enki::TaskScheduler* piImpl = m_uptrImpl.get();
+
+	enki::TaskSchedulerConfig enkiConfig = piImpl->GetConfig();
+	uint32_t threadCount = inConfig.threadCount;
+	if (threadCount == 0)
+	{
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+	}
+	enkiConfig.numTaskThreadsToCreate = threadCount - 1; // enki counts the main thread separately
+	enkiConfig.numExternalTaskThreads = EXTERNAL_THREAD_COUNT;
+	if (inConfig.setThreadAffinity)
+	{
+		enkiConfig.profilerCallbacks.threadStart = _BindThreadToCore;
+	}
+	piImpl->Initialize(enkiConfig);
+
+	m_config = inConfig;
+	m_threadCount = piImpl->GetNumTaskThreads();
+
+	// hand out worker threads in order, thread 0 is the main thread and external threads come last.
+	// Only pinned tasks are steered, general tasks are still run on these threads by enki
+	uint32_t nextThreadIndex = 1;
+	auto reserveThread = [&](bool inPin)->uint32_t
+		{
+			if (!inPin || nextThreadIndex >= threadCount)
+			{
+				return 0;
+			}
+			return nextThreadIndex++;
+		};
+	m_graphicsThreadIndex = reserveThread(inConfig.pinGraphicsThread);
+	m_computeThreadIndex = reserveThread(inConfig.pinComputeThread);
+}
+
+uint32_t MyTaskScheduler::GetThreadCount() const
+{
+	CHECK_TRUE(m_threadCount != 0, "Task scheduler is not created!");
+	return m_threadCount;
+}
+
+bool MyTaskScheduler::_DeferIfPastCutoff(ISingleThreadTask* pSingleThreadTask, IMultiThreadTask* pMultiThreadTask)
+{
+	const enki::ICompletable* pCompletable = (pSingleThreadTask != nullptr ? pSingleThreadTask->GetCompletable() : pMultiThreadTask->GetCompletable());
+	if (pCompletable->m_Priority != _ToEnkiPriority(TaskPriority::BACKGROUND))
+	{
+		return false;
+	}
+
+	// check under the lock, so BeginFrame can't release the list between the check and the push
+	std::lock_guard<std::mutex> lock(m_deferredTasksMutex);
+	if (!IsPastBackgroundCutoff())
+	{
+		return false;
+	}
+
+	if (pSingleThreadTask != nullptr)
+	{
+		m_deferredSingleThreadTasks.push_back(pSingleThreadTask);
+	}
+	else
+	{
+		m_deferredMultiThreadTasks.push_back(pMultiThreadTask);
+	}
+	return true;
+}
+
+void MyTaskScheduler::_AddToEnki(ISingleThreadTask* pSingleThreadTask, IMultiThreadTask* pMultiThreadTask)
+{
+	if (pSingleThreadTask != nullptr)
+	{
+		m_uptrImpl->AddPinnedTask(pSingleThreadTask->GetPinnedTask());
+	}
+	else
+	{
+		m_uptrImpl->AddTaskSetToPipe(pMultiThreadTask->GetTaskSet());
+	}
+}
+
+void MyTaskScheduler::_ReleaseDeferredTasks()
+{
+	std::vector<ISingleThreadTask*> singleThreadTasks;
+	std::vector<IMultiThreadTask*> multiThreadTasks;
+
+	{
+		std::lock_guard<std::mutex> lock(m_deferredTasksMutex);
+		singleThreadTasks.swap(m_deferredSingleThreadTasks);
+		multiThreadTasks.swap(m_deferredMultiThreadTasks);
+	}
+
+	for (auto pTask : singleThreadTasks)
+	{
+		_AddToEnki(pTask, nullptr);
+	}
+	for (auto pTask : multiThreadTasks)
+	{
+		_AddToEnki(nullptr, pTask);
+	}
+}
+
+void MyTaskScheduler::_ReleaseDeferredTasksOf(const IWaitable* pToWait)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_deferredTasksMutex);
+		if (m_deferredSingleThreadTasks.empty() && m_deferredMultiThreadTasks.empty())
+		{
+			return;
+		}
+	}
+
+	// only held back roots can stall a wait, the rest of a chain is kicked off by enki
+	std::unordered_set<const IWaitable*> waitedTasks;
+	std::vector<const IWaitable*> pendingTasks{ pToWait };
+	while (!pendingTasks.empty())
+	{
+		const IWaitable* pTask = pendingTasks.back();
+		pendingTasks.pop_back();
+		// not pruned at finished looking tasks, enki reports a chain that was never added as complete
+		if (waitedTasks.insert(pTask).second)
+		{
+			pTask->GetPreconditions(pendingTasks);
+		}
+	}
+
+	std::vector<ISingleThreadTask*> singleThreadTasks;
+	std::vector<IMultiThreadTask*> multiThreadTasks;
+	auto extractWaited = [&waitedTasks](auto& inoutDeferredTasks, auto& outReleasedTasks)
+		{
+			auto itFirstReleased = std::stable_partition(inoutDeferredTasks.begin(), inoutDeferredTasks.end(),
+				[&waitedTasks](const IWaitable* pTask) { return !waitedTasks.contains(pTask); });
+			outReleasedTasks.assign(itFirstReleased, inoutDeferredTasks.end());
+			inoutDeferredTasks.erase(itFirstReleased, inoutDeferredTasks.end());
+		};
+	{
+		std::lock_guard<std::mutex> lock(m_deferredTasksMutex);
+		extractWaited(m_deferredSingleThreadTasks, singleThreadTasks);
+		extractWaited(m_deferredMultiThreadTasks, multiThreadTasks);
+	}
+
+	for (auto pTask : singleThreadTasks)
+	{
+		_AddToEnki(pTask, nullptr);
+	}
+	for (auto pTask : multiThreadTasks)
+	{
+		_AddToEnki(nullptr, pTask);
+	}
+}
+
+uint32_t MyTaskScheduler::GetCurrentThreadIndex() const
+{
+	return m_uptrImpl->GetThreadNum();
 }
 
 void MyTaskScheduler::AddSingleThreadTask(ISingleThreadTask* pSingleThreadTask)
 {
-	m_uptrImpl->AddSingleThreadTask(_UnpackImpl(pSingleThreadTask));
+	CHECK_TRUE(pSingleThreadTask != nullptr);
+	if (!_DeferIfPastCutoff(pSingleThreadTask, nullptr))
+	{
+		_AddToEnki(pSingleThreadTask, nullptr);
+	}
 }
 
 void MyTaskScheduler::AddMutiThreadTask(IMultiThreadTask* pMultiThreadTask)
 {
-	m_uptrImpl->AddMutiThreadTask(_UnpackImpl(pMultiThreadTask));
+	CHECK_TRUE(pMultiThreadTask != nullptr);
+	if (!_DeferIfPastCutoff(nullptr, pMultiThreadTask))
+	{
+		_AddToEnki(nullptr, pMultiThreadTask);
+	}
 }
 
-void MyTaskScheduler::WaitForTask(const IWaitable* pToWait)
+void MyTaskScheduler::WaitForTask(const IWaitable* pToWait, TaskPriority inLowestPriorityToRun)
 {
-	m_uptrImpl->WaitForTask(_UnpackImpl(pToWait));
+	CHECK_TRUE(pToWait != nullptr);
+	TaskProfiler::ScopedEvent scopedEvent("WaitForTask", TaskProfiler::EventType::WAIT, m_uptrImpl->GetThreadNum());
+
+	// a held back task would never finish otherwise, and neither would a task depending on one.
+	// Everything else stays held back till BeginFrame
+	_ReleaseDeferredTasksOf(pToWait);
+	m_uptrImpl->WaitforTask(pToWait->GetCompletable(), _ToEnkiPriority(inLowestPriorityToRun));
 }
 
 void MyTaskScheduler::WaitForAll()
 {
-	m_uptrImpl->WaitForAll();
+	TaskProfiler::ScopedEvent scopedEvent("WaitForAll", TaskProfiler::EventType::WAIT, m_uptrImpl->GetThreadNum());
+	_ReleaseDeferredTasks();
+	m_uptrImpl->WaitforAll();
+}
+
+void MyTaskScheduler::BeginFrame()
+{
+	const double backgroundTimeNs = static_cast<double>(m_config.targetFrameTimeUs) * 1000.0 * m_config.backgroundFrameShare;
+
+	{
+		std::lock_guard<std::mutex> lock(m_deferredTasksMutex);
+		m_backgroundCutoffNs.store(_GetSteadyClockNs() + static_cast<int64_t>(backgroundTimeNs), std::memory_order_relaxed);
+	}
+	_ReleaseDeferredTasks();
+}
+
+bool MyTaskScheduler::IsPastBackgroundCutoff() const
+{
+	return _GetSteadyClockNs() >= m_backgroundCutoffNs.load(std::memory_order_relaxed);
+}
+
+void MyTaskScheduler::RegisterExternalThread()
+{
+	CHECK_TRUE(m_uptrImpl->RegisterExternalTaskThread(), "No external task thread slot left!");
+}
+
+void MyTaskScheduler::DeregisterExternalThread()
+{
+	m_uptrImpl->DeRegisterExternalTaskThread();
 }
 
 void MyTaskScheduler::Destroy()
 {
-	enki::TaskScheduler* piImpl = dynamic_cast<enki::TaskScheduler*>(m_uptrImpl.get());
-	CHECK_TRUE(piImpl != nullptr);
-	piImpl->ShutdownNow();
+	CoroutineScheduler::GetInstance().Destroy();
+	{
+		std::lock_guard<std::mutex> lock(m_deferredTasksMutex);
+		m_deferredSingleThreadTasks.clear();
+		m_deferredMultiThreadTasks.clear();
+		m_backgroundCutoffNs.store(INT64_MAX, std::memory_order_relaxed);
+	}
+	m_uptrImpl->ShutdownNow();
+	m_threadCount = 0;
+	m_graphicsThreadIndex = 0;
+	m_computeThreadIndex = 0;
 }
@@ -1,12 +1,44 @@
 #pragma once
 #include "common.h"
+#include "small_function.h"
 #include <functional>
+#include <mutex>
+#include <atomic>
+
+namespace enki
+{
+	class ICompletable;
+	class IPinnedTask;
+	class ITaskSet;
+}
+
+class MySinglThreadTaskImpl;
+class MyMultiThreadTaskImpl;
+class MyTaskSchedulerImpl;
+
+// Callables are stored inline up to the size, larger captures fall back to the heap
+using SingleThreadTaskFunction = SmallFunction<void(), 64>;
+using MultiThreadTaskFunction = SmallFunction<void(uint32_t, uint32_t, uint32_t), 64>;
+
+// Workers always pick the highest lane first. Background tasks added late in a frame
+// are held back till the next frame, see TaskSchedulerConfig::backgroundFrameShare
+enum class TaskPriority
+{
+	FRAME_CRITICAL, // recording and submission the current frame waits on
+	NORMAL,
+	BACKGROUND,     // streaming, shader reflection, pipeline prewarm...
+};
 
 class IWaitable
 {
 public:
 	virtual ~IWaitable() = default;
 	virtual void DependOn(IWaitable* pPrecondition) = 0;
+	// The enki object behind the task, so the scheduler never needs a cast to find it
+	virtual enki::ICompletable* GetCompletable() = 0;
+	virtual const enki::ICompletable* GetCompletable() const = 0;
+	// Append the tasks passed to DependOn, so a wait can find held back tasks it needs
+	virtual void GetPreconditions(std::vector<const IWaitable*>& outPreconditions) const = 0;
 };
 
 class ISingleThreadTask : public IWaitable
@@ -14,6 +46,7 @@ class ISingleThreadTask : public IWaitable
 public:
 	virtual ~ISingleThreadTask() = default;
 	virtual void Execute() = 0;
+	virtual enki::IPinnedTask* GetPinnedTask() = 0;
 };
 
 class IMultiThreadTask : public IWaitable
@@ -21,6 +54,7 @@ class IMultiThreadTask : public IWaitable
 public:
 	virtual ~IMultiThreadTask() = default;
 	virtual void ExecuteSubTask(uint32_t SubStart, uint32_t SubEnd, uint32_t inThreadIndex) = 0;
+	virtual enki::ITaskSet* GetTaskSet() = 0;
 };
 
 class ITaskScheduler
@@ -29,59 +63,162 @@ public:
 	virtual ~ITaskScheduler() = default;
 	virtual void AddSingleThreadTask(ISingleThreadTask* pSingleThreadTask) = 0;
 	virtual void AddMutiThreadTask(IMultiThreadTask* pMultiThreadTask) = 0;
-	virtual void WaitForTask(const IWaitable* pToWait) = 0;
+	virtual void WaitForTask(const IWaitable* pToWait, TaskPriority inLowestPriorityToRun = TaskPriority::BACKGROUND) = 0;
 	virtual void WaitForAll() = 0;
 };
 
-// interface that get the real class behind the scene
-class IImplement
+class MySinglThreadTask final : public ISingleThreadTask
 {
+private:
+	std::unique_ptr<MySinglThreadTaskImpl> m_uptrImpl;
+
 public:
-	virtual ~IImplement() = default;
-	virtual void* GetRealImplement() = 0;
-	virtual const void* GetRealImplement() const = 0;
+	MySinglThreadTask(SingleThreadTaskFunction inFunction, uint32_t inThreadIndex = 0);
+	~MySinglThreadTask();
+	// Shown by the task profiler, the string must outlive the task
+	void SetName(const char* inName);
+	void SetPriority(TaskPriority inPriority);
+	virtual void DependOn(IWaitable* pPrecondition) override;
+	virtual void Execute() override;
+	virtual enki::ICompletable* GetCompletable() override;
+	virtual const enki::ICompletable* GetCompletable() const override;
+	virtual void GetPreconditions(std::vector<const IWaitable*>& outPreconditions) const override;
+	virtual enki::IPinnedTask* GetPinnedTask() override;
 };
 
-class MySinglThreadTask final : public ISingleThreadTask, public IImplement
+class MyMultiThreadTask final : public IMultiThreadTask
 {
 private:
-	std::unique_ptr<ISingleThreadTask> m_uptrImpl;
+	std::unique_ptr<MyMultiThreadTaskImpl> m_uptrImpl;
 
 public:
-	MySinglThreadTask(std::function<void()> inFunction, uint32_t inThreadIndex = 0);
+	MyMultiThreadTask(MultiThreadTaskFunction inFunction, uint32_t inSubTaskCount = 1);
+	~MyMultiThreadTask();
+	// Shown by the task profiler, the string must outlive the task
+	void SetName(const char* inName);
+	void SetPriority(TaskPriority inPriority);
 	virtual void DependOn(IWaitable* pPrecondition) override;
-	virtual void Execute() override;
-	virtual void* GetRealImplement() override;
-	virtual const void* GetRealImplement() const override;
+	virtual void ExecuteSubTask(uint32_t SubStart, uint32_t SubEnd, uint32_t inThreadIndex) override;
+	virtual enki::ICompletable* GetCompletable() override;
+	virtual const enki::ICompletable* GetCompletable() const override;
+	virtual void GetPreconditions(std::vector<const IWaitable*>& outPreconditions) const override;
+	virtual enki::ITaskSet* GetTaskSet() override;
 };
 
-class MyMultiThreadTask final : public IMultiThreadTask, public IImplement
+// Tasks and dependencies built once and launched again every frame. enki keeps the
+// dependency counters of finished tasks, so relaunching only adds the root tasks back,
+// nothing is allocated or wired again
+class TaskGraph final
 {
+public:
+	using NodeId = uint32_t;
+	static constexpr NodeId INVALID_NODE = ~0u;
+
 private:
-	std::unique_ptr<IMultiThreadTask> m_uptrImpl;
+	struct Node
+	{
+		std::unique_ptr<MySinglThreadTask> uptrSingleThreadTask; // one of the two is set
+		std::unique_ptr<MyMultiThreadTask> uptrMultiThreadTask;
+		uint32_t predecessorCount = 0;
+		uint32_t successorCount = 0;
+	};
+
+	std::vector<Node> m_nodes;
+	std::vector<NodeId> m_rootNodes; // no predecessors, added to the scheduler on launch
+	std::vector<NodeId> m_leafNodes; // no successors, waited on
+	bool m_dirty = false;            // nodes or edges changed since last launch
+	bool m_launched = false;
+
+private:
+	auto _GetWaitable(NodeId inNode)->IWaitable*;
+	auto _UpdateRootAndLeafNodes()->void;
 
 public:
-	MyMultiThreadTask(std::function<void(uint32_t, uint32_t, uint32_t)> inFunction, uint32_t inSubTaskCount = 1);
-	virtual void DependOn(IWaitable* pPrecondition) override;
-	virtual void ExecuteSubTask(uint32_t SubStart, uint32_t SubEnd, uint32_t inThreadIndex) override;
-	virtual void* GetRealImplement() override;
-	virtual const void* GetRealImplement() const override;
+	TaskGraph() = default;
+	TaskGraph(const TaskGraph&) = delete;
+	TaskGraph& operator=(const TaskGraph&) = delete;
+	~TaskGraph();
+
+	auto AddSingleThreadNode(SingleThreadTaskFunction inFunction, uint32_t inThreadIndex = 0, const char* inName = nullptr)->NodeId;
+
+	auto AddMultiThreadNode(MultiThreadTaskFunction inFunction, uint32_t inSubTaskCount = 1, const char* inName = nullptr)->NodeId;
+
+	// Can't be called while the graph is running
+	auto SetNodePriority(NodeId inNode, TaskPriority inPriority)->void;
+
+	// inTo starts after inFrom is done, can't be called while the graph is running
+	auto AddEdge(NodeId inFrom, NodeId inTo)->void;
+
+	// Run the whole graph once, the previous run must be waited
+	auto Launch()->void;
+
+	// Wait till every node of the current run is done
+	auto Wait()->void;
+
+	// Wait and remove all nodes
+	auto Clear()->void;
+
+	auto GetNodeCount() const->size_t { return m_nodes.size(); };
+};
+
+struct TaskSchedulerConfig
+{
+	uint32_t threadCount = 0;       // threads including the main thread, 0 to use hardware concurrency
+	bool pinGraphicsThread = true;  // give graphics recording tasks a worker thread of their own to be pinned on
+	bool pinComputeThread = true;   // same for compute recording tasks, see GetGraphicsThreadIndex
+	bool setThreadAffinity = false; // bind each worker thread to one CPU core
+	uint32_t targetFrameTimeUs = 16667;
+	float backgroundFrameShare = 0.75f; // background tasks added after this share of the frame wait for the next one
 };
 
 class MyTaskScheduler final : public ITaskScheduler
 {
 private:
 	static std::unique_ptr<MyTaskScheduler> g_uptrInstance;
-	std::unique_ptr<ITaskScheduler> m_uptrImpl;
+	static constexpr uint32_t EXTERNAL_THREAD_COUNT = 1; // the coroutine scheduler thread
+	std::unique_ptr<MyTaskSchedulerImpl> m_uptrImpl;
+	TaskSchedulerConfig m_config{};
+	uint32_t m_threadCount = 0;
+	uint32_t m_graphicsThreadIndex = 0;
+	uint32_t m_computeThreadIndex = 0;
+	std::atomic<int64_t> m_backgroundCutoffNs{ INT64_MAX }; // steady clock time, no cutoff till the first frame starts
+	std::mutex m_deferredTasksMutex;
+	std::vector<ISingleThreadTask*> m_deferredSingleThreadTasks;
+	std::vector<IMultiThreadTask*> m_deferredMultiThreadTasks;
 	MyTaskScheduler();
+	bool _DeferIfPastCutoff(ISingleThreadTask* pSingleThreadTask, IMultiThreadTask* pMultiThreadTask);
+	void _AddToEnki(ISingleThreadTask* pSingleThreadTask, IMultiThreadTask* pMultiThreadTask);
+	void _ReleaseDeferredTasks();
+	// Release only the held back tasks the task waits on, directly or through its preconditions
+	void _ReleaseDeferredTasksOf(const IWaitable* pToWait);
 
 public:
+	~MyTaskScheduler();
 	static MyTaskScheduler& GetInstance();
-	void Create();
+	// Must come before MyDevice::Create, the command queues make a command pool per thread
+	void Create(const TaskSchedulerConfig& inConfig = {});
+	bool IsCreated() const { return m_threadCount != 0; };
+	// Thread count including the main thread and external threads, thread indices passed to tasks are smaller than it
+	uint32_t GetThreadCount() const;
+	// Index of the calling thread, GetThreadCount or more on threads the scheduler doesn't know
+	uint32_t GetCurrentThreadIndex() const;
+	// Thread to pin graphics or compute tasks on, fall back to the main thread (0) if there are not enough threads.
+	// Nothing is reserved: enki still runs other tasks on these threads, the two kinds only don't share one
+	uint32_t GetGraphicsThreadIndex() const { return m_graphicsThreadIndex; };
+	uint32_t GetComputeThreadIndex() const { return m_computeThreadIndex; };
+	const TaskSchedulerConfig& GetConfig() const { return m_config; };
 	virtual void AddSingleThreadTask(ISingleThreadTask* pSingleThreadTask) override;
 	virtual void AddMutiThreadTask(IMultiThreadTask* pMultiThreadTask) override;
-	// Wait till the task is no longer pending/executing on the system
-	virtual void WaitForTask(const IWaitable* pToWait) override;
+	// Wait till the task is no longer pending/executing on the system, tasks below the priority
+	// are not picked up meanwhile, so a frame critical wait is not held up by a long background task
+	virtual void WaitForTask(const IWaitable* pToWait, TaskPriority inLowestPriorityToRun = TaskPriority::BACKGROUND) override;
 	virtual void WaitForAll() override;
+	// Start the frame budget and hand over background tasks held back by the last frame
+	void BeginFrame();
+	// Long background tasks can poll it and leave the rest of their work for the next frame
+	bool IsPastBackgroundCutoff() const;
+	// Let a thread not created by the scheduler add tasks, at most EXTERNAL_THREAD_COUNT of them
+	void RegisterExternalThread();
+	void DeregisterExternalThread();
 	void Destroy();
 };